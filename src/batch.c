@@ -0,0 +1,829 @@
+/*
+ * src/batch.c
+ * batch evaluation of newline-delimited expressions
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <batch.h>
+#include <bignum.h>
+#include <error.h>
+#include <eval.h>
+
+int batch_agg_init(
+    batch_agg_t* agg, int which, const int64_t* bounds, int32_t n_bounds)
+{
+    *agg = (batch_agg_t) {
+        .which=which,
+        .bounds=bounds,
+        .n_bounds=n_bounds,
+        .counts=calloc(n_bounds + 1, sizeof(uint64_t)),
+    };
+    init_literal(&agg->sum, 0, 0);
+    ctx_init(&agg->scratch);
+    return agg->counts ? 0 : -1;
+}
+
+// release the bignum owned by an aggregate, if any
+static void batch_agg_drop(token_t* dst)
+{
+    if (dst->type == BIGNUM)
+    {
+        free((void*) dst->big);
+        init_literal(dst, 0, 0);
+    }
+}
+
+// store a value in an aggregate, copying a bignum out of its context
+static void batch_agg_keep(batch_agg_t* agg, token_t* dst, const token_t* value)
+{
+    if (value->type != BIGNUM)
+    {
+        batch_agg_drop(dst);
+        *dst = *value;
+        return;
+    }
+    bignum_t* big = malloc(bignum_size(value->big));
+    if (!big)
+    {
+        agg->failed = 1;
+        return;
+    }
+    memcpy(big, value->big, bignum_size(value->big));
+    batch_agg_drop(dst);
+    *dst = *value;
+    dst->big = big;
+}
+
+// accumulate the sum and extremes of a value
+static void batch_agg_fold(
+    batch_agg_t* agg, const token_t* value, const token_t* min,
+    const token_t* max, int first)
+{
+    token_t sum;
+    if (op_add_impl(&agg->scratch, &agg->sum, value, &sum))
+    {
+        agg->failed = 1;
+    }
+    else
+    {
+        batch_agg_keep(agg, &agg->sum, &sum);
+    }
+    ctx_reset(&agg->scratch);
+    if (first || bignum_cmp(min, &agg->min) < 0)
+    {
+        batch_agg_keep(agg, &agg->min, min);
+    }
+    if (first || bignum_cmp(max, &agg->max) > 0)
+    {
+        batch_agg_keep(agg, &agg->max, max);
+    }
+}
+
+// accumulate a single result
+static void batch_agg_add(batch_agg_t* agg, const token_t* value)
+{
+    batch_agg_fold(agg, value, value, value, agg->n_results == 0);
+    agg->n_results++;
+    if (agg->n_bounds)
+    {
+        // the bucket is the number of bounds at or below the value; bignums
+        // lie beyond every bound
+        int32_t lo = 0, hi = agg->n_bounds;
+        if (value->type == BIGNUM)
+        {
+            lo = hi = value->big->sign > 0 ? agg->n_bounds : 0;
+        }
+        while (lo < hi)
+        {
+            int32_t mid = (lo + hi) / 2;
+            if (agg->bounds[mid] <= value->value)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        agg->counts[lo]++;
+    }
+}
+
+void batch_agg_merge(batch_agg_t* dst, const batch_agg_t* src)
+{
+    dst->failed |= src->failed;
+    if (src->n_results)
+    {
+        batch_agg_fold(
+            dst, &src->sum, &src->min, &src->max, dst->n_results == 0);
+    }
+    dst->n_results += src->n_results;
+    dst->n_errors += src->n_errors;
+    for (int32_t i = 0; i <= dst->n_bounds; i++)
+    {
+        dst->counts[i] += src->counts[i];
+    }
+}
+
+// write "name: value", or "name: none" without results
+static void batch_agg_put(
+    const batch_agg_t* agg, writer_t* out, const char* name,
+    const token_t* value)
+{
+    writer_puts(out, name);
+    writer_puts(out, ": ");
+    // the extremes of no results are undefined
+    if (agg->n_results || value == &agg->sum)
+    {
+        writer_put_value(out, value);
+    }
+    else
+    {
+        writer_puts(out, "none");
+    }
+    writer_putc(out, '\n');
+}
+
+void batch_agg_write(const batch_agg_t* agg, writer_t* out)
+{
+    char line[128];
+    int base = out->base;
+    out->base = 10;
+    if (agg->failed)
+    {
+        writer_puts(out, "error: not enough memory for the aggregates\n");
+    }
+    if (agg->which & BATCH_AGG_SUM)
+    {
+        batch_agg_put(agg, out, "sum", &agg->sum);
+    }
+    if (agg->which & BATCH_AGG_MIN)
+    {
+        batch_agg_put(agg, out, "min", &agg->min);
+    }
+    if (agg->which & BATCH_AGG_MAX)
+    {
+        batch_agg_put(agg, out, "max", &agg->max);
+    }
+    if (agg->which & BATCH_AGG_ERRORS)
+    {
+        snprintf(line, sizeof(line), "errors: %" PRIu64 "\n", agg->n_errors);
+        writer_puts(out, line);
+    }
+    if (agg->which & BATCH_AGG_HISTOGRAM)
+    {
+        for (int32_t i = 0; i <= agg->n_bounds; i++)
+        {
+            char lo[24] = "-inf", hi[24] = "+inf";
+            if (i > 0)
+            {
+                snprintf(lo, sizeof(lo), "%" PRId64, agg->bounds[i - 1]);
+            }
+            if (i < agg->n_bounds)
+            {
+                snprintf(hi, sizeof(hi), "%" PRId64, agg->bounds[i]);
+            }
+            snprintf(
+                line, sizeof(line), "histogram %c%s, %s): %" PRIu64 "\n",
+                i > 0 ? '[' : '(', lo, hi, agg->counts[i]);
+            writer_puts(out, line);
+        }
+    }
+    out->base = base;
+}
+
+void batch_agg_free(batch_agg_t* agg)
+{
+    batch_agg_drop(&agg->sum);
+    batch_agg_drop(&agg->min);
+    batch_agg_drop(&agg->max);
+    ctx_free(&agg->scratch);
+    free(agg->counts);
+}
+
+int batch_eval_line(
+    engine_t* e, const char* line, size_t len, writer_t* out,
+    batch_agg_t* agg)
+{
+    // accept CRLF line endings
+    if (len && line[len - 1] == '\r')
+    {
+        len--;
+    }
+
+    token_t result;
+    diag_t diag;
+    int rc = engine_eval(e, line, len, &result, &diag);
+    if (agg)
+    {
+        if (rc == 0)
+        {
+            batch_agg_add(agg, &result);
+        }
+        agg->n_errors += rc < 0;
+        return rc < 0 ? -1 : 0;
+    }
+    if (rc == 0)
+    {
+        writer_put_value(out, &result);
+    }
+    else if (rc < 0)
+    {
+        char msg[ERR_MSG_LEN];
+        int msg_len = format_err(msg, sizeof(msg), &diag);
+        writer_puts(out, "error: ");
+        writer_put(out, msg, msg_len);
+    }
+    writer_putc(out, '\n');
+
+    return rc < 0 ? -1 : 0;
+}
+
+// evaluate all complete lines in buf, returns the number of bytes consumed
+static size_t batch_eval_lines(
+    engine_t* e, const char* buf, size_t len, writer_t* out,
+    batch_agg_t* agg)
+{
+    const char* it = buf;
+    const char* end = buf + len;
+    const char* nl;
+    while ((nl = memchr(it, '\n', end - it)))
+    {
+        batch_eval_line(e, it, nl - it, out, agg);
+        it = nl + 1;
+    }
+
+    return it - buf;
+}
+
+// evaluate every line in buf, including a final line missing its newline
+static void batch_eval_chunk(
+    engine_t* e, const char* buf, size_t len, writer_t* out,
+    batch_agg_t* agg)
+{
+    size_t consumed = batch_eval_lines(e, buf, len, out, agg);
+    if (consumed < len)
+    {
+        batch_eval_line(e, buf + consumed, len - consumed, out, agg);
+    }
+}
+
+int batch_eval_fd(engine_t* e, int fd, writer_t* out, batch_agg_t* agg)
+{
+    size_t size = BATCH_READ_SIZE;
+    char* buf = malloc(size);
+    size_t used = 0;
+    int rc = 0;
+    if (!buf)
+    {
+        return -1;
+    }
+
+    while (1)
+    {
+        // grow the buffer if a single line fills it
+        if (used == size)
+        {
+            char* tmp = realloc(buf, 2 * size);
+            if (!tmp)
+            {
+                rc = -1;
+                break;
+            }
+            buf = tmp;
+            size *= 2;
+        }
+
+        ssize_t n = read(fd, buf + used, size - used);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            rc = -1;
+            break;
+        }
+        // evaluate a final line which is missing its newline
+        if (n == 0)
+        {
+            batch_eval_chunk(e, buf, used, out, agg);
+            break;
+        }
+
+        used += n;
+        size_t consumed = batch_eval_lines(e, buf, used, out, agg);
+        // move the partial line to the front of the buffer
+        memmove(buf, buf + consumed, used - consumed);
+        used -= consumed;
+    }
+
+    free(buf);
+    return rc;
+}
+
+/*
+ * batch input: regular files are memory mapped and lines are tokenized in
+ * place, anything else (pipes, terminals) is read in chunks
+ */
+typedef struct {
+    int fd;
+    const char* map;
+    size_t map_len;
+    size_t map_off;
+    writer_t carry;  // partial line carried between reads
+} batch_input_t;
+
+static int batch_open_input(const char* path, batch_input_t* input)
+{
+    *input = (batch_input_t) { .fd=STDIN_FILENO, .map=NULL };
+    if (strcmp(path, "-"))
+    {
+        input->fd = open(path, O_RDONLY);
+        if (input->fd < 0)
+        {
+            return -1;
+        }
+    }
+
+    struct stat st;
+    if (!fstat(input->fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void* map = mmap(
+            NULL, st.st_size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+        if (map != MAP_FAILED)
+        {
+            // input is consumed front to back, let the kernel read ahead
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            input->map = map;
+            input->map_len = st.st_size;
+        }
+    }
+
+    return 0;
+}
+
+static void batch_close_input(batch_input_t* input)
+{
+    if (input->map)
+    {
+        munmap((void*) input->map, input->map_len);
+    }
+    if (input->fd != STDIN_FILENO)
+    {
+        close(input->fd);
+    }
+    writer_free(&input->carry);
+}
+
+/*
+ * parallel batch evaluation
+ *
+ * the input is split into line-aligned chunks which are placed in a ring of
+ * slots; worker threads claim ready slots in order and evaluate them into
+ * per-slot output buffers, each with its own context, while the main thread
+ * keeps the ring filled and writes completed slots back in input order
+ */
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_READY,
+    SLOT_DONE,
+} slot_state;
+
+typedef struct {
+    slot_state state;
+    const char* data;  // chunk, points into buf or the mapped input
+    size_t len;
+    char* buf;         // owned buffer used for chunks which are read
+    size_t buf_size;
+    writer_t out;
+} batch_slot_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    batch_slot_t* slots;
+    size_t n_slots;
+    size_t fill_seq;      // number of chunks handed to the workers
+    size_t dispatch_seq;  // number of chunks claimed by the workers
+    int shutdown;
+    engine_kind engine;
+    size_t cache_capacity;
+    batch_agg_t* agg;  // aggregates, merged from the workers as they exit
+    // cache counters, summed over the workers as they exit
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} batch_pool_t;
+
+// create an engine, with a cache if requested
+static int batch_engine_init(
+    engine_t* e, engine_kind kind, size_t cache_capacity)
+{
+    engine_init(e, kind);
+    if (cache_capacity && engine_enable_cache(e, cache_capacity))
+    {
+        eprintf("failed to allocate expression cache\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void* batch_worker(void* arg)
+{
+    batch_pool_t* pool = arg;
+    engine_t e;
+    batch_engine_init(&e, pool->engine, pool->cache_capacity);
+    // lines are split across workers, so an assignment would only be seen by
+    // whichever worker evaluates it
+    e.read_only = 1;
+    batch_agg_t agg;
+    batch_agg_t* local = NULL;
+    if (pool->agg && !batch_agg_init(
+        &agg, pool->agg->which, pool->agg->bounds, pool->agg->n_bounds))
+    {
+        local = &agg;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (pool->dispatch_seq == pool->fill_seq && !pool->shutdown)
+        {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->dispatch_seq == pool->fill_seq)
+        {
+            break;
+        }
+        batch_slot_t* slot = &pool->slots[pool->dispatch_seq++ % pool->n_slots];
+        pthread_mutex_unlock(&pool->lock);
+
+        // without memory for its own accumulator, the worker accumulates
+        // into the shared one under the lock
+        if (pool->agg && !local)
+        {
+            pthread_mutex_lock(&pool->lock);
+        }
+        batch_eval_chunk(
+            &e, slot->data, slot->len, &slot->out, local ? local : pool->agg);
+        if (pool->agg && !local)
+        {
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&pool->work_done);
+    }
+    if (e.cache)
+    {
+        pool->hits += e.cache->hits;
+        pool->misses += e.cache->misses;
+        pool->evictions += e.cache->evictions;
+    }
+    if (local)
+    {
+        batch_agg_merge(pool->agg, local);
+        batch_agg_free(local);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    engine_free(&e);
+    return NULL;
+}
+
+// take the next line-aligned chunk of a memory mapped input
+static ssize_t batch_map_chunk(batch_input_t* input, batch_slot_t* slot)
+{
+    size_t off = input->map_off;
+    size_t len = input->map_len - off;
+    if (len > BATCH_READ_SIZE)
+    {
+        // extend the chunk to the end of the line it stops in
+        const char* nl = memchr(
+            input->map + off + BATCH_READ_SIZE, '\n', len - BATCH_READ_SIZE);
+        if (nl)
+        {
+            len = nl + 1 - (input->map + off);
+        }
+    }
+    slot->data = input->map + off;
+    slot->len = len;
+    input->map_off += len;
+
+    return len;
+}
+
+/*
+ * read the next line-aligned chunk into a slot; a partial line at the end of
+ * the chunk is moved into carry and prepended to the following chunk
+ * returns the chunk length, 0 at end of file, or -1 if reading failed
+ */
+static ssize_t batch_read_chunk(batch_input_t* input, batch_slot_t* slot)
+{
+    writer_t* carry = &input->carry;
+    if (slot->buf_size < carry->used + BATCH_READ_SIZE)
+    {
+        size_t size = carry->used + BATCH_READ_SIZE;
+        char* buf = realloc(slot->buf, size);
+        if (!buf)
+        {
+            return -1;
+        }
+        slot->buf = buf;
+        slot->buf_size = size;
+    }
+    if (carry->used)
+    {
+        memcpy(slot->buf, carry->buf, carry->used);
+    }
+    slot->data = slot->buf;
+    slot->len = carry->used;
+    carry->used = 0;
+
+    while (1)
+    {
+        ssize_t n = read(
+            input->fd, slot->buf + slot->len, slot->buf_size - slot->len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        // at end of file the chunk keeps its final partial line
+        if (n == 0)
+        {
+            break;
+        }
+        slot->len += n;
+
+        // split off the trailing partial line
+        const char* last = slot->buf + slot->len;
+        while (last > slot->buf && last[-1] != '\n')
+        {
+            last--;
+        }
+        if (last > slot->buf)
+        {
+            size_t tail = slot->buf + slot->len - last;
+            writer_put(carry, last, tail);
+            slot->len -= tail;
+            break;
+        }
+        // a single line fills the chunk, keep reading
+        if (slot->len == slot->buf_size)
+        {
+            char* buf = realloc(slot->buf, 2 * slot->buf_size);
+            if (!buf)
+            {
+                return -1;
+            }
+            slot->buf = buf;
+            slot->data = buf;
+            slot->buf_size *= 2;
+        }
+    }
+
+    return slot->len;
+}
+
+static int batch_eval_parallel(
+    batch_pool_t* pool, batch_input_t* input, writer_t* out)
+{
+    size_t write_seq = pool->fill_seq;
+    int eof = 0, rc = 0;
+
+    while (!eof || write_seq < pool->fill_seq)
+    {
+        // keep every free slot filled with input
+        while (!eof && pool->fill_seq - write_seq < pool->n_slots)
+        {
+            batch_slot_t* slot = &pool->slots[pool->fill_seq % pool->n_slots];
+            ssize_t n = input->map
+                ? batch_map_chunk(input, slot)
+                : batch_read_chunk(input, slot);
+            if (n <= 0)
+            {
+                rc = n < 0 ? -1 : 0;
+                eof = 1;
+                break;
+            }
+            pthread_mutex_lock(&pool->lock);
+            slot->state = SLOT_READY;
+            pool->fill_seq++;
+            pthread_cond_signal(&pool->work_ready);
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        // write out the oldest chunk once it has been evaluated
+        if (write_seq < pool->fill_seq)
+        {
+            batch_slot_t* slot = &pool->slots[write_seq % pool->n_slots];
+            pthread_mutex_lock(&pool->lock);
+            while (slot->state != SLOT_DONE)
+            {
+                pthread_cond_wait(&pool->work_done, &pool->lock);
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            writer_put(out, slot->out.buf, slot->out.used);
+            slot->out.used = 0;
+            slot->state = SLOT_FREE;
+            write_seq++;
+        }
+    }
+
+    return rc;
+}
+
+int batch_main(
+    int n_files, char** files, int n_threads, engine_kind engine,
+    size_t cache_capacity, int obase, batch_agg_t* agg)
+{
+    static char* stdin_only[] = { "-" };
+    if (!n_files)
+    {
+        n_files = 1;
+        files = stdin_only;
+    }
+
+    writer_t out;
+    if (writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE))
+    {
+        eprintf("failed to allocate output buffer\n");
+        return EXIT_FAILURE;
+    }
+    out.base = obase;
+
+    // the pool keeps a few chunks in flight per thread so that workers do
+    // not stall while the main thread writes output
+    batch_pool_t pool = {
+        .lock=PTHREAD_MUTEX_INITIALIZER,
+        .work_ready=PTHREAD_COND_INITIALIZER,
+        .work_done=PTHREAD_COND_INITIALIZER,
+        .n_slots=BATCH_SLOTS_PER_THREAD * n_threads,
+        .engine=engine,
+        .cache_capacity=cache_capacity,
+        .agg=agg,
+    };
+    pthread_t* threads = NULL;
+    if (n_threads > 1)
+    {
+        pool.slots = calloc(pool.n_slots, sizeof(batch_slot_t));
+        threads = calloc(n_threads, sizeof(pthread_t));
+        if (!pool.slots || !threads)
+        {
+            eprintf("failed to allocate worker threads\n");
+            free(pool.slots);
+            free(threads);
+            threads = NULL;
+            n_threads = 1;
+        }
+    }
+    if (n_threads > 1)
+    {
+        for (size_t i = 0; i < pool.n_slots; i++)
+        {
+            writer_init(&pool.slots[i].out, -1, 0);
+            pool.slots[i].out.base = obase;
+        }
+        // workers claim chunks as they become free, so the pool carries on
+        // with whichever threads could be started
+        int n_started = 0;
+        for (int i = 0; i < n_threads; i++)
+        {
+            if (!pthread_create(&threads[n_started], NULL, batch_worker, &pool))
+            {
+                n_started++;
+            }
+        }
+        if (n_started < n_threads)
+        {
+            eprintf(
+                "started %d of %d worker threads\n", n_started, n_threads);
+        }
+        if (!n_started)
+        {
+            for (size_t i = 0; i < pool.n_slots; i++)
+            {
+                writer_free(&pool.slots[i].out);
+            }
+            free(pool.slots);
+            free(threads);
+            threads = NULL;
+        }
+        n_threads = n_started;
+    }
+
+    // the main thread only evaluates when there are no workers
+    engine_t e;
+    if (!threads && batch_engine_init(&e, engine, cache_capacity))
+    {
+        engine_free(&e);
+        writer_free(&out);
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < n_files; i++)
+    {
+        batch_input_t input;
+        if (batch_open_input(files[i], &input))
+        {
+            writer_flush(&out);
+            eprintf("%s: failed to open file\n", files[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        writer_init(&input.carry, -1, 0);
+
+        int rc = 0;
+        if (threads)
+        {
+            rc = batch_eval_parallel(&pool, &input, &out);
+        }
+        else if (input.map)
+        {
+            batch_eval_chunk(&e, input.map, input.map_len, &out, agg);
+        }
+        else
+        {
+            rc = batch_eval_fd(&e, input.fd, &out, agg);
+        }
+        if (rc)
+        {
+            writer_flush(&out);
+            eprintf("%s: failed to read file\n", files[i]);
+            status = EXIT_FAILURE;
+        }
+        batch_close_input(&input);
+    }
+
+    int parallel = threads != NULL;
+    if (threads)
+    {
+        pthread_mutex_lock(&pool.lock);
+        pool.shutdown = 1;
+        pthread_cond_broadcast(&pool.work_ready);
+        pthread_mutex_unlock(&pool.lock);
+        for (int i = 0; i < n_threads; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        for (size_t i = 0; i < pool.n_slots; i++)
+        {
+            free(pool.slots[i].buf);
+            writer_free(&pool.slots[i].out);
+        }
+        free(pool.slots);
+        free(threads);
+    }
+
+    if (agg)
+    {
+        batch_agg_write(agg, &out);
+        if (agg->failed)
+        {
+            status = EXIT_FAILURE;
+        }
+    }
+    if (writer_free(&out))
+    {
+        status = EXIT_FAILURE;
+    }
+    if (parallel && cache_capacity)
+    {
+        cache_report(pool.hits, pool.misses, pool.evictions);
+    }
+    else if (!parallel)
+    {
+        if (e.cache)
+        {
+            cache_report(
+                e.cache->hits, e.cache->misses, e.cache->evictions);
+        }
+        engine_free(&e);
+    }
+
+    return status;
+}
@@ -0,0 +1,144 @@
+/*
+ * src/batch.h
+ * batch evaluation of newline-delimited expressions
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+#include <ctx.h>
+#include <engine.h>
+#include <writer.h>
+
+// size of the chunks read from the input
+#define BATCH_READ_SIZE (1 << 20)
+// number of input chunks in flight per worker thread in parallel mode
+#define BATCH_SLOTS_PER_THREAD 4
+// upper bound on the number of worker threads
+#define BATCH_MAX_THREADS 1024
+
+// aggregates which can be printed instead of the results
+#define BATCH_AGG_SUM       (1 << 0)
+#define BATCH_AGG_MIN       (1 << 1)
+#define BATCH_AGG_MAX       (1 << 2)
+#define BATCH_AGG_ERRORS    (1 << 3)
+#define BATCH_AGG_HISTOGRAM (1 << 4)
+
+/*
+ * accumulator for the aggregates of a batch; each thread accumulates into its
+ * own, and the accumulators are merged once the input is exhausted, so results
+ * are never formatted as text
+ *
+ * the sum and extremes are exact like the results themselves: they are
+ * literals, or bignums which the accumulator owns a malloc'd copy of
+ */
+typedef struct {
+    int which;              // BATCH_AGG_* flags of the aggregates printed
+    int failed;             // a bignum could not be stored, sum is unknown
+    uint64_t n_results;
+    uint64_t n_errors;
+    token_t sum;
+    token_t min;            // undefined without results
+    token_t max;
+    ctx_t scratch;          // intermediate sums
+    const int64_t* bounds;  // ascending bounds between histogram buckets
+    int32_t n_bounds;
+    uint64_t* counts;       // n_bounds + 1 histogram buckets
+} batch_agg_t;
+
+/*
+ * create an empty accumulator
+ *
+ * @oparam agg := accumulator to be initialized
+ * @iparam which := BATCH_AGG_* flags of the aggregates printed
+ * @iparam bounds := ascending bounds between histogram buckets, shared by the
+ *                   accumulators which are merged together
+ * @iparam n_bounds := number of bounds
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int batch_agg_init(
+    batch_agg_t* agg, int which, const int64_t* bounds, int32_t n_bounds);
+
+/*
+ * add the values of one accumulator to another
+ *
+ * @iparam dst := accumulator which receives the values
+ * @iparam src := accumulator with the same bounds
+ */
+void batch_agg_merge(batch_agg_t* dst, const batch_agg_t* src);
+
+/*
+ * write the requested aggregates, one per line, in decimal whatever the base
+ * of the writer; an accumulator which failed is reported as an error
+ *
+ * @iparam agg := accumulator
+ * @iparam out := writer receiving the aggregates
+ */
+void batch_agg_write(const batch_agg_t* agg, writer_t* out);
+
+/*
+ * release the memory of an accumulator
+ *
+ * @iparam agg := accumulator
+ */
+void batch_agg_free(batch_agg_t* agg);
+
+/*
+ * evaluate a single expression and write its result, or its error message,
+ * followed by a newline; blank lines produce an empty output line so that
+ * output lines correspond to input lines
+ *
+ * @iparam e := evaluation engine
+ * @iparam line := expression, without the newline; need not be NUL-terminated
+ * @iparam len := length of the expression
+ * @iparam out := writer receiving the result
+ * @iparam agg := accumulator which receives the result instead of the writer,
+ *                NULL to write it
+ * @returns 0 on success, -1 if the expression failed
+ */
+int batch_eval_line(
+    engine_t* e, const char* line, size_t len, writer_t* out,
+    batch_agg_t* agg);
+
+/*
+ * evaluate every line read from a file descriptor until end of file
+ *
+ * @iparam e := evaluation engine
+ * @iparam fd := file descriptor to read from
+ * @iparam out := writer receiving the results
+ * @iparam agg := accumulator which receives the results instead of the
+ *                writer, NULL to write them
+ * @returns 0 on success, otherwise -1 if reading failed
+ */
+int batch_eval_fd(engine_t* e, int fd, writer_t* out, batch_agg_t* agg);
+
+/*
+ * run batch mode over a list of files, or stdin if no files are given; a file
+ * named "-" also refers to stdin; regular files are memory mapped and their
+ * lines are evaluated in place
+ *
+ * with more than one thread, input is split into line-aligned chunks which are
+ * evaluated concurrently; output is still written in input order
+ *
+ * @iparam n_files := number of files
+ * @iparam files := file paths
+ * @iparam n_threads := number of worker threads
+ * @iparam engine := evaluation engine used by every thread
+ * @iparam cache_capacity := number of expressions cached by each thread, 0
+ *                           disables the cache; counters are printed to
+ *                           stderr at exit
+ * @iparam obase := base of the results, see writer_base_supported
+ * @iparam agg := empty accumulator of the aggregates printed instead of the
+ *                results, or NULL to print the results; aggregates are
+ *                printed in decimal
+ * @returns the process exit status
+ */
+int batch_main(
+    int n_files, char** files, int n_threads, engine_kind engine,
+    size_t cache_capacity, int obase, batch_agg_t* agg);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * src/bench.c
+ * micro-benchmarks comparing evaluation strategies on a single expression
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <bench.h>
+#include <ctx.h>
+#include <dag.h>
+#include <engine.h>
+#include <error.h>
+#include <eval.h>
+#include <jit.h>
+#include <lex.h>
+#include <opt.h>
+#include <regvm.h>
+#include <vm.h>
+#include <writer.h>
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_report(const char* name, double elapsed, long n_iters)
+{
+    printf("%-16s %10.1f ns/eval\n", name, elapsed / n_iters);
+}
+
+int bench_main(const char* expr, long n_iters)
+{
+    size_t len = strlen(expr);
+    ctx_t ctx;
+    ctx_init(&ctx);
+    diag_t diag;
+
+    int32_t n_tokens, n_rpn;
+    token_t* tokens = tokenize_n(&ctx, expr, len, &n_tokens, &diag);
+    token_t* rpn = n_tokens < 0
+        ? NULL : shunting_yard(&ctx, tokens, n_tokens, &n_rpn, &diag);
+    bytecode_t bc;
+    regvm_prog_t prog;
+    if (!rpn || vm_compile(&ctx, rpn, n_rpn, &bc, &diag)
+        || regvm_compile(&ctx, rpn, n_rpn, &prog, &diag))
+    {
+        print_err(&diag);
+        ctx_free(&ctx);
+        return EXIT_FAILURE;
+    }
+    // the result may not fit in 64 bits, only the interpreter has it exactly
+    token_t result;
+    writer_t w;
+    writer_init(&w, -1, 0);
+    if (!evaluate_rpn(&ctx, rpn, n_rpn, NULL, &result, &diag))
+    {
+        writer_put_value(&w, &result);
+    }
+    printf("%s = %.*s, %ld evaluations\n", expr, (int) w.used, w.buf, n_iters);
+    writer_free(&w);
+    printf(
+        "%zu bytes of bytecode, %zu register instructions using %d registers\n",
+        bc.len, prog.len, prog.n_regs);
+    int32_t n_opt;
+    token_t* opt = optimize_rpn(&ctx, rpn, n_rpn, &n_opt, &diag);
+    printf(
+        "optimizer removed %d of %d RPN nodes\n", n_rpn - n_opt, n_rpn);
+    dag_t dag;
+    dag_build(&ctx, rpn, n_rpn, &dag, &diag);
+    printf("%d distinct subexpressions\n", dag.n_nodes);
+
+    // results are accumulated so that the evaluations cannot be elided
+    volatile int64_t sink = 0;
+
+    double start = bench_now();
+    for (long i = 0; i < n_iters; i++)
+    {
+        size_t mark = ctx_mark(&ctx);
+        token_t res;
+        evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag);
+        ctx_release(&ctx, mark);
+        sink += res.value;
+    }
+    bench_report("evaluate_rpn", bench_now() - start, n_iters);
+
+    start = bench_now();
+    for (long i = 0; i < n_iters; i++)
+    {
+        size_t mark = ctx_mark(&ctx);
+        token_t res;
+        evaluate_rpn(&ctx, opt, n_opt, NULL, &res, &diag);
+        ctx_release(&ctx, mark);
+        sink += res.value;
+    }
+    bench_report("optimized rpn", bench_now() - start, n_iters);
+
+    start = bench_now();
+    for (long i = 0; i < n_iters; i++)
+    {
+        int64_t value;
+        dag_eval(&ctx, &dag, NULL, &value);
+        sink += value;
+    }
+    bench_report("dag_eval", bench_now() - start, n_iters);
+
+    start = bench_now();
+    for (long i = 0; i < n_iters; i++)
+    {
+        int64_t value;
+        vm_run(&bc, NULL, &value);
+        sink += value;
+    }
+    bench_report("vm_run", bench_now() - start, n_iters);
+
+    start = bench_now();
+    for (long i = 0; i < n_iters; i++)
+    {
+        int64_t value;
+        regvm_run(&prog, NULL, &value);
+        sink += value;
+    }
+    bench_report("regvm_run", bench_now() - start, n_iters);
+
+    jit_code_t code;
+    if (!jit_compile(&prog, &code))
+    {
+        start = bench_now();
+        for (long i = 0; i < n_iters; i++)
+        {
+            sink += code.fn(NULL).value;
+        }
+        bench_report("jit", bench_now() - start, n_iters);
+        jit_free(&code);
+    }
+
+    // full evaluation from source, including lexing and parsing
+    for (int kind = 0; kind < N_ENGINES; kind++)
+    {
+        engine_t e;
+        engine_init(&e, kind);
+        start = bench_now();
+        for (long i = 0; i < n_iters; i++)
+        {
+            token_t res;
+            engine_eval(&e, expr, len, &res, &diag);
+            sink += res.value;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "engine %s", engine_name(kind));
+        bench_report(name, bench_now() - start, n_iters);
+        engine_free(&e);
+    }
+
+    // tokenization alone, with every lexer implementation; the tokens get a
+    // context of their own so that they always fit in its region
+    ctx_t lex_ctx;
+    ctx_init(&lex_ctx);
+    for (int kernel = 0; kernel < N_LEX_KERNELS; kernel++)
+    {
+        if (!lex_kernel_supported(kernel))
+        {
+            continue;
+        }
+        start = bench_now();
+        for (long i = 0; i < n_iters; i++)
+        {
+            int32_t n;
+            tokenize_kernel(&lex_ctx, expr, len, kernel, &n, &diag);
+            ctx_reset(&lex_ctx);
+            sink += n;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "lex %s", lex_kernel_name(kernel));
+        bench_report(name, bench_now() - start, n_iters);
+    }
+    ctx_free(&lex_ctx);
+
+    ctx_free(&ctx);
+    return EXIT_SUCCESS;
+}
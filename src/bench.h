@@ -0,0 +1,27 @@
+/*
+ * src/bench.h
+ * micro-benchmarks comparing evaluation strategies on a single expression
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+// default number of evaluations per measurement
+#define BENCH_DEFAULT_ITERS 1000000
+
+/*
+ * compile an expression once and time repeated evaluations of it: first the
+ * compiled forms alone (RPN through evaluate_rpn, bytecode through the VM,
+ * register code through the register VM, native code from the JIT where it
+ * is available), then every engine evaluating from source, and finally
+ * tokenization alone with every lexer implementation
+ *
+ * @iparam expr := expression to evaluate
+ * @iparam n_iters := number of evaluations per measurement
+ * @returns the process exit status
+ */
+int bench_main(const char* expr, long n_iters);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * src/bignum.c
+ * arbitrary-precision integers for values which do not fit in 64 bits
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <bignum.h>
+
+// operand as a sign and a magnitude, see bignum_view
+typedef struct {
+    int32_t sign;
+    uint32_t n_limbs;
+    const uint32_t* limbs;
+} bignum_view_t;
+
+// view a literal or bignum; the limbs of a literal are stored in buf
+static void bignum_view(const token_t* t, uint32_t buf[2], bignum_view_t* v)
+{
+    if (t->type == BIGNUM)
+    {
+        *v = (bignum_view_t) {
+            .sign=t->big->sign, .n_limbs=t->big->n_limbs,
+            .limbs=t->big->limbs };
+        return;
+    }
+    // the magnitude of INT64_MIN does not fit in an int64
+    uint64_t m = t->value < 0 ? 0 - (uint64_t) t->value : (uint64_t) t->value;
+    buf[0] = (uint32_t) m;
+    buf[1] = (uint32_t) (m >> 32);
+    *v = (bignum_view_t) {
+        .sign=t->value < 0 ? -1 : 1, .n_limbs=buf[1] ? 2 : buf[0] ? 1 : 0,
+        .limbs=buf };
+}
+
+static int bignum_cmp_mag(const bignum_view_t* a, const bignum_view_t* b)
+{
+    if (a->n_limbs != b->n_limbs)
+    {
+        return a->n_limbs < b->n_limbs ? -1 : 1;
+    }
+    for (uint32_t i = a->n_limbs; i > 0; i--)
+    {
+        if (a->limbs[i - 1] != b->limbs[i - 1])
+        {
+            return a->limbs[i - 1] < b->limbs[i - 1] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// drop the leading zero limbs of a magnitude
+static uint32_t bignum_normalize(const uint32_t* limbs, uint32_t n)
+{
+    while (n && !limbs[n - 1])
+    {
+        n--;
+    }
+    return n;
+}
+
+// out = |a| + |b|, with room for one more limb than the longer operand
+static uint32_t bignum_add_mag(
+    uint32_t* out, const bignum_view_t* a, const bignum_view_t* b)
+{
+    if (a->n_limbs < b->n_limbs)
+    {
+        const bignum_view_t* t = a;
+        a = b;
+        b = t;
+    }
+    uint64_t carry = 0;
+    for (uint32_t i = 0; i < a->n_limbs; i++)
+    {
+        carry += (uint64_t) a->limbs[i] + (i < b->n_limbs ? b->limbs[i] : 0);
+        out[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    out[a->n_limbs] = (uint32_t) carry;
+    return a->n_limbs + (carry != 0);
+}
+
+// out = |a| - |b|, where |a| >= |b|
+static uint32_t bignum_sub_mag(
+    uint32_t* out, const bignum_view_t* a, const bignum_view_t* b)
+{
+    uint64_t borrow = 0;
+    for (uint32_t i = 0; i < a->n_limbs; i++)
+    {
+        uint64_t d = (uint64_t) a->limbs[i]
+            - (i < b->n_limbs ? b->limbs[i] : 0) - borrow;
+        out[i] = (uint32_t) d;
+        borrow = d >> 63;
+    }
+    return bignum_normalize(out, a->n_limbs);
+}
+
+// out = |a| * |b|, with room for the limbs of both operands
+static uint32_t bignum_mul_mag(
+    uint32_t* out, const bignum_view_t* a, const bignum_view_t* b)
+{
+    memset(out, 0, (a->n_limbs + b->n_limbs) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < a->n_limbs; i++)
+    {
+        uint64_t carry = 0;
+        for (uint32_t j = 0; j < b->n_limbs; j++)
+        {
+            carry += (uint64_t) a->limbs[i] * b->limbs[j] + out[i + j];
+            out[i + j] = (uint32_t) carry;
+            carry >>= 32;
+        }
+        out[i + b->n_limbs] = (uint32_t) carry;
+    }
+    return bignum_normalize(out, a->n_limbs + b->n_limbs);
+}
+
+int bignum_apply(
+    ctx_t* ctx, token_type op, const token_t* a, const token_t* b,
+    token_t* res)
+{
+    if (op == OP_POS)
+    {
+        *res = *a;
+        res->offset = 0;
+        return 0;
+    }
+
+    uint32_t a_buf[2], b_buf[2];
+    bignum_view_t va, vb = { .sign=1, .n_limbs=0, .limbs=b_buf };
+    bignum_view(a, a_buf, &va);
+    if (op != OP_NEG)
+    {
+        bignum_view(b, b_buf, &vb);
+    }
+    // a - b and -a are sums with a negated operand
+    if (op == OP_SUB)
+    {
+        vb.sign = -vb.sign;
+    }
+    else if (op == OP_NEG)
+    {
+        va.sign = -va.sign;
+    }
+
+    // the result is released again if it turns out to fit in 64 bits
+    size_t mark = ctx_mark(ctx);
+    uint32_t n = op == OP_MUL ? va.n_limbs + vb.n_limbs
+        : (va.n_limbs > vb.n_limbs ? va.n_limbs : vb.n_limbs) + 1;
+    bignum_t* r = ctx_alloc(ctx, sizeof(bignum_t) + n * sizeof(uint32_t));
+    if (!r)
+    {
+        return -1;
+    }
+    if (op == OP_MUL)
+    {
+        r->sign = va.sign * vb.sign;
+        r->n_limbs = bignum_mul_mag(r->limbs, &va, &vb);
+    }
+    else if (va.sign == vb.sign)
+    {
+        r->sign = va.sign;
+        r->n_limbs = bignum_add_mag(r->limbs, &va, &vb);
+    }
+    else if (bignum_cmp_mag(&va, &vb) >= 0)
+    {
+        r->sign = va.sign;
+        r->n_limbs = bignum_sub_mag(r->limbs, &va, &vb);
+    }
+    else
+    {
+        r->sign = vb.sign;
+        r->n_limbs = bignum_sub_mag(r->limbs, &vb, &va);
+    }
+
+    if (r->n_limbs <= 2)
+    {
+        uint64_t m = r->n_limbs ? r->limbs[0] : 0;
+        if (r->n_limbs == 2)
+        {
+            m |= (uint64_t) r->limbs[1] << 32;
+        }
+        if (m <= INT64_MAX || (r->sign < 0 && m == (uint64_t) INT64_MAX + 1))
+        {
+            int64_t value = r->sign < 0 && m
+                ? -(int64_t) (m - 1) - 1 : (int64_t) m;
+            ctx_release(ctx, mark);
+            init_literal(res, value, 0);
+            return 0;
+        }
+    }
+    res->type = BIGNUM;
+    res->big = r;
+    res->offset = 0;
+
+    return 0;
+}
+
+int bignum_cmp(const token_t* a, const token_t* b)
+{
+    if (a->type != BIGNUM && b->type != BIGNUM)
+    {
+        return (a->value > b->value) - (a->value < b->value);
+    }
+    uint32_t a_buf[2], b_buf[2];
+    bignum_view_t va, vb;
+    bignum_view(a, a_buf, &va);
+    bignum_view(b, b_buf, &vb);
+    // one of the operands is a bignum and so is not 0
+    if (va.sign != vb.sign)
+    {
+        return va.sign;
+    }
+    int c = bignum_cmp_mag(&va, &vb);
+    return va.sign < 0 ? -c : c;
+}
+
+size_t bignum_size(const bignum_t* b)
+{
+    return sizeof(bignum_t) + b->n_limbs * sizeof(uint32_t);
+}
+
+size_t bignum_format_len(const bignum_t* b, int base)
+{
+    // digits per limb, then a sign and a prefix
+    size_t digits = base == 10 ? 10 : base == 16 ? 8 : base == 8 ? 11 : 32;
+    return b->n_limbs * digits + 3;
+}
+
+size_t bignum_format(char* buf, const bignum_t* b, int base, uint32_t* scratch)
+{
+    char* p = buf;
+    if (b->sign < 0)
+    {
+        *p++ = '-';
+    }
+    if (base != 10)
+    {
+        *p++ = '0';
+        *p++ = base == 16 ? 'x' : base == 8 ? 'o' : 'b';
+    }
+
+    // the digits are written backwards from the end of the buffer, then moved
+    // after the prefix
+    char* end = buf + bignum_format_len(b, base);
+    char* it = end;
+    uint32_t n = b->n_limbs;
+    if (base == 10)
+    {
+        // nine digits at a time, the remainders of division by 10^9
+        memcpy(scratch, b->limbs, n * sizeof(uint32_t));
+        while (n)
+        {
+            uint64_t rem = 0;
+            for (uint32_t i = n; i > 0; i--)
+            {
+                uint64_t cur = rem << 32 | scratch[i - 1];
+                scratch[i - 1] = (uint32_t) (cur / 1000000000);
+                rem = cur % 1000000000;
+            }
+            n = bignum_normalize(scratch, n);
+            // only the most significant group is not padded with zeros
+            for (int d = 0; d < 9 && (n || rem); d++)
+            {
+                *--it = (char) ('0' + rem % 10);
+                rem /= 10;
+            }
+        }
+    }
+    else
+    {
+        // each digit is a group of bits, which may span two limbs
+        int bits = base == 16 ? 4 : base == 8 ? 3 : 1;
+        for (size_t pos = 0; pos < (size_t) n * 32; pos += bits)
+        {
+            size_t i = pos / 32;
+            uint64_t w = b->limbs[i];
+            if (i + 1 < n)
+            {
+                w |= (uint64_t) b->limbs[i + 1] << 32;
+            }
+            *--it = "0123456789abcdef"[(w >> pos % 32) & (base - 1)];
+        }
+        while (*it == '0')
+        {
+            it++;
+        }
+    }
+    memmove(p, it, end - it);
+
+    return p + (end - it) - buf;
+}
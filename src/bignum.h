@@ -0,0 +1,78 @@
+/*
+ * src/bignum.h
+ * arbitrary-precision integers for values which do not fit in 64 bits
+ *
+ * arithmetic is done on int64 values with overflow checks, and an operation
+ * only produces a bignum when its result actually overflows; a bignum never
+ * holds a value which fits in an int64, so that results are demoted back to
+ * literals as soon as they are small again and the int64 fast path resumes
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <lex.h>
+
+struct bignum {
+    int32_t sign;      // 1 or -1
+    uint32_t n_limbs;  // the most significant limb is never 0
+    uint32_t limbs[];  // magnitude, least significant limb first
+};
+
+/*
+ * apply an operator exactly to operands which are literals or bignums; a
+ * result which fits in 64 bits is a literal, otherwise a bignum allocated in
+ * the context
+ *
+ * @iparam ctx := evaluation context, owns the result
+ * @iparam op := OP_ADD, OP_SUB, OP_MUL, OP_POS or OP_NEG
+ * @iparam a := left or only operand
+ * @iparam b := right operand, unused by unary operators
+ * @oparam res := result
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int bignum_apply(
+    ctx_t* ctx, token_type op, const token_t* a, const token_t* b,
+    token_t* res);
+
+/*
+ * compare the values of two literals or bignums
+ *
+ * @returns a negative value, 0 or a positive value if a is less than, equal
+ *          to or greater than b
+ */
+int bignum_cmp(const token_t* a, const token_t* b);
+
+/*
+ * get the size in bytes of a bignum, to copy it out of its context
+ */
+size_t bignum_size(const bignum_t* b);
+
+/*
+ * get an upper bound on the length of a formatted bignum
+ *
+ * @iparam b := bignum
+ * @iparam base := 2, 8, 10 or 16
+ * @returns the most characters bignum_format writes
+ */
+size_t bignum_format_len(const bignum_t* b, int base);
+
+/*
+ * format a bignum with a sign if negative, and in a base other than 10 with a
+ * 0b, 0o or 0x prefix, see writer_format_int
+ *
+ * @oparam buf := output, at least bignum_format_len bytes, not NUL-terminated
+ * @iparam b := bignum
+ * @iparam base := 2, 8, 10 or 16
+ * @iparam scratch := room for the n_limbs limbs of the bignum
+ * @returns the length of the output
+ */
+size_t bignum_format(char* buf, const bignum_t* b, int base, uint32_t* scratch);
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * src/cache.c
+ * bounded LRU cache of compiled expressions
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cache.h>
+
+#define CACHE_FREE_SLOT -1
+
+// characters of a literal or a variable name
+#define IS_WORD_CHAR(ch) (isalnum(ch) || (ch) == '_')
+
+int cache_init(cache_t* c, size_t capacity)
+{
+    // the table is kept at most half full so that probe sequences stay short
+    size_t n_slots = 2;
+    while (n_slots < 2 * capacity)
+    {
+        n_slots <<= 1;
+    }
+    *c = (cache_t) {
+        .entries=malloc(capacity * sizeof(cache_entry_t)),
+        .capacity=capacity,
+        .table=malloc(n_slots * sizeof(cache_slot_t)),
+        .mask=n_slots - 1,
+        .head=-1,
+        .tail=-1,
+    };
+    if (!capacity || !c->entries || !c->table)
+    {
+        cache_free(c);
+        return -1;
+    }
+    for (size_t i = 0; i < n_slots; i++)
+    {
+        c->table[i].entry = CACHE_FREE_SLOT;
+    }
+    return 0;
+}
+
+size_t cache_normalize(const char* src, size_t len, char* buf, uint32_t* hash)
+{
+    size_t n = 0;
+    // FNV-1a, computed as the normalized text is written
+    uint32_t h = 2166136261u;
+    int space = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char ch = src[i];
+        if (isspace(ch))
+        {
+            space = 1;
+            continue;
+        }
+        if (space && n && IS_WORD_CHAR((unsigned char) buf[n - 1])
+            && IS_WORD_CHAR(ch))
+        {
+            buf[n++] = ' ';
+            h = (h ^ ' ') * 16777619u;
+        }
+        space = 0;
+        buf[n++] = ch;
+        h = (h ^ ch) * 16777619u;
+    }
+    *hash = h;
+    return n;
+}
+
+// find the table slot holding a key, or the free slot where it would go
+static uint32_t cache_find(
+    const cache_t* c, const char* key, size_t len, uint32_t hash)
+{
+    uint32_t i = hash & c->mask;
+    for (; c->table[i].entry != CACHE_FREE_SLOT; i = (i + 1) & c->mask)
+    {
+        const cache_entry_t* e = &c->entries[c->table[i].entry];
+        if (c->table[i].hash == hash && e->key_len == len
+            && !memcmp(e->key, key, len))
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+// remove a slot from the table, shifting back any later entries of the probe
+// sequence so that lookups never stop early at the hole
+static void cache_remove_slot(cache_t* c, uint32_t i)
+{
+    uint32_t j = i;
+    while (1)
+    {
+        c->table[i].entry = CACHE_FREE_SLOT;
+        uint32_t home;
+        do
+        {
+            j = (j + 1) & c->mask;
+            if (c->table[j].entry == CACHE_FREE_SLOT)
+            {
+                return;
+            }
+            home = c->table[j].hash & c->mask;
+            // j stays if its home lies cyclically within (i, j]
+        } while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+        c->table[i] = c->table[j];
+        i = j;
+    }
+}
+
+static void cache_unlink(cache_t* c, int32_t i)
+{
+    cache_entry_t* e = &c->entries[i];
+    if (e->prev >= 0)
+    {
+        c->entries[e->prev].next = e->next;
+    }
+    else
+    {
+        c->head = e->next;
+    }
+    if (e->next >= 0)
+    {
+        c->entries[e->next].prev = e->prev;
+    }
+    else
+    {
+        c->tail = e->prev;
+    }
+}
+
+static void cache_push_front(cache_t* c, int32_t i)
+{
+    cache_entry_t* e = &c->entries[i];
+    e->prev = -1;
+    e->next = c->head;
+    if (c->head >= 0)
+    {
+        c->entries[c->head].prev = i;
+    }
+    c->head = i;
+    if (c->tail < 0)
+    {
+        c->tail = i;
+    }
+}
+
+const cache_entry_t* cache_get(
+    cache_t* c, const char* key, size_t len, uint32_t hash)
+{
+    uint32_t slot = cache_find(c, key, len, hash);
+    int32_t i = c->table[slot].entry;
+    if (i == CACHE_FREE_SLOT)
+    {
+        c->misses++;
+        return NULL;
+    }
+    c->hits++;
+    if (c->head != i)
+    {
+        cache_unlink(c, i);
+        cache_push_front(c, i);
+    }
+    return &c->entries[i];
+}
+
+const cache_entry_t* cache_put(
+    cache_t* c, const char* key, size_t len, uint32_t hash,
+    const token_t* rpn, int32_t n_rpn, uint8_t constant, int64_t value)
+{
+    // the RPN and the key share one allocation, tokens first for alignment
+    void* block = malloc(n_rpn * sizeof(token_t) + len);
+    if (!block)
+    {
+        return NULL;
+    }
+    token_t* rpn_copy = block;
+    char* key_copy = (char*) (rpn_copy + n_rpn);
+    memcpy(rpn_copy, rpn, n_rpn * sizeof(token_t));
+    memcpy(key_copy, key, len);
+
+    int32_t i;
+    if (c->n_entries < c->capacity)
+    {
+        i = c->n_entries++;
+    }
+    else
+    {
+        // reuse the least recently used entry
+        i = c->tail;
+        cache_entry_t* old = &c->entries[i];
+        cache_remove_slot(c, cache_find(c, old->key, old->key_len, old->hash));
+        cache_unlink(c, i);
+        free(old->block);
+        c->evictions++;
+    }
+
+    c->entries[i] = (cache_entry_t) {
+        .key=key_copy, .key_len=len, .hash=hash, .rpn=rpn_copy, .n_rpn=n_rpn,
+        .value=value, .constant=constant, .block=block,
+    };
+    cache_push_front(c, i);
+    uint32_t slot = cache_find(c, key, len, hash);
+    c->table[slot] = (cache_slot_t) { .hash=hash, .entry=i };
+    return &c->entries[i];
+}
+
+void cache_report(uint64_t hits, uint64_t misses, uint64_t evictions)
+{
+    uint64_t lookups = hits + misses;
+    fprintf(
+        stderr, "cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate),"
+        " %" PRIu64 " evictions\n", hits, misses,
+        lookups ? 100.0 * hits / lookups : 0.0, evictions);
+}
+
+void cache_free(cache_t* c)
+{
+    for (size_t i = 0; c->entries && i < c->n_entries; i++)
+    {
+        free(c->entries[i].block);
+    }
+    free(c->entries);
+    free(c->table);
+    c->entries = NULL;
+    c->table = NULL;
+    c->n_entries = 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * src/cache.h
+ * bounded LRU cache of compiled expressions
+ *
+ * expressions are keyed by their whitespace-normalized text, so that inputs
+ * differing only in spacing share an entry; each entry holds the RPN of the
+ * expression and, when it contains only literals, its value, so that a hit
+ * skips tokenize and shunting_yard, and evaluation too for constants
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <lex.h>
+
+typedef struct {
+    const char* key;  // normalized text, not NUL-terminated
+    uint32_t key_len;
+    uint32_t hash;
+    const token_t* rpn;
+    int32_t n_rpn;
+    int64_t value;     // result of the expression, if constant
+    uint8_t constant;
+    int32_t prev;      // neighbours in recency order, -1 at either end
+    int32_t next;
+    void* block;       // allocation holding the key and the RPN
+} cache_entry_t;
+
+// hash table slot; the hash is kept inline so that probing only touches the
+// table until a likely match is found
+typedef struct {
+    uint32_t hash;
+    int32_t entry;  // index into the entries, -1 if the slot is free
+} cache_slot_t;
+
+typedef struct {
+    cache_entry_t* entries;
+    size_t capacity;
+    size_t n_entries;
+    cache_slot_t* table;
+    uint32_t mask;
+    int32_t head;  // most recently used entry
+    int32_t tail;  // least recently used entry, the next to be evicted
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} cache_t;
+
+/*
+ * create an empty cache
+ *
+ * @iparam c := cache
+ * @iparam capacity := maximum number of entries, must be non-zero
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int cache_init(cache_t* c, size_t capacity);
+
+/*
+ * normalize an expression for use as a key: whitespace is removed, except
+ * that a single space is kept between two characters of a literal or name so
+ * that e.g. "1 2" and "12" remain distinct
+ *
+ * @iparam src := expression, need not be NUL-terminated
+ * @iparam len := length of the expression
+ * @oparam buf := normalized text, at least len bytes
+ * @oparam hash := hash of the normalized text
+ * @returns the length of the normalized text
+ */
+size_t cache_normalize(const char* src, size_t len, char* buf, uint32_t* hash);
+
+/*
+ * look up a normalized expression, marking it most recently used; updates
+ * the hit and miss counters
+ *
+ * @iparam c := cache
+ * @iparam key := normalized text
+ * @iparam len := length of the normalized text
+ * @iparam hash := hash returned by cache_normalize
+ * @returns the entry, NULL if the expression is not cached
+ */
+const cache_entry_t* cache_get(
+    cache_t* c, const char* key, size_t len, uint32_t hash);
+
+/*
+ * add an expression which is not yet cached, evicting the least recently
+ * used entry if the cache is full
+ *
+ * @iparam c := cache
+ * @iparam key := normalized text
+ * @iparam len := length of the normalized text
+ * @iparam hash := hash returned by cache_normalize
+ * @iparam rpn := RPN of the expression, copied into the cache
+ * @iparam n_rpn := length of the RPN array
+ * @iparam constant := whether the value only depends on the expression
+ * @iparam value := value of the expression if constant
+ * @returns the new entry, NULL if there was not enough memory
+ */
+const cache_entry_t* cache_put(
+    cache_t* c, const char* key, size_t len, uint32_t hash,
+    const token_t* rpn, int32_t n_rpn, uint8_t constant, int64_t value);
+
+/*
+ * print cache counters to stderr, e.g. summed over several caches
+ *
+ * @iparam hits := number of lookups which found an entry
+ * @iparam misses := number of lookups which did not
+ * @iparam evictions := number of entries evicted
+ */
+void cache_report(uint64_t hits, uint64_t misses, uint64_t evictions);
+
+/*
+ * release all memory held by a cache
+ *
+ * @iparam c := cache
+ */
+void cache_free(cache_t* c);
+
+#endif
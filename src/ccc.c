@@ -0,0 +1,215 @@
+/*
+ * src/ccc.c
+ * public C API of libccc, the embeddable calculator library
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <stdalign.h>
+#include <stdint.h>
+
+#include <ccc.h>
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <opt.h>
+#include <symtab.h>
+#include <vm.h>
+
+struct ccc {
+    ctx_t ctx;
+};
+
+struct ccc_expr {
+    bytecode_t bc;
+    // optimized RPN the bytecode was built from, evaluated exactly if the
+    // bytecode overflows
+    const token_t* rpn;
+    int32_t n_rpn;
+    // variables of the expression only, so that their slots are the indices
+    // of the values passed to ccc_run_vars
+    symtab_t syms;
+};
+
+size_t ccc_scratch_size(size_t max_len)
+{
+    // token array, operator stack, RPN output, optimized RPN and the
+    // optimizer's scratch, variable names, and bytecode, plus slack for
+    // alignment and the handle itself
+    size_t n = max_len < MAX_TOKENS ? max_len : MAX_TOKENS;
+    size_t len = max_len < MAX_INPUT_LEN ? max_len : MAX_INPUT_LEN;
+    return sizeof(struct ccc) + sizeof(struct ccc_expr)
+        + 4 * n * sizeof(token_t) + optimize_scratch_size(n)
+        + symtab_scratch_size(len) + n * VM_PUSH_SIZE + 256;
+}
+
+ccc_t* ccc_init(void* scratch, size_t size)
+{
+    // the caller's region may have any alignment, the handle is placed at its
+    // first suitably aligned address
+    uintptr_t addr = (uintptr_t) scratch;
+    size_t pad = (alignof(struct ccc) - addr % alignof(struct ccc))
+        % alignof(struct ccc);
+    if (!scratch || size < pad + sizeof(struct ccc))
+    {
+        return NULL;
+    }
+    ccc_t* c = (ccc_t*) ((char*) scratch + pad);
+    ctx_init_fixed(&c->ctx, c + 1, size - pad - sizeof(struct ccc));
+
+    return c;
+}
+
+void ccc_reset(ccc_t* c)
+{
+    ctx_reset(&c->ctx);
+}
+
+// public error kinds are part of the stable API, so they are mapped
+// explicitly rather than relying on the internal enum ordering
+static const ccc_errkind ccc_errkinds[N_ERR_KINDS] = {
+    [E_OK]               = CCC_OK,
+    [E_MAX_TOKENS]       = CCC_E_MAX_TOKENS,
+    [E_MAX_INPUT]        = CCC_E_MAX_INPUT,
+    [E_INVALID_TOKEN]    = CCC_E_INVALID_TOKEN,
+    [E_LIT_OVERFLOW]     = CCC_E_LIT_OVERFLOW,
+    [E_VALUE_RANGE]      = CCC_E_VALUE_RANGE,
+    [E_UNMATCHED_PAREN]  = CCC_E_UNMATCHED_PAREN,
+    [E_OP_MISSING_EXPR]  = CCC_E_OP_MISSING_EXPR,
+    [E_INVALID_LIT_EXPR] = CCC_E_INVALID_LIT_EXPR,
+    [E_EMPTY_EXPR]       = CCC_E_EMPTY_EXPR,
+    [E_NO_MEMORY]        = CCC_E_NO_MEMORY,
+    [E_UNDEFINED_VAR]    = CCC_E_UNDEFINED_VAR,
+    [E_INVALID_ASSIGN]   = CCC_E_INVALID_ASSIGN,
+    // the library has no read-only engines, nor any sheets, see sheet.h
+    [E_READ_ONLY]        = CCC_E_INTERNAL,
+    [E_NOT_FORMULA]      = CCC_E_INTERNAL,
+    [E_CIRCULAR_REF]     = CCC_E_INTERNAL,
+    [E_DEP_ERROR]        = CCC_E_INTERNAL,
+};
+
+// convert an internal diagnostic into an error value
+static ccc_errkind ccc_error(const diag_t* diag, ccc_error_t* err)
+{
+    ccc_errkind kind = ccc_errkinds[diag->kind];
+    if (err)
+    {
+        err->kind = kind;
+        err->offset = diag->offset;
+        format_err(err->message, sizeof(err->message), diag);
+    }
+
+    return kind;
+}
+
+ccc_errkind ccc_compile(
+    ccc_t* c, const char* src, size_t len, ccc_expr_t** expr, ccc_error_t* err)
+{
+    ctx_t* ctx = &c->ctx;
+    size_t mark = ctx_mark(ctx);
+
+    diag_t diag;
+    ccc_expr_t* out = ctx_alloc(ctx, sizeof(ccc_expr_t));
+    if (!out)
+    {
+        set_diag(&diag, E_NO_MEMORY, NULL, -1, 0);
+        return ccc_error(&diag, err);
+    }
+
+    int32_t n_tokens;
+    token_t* tokens = tokenize_n(ctx, src, len, &n_tokens, &diag);
+    symtab_init(&out->syms, ctx);
+    if (n_tokens < 0
+        || symtab_resolve(&out->syms, src, len, tokens, n_tokens, 1, &diag))
+    {
+        ctx_release(ctx, mark);
+        return ccc_error(&diag, err);
+    }
+
+    // the token and RPN arrays are kept alongside the bytecode since the
+    // context cannot free them individually, and the optimized RPN is needed
+    // again if the bytecode overflows; compiled expressions are meant to be
+    // run repeatedly, so the RPN is simplified first
+    int32_t n_rpn, n_opt;
+    token_t* rpn = shunting_yard(ctx, tokens, n_tokens, &n_rpn, &diag);
+    token_t* opt = n_rpn < 0
+        ? NULL : optimize_rpn(ctx, rpn, n_rpn, &n_opt, &diag);
+    if (!opt || vm_compile(ctx, opt, n_opt, &out->bc, &diag))
+    {
+        ctx_release(ctx, mark);
+        return ccc_error(&diag, err);
+    }
+
+    out->rpn = opt;
+    out->n_rpn = n_opt;
+    *expr = out;
+    return CCC_OK;
+}
+
+ccc_errkind ccc_run(
+    ccc_t* c, const ccc_expr_t* expr, int64_t* result, ccc_error_t* err)
+{
+    return ccc_run_vars(c, expr, NULL, 0, result, err);
+}
+
+size_t ccc_n_vars(const ccc_expr_t* expr)
+{
+    return expr->syms.n_slots;
+}
+
+int32_t ccc_var_index(const ccc_expr_t* expr, const char* name, size_t len)
+{
+    return symtab_find(&expr->syms, name, len);
+}
+
+ccc_errkind ccc_run_vars(
+    ccc_t* c, const ccc_expr_t* expr, const int64_t* values, size_t n_values,
+    int64_t* result, ccc_error_t* err)
+{
+    // the bytecode was checked when it was compiled, so running it only needs
+    // a value for every variable, and no scratch space unless it overflows
+    diag_t diag;
+    if (n_values < (size_t) expr->syms.n_slots)
+    {
+        set_diag(&diag, E_UNDEFINED_VAR, NULL, -1, 0);
+        return ccc_error(&diag, err);
+    }
+    if (!vm_run(&expr->bc, values, result))
+    {
+        return CCC_OK;
+    }
+
+    size_t mark = ctx_mark(&c->ctx);
+    token_t res;
+    int rc = evaluate_rpn_vars(
+        &c->ctx, expr->rpn, expr->n_rpn, values, &res, &diag);
+    ctx_release(&c->ctx, mark);
+    if (!rc && !IS_LITERAL(res))
+    {
+        set_diag(&diag, E_VALUE_RANGE, NULL, -1, 0);
+        rc = -1;
+    }
+    if (rc)
+    {
+        return ccc_error(&diag, err);
+    }
+    *result = res.value;
+    return CCC_OK;
+}
+
+ccc_errkind ccc_eval(
+    ccc_t* c, const char* src, size_t len, int64_t* result, ccc_error_t* err)
+{
+    size_t mark = ctx_mark(&c->ctx);
+
+    ccc_expr_t* expr;
+    ccc_errkind kind = ccc_compile(c, src, len, &expr, err);
+    if (kind == CCC_OK)
+    {
+        kind = ccc_run(c, expr, result, err);
+    }
+    ctx_release(&c->ctx, mark);
+
+    return kind;
+}
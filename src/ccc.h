@@ -0,0 +1,175 @@
+/*
+ * src/ccc.h
+ * public C API of libccc, the embeddable calculator library
+ *
+ * the library performs no allocations of its own: every handle lives in a
+ * scratch region provided by the caller, and errors are returned as values
+ * rather than printed; handles are independent, so separate threads may use
+ * separate handles concurrently
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef CCC_H
+#define CCC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CCC_VERSION_MAJOR 0
+#define CCC_VERSION_MINOR 4
+
+// maximum length of an error message, including the NUL terminator
+#define CCC_ERR_MSG_LEN 128
+
+typedef enum {
+    CCC_OK = 0,
+    CCC_E_MAX_TOKENS,
+    CCC_E_MAX_INPUT,
+    CCC_E_INVALID_TOKEN,
+    CCC_E_UNMATCHED_PAREN,
+    CCC_E_OP_MISSING_EXPR,
+    CCC_E_INVALID_LIT_EXPR,
+    CCC_E_EMPTY_EXPR,
+    CCC_E_NO_MEMORY,
+    CCC_E_UNDEFINED_VAR,
+    CCC_E_INVALID_ASSIGN,
+    CCC_E_LIT_OVERFLOW,
+    CCC_E_VALUE_RANGE,
+    // an error of the calculator which the library cannot produce, such as
+    // those of sheets; reported instead of a misleading kind should one occur
+    CCC_E_INTERNAL,
+} ccc_errkind;
+
+typedef struct {
+    ccc_errkind kind;
+    int64_t offset;  // byte offset into the source, -1 if not applicable
+    char message[CCC_ERR_MSG_LEN];
+} ccc_error_t;
+
+// evaluation handle, placed at the first suitably aligned address of the
+// caller's scratch region
+typedef struct ccc ccc_t;
+// compiled expression, owned by the handle it was compiled with
+typedef struct ccc_expr ccc_expr_t;
+
+/*
+ * recommended scratch size to compile and evaluate expressions of up to
+ * max_len bytes
+ *
+ * @iparam max_len := maximum expression length
+ * @returns size in bytes
+ */
+size_t ccc_scratch_size(size_t max_len);
+
+/*
+ * create a handle in a caller-provided scratch region
+ *
+ * @iparam scratch := scratch region, must outlive the handle; it needs no
+ *                    particular alignment
+ * @iparam size := size of the scratch region
+ * @returns the handle, or NULL if the region is too small
+ */
+ccc_t* ccc_init(void* scratch, size_t size);
+
+/*
+ * release all compiled expressions, making their scratch space reusable
+ *
+ * @iparam c := handle
+ */
+void ccc_reset(ccc_t* c);
+
+/*
+ * compile an expression for repeated evaluation; the compiled expression stays
+ * valid until the next ccc_reset
+ *
+ * @iparam c := handle
+ * @iparam src := expression source, need not be NUL-terminated
+ * @iparam len := length of the expression source
+ * @oparam expr := compiled expression
+ * @oparam err := error details on failure, may be NULL
+ * @returns CCC_OK on success, otherwise the error kind
+ */
+ccc_errkind ccc_compile(
+    ccc_t* c, const char* src, size_t len, ccc_expr_t** expr, ccc_error_t* err);
+
+/*
+ * evaluate a compiled expression; expressions are compiled to bytecode which
+ * is checked ahead of time, so evaluation only fails if the expression has
+ * variables, see ccc_run_vars, or if its result does not fit in 64 bits
+ *
+ * arithmetic is done in 64 bits; only if an intermediate result overflows is
+ * the expression evaluated again exactly, in the handle's scratch space, so
+ * that e.g. a product which is divided back down by a later subtraction is
+ * still correct
+ *
+ * @iparam c := handle the expression was compiled with
+ * @iparam expr := compiled expression
+ * @oparam result := expression result
+ * @oparam err := error details on failure, may be NULL
+ * @returns CCC_OK on success, otherwise the error kind
+ */
+ccc_errkind ccc_run(
+    ccc_t* c, const ccc_expr_t* expr, int64_t* result, ccc_error_t* err);
+
+/*
+ * get the number of distinct variables in a compiled expression; they are
+ * numbered from 0 in order of first appearance
+ *
+ * @iparam expr := compiled expression
+ * @returns the number of variables
+ */
+size_t ccc_n_vars(const ccc_expr_t* expr);
+
+/*
+ * look up the index of a variable in a compiled expression
+ *
+ * @iparam expr := compiled expression
+ * @iparam name := variable name, need not be NUL-terminated
+ * @iparam len := length of the name
+ * @returns the index of the variable, or -1 if the expression does not use it
+ */
+int32_t ccc_var_index(const ccc_expr_t* expr, const char* name, size_t len);
+
+/*
+ * evaluate a compiled expression with its variables bound to the given
+ * values; variables are resolved to their indices when compiling, so binding
+ * them costs nothing per evaluation
+ *
+ * @iparam c := handle the expression was compiled with
+ * @iparam expr := compiled expression
+ * @iparam values := variable values, indexed as reported by ccc_var_index
+ * @iparam n_values := number of values, at least ccc_n_vars(expr)
+ * @oparam result := expression result
+ * @oparam err := error details on failure, may be NULL
+ * @returns CCC_OK on success, CCC_E_UNDEFINED_VAR if there are too few values,
+ *          CCC_E_VALUE_RANGE if the result does not fit in 64 bits, or
+ *          CCC_E_NO_MEMORY if the scratch space ran out while evaluating an
+ *          overflowing expression exactly
+ */
+ccc_errkind ccc_run_vars(
+    ccc_t* c, const ccc_expr_t* expr, const int64_t* values, size_t n_values,
+    int64_t* result, ccc_error_t* err);
+
+/*
+ * compile and evaluate an expression in one step; no scratch space is retained
+ *
+ * @iparam c := handle
+ * @iparam src := expression source, need not be NUL-terminated
+ * @iparam len := length of the expression source
+ * @oparam result := expression result
+ * @oparam err := error details on failure, may be NULL
+ * @returns CCC_OK on success, otherwise the error kind
+ */
+ccc_errkind ccc_eval(
+    ccc_t* c, const char* src, size_t len, int64_t* result, ccc_error_t* err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+/*
+ * src/check.c
+ * differential testing of the compiled engines against the interpreter
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bignum.h>
+#include <check.h>
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <jit.h>
+#include <lex.h>
+#include <opt.h>
+#include <regvm.h>
+#include <writer.h>
+
+// xorshift32
+static uint32_t check_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+typedef struct {
+    uint32_t* state;
+    char* buf;
+    size_t size;
+    size_t len;
+} check_gen_t;
+
+static void check_put(check_gen_t* g, const char* s)
+{
+    while (*s && g->len + 1 < g->size)
+    {
+        g->buf[g->len++] = *s++;
+    }
+}
+
+static void check_gen_literal(check_gen_t* g)
+{
+    // mostly small values, with some large enough to overflow 64 bits when
+    // combined
+    char lit[24];
+    uint32_t r = check_rand(g->state);
+    uint64_t v = r % 4 ? r % 100 : r % 2000000000;
+    if (r % 16 == 0)
+    {
+        v = v << 31 | check_rand(g->state);
+    }
+    snprintf(lit, sizeof(lit), "%" PRIu64, v);
+    check_put(g, lit);
+}
+
+static const char* const check_ops[] = { " + ", " - ", " * " };
+
+static void check_gen(check_gen_t* g, int depth)
+{
+    uint32_t r = check_rand(g->state);
+    // keep clear of the end of the buffer so that every expression closes
+    if (depth == 0 || g->len + 64 > g->size || r % 4 == 0)
+    {
+        check_gen_literal(g);
+        return;
+    }
+    switch (r % 7)
+    {
+    case 1:
+        // unary operators apply to a literal or a parenthesized expression,
+        // they cannot be chained
+        if (r & 8)
+        {
+            check_put(g, "-");
+            check_gen_literal(g);
+        }
+        else
+        {
+            check_put(g, "-(");
+            check_gen(g, depth - 1);
+            check_put(g, ")");
+        }
+        break;
+    case 2:
+        check_put(g, "(");
+        check_gen(g, depth - 1);
+        check_put(g, ")");
+        break;
+    default:
+        check_gen(g, depth - 1);
+        check_put(g, check_ops[r % 3]);
+        check_gen(g, depth - 1);
+        break;
+    }
+}
+
+size_t check_gen_expr(uint32_t* state, char* buf, size_t size)
+{
+    check_gen_t g = { .state=state, .buf=buf, .size=size, .len=0 };
+    check_gen(&g, 1 + check_rand(state) % 10);
+    buf[g.len] = 0;
+    return g.len;
+}
+
+// print a value of a mismatch to stderr
+static void check_print_value(const char* label, const token_t* value)
+{
+    writer_t w;
+    writer_init(&w, -1, 0);
+    writer_put_value(&w, value);
+    fprintf(stderr, "  %s: %.*s\n", label, (int) w.used, w.buf);
+    writer_free(&w);
+}
+
+int check_jit_main(long n_exprs, uint32_t seed)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    uint32_t state = seed ? seed : 1;
+    char expr[MAX_INPUT_LEN];
+    long n_checked = 0, n_native = 0, n_overflow = 0, n_failed = 0;
+
+    for (long i = 0; i < n_exprs; i++)
+    {
+        ctx_reset(&ctx);
+        check_gen_expr(&state, expr, sizeof(expr));
+
+        diag_t diag;
+        int32_t n_tokens, n_rpn;
+        token_t* tokens = tokenize(&ctx, expr, &n_tokens, &diag);
+        token_t* rpn = tokens
+            ? shunting_yard(&ctx, tokens, n_tokens, &n_rpn, &diag) : NULL;
+        token_t res, opt_res;
+        regvm_prog_t prog;
+        // generated expressions can still exceed the token limit
+        if (!rpn || evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag)
+            || regvm_compile(&ctx, rpn, n_rpn, &prog, &diag))
+        {
+            continue;
+        }
+
+        // the optimizer must not change the result either
+        int32_t n_opt;
+        token_t* opt = optimize_rpn(&ctx, rpn, n_rpn, &n_opt, &diag);
+        if (!opt || evaluate_rpn(&ctx, opt, n_opt, NULL, &opt_res, &diag)
+            || bignum_cmp(&opt_res, &res))
+        {
+            fprintf(stderr, "mismatch: %s\n", expr);
+            check_print_value("evaluate_rpn", &res);
+            if (opt)
+            {
+                check_print_value("optimized", &opt_res);
+            }
+            n_failed++;
+        }
+
+        // native code only computes 64-bit results, and must report an
+        // overflow for any other; it may also report one for a result which
+        // fits when an intermediate result did not, the engines then fall
+        // back to the interpreter
+        token_t native;
+        init_literal(&native, 0, 0);
+        int overflow;
+        jit_code_t code;
+        if (!jit_compile(&prog, &code))
+        {
+            jit_result_t r = code.fn(NULL);
+            native.value = r.value;
+            overflow = r.overflow != 0;
+            jit_free(&code);
+            n_native++;
+        }
+        else
+        {
+            overflow = regvm_run(&prog, NULL, &native.value);
+        }
+        n_checked++;
+        n_overflow += overflow;
+
+        if (!overflow && bignum_cmp(&native, &res))
+        {
+            fprintf(stderr, "mismatch: %s\n", expr);
+            check_print_value("evaluate_rpn", &res);
+            check_print_value("jit", &native);
+            n_failed++;
+        }
+    }
+
+    printf(
+        "%ld expressions checked (%ld compiled to native code, %ld "
+        "overflowed), %ld mismatches\n",
+        n_checked, n_native, n_overflow, n_failed);
+    ctx_free(&ctx);
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
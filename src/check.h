@@ -0,0 +1,41 @@
+/*
+ * src/check.h
+ * differential testing of the compiled engines against the interpreter on
+ * randomly generated expressions
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// default number of random expressions checked
+#define CHECK_DEFAULT_EXPRS 100000
+
+/*
+ * generate a random well-formed expression; the same seed state always
+ * produces the same sequence of expressions
+ *
+ * @iparam state := random number generator state, must be non-zero
+ * @oparam buf := output buffer
+ * @iparam size := size of the output buffer, the expression is truncated to
+ *                 fit so that it stays within the input limits
+ * @returns the length of the expression
+ */
+size_t check_gen_expr(uint32_t* state, char* buf, size_t size);
+
+/*
+ * evaluate random expressions with evaluate_rpn, with the JIT (or the
+ * register VM where the JIT is unavailable), and after optimize_rpn, and
+ * report any mismatches
+ *
+ * @iparam n_exprs := number of expressions
+ * @iparam seed := random seed
+ * @returns the process exit status, failure if any result differed
+ */
+int check_jit_main(long n_exprs, uint32_t seed);
+
+#endif
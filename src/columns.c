@@ -0,0 +1,1029 @@
+/*
+ * src/columns.c
+ * columnar evaluation of one expression across many rows
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <columns.h>
+#include <eval.h>
+#include <opt.h>
+#include <symtab.h>
+#include <writer.h>
+
+#if defined(__x86_64__)
+#define COLUMNS_X86 1
+#include <immintrin.h>
+#else
+#define COLUMNS_X86 0
+#endif
+
+static const char* const columns_isa_names[N_COLUMNS_ISAS] = {
+    [COLUMNS_SCALAR] = "scalar",
+    [COLUMNS_SSE2]   = "sse2",
+    [COLUMNS_AVX2]   = "avx2",
+};
+
+/* KERNELS
+ * every kernel handles any number of rows: the vector kernels process whole
+ * vectors and leave the remaining rows to the scalar kernel; arithmetic is
+ * done in 64 bits, and a kernel reports whether any row overflowed so that
+ * the block can be evaluated exactly instead
+ */
+
+static int columns_add_scalar(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n)
+{
+    int overflow = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        overflow |= __builtin_add_overflow(a[i], b[i], &dst[i]);
+    }
+    return overflow;
+}
+
+static int columns_sub_scalar(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n)
+{
+    int overflow = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        overflow |= __builtin_sub_overflow(a[i], b[i], &dst[i]);
+    }
+    return overflow;
+}
+
+// SSE2 and AVX2 have no 64-bit multiply, so every instruction set uses this
+static int columns_mul_scalar(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n)
+{
+    int overflow = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        overflow |= __builtin_mul_overflow(a[i], b[i], &dst[i]);
+    }
+    return overflow;
+}
+
+static int columns_neg_scalar(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n)
+{
+    (void) b;
+    int overflow = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        overflow |= __builtin_sub_overflow((int64_t) 0, a[i], &dst[i]);
+    }
+    return overflow;
+}
+
+#if COLUMNS_X86
+
+/*
+ * the vector kernels wrap, and detect overflow from the signs: a + b
+ * overflowed where the result's sign differs from both operands', a - b where
+ * the operands' signs differ and the result's differs from a's; the sign bits
+ * are accumulated and checked once per call
+ */
+
+static inline __m128i columns_add_ov_sse2(__m128i a, __m128i b, __m128i r)
+{
+    return _mm_and_si128(_mm_xor_si128(a, r), _mm_xor_si128(b, r));
+}
+
+static inline __m128i columns_sub_ov_sse2(__m128i a, __m128i b, __m128i r)
+{
+    return _mm_and_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, r));
+}
+
+// defines the SSE2 kernel of a binary operator
+#define COLUMNS_SSE2_KERNEL(name, vop)                                      \
+    static int columns_##name##_sse2(                                       \
+        int64_t* dst, const int64_t* a, const int64_t* b, size_t n)         \
+    {                                                                       \
+        __m128i ov = _mm_setzero_si128();                                   \
+        size_t i = 0;                                                       \
+        for (; i + 2 <= n; i += 2)                                          \
+        {                                                                   \
+            __m128i va = _mm_loadu_si128((const __m128i*) &a[i]);           \
+            __m128i vb = _mm_loadu_si128((const __m128i*) &b[i]);           \
+            __m128i r = _mm_##name##_epi64(va, vb);                         \
+            ov = _mm_or_si128(ov, vop(va, vb, r));                          \
+            _mm_storeu_si128((__m128i*) &dst[i], r);                        \
+        }                                                                   \
+        int overflow = columns_##name##_scalar(dst + i, a + i, b + i, n - i); \
+        return overflow | _mm_movemask_pd(_mm_castsi128_pd(ov));            \
+    }
+
+COLUMNS_SSE2_KERNEL(add, columns_add_ov_sse2)
+COLUMNS_SSE2_KERNEL(sub, columns_sub_ov_sse2)
+
+static int columns_neg_sse2(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n)
+{
+    __m128i ov = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*) &a[i]);
+        __m128i r = _mm_sub_epi64(_mm_setzero_si128(), va);
+        // only INT64_MIN is negative both before and after
+        ov = _mm_or_si128(ov, _mm_and_si128(va, r));
+        _mm_storeu_si128((__m128i*) &dst[i], r);
+    }
+    int overflow = columns_neg_scalar(dst + i, a + i, b, n - i);
+    return overflow | _mm_movemask_pd(_mm_castsi128_pd(ov));
+}
+
+// the target attribute lets the AVX2 kernels be compiled without enabling
+// AVX2 for the rest of the program
+__attribute__((target("avx2")))
+static inline __m256i columns_add_ov_avx2(__m256i a, __m256i b, __m256i r)
+{
+    return _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i columns_sub_ov_avx2(__m256i a, __m256i b, __m256i r)
+{
+    return _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r));
+}
+
+// defines the AVX2 kernel of a binary operator
+#define COLUMNS_AVX2_KERNEL(name, vop)                                      \
+    __attribute__((target("avx2")))                                         \
+    static int columns_##name##_avx2(                                       \
+        int64_t* dst, const int64_t* a, const int64_t* b, size_t n)         \
+    {                                                                       \
+        __m256i ov = _mm256_setzero_si256();                                \
+        size_t i = 0;                                                       \
+        for (; i + 4 <= n; i += 4)                                          \
+        {                                                                   \
+            __m256i va = _mm256_loadu_si256((const __m256i*) &a[i]);        \
+            __m256i vb = _mm256_loadu_si256((const __m256i*) &b[i]);        \
+            __m256i r = _mm256_##name##_epi64(va, vb);                      \
+            ov = _mm256_or_si256(ov, vop(va, vb, r));                       \
+            _mm256_storeu_si256((__m256i*) &dst[i], r);                     \
+        }                                                                   \
+        int overflow = columns_##name##_scalar(dst + i, a + i, b + i, n - i); \
+        return overflow | _mm256_movemask_pd(_mm256_castsi256_pd(ov));      \
+    }
+
+COLUMNS_AVX2_KERNEL(add, columns_add_ov_avx2)
+COLUMNS_AVX2_KERNEL(sub, columns_sub_ov_avx2)
+
+__attribute__((target("avx2")))
+static int columns_neg_avx2(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n)
+{
+    __m256i ov = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*) &a[i]);
+        __m256i r = _mm256_sub_epi64(_mm256_setzero_si256(), va);
+        ov = _mm256_or_si256(ov, _mm256_and_si256(va, r));
+        _mm256_storeu_si256((__m256i*) &dst[i], r);
+    }
+    int overflow = columns_neg_scalar(dst + i, a + i, b, n - i);
+    return overflow | _mm256_movemask_pd(_mm256_castsi256_pd(ov));
+}
+
+#endif
+
+static const columns_kernel columns_kernels[N_COLUMNS_ISAS][N_TOKEN_TYPES] = {
+    [COLUMNS_SCALAR] = {
+        [OP_ADD] = columns_add_scalar,
+        [OP_SUB] = columns_sub_scalar,
+        [OP_MUL] = columns_mul_scalar,
+        [OP_NEG] = columns_neg_scalar,
+    },
+#if COLUMNS_X86
+    [COLUMNS_SSE2] = {
+        [OP_ADD] = columns_add_sse2,
+        [OP_SUB] = columns_sub_sse2,
+        [OP_MUL] = columns_mul_scalar,
+        [OP_NEG] = columns_neg_sse2,
+    },
+    [COLUMNS_AVX2] = {
+        [OP_ADD] = columns_add_avx2,
+        [OP_SUB] = columns_sub_avx2,
+        [OP_MUL] = columns_mul_scalar,
+        [OP_NEG] = columns_neg_avx2,
+    },
+#endif
+};
+
+int columns_isa_from_name(const char* name)
+{
+    for (int i = 0; i < N_COLUMNS_ISAS; i++)
+    {
+        if (!strcmp(name, columns_isa_names[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* columns_isa_name(columns_isa isa)
+{
+    return columns_isa_names[isa];
+}
+
+int columns_isa_supported(columns_isa isa)
+{
+#if COLUMNS_X86
+    __builtin_cpu_init();
+    switch (isa)
+    {
+    case COLUMNS_SSE2:
+        // part of the x86-64 baseline
+        return 1;
+    case COLUMNS_AVX2:
+        return __builtin_cpu_supports("avx2") ? 1 : 0;
+    default:
+        break;
+    }
+#endif
+    return isa == COLUMNS_SCALAR;
+}
+
+columns_isa columns_detect_isa(void)
+{
+    columns_isa isa = N_COLUMNS_ISAS - 1;
+    while (isa > COLUMNS_SCALAR && !columns_isa_supported(isa))
+    {
+        isa--;
+    }
+    return isa;
+}
+
+int columns_compile(
+    ctx_t* ctx, const token_t* rpn, int32_t n_rpn, int32_t n_vars,
+    columns_prog_t* prog, diag_t* diag)
+{
+    int32_t n_opt;
+    token_t* opt = optimize_rpn(ctx, rpn, n_rpn, &n_opt, diag);
+    if (!opt)
+    {
+        return -1;
+    }
+
+    // the temporary of each operator is the block of the stack position its
+    // result is pushed to, so the number of temporaries is the stack depth
+    int32_t depth = 0, max_depth = 0, n_consts = 0, n_code = 0;
+    for (int32_t n = 0; n < n_opt; n++)
+    {
+        if (IS_OPERAND(opt[n]))
+        {
+            n_consts += IS_LITERAL(opt[n]);
+            max_depth = ++depth > max_depth ? depth : max_depth;
+        }
+        else if (opt[n].type != OP_POS)
+        {
+            depth -= ARITY(opt[n]) - 1;
+            n_code++;
+        }
+    }
+
+    *prog = (columns_prog_t) {
+        .code=ctx_alloc(ctx, (n_code + 1) * sizeof(columns_insn_t)),
+        .n_vars=n_vars,
+        .n_temps=max_depth,
+        .consts=ctx_alloc(ctx, (n_consts + 1) * sizeof(int64_t)),
+        .rpn=rpn,
+        .n_rpn=n_rpn,
+    };
+    int32_t* stack = ctx_alloc(ctx, (max_depth + 1) * sizeof(int32_t));
+    if (!prog->code || !prog->consts || !stack)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+
+    depth = 0;
+    int32_t temps = n_vars, consts = n_vars + max_depth;
+    for (int32_t n = 0; n < n_opt; n++)
+    {
+        if (IS_VARIABLE(opt[n]))
+        {
+            stack[depth++] = opt[n].value;
+        }
+        else if (IS_LITERAL(opt[n]))
+        {
+            stack[depth++] = consts + prog->n_consts;
+            prog->consts[prog->n_consts++] = opt[n].value;
+        }
+        else if (opt[n].type != OP_POS)
+        {
+            // the result may overwrite its left operand's temporary, the
+            // kernels allow their destination to alias an operand
+            int32_t n_operands = ARITY(opt[n]);
+            int32_t a = stack[depth - n_operands], b = stack[depth - 1];
+            depth -= n_operands - 1;
+            stack[depth - 1] = temps + depth - 1;
+            prog->code[prog->n_code++] = (columns_insn_t) {
+                .op=opt[n].type, .dst=stack[depth - 1], .a=a, .b=b };
+        }
+    }
+    prog->result = stack[0];
+    return 0;
+}
+
+int columns_exec_init(
+    columns_exec_t* x, const columns_prog_t* prog, columns_isa isa)
+{
+    int32_t n_blocks = prog->n_temps + prog->n_consts;
+    int32_t n_operands = prog->n_vars + n_blocks;
+    size_t block_size = COLUMNS_BLOCK_ROWS * sizeof(int64_t);
+    // blocks are aligned to cache lines, which is also enough for any vector
+    // load; there is always at least one block so that the size is non-zero
+    *x = (columns_exec_t) {
+        .prog=prog,
+        .kernels=columns_kernels[isa],
+        .mem=aligned_alloc(64, (n_blocks + 1) * block_size),
+        .operands=malloc((n_operands + 1) * sizeof(int64_t*)),
+    };
+    if (!x->mem || !x->operands)
+    {
+        columns_exec_free(x);
+        return -1;
+    }
+
+    for (int32_t i = 0; i < n_blocks; i++)
+    {
+        x->operands[prog->n_vars + i] = x->mem + i * COLUMNS_BLOCK_ROWS;
+    }
+    for (int32_t i = 0; i < prog->n_consts; i++)
+    {
+        int64_t* block = x->mem + (prog->n_temps + i) * COLUMNS_BLOCK_ROWS;
+        for (size_t j = 0; j < COLUMNS_BLOCK_ROWS; j++)
+        {
+            block[j] = prog->consts[i];
+        }
+    }
+    return 0;
+}
+
+int columns_exec_block(
+    columns_exec_t* x, const int64_t* const* vars, size_t n, int64_t* out)
+{
+    const columns_prog_t* prog = x->prog;
+    for (int32_t i = 0; i < prog->n_vars; i++)
+    {
+        x->operands[i] = vars[i];
+    }
+    // a result computed into a temporary is computed straight into the
+    // output instead, which is not read until the block is done
+    int in_temp = prog->result >= prog->n_vars
+        && prog->result < prog->n_vars + prog->n_temps;
+    if (in_temp)
+    {
+        x->operands[prog->result] = out;
+    }
+
+    // the block is finished even if it overflowed, the flags are only
+    // checked once at the end
+    int overflow = 0;
+    for (int32_t i = 0; i < prog->n_code; i++)
+    {
+        const columns_insn_t* insn = &prog->code[i];
+        overflow |= x->kernels[insn->op](
+            (int64_t*) x->operands[insn->dst], x->operands[insn->a],
+            x->operands[insn->b], n);
+    }
+
+    if (!in_temp)
+    {
+        memcpy(out, x->operands[prog->result], n * sizeof(int64_t));
+    }
+    return overflow != 0;
+}
+
+void columns_exec_free(columns_exec_t* x)
+{
+    free(x->mem);
+    free(x->operands);
+}
+
+/* INPUT
+ * the columns read by the expression are indexed by the slots of their names;
+ * columns of the other names in the sources are skipped
+ */
+
+typedef struct {
+    const void* data;
+    int width;        // bytes per value, 4 or 8
+    size_t n_rows;
+    size_t map_len;   // the data is mapped if non-zero, otherwise malloc'd
+    int64_t* block;   // 32-bit values widened for the current block
+} columns_col_t;
+
+static double columns_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// look up the column of a name, NULL if the expression does not use it
+static columns_col_t* columns_find(
+    const symtab_t* syms, columns_col_t* cols, const char* name, size_t len,
+    const char* source)
+{
+    int32_t slot = symtab_find(syms, name, len);
+    if (slot < 0)
+    {
+        return NULL;
+    }
+    if (cols[slot].data || cols[slot].n_rows)
+    {
+        eprintf("%s: column \"%.*s\" given twice\n", source, (int) len, name);
+        return NULL;
+    }
+    return &cols[slot];
+}
+
+/*
+ * map a raw column file given as NAME=PATH, NAME:i32=PATH or NAME:i64=PATH
+ * returns 0 on success, otherwise -1 after printing the error
+ */
+static int columns_open_raw(
+    const symtab_t* syms, columns_col_t* cols, const char* source)
+{
+    const char* eq = strchr(source, '=');
+    const char* path = eq + 1;
+    const char* colon = memchr(source, ':', eq - source);
+    const char* name_end = colon ? colon : eq;
+    int width = 4;
+    if (colon)
+    {
+        if (eq - colon == 4 && !strncmp(colon, ":i64", 4))
+        {
+            width = 8;
+        }
+        else if (eq - colon != 4 || strncmp(colon, ":i32", 4))
+        {
+            eprintf("%s: expected a type of i32 or i64\n", source);
+            return -1;
+        }
+    }
+    size_t name_len = name_end - source;
+    if (!name_len || lex_name(source, name_end) != name_len)
+    {
+        eprintf("%s: not a valid variable name\n", source);
+        return -1;
+    }
+    columns_col_t* col = columns_find(syms, cols, source, name_len, source);
+    if (!col)
+    {
+        // unused columns are not opened, columns given twice have failed
+        return symtab_find(syms, source, name_len) < 0 ? 0 : -1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st))
+    {
+        eprintf("%s: failed to open file\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size % width)
+    {
+        eprintf("%s: size is not a multiple of %d bytes\n", path, width);
+        close(fd);
+        return -1;
+    }
+    col->width = width;
+    col->n_rows = st.st_size / width;
+    if (st.st_size)
+    {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            eprintf("%s: failed to map file\n", path);
+            close(fd);
+            return -1;
+        }
+        // columns are consumed front to back, let the kernel read ahead
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        col->data = map;
+        col->map_len = st.st_size;
+    }
+    close(fd);
+    return 0;
+}
+
+/*
+ * parse a CSV value like a decimal literal with an optional sign; returns the
+ * end of the value, or NULL if there is none or it does not fit in 64 bits
+ */
+static const char* columns_parse_value(
+    const char* c, const char* end, int64_t* value)
+{
+    int neg = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+'))
+    {
+        c++;
+    }
+    // the magnitude of INT64_MIN is one more than INT64_MAX
+    uint64_t max = (uint64_t) INT64_MAX + neg, val = 0;
+    const char* digits = c;
+    while (c < end && *c >= '0' && *c <= '9')
+    {
+        uint64_t digit = *c - '0';
+        if (val > (max - digit) / 10)
+        {
+            return NULL;
+        }
+        val = val * 10 + digit;
+        c++;
+    }
+    if (c == digits)
+    {
+        return NULL;
+    }
+    *value = neg ? (int64_t) (0 - val) : (int64_t) val;
+    return c;
+}
+
+static const char* columns_skip_blank(const char* c, const char* end)
+{
+    while (c < end && (*c == ' ' || *c == '\t' || *c == '\r'))
+    {
+        c++;
+    }
+    return c;
+}
+
+// read a whole file into memory, returns NULL after printing the error
+static char* columns_read_file(const char* path, size_t* len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        eprintf("%s: failed to open file\n", path);
+        return NULL;
+    }
+    size_t size = 1 << 20, used = 0;
+    char* buf = malloc(size);
+    ssize_t n = 0;
+    while (buf && (n = read(fd, buf + used, size - used)) > 0)
+    {
+        used += n;
+        if (used == size)
+        {
+            char* tmp = realloc(buf, 2 * size);
+            if (!tmp)
+            {
+                free(buf);
+            }
+            buf = tmp;
+            size *= 2;
+        }
+    }
+    close(fd);
+    if (!buf || n < 0)
+    {
+        eprintf("%s: failed to read file\n", path);
+        free(buf);
+        return NULL;
+    }
+    *len = used;
+    return buf;
+}
+
+/*
+ * load the columns of a CSV file whose first line names its columns
+ * returns 0 on success, otherwise -1 after printing the error
+ */
+static int columns_load_csv(
+    const symtab_t* syms, columns_col_t* cols, const char* path)
+{
+    size_t len;
+    char* buf = columns_read_file(path, &len);
+    if (!buf)
+    {
+        return -1;
+    }
+    const char* c = buf;
+    const char* end = buf + len;
+    int rc = 0;
+
+    // map each field of the header to the column it fills, if any
+    int32_t n_fields = 0, size = 0;
+    columns_col_t** fields = NULL;
+    while (c < end && rc == 0)
+    {
+        c = columns_skip_blank(c, end);
+        const char* name = c;
+        c += lex_name(c, end);
+        size_t name_len = c - name;
+        c = columns_skip_blank(c, end);
+        if (!name_len || (c < end && *c != ',' && *c != '\n'))
+        {
+            eprintf("%s:1: expected a column name\n", path);
+            rc = -1;
+            break;
+        }
+        if (n_fields == size)
+        {
+            size = size ? 2 * size : 16;
+            columns_col_t** tmp = realloc(fields, size * sizeof(*fields));
+            if (!tmp)
+            {
+                eprintf("out of memory\n");
+                rc = -1;
+                break;
+            }
+            fields = tmp;
+        }
+        fields[n_fields] = columns_find(syms, cols, name, name_len, path);
+        if (!fields[n_fields] && symtab_find(syms, name, name_len) >= 0)
+        {
+            rc = -1;
+        }
+        if (fields[n_fields])
+        {
+            // claim the column so that a second source naming it fails
+            fields[n_fields]->width = sizeof(int64_t);
+            fields[n_fields]->n_rows = 1;
+        }
+        n_fields++;
+        if (c == end || *c++ == '\n')
+        {
+            break;
+        }
+    }
+
+    // the values are stored per column, growing together
+    size_t n_rows = 0, capacity = 0;
+    long lineno = 1;
+    while (c < end && rc == 0)
+    {
+        lineno++;
+        // skip blank lines
+        const char* it = columns_skip_blank(c, end);
+        if (it == end || *it == '\n')
+        {
+            c = it + (it < end);
+            continue;
+        }
+        if (n_rows == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 4096;
+            for (int32_t i = 0; i < n_fields && rc == 0; i++)
+            {
+                if (!fields[i])
+                {
+                    continue;
+                }
+                int64_t* tmp = realloc(
+                    (void*) fields[i]->data, capacity * sizeof(int64_t));
+                if (!tmp)
+                {
+                    eprintf("out of memory\n");
+                    rc = -1;
+                    break;
+                }
+                fields[i]->data = tmp;
+            }
+        }
+        for (int32_t i = 0; i < n_fields && rc == 0; i++)
+        {
+            c = columns_skip_blank(c, end);
+            if (fields[i])
+            {
+                int64_t* data = (int64_t*) fields[i]->data;
+                c = columns_parse_value(c, end, &data[n_rows]);
+                c = c ? columns_skip_blank(c, end) : NULL;
+            }
+            else
+            {
+                while (c < end && *c != ',' && *c != '\n')
+                {
+                    c++;
+                }
+            }
+            int last = i == n_fields - 1;
+            if (!c || (last ? c < end && *c != '\n' : c == end || *c != ','))
+            {
+                eprintf("%s:%ld: expected %d 64-bit integer fields\n",
+                    path, lineno, n_fields);
+                rc = -1;
+                break;
+            }
+            c += c < end;
+        }
+        n_rows++;
+    }
+
+    for (int32_t i = 0; i < n_fields; i++)
+    {
+        if (fields[i])
+        {
+            fields[i]->n_rows = n_rows;
+        }
+    }
+    free(fields);
+    free(buf);
+    return rc;
+}
+
+/*
+ * check that every variable has a column and that the columns have the same
+ * number of rows; returns the number of rows, or -1 after printing the error
+ */
+static long columns_check(
+    const symtab_t* syms, const columns_col_t* cols, const token_t* tokens,
+    int32_t n_tokens)
+{
+    for (int32_t i = 0; i < n_tokens; i++)
+    {
+        if (IS_VARIABLE(tokens[i]) && !cols[tokens[i].value].width)
+        {
+            diag_t diag;
+            set_diag(&diag, E_UNDEFINED_VAR, &tokens[i], i, 0);
+            print_err(&diag);
+            return -1;
+        }
+    }
+    for (int32_t i = 1; i < syms->n_slots; i++)
+    {
+        if (cols[i].n_rows != cols[0].n_rows)
+        {
+            eprintf("columns have different numbers of rows\n");
+            return -1;
+        }
+    }
+    return cols[0].n_rows;
+}
+
+/*
+ * evaluate each row of a block which overflowed with the exact evaluator and
+ * write its result; returns 0 on success, otherwise -1 after printing the
+ * error
+ */
+static int columns_run_exact(
+    const columns_prog_t* prog, const int64_t* const* vars, int32_t n_cols,
+    size_t row, size_t n, int raw, writer_t* out, int64_t* values)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    int rc = 0;
+    for (size_t j = 0; j < n && rc == 0; j++)
+    {
+        for (int32_t i = 0; i < n_cols; i++)
+        {
+            values[i] = vars[i][j];
+        }
+        token_t res;
+        diag_t diag;
+        if (evaluate_rpn_vars(
+            &ctx, prog->rpn, prog->n_rpn, values, &res, &diag))
+        {
+            print_err(&diag);
+            rc = -1;
+        }
+        else if (!raw)
+        {
+            writer_put_value(out, &res);
+            writer_putc(out, '\n');
+        }
+        else if (IS_LITERAL(res))
+        {
+            writer_put(out, (const char*) &res.value, sizeof(int64_t));
+        }
+        else
+        {
+            eprintf("row %zu: value does not fit in 64 bits\n", row + j + 1);
+            rc = -1;
+        }
+        ctx_reset(&ctx);
+    }
+    ctx_free(&ctx);
+    return rc;
+}
+
+// evaluate every block and write its results
+static int columns_run(
+    columns_exec_t* x, columns_col_t* cols, int32_t n_cols, size_t n_rows,
+    int raw, writer_t* out, double* elapsed)
+{
+    const int64_t** vars = malloc((n_cols + 1) * sizeof(int64_t*));
+    int64_t* result = malloc(COLUMNS_BLOCK_ROWS * sizeof(int64_t));
+    int64_t* values = malloc((n_cols + 1) * sizeof(int64_t));
+    int rc = vars && result && values ? 0 : -1;
+    if (rc)
+    {
+        eprintf("out of memory\n");
+    }
+    *elapsed = 0;
+    for (size_t row = 0; row < n_rows && rc == 0; row += COLUMNS_BLOCK_ROWS)
+    {
+        size_t n = n_rows - row < COLUMNS_BLOCK_ROWS
+            ? n_rows - row : COLUMNS_BLOCK_ROWS;
+        for (int32_t i = 0; i < n_cols; i++)
+        {
+            if (cols[i].width == sizeof(int64_t))
+            {
+                vars[i] = (const int64_t*) cols[i].data + row;
+                continue;
+            }
+            const int32_t* data = (const int32_t*) cols[i].data + row;
+            for (size_t j = 0; j < n; j++)
+            {
+                cols[i].block[j] = data[j];
+            }
+            vars[i] = cols[i].block;
+        }
+
+        double start = columns_now();
+        int overflow = columns_exec_block(x, vars, n, result);
+        *elapsed += columns_now() - start;
+
+        if (overflow)
+        {
+            rc = columns_run_exact(
+                x->prog, vars, n_cols, row, n, raw, out, values);
+        }
+        else if (raw)
+        {
+            writer_put(out, (const char*) result, n * sizeof(int64_t));
+        }
+        else
+        {
+            for (size_t j = 0; j < n; j++)
+            {
+                writer_put_int(out, result[j]);
+                writer_putc(out, '\n');
+            }
+        }
+    }
+    free(vars);
+    free(result);
+    free(values);
+    return rc;
+}
+
+// evaluate the columns and write the results, returns 0 on success
+static int columns_write(
+    const columns_prog_t* prog, columns_col_t* cols, int32_t n_cols,
+    size_t n_rows, columns_isa isa, const char* out_path)
+{
+    columns_exec_t x;
+    if (columns_exec_init(&x, prog, isa))
+    {
+        eprintf("out of memory\n");
+        return -1;
+    }
+    int fd = out_path
+        ? open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDOUT_FILENO;
+    if (fd < 0)
+    {
+        eprintf("%s: failed to open file\n", out_path);
+        columns_exec_free(&x);
+        return -1;
+    }
+    writer_t out;
+    writer_init(&out, fd, WRITER_BUF_SIZE);
+    double elapsed;
+    int rc = columns_run(
+        &x, cols, n_cols, n_rows, out_path != NULL, &out, &elapsed);
+    if (writer_free(&out))
+    {
+        rc = -1;
+    }
+    if (out_path)
+    {
+        close(fd);
+    }
+    columns_exec_free(&x);
+    if (!rc)
+    {
+        // only the kernels are timed, not reading the input or writing the
+        // results
+        fprintf(
+            stderr, "columns: %zu rows in %.3f s (%.1f million rows/s, %s)\n",
+            n_rows, elapsed, elapsed > 0 ? n_rows / elapsed * 1e-6 : 0.0,
+            columns_isa_name(isa));
+    }
+    return rc;
+}
+
+// load the columns of a compiled expression and evaluate it over them
+static int columns_eval(
+    const symtab_t* syms, const columns_prog_t* prog, const token_t* tokens,
+    int32_t n_tokens, int n_sources, char** sources, columns_isa isa,
+    const char* out_path)
+{
+    int32_t n_cols = syms->n_slots;
+    columns_col_t* cols = calloc(n_cols + 1, sizeof(columns_col_t));
+    int rc = cols ? 0 : -1;
+    if (rc)
+    {
+        eprintf("out of memory\n");
+    }
+    for (int i = 0; i < n_sources && rc == 0; i++)
+    {
+        rc = strchr(sources[i], '=')
+            ? columns_open_raw(syms, cols, sources[i])
+            : columns_load_csv(syms, cols, sources[i]);
+    }
+    long n_rows = rc ? -1 : columns_check(syms, cols, tokens, n_tokens);
+    for (int32_t i = 0; i < n_cols && n_rows >= 0; i++)
+    {
+        if (cols[i].width != sizeof(int32_t))
+        {
+            continue;
+        }
+        cols[i].block = malloc(COLUMNS_BLOCK_ROWS * sizeof(int64_t));
+        if (!cols[i].block)
+        {
+            eprintf("out of memory\n");
+            n_rows = -1;
+        }
+    }
+    if (n_rows >= 0)
+    {
+        rc = columns_write(prog, cols, n_cols, n_rows, isa, out_path);
+    }
+
+    for (int32_t i = 0; cols && i < n_cols; i++)
+    {
+        if (cols[i].map_len)
+        {
+            munmap((void*) cols[i].data, cols[i].map_len);
+        }
+        else
+        {
+            free((void*) cols[i].data);
+        }
+        free(cols[i].block);
+    }
+    free(cols);
+    return n_rows < 0 || rc ? -1 : 0;
+}
+
+int columns_main(
+    int n_sources, char** sources, const char* expr, int isa,
+    const char* out_path)
+{
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+
+    size_t len = strlen(expr);
+    diag_t diag;
+    int32_t n_tokens, n_rpn;
+    columns_prog_t prog;
+    token_t* tokens = tokenize_n(&ctx, expr, len, &n_tokens, &diag);
+    token_t* rpn = NULL;
+    if (n_tokens == 0)
+    {
+        set_diag(&diag, E_EMPTY_EXPR, NULL, -1, 0);
+    }
+    else if (n_tokens > 0
+        && !symtab_resolve(&syms, expr, len, tokens, n_tokens, 1, &diag))
+    {
+        rpn = shunting_yard(&ctx, tokens, n_tokens, &n_rpn, &diag);
+    }
+
+    int rc = -1;
+    if (!rpn || columns_compile(&ctx, rpn, n_rpn, syms.n_slots, &prog, &diag))
+    {
+        print_err(&diag);
+    }
+    else if (!syms.n_slots)
+    {
+        eprintf("expression does not read any column\n");
+    }
+    else
+    {
+        rc = columns_eval(
+            &syms, &prog, tokens, n_tokens, n_sources, sources,
+            isa < 0 ? columns_detect_isa() : (columns_isa) isa, out_path);
+    }
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
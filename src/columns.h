@@ -0,0 +1,182 @@
+/*
+ * src/columns.h
+ * columnar evaluation of one expression across many rows
+ *
+ * the expression is compiled once into a short list of instructions over
+ * blocks of rows; each instruction applies one operator to whole blocks with
+ * a vectorized kernel, so the per-row cost is a few SIMD instructions per
+ * operator rather than a call to the evaluator per row; variables name the
+ * input columns, and blocks are small enough for the operand and temporary
+ * blocks of typical expressions to stay in L1
+ *
+ * values are 64 bits wide; the kernels wrap but report whether any row
+ * overflowed, and such a block is evaluated again row by row with the exact
+ * evaluator, so that the results are the same as evaluate_rpn's
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+
+// rows per block: 8 KiB per block, so that a handful of operand and
+// temporary blocks fit in a 32 KiB L1 data cache
+#define COLUMNS_BLOCK_ROWS 1024
+
+// instruction sets the kernels are compiled for, selected at runtime
+typedef enum {
+    COLUMNS_SCALAR,
+    COLUMNS_SSE2,
+    COLUMNS_AVX2,
+    N_COLUMNS_ISAS
+} columns_isa;
+
+/*
+ * dst[i] = a[i] op b[i] for i < n; b is unused by unary operators; dst may
+ * alias either operand; returns non-zero if any row overflowed 64 bits
+ */
+typedef int (*columns_kernel)(
+    int64_t* dst, const int64_t* a, const int64_t* b, size_t n);
+
+/*
+ * block operand: variable columns come first, indexed by their slot, then
+ * temporaries, then constants broadcast to a whole block
+ */
+typedef struct {
+    uint8_t op;  // token_type of the operator
+    int32_t dst;
+    int32_t a;
+    int32_t b;
+} columns_insn_t;
+
+typedef struct {
+    columns_insn_t* code;
+    int32_t n_code;
+    int32_t n_vars;
+    int32_t n_temps;
+    int32_t n_consts;
+    int64_t* consts;       // values of the constant blocks
+    int32_t result;        // operand holding the result
+    const token_t* rpn;    // source expression, for blocks which overflow
+    int32_t n_rpn;
+} columns_prog_t;
+
+// state for running a program over blocks, see columns_exec_init
+typedef struct {
+    const columns_prog_t* prog;
+    const columns_kernel* kernels;  // indexed by token_type
+    int64_t* mem;                   // temporary and constant blocks
+    const int64_t** operands;       // block of each operand
+} columns_exec_t;
+
+/*
+ * look up an instruction set by name
+ *
+ * @iparam name := "scalar", "sse2" or "avx2"
+ * @returns the instruction set, or -1 if the name is unknown
+ */
+int columns_isa_from_name(const char* name);
+
+/*
+ * get the name of an instruction set, as accepted by columns_isa_from_name
+ *
+ * @iparam isa := instruction set
+ * @returns the instruction set name
+ */
+const char* columns_isa_name(columns_isa isa);
+
+/*
+ * check whether the processor supports an instruction set
+ *
+ * @iparam isa := instruction set
+ * @returns 1 if the kernels for the instruction set can run, otherwise 0
+ */
+int columns_isa_supported(columns_isa isa);
+
+/*
+ * get the widest instruction set supported by the processor
+ *
+ * @returns the instruction set
+ */
+columns_isa columns_detect_isa(void);
+
+/*
+ * lower an expression in Reverse Polish notation into block instructions; the
+ * variables must have been resolved to slots below n_vars, and the expression
+ * is simplified first, see optimize_rpn; the program keeps a reference to
+ * the expression
+ *
+ * @iparam ctx := evaluation context, owns the program
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @iparam n_vars := number of variable slots, i.e. input columns
+ * @oparam prog := compiled program
+ * @oparam diag := filled in with the error details if compilation fails; the
+ *                 errors are the same ones evaluate_rpn reports
+ * @returns 0 on success, -1 on error
+ */
+int columns_compile(
+    ctx_t* ctx, const token_t* rpn, int32_t n_rpn, int32_t n_vars,
+    columns_prog_t* prog, diag_t* diag);
+
+/*
+ * prepare to run a program; the constant blocks are filled in once here
+ *
+ * @oparam x := execution state
+ * @iparam prog := compiled program
+ * @iparam isa := instruction set of the kernels, must be supported
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int columns_exec_init(
+    columns_exec_t* x, const columns_prog_t* prog, columns_isa isa);
+
+/*
+ * evaluate a block of rows
+ *
+ * @iparam x := execution state
+ * @iparam vars := block of each variable column, indexed by slot
+ * @iparam n := number of rows, at most COLUMNS_BLOCK_ROWS
+ * @oparam out := result of each row
+ * @returns 0 on success, or 1 if a row overflowed 64 bits; the results of
+ *          the block are then unusable and each row must be evaluated with
+ *          evaluate_rpn_vars instead
+ */
+int columns_exec_block(
+    columns_exec_t* x, const int64_t* const* vars, size_t n, int64_t* out);
+
+/*
+ * release the memory of the execution state
+ *
+ * @iparam x := execution state
+ */
+void columns_exec_free(columns_exec_t* x);
+
+/*
+ * evaluate an expression over every row of a set of columns and write one
+ * result per row; the evaluation throughput is reported on stderr
+ *
+ * each source is either a CSV file, whose header row names its columns, or
+ * NAME=PATH, NAME:i32=PATH or NAME:i64=PATH for a raw file of little-endian
+ * integers which is memory mapped; 32-bit values are widened to 64 bits
+ *
+ * @iparam n_sources := number of sources
+ * @iparam sources := column sources
+ * @iparam expr := expression
+ * @iparam isa := instruction set, or -1 to select the widest one supported
+ * @iparam out_path := file receiving the results as raw little-endian 64-bit
+ *                     integers, or NULL to print them one per line; a result
+ *                     which does not fit in 64 bits is an error in a file
+ * @returns the process exit status
+ */
+int columns_main(
+    int n_sources, char** sources, const char* expr, int isa,
+    const char* out_path);
+
+#endif
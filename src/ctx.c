@@ -0,0 +1,143 @@
+/*
+ * src/ctx.c
+ * evaluation context which owns the scratch memory used while lexing,
+ * converting, and evaluating an expression
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <ctx.h>
+
+#define CTX_ALIGN \
+    (sizeof(void*) > sizeof(int64_t) ? sizeof(void*) : sizeof(int64_t))
+#define ALIGN_UP(n) (((n) + CTX_ALIGN - 1) & ~(CTX_ALIGN - 1))
+
+void ctx_init(ctx_t* ctx)
+{
+    *ctx = (ctx_t) {
+        .base=NULL, .size=0, .used=0, .overflow=NULL, .overflow_size=0,
+        .fixed=0 };
+}
+
+void ctx_init_fixed(ctx_t* ctx, void* buf, size_t size)
+{
+    ctx_init(ctx);
+    // align the start of the region, the caller's buffer may not be
+    uintptr_t addr = (uintptr_t) buf;
+    size_t pad = ALIGN_UP(addr) - addr;
+    ctx->base = (char*) buf + (pad < size ? pad : size);
+    ctx->size = pad < size ? size - pad : 0;
+    ctx->fixed = 1;
+}
+
+// fall back to a dedicated block when the arena region is exhausted
+static void* ctx_alloc_overflow(ctx_t* ctx, size_t size)
+{
+    ctx_block_t* block = malloc(sizeof(ctx_block_t) + size);
+    if (!block)
+    {
+        return NULL;
+    }
+    block->next = ctx->overflow;
+    block->size = size;
+    ctx->overflow = block;
+    ctx->overflow_size += size;
+
+    return block->data;
+}
+
+void* ctx_alloc(ctx_t* ctx, size_t size)
+{
+    size = ALIGN_UP(size);
+    // the region is only allocated on first use
+    if (!ctx->base)
+    {
+        size_t init = size > CTX_INIT_SIZE ? size : CTX_INIT_SIZE;
+        ctx->base = malloc(init);
+        if (!ctx->base)
+        {
+            return NULL;
+        }
+        ctx->size = init;
+    }
+
+    if (ctx->size - ctx->used < size)
+    {
+        return ctx->fixed ? NULL : ctx_alloc_overflow(ctx, size);
+    }
+
+    void* ptr = ctx->base + ctx->used;
+    ctx->used += size;
+
+    return ptr;
+}
+
+static void ctx_free_overflow(ctx_t* ctx)
+{
+    while (ctx->overflow)
+    {
+        ctx_block_t* next = ctx->overflow->next;
+        free(ctx->overflow);
+        ctx->overflow = next;
+    }
+    ctx->overflow_size = 0;
+}
+
+void ctx_reset(ctx_t* ctx)
+{
+    // fold any overflow blocks into a single larger region so that the next
+    // expression of a similar size fits without further allocations
+    if (ctx->overflow)
+    {
+        size_t size = ctx->size;
+        while (size < ctx->size + ctx->overflow_size)
+        {
+            size *= 2;
+        }
+        ctx_free_overflow(ctx);
+
+        char* base = realloc(ctx->base, size);
+        if (base)
+        {
+            ctx->base = base;
+            ctx->size = size;
+        }
+    }
+    ctx->used = 0;
+}
+
+size_t ctx_mark(ctx_t* ctx)
+{
+    return ctx->used;
+}
+
+void ctx_release(ctx_t* ctx, size_t mark)
+{
+    ctx->used = mark;
+}
+
+int ctx_mark_of(ctx_t* ctx, const void* ptr, size_t* mark)
+{
+    uintptr_t addr = (uintptr_t) ptr;
+    uintptr_t base = (uintptr_t) ctx->base;
+    if (!ctx->base || addr < base || addr >= base + ctx->used)
+    {
+        return -1;
+    }
+    *mark = addr - base;
+
+    return 0;
+}
+
+void ctx_free(ctx_t* ctx)
+{
+    ctx_free_overflow(ctx);
+    if (!ctx->fixed)
+    {
+        free(ctx->base);
+    }
+    ctx_init(ctx);
+}
@@ -0,0 +1,112 @@
+/*
+ * src/ctx.h
+ * evaluation context which owns the scratch memory used while lexing,
+ * converting, and evaluating an expression
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef CTX_H
+#define CTX_H
+
+#include <stddef.h>
+
+// initial size of the arena region, enough for typical REPL input
+#define CTX_INIT_SIZE (16 * 1024)
+
+// overflow block, allocated when the arena region runs out mid-expression
+typedef struct ctx_block {
+    struct ctx_block* next;
+    size_t size;
+    char data[];
+} ctx_block_t;
+
+/*
+ * the context is a bump allocator: allocations are never freed individually,
+ * instead the whole region is released at once with ctx_reset between
+ * expressions; if an expression outgrows the region, overflow blocks are
+ * chained on and folded into a single larger region on the next reset, so
+ * that steady-state evaluation does not call malloc
+ */
+typedef struct {
+    char* base;
+    size_t size;
+    size_t used;
+    ctx_block_t* overflow;
+    size_t overflow_size;
+    int fixed;  // region is caller-provided and never grows
+} ctx_t;
+
+/*
+ * initialize an empty context; the arena region is allocated lazily
+ *
+ * @oparam ctx := context to be initialized
+ */
+void ctx_init(ctx_t* ctx);
+
+/*
+ * initialize a context over a caller-provided region; the context never calls
+ * malloc and allocations fail once the region is exhausted
+ *
+ * @oparam ctx := context to be initialized
+ * @iparam buf := scratch region
+ * @iparam size := size of the scratch region
+ */
+void ctx_init_fixed(ctx_t* ctx, void* buf, size_t size);
+
+/*
+ * allocate scratch memory from the context; the memory is valid until the
+ * next call to ctx_reset or ctx_free
+ *
+ * @iparam ctx := context to allocate from
+ * @iparam size := number of bytes requested
+ * @returns a pointer aligned for any token/value type, or NULL if a fixed
+ *           context is exhausted or memory could not be allocated
+ */
+void* ctx_alloc(ctx_t* ctx, size_t size);
+
+/*
+ * record the current allocation position of the context
+ *
+ * @iparam ctx := context
+ * @returns a mark to be passed to ctx_release
+ */
+size_t ctx_mark(ctx_t* ctx);
+
+/*
+ * release the allocations made since a mark was taken, keeping older ones;
+ * overflow blocks are only released by ctx_reset
+ *
+ * @iparam ctx := context
+ * @iparam mark := position returned by ctx_mark
+ */
+void ctx_release(ctx_t* ctx, size_t mark);
+
+/*
+ * get the mark at which an allocation from the arena region starts, so that
+ * it can be released along with everything allocated after it
+ *
+ * @iparam ctx := context
+ * @iparam ptr := memory returned by ctx_alloc
+ * @oparam mark := position to be passed to ctx_release
+ * @returns 0 on success, -1 if the memory is in an overflow block, which is
+ *          only released by ctx_reset
+ */
+int ctx_mark_of(ctx_t* ctx, const void* ptr, size_t* mark);
+
+/*
+ * release all allocations made since the last reset
+ *
+ * @iparam ctx := context to be reset
+ */
+void ctx_reset(ctx_t* ctx);
+
+/*
+ * release all memory owned by the context; the region of a fixed context
+ * belongs to the caller and is not freed
+ *
+ * @iparam ctx := context to be freed
+ */
+void ctx_free(ctx_t* ctx);
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * src/dag.c
+ * hash-consed expression DAG
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <dag.h>
+#include <eval.h>
+
+#define DAG_EMPTY -1
+
+typedef struct {
+    dag_node_t* nodes;
+    int32_t n_nodes;
+    int32_t* table;  // node indices, DAG_EMPTY if the slot is free
+    uint32_t mask;
+} dag_builder_t;
+
+static uint32_t dag_hash(const dag_node_t* node)
+{
+    // FNV-1a over the fields which identify a node
+    uint32_t fields[5] = {
+        node->type, (uint32_t) node->value, (uint32_t) (node->value >> 32),
+        (uint32_t) node->lhs, (uint32_t) node->rhs };
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        h = (h ^ fields[i]) * 16777619u;
+    }
+    return h;
+}
+
+// return the index of the node equal to the given one, adding it if needed
+static int32_t dag_intern(dag_builder_t* b, dag_node_t node)
+{
+    // + and * commute, so order their operands to share a + b and b + a
+    if ((node.type == OP_ADD || node.type == OP_MUL) && node.lhs > node.rhs)
+    {
+        int32_t tmp = node.lhs;
+        node.lhs = node.rhs;
+        node.rhs = tmp;
+    }
+
+    // linear probing; the table is never more than half full
+    uint32_t slot = dag_hash(&node) & b->mask;
+    for (; b->table[slot] != DAG_EMPTY; slot = (slot + 1) & b->mask)
+    {
+        const dag_node_t* other = &b->nodes[b->table[slot]];
+        if (other->type == node.type && other->value == node.value
+            && other->lhs == node.lhs && other->rhs == node.rhs)
+        {
+            return b->table[slot];
+        }
+    }
+    b->nodes[b->n_nodes] = node;
+    b->table[slot] = b->n_nodes;
+    return b->n_nodes++;
+}
+
+int dag_build(
+    ctx_t* ctx, const token_t* rpn, int32_t n_rpn, dag_t* dag, diag_t* diag)
+{
+    uint32_t n_slots = 2;
+    while (n_slots < 2 * (uint32_t) n_rpn)
+    {
+        n_slots <<= 1;
+    }
+    dag_builder_t b = {
+        .nodes=ctx_alloc(ctx, n_rpn * sizeof(dag_node_t)),
+        .n_nodes=0,
+        .table=ctx_alloc(ctx, n_slots * sizeof(int32_t)),
+        .mask=n_slots - 1,
+    };
+    int32_t* stack = ctx_alloc(ctx, n_rpn * sizeof(int32_t));
+    if (!b.nodes || !b.table || !stack)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+    memset(b.table, 0xff, n_slots * sizeof(int32_t));
+    int32_t n_stack = 0;
+
+    for (int32_t n = 0; n < n_rpn; n++)
+    {
+        dag_node_t node = {
+            .type=rpn[n].type, .value=0, .lhs=-1, .rhs=-1 };
+        // a variable is interned by its slot, so repeated uses are shared
+        if (IS_OPERAND(rpn[n]))
+        {
+            node.value = rpn[n].value;
+        }
+        else
+        {
+            // not enough operands on the stack, see eval.c:evaluate_rpn
+            if (n_stack < ARITY(rpn[n]))
+            {
+                set_diag(diag, E_OP_MISSING_EXPR, &rpn[n], n, SIDE_RIGHT);
+                return -1;
+            }
+            // unary plus leaves its operand unchanged
+            if (rpn[n].type == OP_POS)
+            {
+                continue;
+            }
+            if (ARITY(rpn[n]) == 2)
+            {
+                node.rhs = STACK_POP(stack, n_stack);
+            }
+            node.lhs = STACK_POP(stack, n_stack);
+        }
+        STACK_PUSH(stack, n_stack, dag_intern(&b, node));
+    }
+    if (!n_stack)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        return -1;
+    }
+
+    dag->nodes = b.nodes;
+    dag->n_nodes = b.n_nodes;
+    // the result is the last value pushed, as in evaluate_rpn
+    dag->root = stack[n_stack - 1];
+    return 0;
+}
+
+int dag_eval(
+    ctx_t* ctx, const dag_t* dag, const int64_t* vars, int64_t* result)
+{
+    size_t mark = ctx_mark(ctx);
+    int64_t* values = ctx_alloc(ctx, dag->n_nodes * sizeof(int64_t));
+    if (!values)
+    {
+        return -1;
+    }
+
+    // operands precede their users, so a single pass evaluates every node
+    // after its operands; nodes past the root are not needed, and an
+    // overflow abandons the evaluation
+    int overflow = 0;
+    for (int32_t i = 0; i <= dag->root && !overflow; i++)
+    {
+        const dag_node_t* node = &dag->nodes[i];
+        switch (node->type)
+        {
+        case OP_ADD:
+            overflow = __builtin_add_overflow(
+                values[node->lhs], values[node->rhs], &values[i]);
+            break;
+        case OP_SUB:
+            overflow = __builtin_sub_overflow(
+                values[node->lhs], values[node->rhs], &values[i]);
+            break;
+        case OP_MUL:
+            overflow = __builtin_mul_overflow(
+                values[node->lhs], values[node->rhs], &values[i]);
+            break;
+        case OP_NEG:
+            overflow = __builtin_sub_overflow(
+                (int64_t) 0, values[node->lhs], &values[i]);
+            break;
+        case VARIABLE:
+            values[i] = vars[node->value];
+            break;
+        default:
+            values[i] = node->value;
+            break;
+        }
+    }
+    *result = values[dag->root];
+
+    ctx_release(ctx, mark);
+    return overflow;
+}
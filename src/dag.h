@@ -0,0 +1,69 @@
+/*
+ * src/dag.h
+ * hash-consed expression DAG
+ *
+ * an expression in Reverse Polish notation is rebuilt bottom-up, interning
+ * each node in a hash table keyed on its operator and operands; structurally
+ * identical subexpressions therefore map to a single node, so evaluation time
+ * and the size of the DAG grow with the number of distinct subexpressions
+ * rather than with the number of tokens
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef DAG_H
+#define DAG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+
+typedef struct {
+    token_type type;
+    int64_t value;  // literal value or variable slot, unused for operators
+    int32_t lhs;    // operand node indices, -1 if absent
+    int32_t rhs;
+} dag_node_t;
+
+typedef struct {
+    // nodes in topological order, operands always precede their users
+    dag_node_t* nodes;
+    int32_t n_nodes;
+    int32_t root;
+} dag_t;
+
+/*
+ * build the DAG of an expression in Reverse Polish notation; the operand
+ * counts are checked while building, so evaluating the DAG cannot fail
+ *
+ * @iparam ctx := evaluation context, provides memory for the DAG
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @oparam dag := DAG, valid until the context is reset
+ * @oparam diag := filled in with the error details if the expression is
+ *                 invalid; the errors are the same ones evaluate_rpn reports
+ * @returns 0 on success, -1 on error
+ */
+int dag_build(
+    ctx_t* ctx, const token_t* rpn, int32_t n_rpn, dag_t* dag, diag_t* diag);
+
+/*
+ * evaluate a DAG, computing each distinct subexpression once
+ *
+ * @iparam ctx := evaluation context, provides scratch for one value per node
+ *                which is released on return
+ * @iparam dag := DAG
+ * @iparam vars := variable values indexed by slot, may be NULL if the
+ *                 expression has no variables
+ * @oparam result := value of the expression
+ * @returns 0 on success, 1 if an operation overflowed 64 bits, in which case
+ *          the expression must be evaluated with evaluate_rpn instead, or -1
+ *          if there was not enough memory
+ */
+int dag_eval(
+    ctx_t* ctx, const dag_t* dag, const int64_t* vars, int64_t* result);
+
+#endif
@@ -0,0 +1,487 @@
+/*
+ * src/emit.c
+ * ahead-of-time C code emitter
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <emit.h>
+#include <eval.h>
+#include <symtab.h>
+
+// expression tree node rebuilt from the RPN
+typedef struct {
+    token_type type;
+    int64_t value;  // literals, variable slots, and folded constants
+    int32_t lhs;    // operand node indices, -1 if absent
+    int32_t rhs;
+    uint8_t constant;
+} emit_node_t;
+
+/*
+ * combine constant operands, as in eval.c; returns 0 if the result overflows
+ * 64 bits, in which case the operator is left to the generated code
+ */
+static int emit_fold(token_type type, int64_t a, int64_t b, int64_t* value)
+{
+    switch (type)
+    {
+    case OP_ADD:
+        return !__builtin_add_overflow(a, b, value);
+    case OP_SUB:
+        return !__builtin_sub_overflow(a, b, value);
+    case OP_MUL:
+        return !__builtin_mul_overflow(a, b, value);
+    case OP_NEG:
+        return !__builtin_sub_overflow((int64_t) 0, a, value);
+    default:
+        *value = a;
+        return 1;
+    }
+}
+
+static const char* const emit_helpers[N_TOKEN_TYPES] = {
+    [OP_ADD] = "ccc_add",
+    [OP_SUB] = "ccc_sub",
+    [OP_MUL] = "ccc_mul",
+    [OP_NEG] = "ccc_neg",
+};
+
+void emit_prelude(writer_t* out)
+{
+    writer_puts(out,
+        "#include <stdint.h>\n"
+        "\n"
+        "// 64-bit arithmetic, as evaluated by ccc; an operation which\n"
+        "// overflows sets the flag, where ccc would promote the result\n"
+        "static inline int64_t ccc_add(int* overflow, int64_t a, int64_t b)\n"
+        "{\n"
+        "    int64_t r;\n"
+        "    *overflow |= __builtin_add_overflow(a, b, &r);\n"
+        "    return r;\n"
+        "}\n"
+        "\n"
+        "static inline int64_t ccc_sub(int* overflow, int64_t a, int64_t b)\n"
+        "{\n"
+        "    int64_t r;\n"
+        "    *overflow |= __builtin_sub_overflow(a, b, &r);\n"
+        "    return r;\n"
+        "}\n"
+        "\n"
+        "static inline int64_t ccc_mul(int* overflow, int64_t a, int64_t b)\n"
+        "{\n"
+        "    int64_t r;\n"
+        "    *overflow |= __builtin_mul_overflow(a, b, &r);\n"
+        "    return r;\n"
+        "}\n"
+        "\n"
+        "static inline int64_t ccc_neg(int* overflow, int64_t a)\n"
+        "{\n"
+        "    int64_t r;\n"
+        "    *overflow |= __builtin_sub_overflow((int64_t) 0, a, &r);\n"
+        "    return r;\n"
+        "}\n");
+}
+
+// INT64_MIN cannot be written as a negated decimal literal of type int64_t
+static void emit_literal(writer_t* out, int64_t value)
+{
+    if (value == INT64_MIN)
+    {
+        writer_puts(out, "INT64_MIN");
+    }
+    else
+    {
+        writer_put_int(out, value);
+    }
+}
+
+// parameters are prefixed so that variable names cannot collide with C
+// keywords, macros or the prelude helpers
+static void emit_var(writer_t* out, const symtab_t* syms, int32_t slot)
+{
+    writer_puts(out, "v_");
+    writer_put(out, syms->names[slot].name, syms->names[slot].len);
+}
+
+// the result is stored through the first parameter, and every variable of
+// the table is a parameter, so that the functions emitted against one table
+// share a type
+static void emit_params(writer_t* out, const symtab_t* syms)
+{
+    writer_puts(out, "int64_t* result");
+    for (int32_t slot = 0; syms && slot < syms->n_slots; slot++)
+    {
+        writer_puts(out, ", int64_t ");
+        emit_var(out, syms, slot);
+    }
+}
+
+static void emit_node(
+    writer_t* out, const emit_node_t* nodes, const symtab_t* syms, int32_t i)
+{
+    const emit_node_t* node = &nodes[i];
+    if (node->constant)
+    {
+        emit_literal(out, node->value);
+        return;
+    }
+    if (node->type == VARIABLE)
+    {
+        emit_var(out, syms, node->value);
+        return;
+    }
+    // unary plus leaves its operand unchanged
+    if (node->type == OP_POS)
+    {
+        emit_node(out, nodes, syms, node->lhs);
+        return;
+    }
+
+    writer_puts(out, emit_helpers[node->type]);
+    writer_puts(out, "(&overflow, ");
+    emit_node(out, nodes, syms, node->lhs);
+    if (node->rhs >= 0)
+    {
+        writer_puts(out, ", ");
+        emit_node(out, nodes, syms, node->rhs);
+    }
+    writer_putc(out, ')');
+}
+
+int emit_function(
+    ctx_t* ctx, writer_t* out, const char* name, const token_t* rpn,
+    int n_rpn, const symtab_t* syms, int fold, diag_t* diag)
+{
+    emit_node_t* nodes = ctx_alloc(ctx, n_rpn * sizeof(emit_node_t));
+    int32_t* stack = ctx_alloc(ctx, n_rpn * sizeof(int32_t));
+    if (!nodes || !stack)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+    int32_t n_stack = 0;
+
+    for (int n = 0; n < n_rpn; n++)
+    {
+        emit_node_t* node = &nodes[n];
+        *node = (emit_node_t) {
+            .type=rpn[n].type, .value=rpn[n].value, .lhs=-1, .rhs=-1,
+            .constant=IS_LITERAL(rpn[n]) };
+        if (IS_OPERATOR(rpn[n]))
+        {
+            // not enough operands on the stack, see eval.c:evaluate_rpn
+            if (n_stack < ARITY(rpn[n]))
+            {
+                set_diag(diag, E_OP_MISSING_EXPR, &rpn[n], n, SIDE_RIGHT);
+                return -1;
+            }
+            if (ARITY(rpn[n]) == 2)
+            {
+                node->rhs = STACK_POP(stack, n_stack);
+            }
+            node->lhs = STACK_POP(stack, n_stack);
+
+            // fold operators whose operands are all constant
+            const emit_node_t* lhs = &nodes[node->lhs];
+            const emit_node_t* rhs = node->rhs >= 0 ? &nodes[node->rhs] : lhs;
+            if (fold && lhs->constant && rhs->constant)
+            {
+                node->constant = emit_fold(
+                    node->type, lhs->value, rhs->value, &node->value);
+            }
+        }
+        STACK_PUSH(stack, n_stack, n);
+    }
+    if (!n_stack)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        return -1;
+    }
+
+    // the result is the last value pushed, as in evaluate_rpn; only the
+    // helpers can overflow
+    int32_t root = stack[n_stack - 1];
+    writer_puts(out, "\nint ");
+    writer_puts(out, name);
+    writer_putc(out, '(');
+    emit_params(out, syms);
+    writer_puts(out, ")\n{\n");
+    if (nodes[root].constant)
+    {
+        writer_puts(out, "    *result = ");
+        emit_literal(out, nodes[root].value);
+        writer_puts(out, ";\n    return 0;\n}\n");
+        return 0;
+    }
+    writer_puts(out, "    int overflow = 0;\n    *result = ");
+    emit_node(out, nodes, syms, root);
+    writer_puts(out, ";\n    return overflow ? -1 : 0;\n}\n");
+    return 0;
+}
+
+static int emit_valid_name(const char* name)
+{
+    if (!isalpha((unsigned char) *name) && *name != '_')
+    {
+        return 0;
+    }
+    for (const char* c = name; *c; c++)
+    {
+        if (!isalnum((unsigned char) *c) && *c != '_')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// tokenize -> symtab_resolve -> shunting_yard -> emit_function; the names of
+// the expression are interned into syms
+static int emit_expr(
+    ctx_t* ctx, writer_t* out, const char* name, const char* expr,
+    size_t len, symtab_t* syms, int fold, diag_t* diag)
+{
+    ctx_reset(ctx);
+    int32_t n_tokens, n_rpn;
+    token_t* tokens = tokenize_n(ctx, expr, len, &n_tokens, diag);
+    if (n_tokens == 0)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        return -1;
+    }
+    if (tokens && symtab_resolve(syms, expr, len, tokens, n_tokens, 1, diag))
+    {
+        return -1;
+    }
+    token_t* rpn = tokens
+        ? shunting_yard(ctx, tokens, n_tokens, &n_rpn, diag) : NULL;
+    if (!rpn)
+    {
+        return -1;
+    }
+    return emit_function(ctx, out, name, rpn, n_rpn, syms, fold, diag);
+}
+
+int emit_main(const char* name, const char* expr, int fold)
+{
+    if (!emit_valid_name(name))
+    {
+        eprintf("%s: not a valid C identifier\n", name);
+        return EXIT_FAILURE;
+    }
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+    writer_t out;
+    writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE);
+
+    emit_prelude(&out);
+    diag_t diag;
+    int rc = emit_expr(
+        &ctx, &out, name, expr, strlen(expr), &syms, fold, &diag);
+    writer_free(&out);
+    if (rc)
+    {
+        print_err(&diag);
+    }
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+    return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// a line of input, kept until the variables of every line are known
+typedef struct {
+    const char* file;
+    long lineno;
+    size_t offset;  // into the collected text
+    size_t len;
+} emit_line_t;
+
+/*
+ * collect the non-blank lines of the given files, interning the variables
+ * they use; returns the number of lines, or -1 if there was not enough memory
+ */
+static long emit_collect(
+    ctx_t* ctx, symtab_t* syms, int n_files, char** files, writer_t* text,
+    emit_line_t** lines, int* status)
+{
+    long n_lines = 0, size = 0;
+    char* line = NULL;
+    size_t line_size = 0;
+    for (int i = 0; i < n_files; i++)
+    {
+        int is_stdin = !strcmp(files[i], "-");
+        FILE* f = is_stdin ? stdin : fopen(files[i], "r");
+        if (!f)
+        {
+            eprintf("%s: failed to open file\n", files[i]);
+            *status = EXIT_FAILURE;
+            continue;
+        }
+
+        ssize_t len;
+        for (long lineno = 1; (len = getline(&line, &line_size, f)) >= 0;
+            lineno++)
+        {
+            while (len && isspace((unsigned char) line[len - 1]))
+            {
+                len--;
+            }
+            // skip blank lines
+            const char* it = line;
+            while (it < line + len && isspace((unsigned char) *it))
+            {
+                it++;
+            }
+            if (it == line + len)
+            {
+                continue;
+            }
+
+            if (n_lines == size)
+            {
+                size = size ? 2 * size : 64;
+                emit_line_t* tmp = realloc(*lines, size * sizeof(emit_line_t));
+                if (!tmp)
+                {
+                    n_lines = -1;
+                    break;
+                }
+                *lines = tmp;
+            }
+            (*lines)[n_lines++] = (emit_line_t) {
+                .file=files[i], .lineno=lineno, .offset=text->used, .len=len };
+            writer_put(text, line, len);
+
+            // invalid lines are reported when they are emitted
+            ctx_reset(ctx);
+            int32_t n_tokens;
+            diag_t diag;
+            token_t* tokens = tokenize_n(ctx, line, len, &n_tokens, &diag);
+            if (tokens
+                && symtab_resolve(syms, line, len, tokens, n_tokens, 1, &diag))
+            {
+                n_lines = -1;
+            }
+            if (n_lines < 0)
+            {
+                break;
+            }
+        }
+        if (!is_stdin)
+        {
+            fclose(f);
+        }
+        if (n_lines < 0)
+        {
+            break;
+        }
+    }
+    free(line);
+
+    return text->failed ? -1 : n_lines;
+}
+
+int emit_batch_main(const char* prefix, int n_files, char** files, int fold)
+{
+    static char* stdin_only[] = { "-" };
+    if (!emit_valid_name(prefix))
+    {
+        eprintf("%s: not a valid C identifier\n", prefix);
+        return EXIT_FAILURE;
+    }
+    if (!n_files)
+    {
+        n_files = 1;
+        files = stdin_only;
+    }
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+    writer_t text;
+    writer_init(&text, -1, 0);
+    emit_line_t* lines = NULL;
+
+    // every function takes every variable, so all of the input is read before
+    // the first function is written
+    int status = EXIT_SUCCESS;
+    long n_lines = emit_collect(
+        &ctx, &syms, n_files, files, &text, &lines, &status);
+    if (n_lines < 0)
+    {
+        eprintf("out of memory\n");
+        writer_free(&text);
+        free(lines);
+        ctx_free(&ctx);
+        ctx_free(&sym_ctx);
+        return EXIT_FAILURE;
+    }
+
+    writer_t out;
+    writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE);
+    emit_prelude(&out);
+    long n_funcs = 0;
+    for (long i = 0; i < n_lines; i++)
+    {
+        char name[256];
+        snprintf(name, sizeof(name), "%s_%ld", prefix, n_funcs);
+        diag_t diag;
+        if (emit_expr(
+            &ctx, &out, name, text.buf + lines[i].offset, lines[i].len, &syms,
+            fold, &diag))
+        {
+            char msg[ERR_MSG_LEN];
+            format_err(msg, sizeof(msg), &diag);
+            writer_flush(&out);
+            eprintf("%s:%ld: %s\n", lines[i].file, lines[i].lineno, msg);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        n_funcs++;
+    }
+    writer_free(&text);
+    free(lines);
+
+    // table of the emitted functions, in input order
+    char decl[512];
+    snprintf(
+        decl, sizeof(decl),
+        "\nconst long %s_count = %ld;\n\nint (* const %s_table[])(",
+        prefix, n_funcs, prefix);
+    writer_puts(&out, decl);
+    emit_params(&out, &syms);
+    writer_puts(&out, ") = {\n");
+    for (long i = 0; i < n_funcs; i++)
+    {
+        snprintf(decl, sizeof(decl), "    %s_%ld,\n", prefix, i);
+        writer_puts(&out, decl);
+    }
+    // C does not allow an empty initializer list
+    if (!n_funcs)
+    {
+        writer_puts(&out, "    0,\n");
+    }
+    writer_puts(&out, "};\n");
+    if (writer_free(&out))
+    {
+        status = EXIT_FAILURE;
+    }
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+    return status;
+}
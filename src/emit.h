@@ -0,0 +1,77 @@
+/*
+ * src/emit.h
+ * ahead-of-time C code emitter
+ *
+ * each expression becomes a C function storing its value through a pointer;
+ * constant subexpressions are folded where they fit in 64 bits, and the
+ * arithmetic left in the generated code is checked for overflow: a function
+ * whose result does not fit in 64 bits, which ccc would promote to a bignum,
+ * returns -1 instead of a wrapped value
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+#include <symtab.h>
+#include <writer.h>
+
+/*
+ * write the declarations used by emitted functions; must precede them
+ *
+ * @iparam out := writer receiving the C source
+ */
+void emit_prelude(writer_t* out);
+
+/*
+ * write a C function evaluating an expression in Reverse Polish notation
+ *
+ * @iparam ctx := evaluation context, provides scratch memory
+ * @iparam out := writer receiving the C source
+ * @iparam name := function name, a valid C identifier
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @iparam syms := symbol table the variables were resolved against, NULL if
+ *                 there are none; every variable in it becomes an int64_t
+ *                 parameter after the result pointer, in slot order, named
+ *                 after the variable with a "v_" prefix
+ * @iparam fold := whether constant subexpressions are folded
+ * @oparam diag := filled in with the error details if the expression is
+ *                 invalid; the errors are the same ones evaluate_rpn reports
+ * @returns 0 on success, -1 on error, in which case nothing is written
+ */
+int emit_function(
+    ctx_t* ctx, writer_t* out, const char* name, const token_t* rpn,
+    int n_rpn, const symtab_t* syms, int fold, diag_t* diag);
+
+/*
+ * emit a single expression as a C function, written to stdout
+ *
+ * @iparam name := function name
+ * @iparam expr := expression
+ * @iparam fold := whether constant subexpressions are folded
+ * @returns the process exit status
+ */
+int emit_main(const char* name, const char* expr, int fold);
+
+/*
+ * emit one C function per line of the given files (or stdin), named
+ * <prefix>_<n> for the n-th expression, followed by <prefix>_count and a
+ * <prefix>_table of function pointers in input order; blank lines are
+ * skipped, invalid expressions are reported and cause a failure status; the
+ * functions share one type, taking every variable used by any line in order
+ * of first appearance
+ *
+ * @iparam prefix := function name prefix
+ * @iparam n_files := number of files
+ * @iparam files := file paths, "-" refers to stdin
+ * @iparam fold := whether constant subexpressions are folded
+ * @returns the process exit status
+ */
+int emit_batch_main(const char* prefix, int n_files, char** files, int fold);
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * src/engine.c
+ * selects how expressions are evaluated
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cache.h>
+#include <dag.h>
+#include <engine.h>
+#include <eval.h>
+#include <regvm.h>
+#include <symtab.h>
+#include <vm.h>
+
+static const char* const engine_names[N_ENGINES] = {
+    [ENGINE_PIPELINE] = "pipeline",
+    [ENGINE_FUSED]    = "fused",
+    [ENGINE_VM]       = "vm",
+    [ENGINE_REGVM]    = "regvm",
+    [ENGINE_DAG]      = "dag",
+};
+
+int engine_from_name(const char* name)
+{
+    for (int i = 0; i < N_ENGINES; i++)
+    {
+        if (!strcmp(name, engine_names[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* engine_name(engine_kind kind)
+{
+    return engine_names[kind];
+}
+
+void engine_init(engine_t* e, engine_kind kind)
+{
+    e->kind = kind;
+    ctx_init(&e->ctx);
+    reduce_init(&e->r);
+    e->cache = NULL;
+    ctx_init(&e->sym_ctx);
+    symtab_init(&e->syms, &e->sym_ctx);
+    e->r.syms = &e->syms;
+    e->r.ctx = &e->ctx;
+    e->read_only = 0;
+}
+
+// tokenize -> shunting_yard -> evaluate_rpn
+static int engine_eval_pipeline(
+    engine_t* e, const char* src, size_t len, token_t* res, diag_t* diag)
+{
+    ctx_reset(&e->ctx);
+
+    int32_t n_tokens;
+    token_t* tokens = tokenize_n(&e->ctx, src, len, &n_tokens, diag);
+    if (n_tokens <= 0)
+    {
+        return n_tokens < 0 ? -1 : 1;
+    }
+    if (symtab_resolve(&e->syms, src, len, tokens, n_tokens, 0, diag))
+    {
+        return -1;
+    }
+
+    return eval_expr(&e->ctx, tokens, n_tokens, &e->syms, res, diag);
+}
+
+/*
+ * tokenize -> shunting_yard, for the engines which compile the RPN
+ * returns 0 on success, 1 if the input contains no tokens, -1 on error
+ */
+static int engine_rpn(
+    engine_t* e, const char* src, size_t len, token_t** rpn, int32_t* n_rpn,
+    diag_t* diag)
+{
+    ctx_reset(&e->ctx);
+
+    int32_t n_tokens;
+    token_t* tokens = tokenize_n(&e->ctx, src, len, &n_tokens, diag);
+    if (n_tokens <= 0)
+    {
+        return n_tokens < 0 ? -1 : 1;
+    }
+    if (symtab_resolve(&e->syms, src, len, tokens, n_tokens, 0, diag))
+    {
+        return -1;
+    }
+    *rpn = shunting_yard(&e->ctx, tokens, n_tokens, n_rpn, diag);
+    return *n_rpn < 0 ? -1 : 0;
+}
+
+// RPN -> the engine's evaluator, for every engine except the fused one
+static int engine_eval_rpn(
+    engine_t* e, const token_t* rpn, int32_t n_rpn, token_t* res,
+    diag_t* diag)
+{
+    // the compiled evaluators read variables by slot without checking them,
+    // evaluate_rpn checks them itself
+    int compiled = e->kind == ENGINE_VM || e->kind == ENGINE_REGVM
+        || e->kind == ENGINE_DAG;
+    if (compiled && symtab_check(&e->syms, rpn, n_rpn, diag))
+    {
+        return -1;
+    }
+    int rc;
+    int64_t value = 0;
+    switch (e->kind)
+    {
+    case ENGINE_VM:
+    {
+        bytecode_t bc;
+        rc = vm_compile(&e->ctx, rpn, n_rpn, &bc, diag);
+        rc = rc ? rc : vm_run(&bc, e->syms.values, &value);
+        break;
+    }
+    case ENGINE_REGVM:
+    {
+        regvm_prog_t prog;
+        rc = regvm_compile(&e->ctx, rpn, n_rpn, &prog, diag);
+        rc = rc ? rc : regvm_run(&prog, e->syms.values, &value);
+        break;
+    }
+    case ENGINE_DAG:
+    {
+        dag_t dag;
+        rc = dag_build(&e->ctx, rpn, n_rpn, &dag, diag);
+        if (!rc)
+        {
+            rc = dag_eval(&e->ctx, &dag, e->syms.values, &value);
+            if (rc < 0)
+            {
+                set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+            }
+        }
+        break;
+    }
+    default:
+        return evaluate_rpn(&e->ctx, rpn, n_rpn, &e->syms, res, diag);
+    }
+    // the compiled evaluators only work in 64 bits, a result which
+    // overflowed is computed exactly instead
+    if (rc > 0)
+    {
+        return evaluate_rpn(&e->ctx, rpn, n_rpn, &e->syms, res, diag);
+    }
+    if (!rc)
+    {
+        init_literal(res, value, 0);
+    }
+    return rc;
+}
+
+static int engine_eval_uncached(
+    engine_t* e, const char* src, size_t len, token_t* res, diag_t* diag)
+{
+    if (e->kind == ENGINE_FUSED)
+    {
+        // the context only holds results which overflow 64 bits
+        ctx_reset(&e->ctx);
+        return reduce_eval_n(&e->r, src, len, res, diag);
+    }
+    if (e->kind == ENGINE_PIPELINE)
+    {
+        return engine_eval_pipeline(e, src, len, res, diag);
+    }
+    token_t* rpn;
+    int32_t n_rpn;
+    int rc = engine_rpn(e, src, len, &rpn, &n_rpn, diag);
+    return rc ? rc : engine_eval_rpn(e, rpn, n_rpn, res, diag);
+}
+
+// normalized text -> cache_get, falling back to the RPN on a miss; only
+// successfully evaluated expressions are cached
+static int engine_eval_cached(
+    engine_t* e, const char* src, size_t len, token_t* res, diag_t* diag)
+{
+    // inputs over the limit are rejected even if they normalize under it
+    char key[MAX_INPUT_LEN];
+    if (len >= MAX_INPUT_LEN)
+    {
+        return engine_eval_uncached(e, src, len, res, diag);
+    }
+    uint32_t hash;
+    size_t key_len = cache_normalize(src, len, key, &hash);
+    if (!key_len)
+    {
+        return 1;
+    }
+
+    const cache_entry_t* entry = cache_get(e->cache, key, key_len, hash);
+    if (entry)
+    {
+        if (entry->constant)
+        {
+            init_literal(res, entry->value, 0);
+            return 0;
+        }
+        ctx_reset(&e->ctx);
+        return engine_eval_rpn(e, entry->rpn, entry->n_rpn, res, diag);
+    }
+
+    token_t* rpn;
+    int32_t n_rpn;
+    int rc = engine_rpn(e, src, len, &rpn, &n_rpn, diag);
+    if (!rc)
+    {
+        rc = engine_eval_rpn(e, rpn, n_rpn, res, diag);
+    }
+    if (!rc)
+    {
+        // a failed insertion only costs a later miss; a result which does
+        // not fit in 64 bits is recomputed each time
+        uint8_t constant = IS_LITERAL(*res);
+        for (int32_t i = 0; i < n_rpn; i++)
+        {
+            constant &= IS_LITERAL(rpn[i]) || IS_OPERATOR(rpn[i]);
+        }
+        cache_put(
+            e->cache, key, key_len, hash, rpn, n_rpn, constant, res->value);
+    }
+    return rc;
+}
+
+static int engine_eval_expr(
+    engine_t* e, const char* src, size_t len, token_t* res, diag_t* diag)
+{
+    if (e->cache)
+    {
+        return engine_eval_cached(e, src, len, res, diag);
+    }
+    return engine_eval_uncached(e, src, len, res, diag);
+}
+
+int engine_eval(
+    engine_t* e, const char* src, size_t len, token_t* res, diag_t* diag)
+{
+    // the limit applies to the whole statement, not just its expression
+    if (len >= MAX_INPUT_LEN)
+    {
+        set_diag(diag, E_MAX_INPUT, NULL, -1, 0);
+        return -1;
+    }
+    size_t name, name_len;
+    size_t expr = lex_assignment(src, len, &name, &name_len);
+    if (!expr)
+    {
+        return engine_eval_expr(e, src, len, res, diag);
+    }
+
+    token_t assign;
+    init_token(&assign, ASSIGN, expr - 1);
+    if (e->read_only)
+    {
+        set_diag(diag, E_READ_ONLY, &assign, -1, 0);
+        return -1;
+    }
+    int rc = engine_eval_expr(e, src + expr, len - expr, res, diag);
+    if (rc > 0)
+    {
+        set_diag(diag, E_OP_MISSING_EXPR, &assign, -1, SIDE_RIGHT);
+        return -1;
+    }
+    if (rc < 0)
+    {
+        // the expression was evaluated on its own, so its offsets start at
+        // the "="
+        if (diag->offset >= 0)
+        {
+            diag->offset += expr;
+            diag->token.offset += expr;
+        }
+        return -1;
+    }
+
+    // variables hold 64 bits
+    if (!IS_LITERAL(*res))
+    {
+        set_diag(diag, E_VALUE_RANGE, &assign, -1, 0);
+        return -1;
+    }
+    int32_t slot = symtab_intern(&e->syms, src + name, name_len);
+    if (slot < 0)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+    symtab_set(&e->syms, slot, res->value);
+    return 0;
+}
+
+int engine_enable_cache(engine_t* e, size_t capacity)
+{
+    e->cache = malloc(sizeof(cache_t));
+    if (!e->cache || cache_init(e->cache, capacity))
+    {
+        free(e->cache);
+        e->cache = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void engine_free(engine_t* e)
+{
+    ctx_free(&e->ctx);
+    ctx_free(&e->sym_ctx);
+    reduce_free(&e->r);
+    if (e->cache)
+    {
+        cache_free(e->cache);
+        free(e->cache);
+    }
+}
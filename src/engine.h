@@ -0,0 +1,105 @@
+/*
+ * src/engine.h
+ * selects how expressions are evaluated, so that evaluation strategies can be
+ * compared against each other on the same input
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+
+#include <cache.h>
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+#include <reduce.h>
+#include <symtab.h>
+
+typedef enum {
+    // tokenize -> shunting_yard -> evaluate_rpn, each pass builds an array
+    ENGINE_PIPELINE,
+    // single pass which evaluates while parsing, see reduce_eval_n
+    ENGINE_FUSED,
+    // RPN lowered to bytecode and run by the VM, see vm.h
+    ENGINE_VM,
+    // RPN lowered to register code and run by the register VM, see regvm.h
+    ENGINE_REGVM,
+    // RPN interned into a DAG which evaluates shared subexpressions once,
+    // see dag.h
+    ENGINE_DAG,
+    N_ENGINES
+} engine_kind;
+
+/*
+ * evaluation state for a single thread; each engine keeps its scratch memory
+ * and its variables across expressions
+ */
+typedef struct {
+    engine_kind kind;
+    ctx_t ctx;
+    reduce_t r;
+    cache_t* cache;  // compiled expression cache, NULL if disabled
+    ctx_t sym_ctx;   // owns the symbol table, never reset
+    symtab_t syms;
+    int read_only;   // assignments are rejected with E_READ_ONLY
+} engine_t;
+
+/*
+ * look up an engine by name
+ *
+ * @iparam name := engine name, e.g. "pipeline" or "fused"
+ * @returns the engine kind, or -1 if the name is unknown
+ */
+int engine_from_name(const char* name);
+
+/*
+ * get the name of an engine, as accepted by engine_from_name
+ *
+ * @iparam kind := engine kind
+ * @returns the engine name
+ */
+const char* engine_name(engine_kind kind);
+
+/*
+ * initialize an engine
+ *
+ * @oparam e := engine to be initialized
+ * @iparam kind := evaluation strategy
+ */
+void engine_init(engine_t* e, engine_kind kind);
+
+/*
+ * cache compiled expressions by their normalized text, so that repeated
+ * expressions skip lexing and parsing; see cache.h
+ *
+ * @iparam e := engine
+ * @iparam capacity := maximum number of cached expressions
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int engine_enable_cache(engine_t* e, size_t capacity);
+
+/*
+ * evaluate a statement: either an expression, or an assignment "name = expr"
+ * which stores the value of the expression in the variable and yields it
+ *
+ * @iparam e := engine
+ * @iparam src := statement; need not be NUL-terminated
+ * @iparam len := length of the statement
+ * @oparam res := expression result
+ * @oparam diag := filled in with the error details if evaluation fails
+ * @returns 0 on success, 1 if the input contains no tokens, -1 on error
+ */
+int engine_eval(
+    engine_t* e, const char* src, size_t len, token_t* res, diag_t* diag);
+
+/*
+ * release the engine's scratch memory and variables
+ *
+ * @iparam e := engine
+ */
+void engine_free(engine_t* e);
+
+#endif
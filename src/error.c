@@ -5,6 +5,7 @@
  * author: Ian Brault <ian.brault@engineering.ucla.edu>
  */
 
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -44,6 +45,9 @@ static char operator_to_char(token_t token)
     case OP_MUL:
         ch = '*';
         break;
+    case ASSIGN:
+        ch = '=';
+        break;
     default:
         break;
     }
@@ -51,77 +55,139 @@ static char operator_to_char(token_t token)
     return ch;
 }
 
-static int32_t e_max_tokens_flag       = 0x1 << 30;
-static int32_t e_max_input_flag        = 0x1 << 29;
-static int32_t e_invalid_token_flag    = 0x1 << 28;
-static int32_t e_unmatched_paren_flag  = 0x1 << 27;
-static int32_t e_op_missing_expr_flag  = 0x1 << 26;
-static int32_t e_invalid_lit_expr_flag = 0x1 << 25;
-
-// given a token offset, return the index in the token array
-static int32_t get_index_from_offset(token_t* tokens, int32_t offset)
+void set_diag(
+    diag_t* diag, err_kind kind, const token_t* token, int64_t index,
+    uint8_t side)
 {
-    // NOTE: this has the potential to raise a null-pointer exception if called
-    // with an offset that does not exist, but this is a risk taken for API
-    // simplicity; possibly rework if issues arise
-    int index = -1;
-    for (int i = 0; i < MAX_TOKENS; i++)
+    diag->kind = kind;
+    diag->index = index;
+    diag->side = side;
+    if (token)
     {
-        if (tokens[i].offset == offset)
-        {
-            index = i;
-            break;
-        }
+        diag->token = *token;
+        diag->offset = token->offset;
+    }
+    else
+    {
+        diag->token.type = INVALID;
+        diag->token.value = 0;
+        diag->token.offset = -1;
+        diag->offset = -1;
     }
-    return index;
 }
 
-void print_err(int errno, token_t* tokens)
+int format_err(char* buf, size_t size, const diag_t* diag)
 {
-    if (errno & e_max_tokens_flag)
+    int len = 0;
+    int64_t pos = diag->offset;
+    switch (diag->kind)
     {
-        eprintf("maximum number of tokens (%d) exceeeded\n", MAX_TOKENS);
-    }
-    else if (errno & e_max_input_flag)
-    {
-        eprintf("maximum input length (%d) exceeded\n", MAX_INPUT_LEN);
-    }
-    else if (errno & e_invalid_token_flag)
-    {
-        // get token offset
-        int32_t pos = errno & 0x3ff;
-        eprintf("%d: invalid token\n", pos);
-    }
-    else if (errno & e_unmatched_paren_flag)
-    {
-        // get token offset and index into tokens array
-        int32_t pos = errno & 0x3ff;
-        int32_t index = get_index_from_offset(tokens, pos);
-        char paren = tokens[index].type == L_PAREN ? '(' : ')';
-        eprintf("%d: unmatched \"%c\"\n", pos, paren);
+    case E_MAX_TOKENS:
+        len = snprintf(
+            buf, size, "maximum number of tokens (%d) exceeeded", MAX_TOKENS);
+        break;
+    case E_MAX_INPUT:
+        len = snprintf(
+            buf, size, "maximum input length (%d) exceeded", MAX_INPUT_LEN);
+        break;
+    case E_INVALID_TOKEN:
+        len = snprintf(buf, size, "%" PRId64 ": invalid token", pos);
+        break;
+    case E_LIT_OVERFLOW:
+        len = snprintf(
+            buf, size, "%" PRId64 ": integer literal out of range", pos);
+        break;
+    case E_UNMATCHED_PAREN:
+        len = snprintf(
+            buf, size, "%" PRId64 ": unmatched \"%c\"",
+            pos, operator_to_char(diag->token));
+        break;
+    case E_OP_MISSING_EXPR:
+        len = snprintf(
+            buf, size,
+            "%" PRId64 ": operator \"%c\" missing %s-hand expression",
+            pos, operator_to_char(diag->token),
+            diag->side == SIDE_RIGHT ? "right" : "left");
+        break;
+    case E_INVALID_LIT_EXPR:
+        if (IS_VARIABLE(diag->token))
+        {
+            len = snprintf(
+                buf, size,
+                "%" PRId64 ": variable must be followed by an operator or end "
+                "of expression", pos);
+        }
+        else
+        {
+            len = snprintf(
+                buf, size,
+                "%" PRId64 ": %" PRId64 " must be followed by an operator or "
+                "end of expression", pos, diag->token.value);
+        }
+        break;
+    case E_EMPTY_EXPR:
+        len = snprintf(buf, size, "empty expression");
+        break;
+    case E_UNDEFINED_VAR:
+        len = pos < 0
+            ? snprintf(buf, size, "undefined variable")
+            : snprintf(buf, size, "%" PRId64 ": undefined variable", pos);
+        break;
+    case E_INVALID_ASSIGN:
+        len = snprintf(
+            buf, size,
+            "%" PRId64 ": \"=\" must follow the variable name at the start "
+            "of a statement", pos);
+        break;
+    case E_READ_ONLY:
+        len = snprintf(
+            buf, size, "%" PRId64 ": assignment is not allowed here", pos);
+        break;
+    case E_VALUE_RANGE:
+        len = pos < 0
+            ? snprintf(buf, size, "value does not fit in 64 bits")
+            : snprintf(
+                buf, size, "%" PRId64 ": value does not fit in 64 bits", pos);
+        break;
+    case E_NOT_FORMULA:
+        len = snprintf(
+            buf, size, "expected a formula of the form \"name = expression\"");
+        break;
+    case E_CIRCULAR_REF:
+        len = snprintf(buf, size, "%" PRId64 ": circular reference", pos);
+        break;
+    case E_DEP_ERROR:
+        len = snprintf(
+            buf, size,
+            "%" PRId64 ": variable refers to a formula with an error", pos);
+        break;
+    case E_NO_MEMORY:
+        len = snprintf(buf, size, "out of scratch memory");
+        break;
+    default:
+        if (size)
+        {
+            buf[0] = 0;
+        }
+        break;
     }
-    else if (errno & e_op_missing_expr_flag)
+
+    // snprintf reports the untruncated length
+    if (len < 0)
     {
-        // get token offset and index into tokens array
-        int32_t pos = errno & 0x3ff;
-        int32_t index = get_index_from_offset(tokens, pos);
-        char op_str = operator_to_char(tokens[index]);
-        // get side information
-        int32_t side = errno & (0x1 << 10);
-        const char* side_str = side ? "right" : "left";
-        eprintf(
-            "%d: operator \"%c\" missing %s-hand expression\n",
-            pos, op_str, side_str);
+        len = 0;
     }
-    else if (errno & e_invalid_lit_expr_flag)
+    else if (size && (size_t) len >= size)
     {
-        // get token offset and index into tokens array
-        int32_t pos = errno & 0x3ff;
-        int32_t index = get_index_from_offset(tokens, pos);
-        char lit_str[32];
-        snprintf(lit_str, 32, "%d", tokens[index].value);
-        eprintf(
-            "%d: %s must be followed by an operator or end of expression\n",
-            pos, lit_str);
+        len = size - 1;
     }
-}
\ No newline at end of file
+
+    return len;
+}
+
+void print_err(const diag_t* diag)
+{
+    char msg[ERR_MSG_LEN];
+    format_err(msg, sizeof(msg), diag);
+    eprintf("%s\n", msg);
+}
@@ -8,41 +8,102 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <lex.h>
 
-/* ERROR NUMBERS
- * define new error codes below
- * the format currently allows for 11 error codes
+/* ERROR KINDS
+ * define new error kinds below; errors are reported through a diag_t record
+ * which carries the position and details of the offending token
+ */
+typedef enum {
+    E_OK,
+
+    // LEX_H
+
+    // if MAX_TOKENS is exceeded
+    E_MAX_TOKENS,
+    // if MAX_INPUT is exceeded
+    E_MAX_INPUT,
+    // invalid token encountered
+    E_INVALID_TOKEN,
+    // literal too large for 64 bits, see LEX_LIT_MAX
+    E_LIT_OVERFLOW,
+
+    // EVAL_H
+
+    // unmatched parenthesis
+    E_UNMATCHED_PAREN,
+    // operator missing either left-side or right-side expression
+    E_OP_MISSING_EXPR,
+    // literal was not followed by an operator or expression termination
+    E_INVALID_LIT_EXPR,
+    // expression contains no tokens
+    E_EMPTY_EXPR,
+
+    // SYMTAB_H
+
+    // variable used before a value was assigned to it
+    E_UNDEFINED_VAR,
+    // "=" anywhere other than after the variable name starting a statement
+    E_INVALID_ASSIGN,
+    // assignment in a context whose variables cannot change
+    E_READ_ONLY,
+    // result stored in a variable or returned as an int64 which does not fit
+    // in 64 bits, see bignum.h
+    E_VALUE_RANGE,
+
+    // SHEET_H
+
+    // sheet line which is not an assignment
+    E_NOT_FORMULA,
+    // formula which depends on itself, directly or through other formulas
+    E_CIRCULAR_REF,
+    // formula which refers to a formula with an error
+    E_DEP_ERROR,
+
+    // CTX_H
+
+    // scratch memory could not be allocated
+    E_NO_MEMORY,
+
+    N_ERR_KINDS
+} err_kind;
+
+// side of an operator which is missing its operand
+#define SIDE_LEFT  0
+#define SIDE_RIGHT 1
+
+/*
+ * diagnostic record describing an error, filled in directly by the stage
+ * which found it so that reporting needs no further lookups
+ */
+struct diag {
+    err_kind kind;
+    int64_t offset;  // byte offset of the offending token, -1 if none
+    int64_t index;   // index of the offending token in the array being
+                     // processed by the failing stage, -1 if none
+    token_t token;   // offending token: operator, parenthesis, literal or
+                     // variable
+    uint8_t side;    // E_OP_MISSING_EXPR: which operand is missing
+};
+
+/*
+ * fill in a diagnostic record
  *
- * +----+-----------------+----------------------+
- * | 31 | 30    ...    20 | 19       ...      00 |
- * +----+-----------------+----------------------+
- * |  1 |       flag      |  further error info  |
- * +----+-----------------+----------------------+
+ * @oparam diag := diagnostic record
+ * @iparam kind := error kind
+ * @iparam token := offending token, or NULL if the error has no position
+ * @iparam index := index of the offending token, -1 if none
+ * @iparam side := missing operand side, for E_OP_MISSING_EXPR
  */
+void set_diag(
+    diag_t* diag, err_kind kind, const token_t* token, int64_t index,
+    uint8_t side);
 
-// LEX_H
-
-// if MAX_TOKENS is exceeded
-#define E_MAX_TOKENS       (INT32_MIN | (0x1 << 30))
-// if MAX_INPUT is exceeded
-#define E_MAX_INPUT        (INT32_MIN | (0x1 << 29))
-// invalid token encountered
-// bits 0-9 contain the token offset
-#define E_INVALID_TOKEN    (INT32_MIN | (0x1 << 28))
-
-// EVAL_H
-
-// unmatched parenthesis
-// bits 0-9 contain the token offset
-#define E_UNMATCHED_PAREN  (INT32_MIN | (0x1 << 27))
-// operator missing either left-side or right-side expression
-// bits 0-9 contain the operator token offset
-// bit 10 indicates the side (0 for left, 1 for right)
-#define E_OP_MISSING_EXPR  (INT32_MIN | (0x1 << 26))
-// literal was not followed by an operator or expression termination
-// bits 0-9 contain the token offset
-#define E_INVALID_LIT_EXPR (INT32_MIN | (0x1 << 25))
+// maximum length of a formatted error message
+#define ERR_MSG_LEN (128)
 
 /*
  * print an error message with a red "error:" prepended
@@ -51,12 +112,21 @@
 void eprintf(const char* format, ...);
 
 /*
- * print an error message corresponding to an error code
+ * format the error message for a diagnostic, without the "error:" prefix or a
+ * trailing newline
+ *
+ * @oparam buf := output buffer
+ * @iparam size := size of the output buffer
+ * @iparam diag := diagnostic record
+ * @returns the length of the formatted message
+ */
+int format_err(char* buf, size_t size, const diag_t* diag);
+
+/*
+ * print the error message for a diagnostic
  *
- * @iparam errno := error code
- * @iparam tokens := token array lexed from input string, used for informative
- *                   error messages
+ * @iparam diag := diagnostic record
  */
-void print_err(int errno, token_t* tokens);
+void print_err(const diag_t* diag);
 
 #endif
@@ -4,64 +4,99 @@
  * author: Ian Brault <ian.brault@engineering.ucla.edu>
  */
 
-#include <stdlib.h>
-
+#include <bignum.h>
 #include <error.h>
 #include <eval.h>
+#include <symtab.h>
 
-void op_add_impl(token_t* op1, token_t* op2, token_t* res)
+// the int64 fast path, which falls back to bignum_apply on overflow
+int op_add_impl(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res)
 {
-    int32_t out = op1->value + op2->value;
-    init_literal(res, out, 0);
+    int64_t out;
+    if (IS_LITERAL(*op1) && IS_LITERAL(*op2)
+        && !__builtin_add_overflow(op1->value, op2->value, &out))
+    {
+        init_literal(res, out, 0);
+        return 0;
+    }
+    return bignum_apply(ctx, OP_ADD, op1, op2, res);
 }
 
-void op_sub_impl(token_t* op1, token_t* op2, token_t* res)
+int op_sub_impl(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res)
 {
-    int32_t out = op1->value - op2->value;
-    init_literal(res, out, 0);
+    int64_t out;
+    if (IS_LITERAL(*op1) && IS_LITERAL(*op2)
+        && !__builtin_sub_overflow(op1->value, op2->value, &out))
+    {
+        init_literal(res, out, 0);
+        return 0;
+    }
+    return bignum_apply(ctx, OP_SUB, op1, op2, res);
 }
 
-void op_mul_impl(token_t* op1, token_t* op2, token_t* res)
+int op_mul_impl(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res)
 {
-    int32_t out = op1->value * op2->value;
-    init_literal(res, out, 0);
+    int64_t out;
+    if (IS_LITERAL(*op1) && IS_LITERAL(*op2)
+        && !__builtin_mul_overflow(op1->value, op2->value, &out))
+    {
+        init_literal(res, out, 0);
+        return 0;
+    }
+    return bignum_apply(ctx, OP_MUL, op1, op2, res);
 }
 
-void op_pos_impl(token_t* op, token_t* res)
+int op_pos_impl(ctx_t* ctx, const token_t* op, token_t* res)
 {
-    init_literal(res, op->value, 0);
+    return bignum_apply(ctx, OP_POS, op, NULL, res);
 }
 
-void op_neg_impl(token_t* op, token_t* res)
+int op_neg_impl(ctx_t* ctx, const token_t* op, token_t* res)
 {
-    int32_t out = op->value * (-1);
-    init_literal(res, out, 0);
+    if (IS_LITERAL(*op) && op->value != INT64_MIN)
+    {
+        init_literal(res, -op->value, 0);
+        return 0;
+    }
+    return bignum_apply(ctx, OP_NEG, op, NULL, res);
 }
 
-token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn)
+token_t* shunting_yard(
+    ctx_t* ctx, token_t* tokens, int n_tokens, int* n_rpn, diag_t* diag)
 {
-    token_t* op_stack  = malloc(n_tokens * sizeof(token_t));
-    token_t* out_stack  = malloc(n_tokens * sizeof(token_t));
+    token_t* op_stack = ctx_alloc(ctx, n_tokens * sizeof(token_t));
+    token_t* out_stack = ctx_alloc(ctx, n_tokens * sizeof(token_t));
+    if (!op_stack || !out_stack)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        *n_rpn = -1;
+        return NULL;
+    }
     int n = 0, n_out = 0, n_op = 0;
     int literal_was_prev = 0;
 
     // an operator at the start must be unary and right-associative
-    if (IS_OPERATOR(tokens[0]))
+    if (n_tokens && IS_OPERATOR(tokens[0]))
     {
         if (ARITY(tokens[0]) != 1 || ASSOC(tokens[0]) != ASSOC_R)
         {
-            n_out = E_OP_MISSING_EXPR | tokens[0].offset;
+            set_diag(diag, E_OP_MISSING_EXPR, &tokens[0], 0, SIDE_LEFT);
+            n_out = -1;
             n = n_tokens;
         }
     }
     // an operator at the end must be unary and left-associative
     int end = n_tokens - 1;
-    if (!n && IS_OPERATOR(tokens[end]))
+    if (!n && n_tokens && IS_OPERATOR(tokens[end]))
     {
         if (ARITY(tokens[end]) != 1 || ASSOC(tokens[end]) != ASSOC_L)
         {
-            n_out = E_OP_MISSING_EXPR;
-            n_out |= (0x1 << 10) | tokens[end].offset;
+            set_diag(
+                diag, E_OP_MISSING_EXPR, &tokens[end], end, SIDE_RIGHT);
+            n_out = -1;
             n = n_tokens;
         }
     }
@@ -69,13 +104,15 @@ token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn)
     // while there are still tokens to be read
     while (n < n_tokens)
     {
-        // if token is a number, push to output stack
-        if (IS_LITERAL(tokens[n]))
+        // if token is a number or a variable, push to output stack
+        if (IS_OPERAND(tokens[n]))
         {
-            // literal cannot follow another literal
+            // operand cannot follow another operand
             if (literal_was_prev)
             {
-                n_out = E_INVALID_LIT_EXPR | tokens[n - 1].offset;
+                set_diag(
+                    diag, E_INVALID_LIT_EXPR, &tokens[n - 1], n - 1, 0);
+                n_out = -1;
                 n = n_tokens;
             }
             else
@@ -108,7 +145,9 @@ token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn)
             // left parenthesis cannot follow another literal
             if (literal_was_prev)
             {
-                n_out = E_INVALID_LIT_EXPR | tokens[n - 1].offset;
+                set_diag(
+                    diag, E_INVALID_LIT_EXPR, &tokens[n - 1], n - 1, 0);
+                n_out = -1;
                 n = n_tokens;
             }
             else
@@ -117,6 +156,14 @@ token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn)
                 STACK_PUSH(op_stack, n_op, tokens[n]);
             }
         }
+        // assignment is split off the statement before it is tokenized, see
+        // lex_assignment, so any "=" left over is misplaced
+        else if (tokens[n].type == ASSIGN)
+        {
+            set_diag(diag, E_INVALID_ASSIGN, &tokens[n], n, 0);
+            n_out = -1;
+            n = n_tokens;
+        }
         // if token is a right parentheses
         else if (tokens[n].type == R_PAREN)
         {
@@ -135,21 +182,25 @@ token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn)
             // otherwise there are mismatched parentheses
             else
             {
-                n_out = E_UNMATCHED_PAREN | tokens[n].offset;
+                set_diag(diag, E_UNMATCHED_PAREN, &tokens[n], n, 0);
+                n_out = -1;
                 n = n_tokens;
                 n_op = 0;
             }
         }
         n++;
     }
-    // if operator stack is non-empty, pop everything to output queue
-    while (n_op)
+    // if operator stack is non-empty, pop everything to output queue; this is
+    // skipped if an error has already been encountered
+    while (n_out >= 0 && n_op)
     {
         token_t op = STACK_POP(op_stack, n_op);
         // if popped operator is a parentheses, mismatched parentheses
         if (op.type == L_PAREN || op.type == R_PAREN)
         {
-            n_out = E_UNMATCHED_PAREN | op.offset;
+            // the operator stack does not track token indices
+            set_diag(diag, E_UNMATCHED_PAREN, &op, -1, 0);
+            n_out = -1;
             n_op = 0;
         }
         else
@@ -159,22 +210,31 @@ token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn)
     }
 
     *n_rpn = n_out;
-    // free out_stack if an error occurred
+    // discard out_stack if an error occurred
     if (n_out < 0)
     {
-        free(out_stack);
         out_stack = NULL;
     }
-    free(op_stack);
 
     return out_stack;
 }
 
-int evaluate_rpn(token_t* rpn, int n_rpn, token_t* res)
+/*
+ * the variables are read from vars; they are checked against syms if it is
+ * not NULL, and are all undefined if vars is NULL
+ */
+static int evaluate_rpn_impl(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, const symtab_t* syms,
+    const int64_t* vars, token_t* res, diag_t* diag)
 {
     int rc = 0;
-    token_t* stack = malloc(n_rpn * sizeof(token_t));
+    token_t* stack = ctx_alloc(ctx, n_rpn * sizeof(token_t));
     int n_stack = 0;
+    if (!stack)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
 
     for (int n = 0; n < n_rpn; n++)
     {
@@ -183,11 +243,27 @@ int evaluate_rpn(token_t* rpn, int n_rpn, token_t* res)
             // unary operator
             if (ARITY(rpn[n]) == 1)
             {
-                // conditions in lex.c:add_unary_pos_neg_ops are strong enough
-                // to ensure that there is an operand on the stack
-                token_t op = STACK_POP(stack, n_stack);
-                // evaluate result
-                OP_UN(rpn[n])(&op, &stack[n_stack++]);
+                // conditions in lex.c:add_unary_pos_neg_ops ensure that a
+                // literal or parenthesis follows, but the parentheses may be
+                // empty, e.g. "-()"
+                if (n_stack < 1)
+                {
+                    set_diag(
+                        diag, E_OP_MISSING_EXPR, &rpn[n], n, SIDE_RIGHT);
+                    rc = -1;
+                    n = n_rpn;
+                }
+                else
+                {
+                    token_t op = STACK_POP(stack, n_stack);
+                    // evaluate result
+                    if (OP_UN(rpn[n])(ctx, &op, &stack[n_stack++]))
+                    {
+                        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+                        rc = -1;
+                        n = n_rpn;
+                    }
+                }
             }
             // binary operator
             else if (ARITY(rpn[n]) == 2)
@@ -195,7 +271,9 @@ int evaluate_rpn(token_t* rpn, int n_rpn, token_t* res)
                 // not enough operands on the stack
                 if (n_stack < 2)
                 {
-                    rc = E_OP_MISSING_EXPR | (0x1 << 10) | rpn[n].offset;
+                    set_diag(
+                        diag, E_OP_MISSING_EXPR, &rpn[n], n, SIDE_RIGHT);
+                    rc = -1;
                     n = n_rpn;
                 }
                 else
@@ -203,10 +281,30 @@ int evaluate_rpn(token_t* rpn, int n_rpn, token_t* res)
                     token_t op2 = STACK_POP(stack, n_stack);
                     token_t op1 = STACK_POP(stack, n_stack);
                     // evaluate result
-                    OP_BIN(rpn[n])(&op1, &op2, &stack[n_stack++]);
+                    if (OP_BIN(rpn[n])(ctx, &op1, &op2, &stack[n_stack++]))
+                    {
+                        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+                        rc = -1;
+                        n = n_rpn;
+                    }
                 }
             }
         }
+        // push the value of a variable onto the stack
+        else if (IS_VARIABLE(rpn[n]))
+        {
+            if (!vars || (syms && !symtab_defined(syms, &rpn[n])))
+            {
+                set_diag(diag, E_UNDEFINED_VAR, &rpn[n], n, 0);
+                rc = -1;
+                n = n_rpn;
+            }
+            else
+            {
+                init_literal(
+                    &stack[n_stack++], vars[rpn[n].value], rpn[n].offset);
+            }
+        }
         else
         {
             // push operand token onto the stack
@@ -214,11 +312,51 @@ int evaluate_rpn(token_t* rpn, int n_rpn, token_t* res)
         }
     }
 
+    if (!rc && !n_stack)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        rc = -1;
+    }
     if (!rc)
     {
         *res = STACK_POP(stack, n_stack);
     }
 
-    free(stack);
+    return rc;
+}
+
+int evaluate_rpn(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, const symtab_t* syms,
+    token_t* res, diag_t* diag)
+{
+    return evaluate_rpn_impl(
+        ctx, rpn, n_rpn, syms, syms ? syms->values : NULL, res, diag);
+}
+
+int evaluate_rpn_vars(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, const int64_t* vars,
+    token_t* res, diag_t* diag)
+{
+    return evaluate_rpn_impl(ctx, rpn, n_rpn, NULL, vars, res, diag);
+}
+
+int eval_expr(
+    ctx_t* ctx, token_t* expr, int32_t n_tokens, const symtab_t* syms,
+    token_t* result, diag_t* diag)
+{
+    int rc = 0;
+    // convert infix expression to Reverse Polish (postfix) notation
+    int32_t n_rpn;
+    token_t* rpn = shunting_yard(ctx, expr, n_tokens, &n_rpn, diag);
+    if (n_rpn < 0)
+    {
+        rc = -1;
+    }
+    else
+    {
+        // evaluate postfix expression
+        rc = evaluate_rpn(ctx, rpn, n_rpn, syms, result, diag);
+    }
+
     return rc;
 }
@@ -8,26 +8,41 @@
 #define EVAL_H
 
 #include <lex.h>
+#include <symtab.h>
 
 #define STACK_PUSH(stack, count, item) stack[count++] = item
 #define STACK_POP(stack, count) stack[--count]
 
-void op_add_impl(token_t* op1, token_t* op2, token_t* res);
-void op_sub_impl(token_t* op1, token_t* op2, token_t* res);
-void op_mul_impl(token_t* op1, token_t* op2, token_t* res);
+/*
+ * the operators work on int64 literals, and promote the result to a bignum
+ * when it overflows 64 bits; the operands may also be bignums, see bignum.h
+ *
+ * @iparam ctx := evaluation context, owns a bignum result
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int op_add_impl(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res);
+int op_sub_impl(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res);
+int op_mul_impl(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res);
+
+int op_pos_impl(ctx_t* ctx, const token_t* op, token_t* res);
+int op_neg_impl(ctx_t* ctx, const token_t* op, token_t* res);
 
-void op_pos_impl(token_t* op, token_t* res);
-void op_neg_impl(token_t* op, token_t* res);
+typedef int (*op_binary_fn)(
+    ctx_t* ctx, const token_t* op1, const token_t* op2, token_t* res);
+typedef int (*op_unary_fn)(ctx_t* ctx, const token_t* op, token_t* res);
 
 // applies a binary operator to its operands
-static void (*ops_binary[N_BINARY_OPS])(token_t*, token_t*, token_t*) = {
+static const op_binary_fn ops_binary[N_BINARY_OPS] = {
     [OP_ADD - OP_ADD] = &op_add_impl,
     [OP_SUB - OP_ADD] = &op_sub_impl,
     [OP_MUL - OP_ADD] = &op_mul_impl,
 };
 
 // applies a unary operator to its operand
-static void (*ops_unary[N_UNARY_OPS])(token_t*, token_t*) = {
+static const op_unary_fn ops_unary[N_UNARY_OPS] = {
     [OP_POS - OP_POS] = &op_pos_impl,
     [OP_NEG - OP_POS] = &op_neg_impl,
 };
@@ -39,23 +54,67 @@ static void (*ops_unary[N_UNARY_OPS])(token_t*, token_t*) = {
  * converts an infix array of tokens into Reverse Polish (postfix) notation
  * using the shunting-yard algorithm
  *
+ * @iparam ctx := evaluation context, owns the returned array
  * @iparam tokens := array of tokens in infix notation
  * @iparam n_tokens := length of tokens array
  * @oparam n_rpn := length of the returned array, shunting-yard removes the
- *                  parentheses so this will likely be different from n_tokens
+ *                  parentheses so this will likely be different from n_tokens;
+ *                  -1 on error
+ * @oparam diag := filled in with the error details if conversion fails
  * @returns an array of tokens in Reverse Polish notation
  */
-token_t* shunting_yard(token_t* tokens, int n_tokens, int* n_rpn);
+token_t* shunting_yard(
+    ctx_t* ctx, token_t* tokens, int n_tokens, int* n_rpn, diag_t* diag);
 
 /*
  * evaluate an expression in Reverse Polish (postfix) notation
  *
+ * @iparam ctx := evaluation context, provides the evaluation stack
  * @iparam rpn := array of tokens in postfix notation
  * @iparam n_rpn := length of RPN array
- * @oparam res := expression result; for now, expect an integer literal; in the
- *                future, this can be used for things like variable assignment
- * @returns 0 on success, otherwise an error code
+ * @iparam syms := symbol table the variables were resolved against, NULL if
+ *                 no variables are defined
+ * @oparam res := expression result, an integer literal, or a bignum owned by
+ *                 the context if it does not fit in 64 bits
+ * @oparam diag := filled in with the error details if evaluation fails
+ * @returns 0 on success, -1 on error
+ */
+int evaluate_rpn(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, const symtab_t* syms,
+    token_t* res, diag_t* diag);
+
+/*
+ * evaluate an expression in Reverse Polish notation whose variables have all
+ * been checked to be defined, e.g. to redo exactly an evaluation which
+ * overflowed in one of the 64-bit engines
+ *
+ * @iparam ctx := evaluation context, provides the evaluation stack
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @iparam vars := variable values, indexed by slot
+ * @oparam res := expression result, see evaluate_rpn
+ * @oparam diag := filled in with the error details if evaluation fails
+ * @returns 0 on success, -1 on error
+ */
+int evaluate_rpn_vars(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, const int64_t* vars,
+    token_t* res, diag_t* diag);
+
+/*
+ * evaluate an infix expression: convert it to Reverse Polish notation and
+ * evaluate the result
+ *
+ * @iparam ctx := evaluation context
+ * @iparam expr := array of tokens in infix notation
+ * @iparam n_tokens := length of tokens array
+ * @iparam syms := symbol table the variables were resolved against, NULL if
+ *                 no variables are defined
+ * @oparam result := expression result
+ * @oparam diag := filled in with the error details if evaluation fails
+ * @returns 0 on success, -1 on error
  */
-int evaluate_rpn(token_t* rpn, int n_rpn, token_t* res);
+int eval_expr(
+    ctx_t* ctx, token_t* expr, int32_t n_tokens, const symtab_t* syms,
+    token_t* result, diag_t* diag);
 
 #endif
@@ -0,0 +1,332 @@
+/*
+ * src/jit.c
+ * x86-64 JIT compilation of hot expressions
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <jit.h>
+
+#if JIT_AVAILABLE
+
+// VM register -> machine register: rax, rcx, rdx, rsi, r8-r11; rdi holds
+// the pointer to the variable values
+static const uint8_t jit_regs[JIT_N_REGS] = { 0, 1, 2, 6, 8, 9, 10, 11 };
+
+// longest encoding of a single VM instruction and its overflow checks
+#define JIT_MAX_INSN_SIZE 48
+
+// mov edx, 1; ret: the overflow exit at the start of the code, which every
+// overflow check jumps to
+static const uint8_t jit_overflow_exit[] = { 0xba, 1, 0, 0, 0, 0xc3 };
+
+typedef struct {
+    uint8_t* buf;
+    size_t len;
+} jit_buf_t;
+
+static void jit_byte(jit_buf_t* b, uint8_t byte)
+{
+    b->buf[b->len++] = byte;
+}
+
+static void jit_imm32(jit_buf_t* b, int32_t imm)
+{
+    memcpy(&b->buf[b->len], &imm, sizeof(imm));
+    b->len += sizeof(imm);
+}
+
+// REX.W prefix for 64-bit operands, extended for r8-r15
+static void jit_rex(jit_buf_t* b, uint8_t reg, uint8_t rm)
+{
+    jit_byte(b, 0x48 | ((reg >= 8) << 2) | (rm >= 8));
+}
+
+static void jit_modrm(jit_buf_t* b, uint8_t reg, uint8_t rm)
+{
+    jit_byte(b, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op r/m64, r64 for the single-byte opcodes (add, sub, mov)
+static void jit_op_rr(jit_buf_t* b, uint8_t opcode, uint8_t dst, uint8_t src)
+{
+    jit_rex(b, src, dst);
+    jit_byte(b, opcode);
+    jit_modrm(b, src, dst);
+}
+
+// check whether a value can be a sign-extended 32-bit immediate
+static int jit_fits_imm32(int64_t imm)
+{
+    return imm >= INT32_MIN && imm <= INT32_MAX;
+}
+
+// mov r64, imm32 sign-extended, or movabs r64, imm64
+static void jit_mov_imm(jit_buf_t* b, uint8_t dst, int64_t imm)
+{
+    jit_rex(b, 0, dst);
+    if (jit_fits_imm32(imm))
+    {
+        jit_byte(b, 0xc7);
+        jit_modrm(b, 0, dst);
+        jit_imm32(b, (int32_t) imm);
+        return;
+    }
+    jit_byte(b, 0xb8 | (dst & 7));
+    memcpy(&b->buf[b->len], &imm, sizeof(imm));
+    b->len += sizeof(imm);
+}
+
+// mov r64, [rdi + slot * 8]
+static void jit_load(jit_buf_t* b, uint8_t dst, int64_t slot)
+{
+    jit_rex(b, dst, 0);
+    jit_byte(b, 0x8b);
+    // mod 10: base register plus a 32-bit displacement, rm 111: rdi
+    jit_byte(b, 0x80 | ((dst & 7) << 3) | 7);
+    jit_imm32(b, (int32_t) slot * (int32_t) sizeof(int64_t));
+}
+
+/*
+ * op r64, [rip + disp32] for an immediate which does not fit in 32 bits: the
+ * immediate is stored in the code right before the instruction, behind a
+ * jump over it
+ */
+static void jit_op_imm64(
+    jit_buf_t* b, uint8_t opcode, uint8_t opcode2, uint8_t dst, int64_t imm)
+{
+    jit_byte(b, 0xeb);
+    jit_byte(b, sizeof(imm));
+    size_t pos = b->len;
+    memcpy(&b->buf[b->len], &imm, sizeof(imm));
+    b->len += sizeof(imm);
+    jit_rex(b, dst, 0);
+    jit_byte(b, opcode);
+    if (opcode2)
+    {
+        jit_byte(b, opcode2);
+    }
+    // mod 00, rm 101: displacement from the end of the instruction
+    jit_byte(b, ((dst & 7) << 3) | 5);
+    jit_imm32(b, -(int32_t) (b->len + sizeof(int32_t) - pos));
+}
+
+// group 1 arithmetic with an immediate: add (/0) or sub (/5)
+static void jit_op_imm(jit_buf_t* b, uint8_t ext, uint8_t dst, int64_t imm)
+{
+    if (!jit_fits_imm32(imm))
+    {
+        // add r64, r/m64 or sub r64, r/m64
+        jit_op_imm64(b, ext == 0 ? 0x03 : 0x2b, 0, dst, imm);
+        return;
+    }
+    jit_rex(b, 0, dst);
+    jit_byte(b, 0x81);
+    jit_modrm(b, ext, dst);
+    jit_imm32(b, (int32_t) imm);
+}
+
+// imul dst, src
+static void jit_imul(jit_buf_t* b, uint8_t dst, uint8_t src)
+{
+    jit_rex(b, dst, src);
+    jit_byte(b, 0x0f);
+    jit_byte(b, 0xaf);
+    jit_modrm(b, dst, src);
+}
+
+// imul dst, src, imm32
+static void jit_imul_imm(jit_buf_t* b, uint8_t dst, uint8_t src, int64_t imm)
+{
+    jit_rex(b, dst, src);
+    jit_byte(b, 0x69);
+    jit_modrm(b, dst, src);
+    jit_imm32(b, (int32_t) imm);
+}
+
+// jo to the overflow exit at the start of the code
+static void jit_check(jit_buf_t* b)
+{
+    jit_byte(b, 0x0f);
+    jit_byte(b, 0x80);
+    jit_imm32(b, -(int32_t) (b->len + sizeof(int32_t)));
+}
+
+// neg r64
+static void jit_neg(jit_buf_t* b, uint8_t dst)
+{
+    jit_rex(b, 0, dst);
+    jit_byte(b, 0xf7);
+    jit_modrm(b, 3, dst);
+}
+
+#define JIT_ADD 0x01
+#define JIT_SUB 0x29
+#define JIT_MOV 0x89
+#define JIT_EXT_ADD 0
+#define JIT_EXT_SUB 5
+
+static void jit_mov(jit_buf_t* b, uint8_t dst, uint8_t src)
+{
+    if (dst != src)
+    {
+        jit_op_rr(b, JIT_MOV, dst, src);
+    }
+}
+
+// translate a three-address instruction into two-address machine code, with
+// an overflow check after each arithmetic instruction
+static void jit_insn(jit_buf_t* b, const regvm_insn_t* insn)
+{
+    uint8_t dst = jit_regs[insn->dst];
+    uint8_t a = jit_regs[insn->a];
+    uint8_t rb = jit_regs[insn->b];
+    switch ((regvm_op) insn->op)
+    {
+    case REGVM_LOADI:
+        jit_mov_imm(b, dst, insn->imm);
+        return;
+    case REGVM_LOAD:
+        jit_load(b, dst, insn->imm);
+        return;
+    case REGVM_ADD:
+    case REGVM_MUL:
+        // commutative, so dst may alias either operand
+        if (dst == rb)
+        {
+            rb = a;
+        }
+        else
+        {
+            jit_mov(b, dst, a);
+        }
+        if (insn->op == REGVM_ADD)
+        {
+            jit_op_rr(b, JIT_ADD, dst, rb);
+        }
+        else
+        {
+            jit_imul(b, dst, rb);
+        }
+        break;
+    case REGVM_SUB:
+        // dst = a - b where dst aliases b becomes dst = -b + a, which also
+        // reports an overflow when b is INT64_MIN
+        if (dst == rb && dst != a)
+        {
+            jit_neg(b, dst);
+            jit_check(b);
+            jit_op_rr(b, JIT_ADD, dst, a);
+        }
+        else
+        {
+            jit_mov(b, dst, a);
+            jit_op_rr(b, JIT_SUB, dst, rb);
+        }
+        break;
+    case REGVM_ADDI:
+        jit_mov(b, dst, a);
+        jit_op_imm(b, JIT_EXT_ADD, dst, insn->imm);
+        break;
+    case REGVM_SUBI:
+        jit_mov(b, dst, a);
+        jit_op_imm(b, JIT_EXT_SUB, dst, insn->imm);
+        break;
+    case REGVM_RSUBI:
+        jit_mov(b, dst, a);
+        jit_neg(b, dst);
+        jit_check(b);
+        jit_op_imm(b, JIT_EXT_ADD, dst, insn->imm);
+        break;
+    case REGVM_MULI:
+        if (jit_fits_imm32(insn->imm))
+        {
+            jit_imul_imm(b, dst, a, insn->imm);
+            break;
+        }
+        jit_mov(b, dst, a);
+        jit_op_imm64(b, 0x0f, 0xaf, dst, insn->imm);
+        break;
+    case REGVM_NEG:
+        jit_mov(b, dst, a);
+        jit_neg(b, dst);
+        break;
+    default:
+        return;
+    }
+    jit_check(b);
+}
+
+int jit_compile(const regvm_prog_t* prog, jit_code_t* code)
+{
+    if (prog->n_regs > JIT_N_REGS)
+    {
+        return -1;
+    }
+
+    // code is written while the page is writable, then made executable
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = sizeof(jit_overflow_exit)
+        + prog->len * JIT_MAX_INSN_SIZE + 3;
+    size = (size + page - 1) / page * page;
+    void* mem = mmap(
+        NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        return -1;
+    }
+
+    jit_buf_t b = { .buf=mem, .len=0 };
+    memcpy(b.buf, jit_overflow_exit, sizeof(jit_overflow_exit));
+    b.len = sizeof(jit_overflow_exit);
+    for (size_t i = 0; i < prog->len; i++)
+    {
+        jit_insn(&b, &prog->code[i]);
+    }
+    // xor edx, edx; ret: no overflow, the result is already in rax
+    jit_byte(&b, 0x31);
+    jit_byte(&b, 0xd2);
+    jit_byte(&b, 0xc3);
+
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC))
+    {
+        munmap(mem, size);
+        return -1;
+    }
+    code->mem = mem;
+    code->size = size;
+    // the code starts after the overflow exit; ISO C has no conversion from
+    // object to function pointers, POSIX guarantees that this one works
+    void* entry = (uint8_t*) mem + sizeof(jit_overflow_exit);
+    memcpy(&code->fn, &entry, sizeof(code->fn));
+    return 0;
+}
+
+void jit_free(jit_code_t* code)
+{
+    munmap(code->mem, code->size);
+    code->mem = NULL;
+    code->fn = NULL;
+}
+
+#else
+
+int jit_compile(const regvm_prog_t* prog, jit_code_t* code)
+{
+    (void) prog;
+    (void) code;
+    return -1;
+}
+
+void jit_free(jit_code_t* code)
+{
+    (void) code;
+}
+
+#endif
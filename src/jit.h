@@ -0,0 +1,72 @@
+/*
+ * src/jit.h
+ * x86-64 JIT compilation of hot expressions
+ *
+ * register code from the register VM is translated into native code in an
+ * executable page: literals become immediates and the VM registers map
+ * directly onto caller-saved machine registers, with the result in rax; the
+ * compiled expression is called through a function pointer, with the values
+ * of its variables passed in rdi; every operation is followed by a jump on
+ * the overflow flag to a shared exit which reports the overflow in rdx;
+ * operand immediates which do not fit in 32 bits are read from the code
+ *
+ * on other architectures, or when an expression needs more registers than
+ * are available, jit_compile fails and callers keep using the interpreter
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <regvm.h>
+
+#if defined(__x86_64__)
+#define JIT_AVAILABLE 1
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+// machine registers available to compiled expressions
+#define JIT_N_REGS 8
+
+// returned in rax and rdx
+typedef struct {
+    int64_t value;
+    // nonzero if an operation overflowed 64 bits, in which case the value is
+    // meaningless and the expression must be evaluated with evaluate_rpn; an
+    // overflow may also be reported for a few results which do fit
+    int64_t overflow;
+} jit_result_t;
+
+// takes the variable values indexed by slot, may be NULL if the expression
+// has no variables
+typedef jit_result_t (*jit_fn)(const int64_t* vars);
+
+typedef struct {
+    jit_fn fn;
+    void* mem;
+    size_t size;
+} jit_code_t;
+
+/*
+ * translate a register VM program into native code
+ *
+ * @iparam prog := compiled register VM program
+ * @oparam code := native code, callable through code->fn
+ * @returns 0 on success, -1 if the program cannot be compiled on this
+ *          platform, in which case regvm_run should be used instead
+ */
+int jit_compile(const regvm_prog_t* prog, jit_code_t* code);
+
+/*
+ * release native code
+ *
+ * @iparam code := native code from jit_compile
+ */
+void jit_free(jit_code_t* code);
+
+#endif
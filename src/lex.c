@@ -6,19 +6,35 @@
  */
 
 #include <ctype.h>
-#include <stdlib.h>
+#include <stdatomic.h>
 #include <string.h>
 
 #include <error.h>
 #include <lex.h>
 
+#if defined(__x86_64__)
+#define LEX_X86 1
+#include <immintrin.h>
+#else
+#define LEX_X86 0
+#endif
+
+static const char* const lex_kernel_names[N_LEX_KERNELS] = {
+    [LEX_BYTEWISE] = "bytewise",
+    [LEX_SSE2]     = "sse2",
+    [LEX_AVX2]     = "avx2",
+};
+
+// kernel used by tokenize_n, detected on first use; -1 until then
+static _Atomic int lex_kernel_used = -1;
+
 /*
- * skip all leading/trailing whitespace
+ * skip all leading/trailing whitespace, stopping at the end of the input
  */
-static inline const char* skip_whitespace(const char* c)
+static inline const char* skip_whitespace(const char* c, const char* end)
 {
     const char* it = c;
-    while (isspace(*it))
+    while (it < end && isspace((unsigned char) *it))
     {
         it++;
     }
@@ -49,41 +65,142 @@ static token_type get_operator_type(const char* c)
     case '*':
         type = OP_MUL;
         break;
+    case '=':
+        type = ASSIGN;
+        break;
     default:
         type = INVALID;
     }
     return type;
 }
 
-/*
- * attempt to get a literal (passed as an oparam)
- * return the end position of the literal if successful, or return NULL if the
- * string passed is not a literal
+/* LITERALS
+ * plain decimal digits are converted 8 at a time with SWAR arithmetic on a
+ * 64-bit word: digit pairs, then quadruples, are combined with shifts and
+ * multiplies rather than one multiply-add per digit; values are accumulated in
+ * 64 bits with overflow checks, saturating past LEX_LIT_MIN_MAGNITUDE
  */
-static const char* get_literal(const char* c, int32_t* value)
+
+#define LEX_ONES 0x0101010101010101ULL
+
+// check whether the 8 characters at c are all decimal digits
+static inline int lex_is_eight_digits(const char* c)
+{
+    uint64_t v;
+    memcpy(&v, c, sizeof(v));
+    // a digit has 3 in its high nibble and stays below 0x40 when 6 is added
+    uint64_t high = v & (0xF0 * LEX_ONES);
+    uint64_t carry = (v + 6 * LEX_ONES) & (0xF0 * LEX_ONES);
+    return (high | carry >> 4) == 0x33 * LEX_ONES;
+}
+
+// convert 8 decimal digits, the first one being the most significant
+static inline uint32_t lex_eight_digits(const char* c)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, c, sizeof(v));
+    // the first digit is in the lowest byte
+    v -= '0' * LEX_ONES;
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))
+        + ((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32))) >> 32;
+    return (uint32_t) v;
+#else
+    uint32_t v = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        v = v * 10 + (uint32_t) (c[i] - '0');
+    }
+    return v;
+#endif
+}
+
+// val * scale + digits, saturated so that the value cannot wrap
+static inline uint64_t lex_accumulate(
+    uint64_t val, uint64_t scale, uint64_t digits)
 {
-    char* it;
-    int32_t val = strtol(c, &it, 10);
-    // if it has not moved, not a valid literal
-    if (it == c)
+    uint64_t out;
+    if (__builtin_mul_overflow(val, scale, &out)
+        || __builtin_add_overflow(out, digits, &out)
+        || out > LEX_LIT_MIN_MAGNITUDE)
     {
-        it = NULL;
+        return UINT64_MAX;
     }
-    // otherwise get the value of the parsed literal
-    else
+    return out;
+}
+
+int64_t lex_literal(const char* c, const char* end, int64_t* value)
+{
+    const char* it = c;
+    if (it == end || *it < '0' || *it > '9')
     {
-        *value = val;
+        return 0;
     }
 
-    return it;
+    // a prefix only counts if a digit of its radix follows
+    int radix = 10;
+    if (end - it > 2 && it[0] == '0')
+    {
+        int prefix_radix = lex_prefix_radix(it[1]);
+        if (prefix_radix && lex_digit_value(it[2]) < prefix_radix)
+        {
+            radix = prefix_radix;
+            it += 2;
+        }
+    }
+
+    uint64_t val = 0;
+    for (;;)
+    {
+        while (radix == 10 && end - it >= 8 && lex_is_eight_digits(it))
+        {
+            val = lex_accumulate(val, 100000000, lex_eight_digits(it));
+            it += 8;
+        }
+        int digit;
+        while (it < end && (digit = lex_digit_value(*it)) < radix)
+        {
+            val = lex_accumulate(val, radix, digit);
+            it++;
+        }
+        // an underscore only separates digits
+        if (end - it >= 2 && it[0] == '_' && lex_digit_value(it[1]) < radix)
+        {
+            it++;
+            continue;
+        }
+        break;
+    }
+
+    if (val > LEX_LIT_MIN_MAGNITUDE)
+    {
+        return -1;
+    }
+    *value = val == LEX_LIT_MIN_MAGNITUDE ? INT64_MIN : (int64_t) val;
+    return it - c;
 }
 
-void init_token(token_t* token, token_type type, int32_t offset)
+int lex_fold_min_literal(token_t* prev, const token_t* token)
+{
+    if (!IS_MIN_MAGNITUDE(*token))
+    {
+        return 0;
+    }
+    if (!prev || prev->type != OP_NEG)
+    {
+        return -1;
+    }
+    prev->type = OP_POS;
+    return 0;
+}
+
+void init_token(token_t* token, token_type type, int64_t offset)
 {
     *token = (token_t) { .type=type, .value=0, .offset=offset };
 }
 
-void init_literal(token_t* token, int32_t value, int32_t offset)
+void init_literal(token_t* token, int64_t value, int64_t offset)
 {
     *token = (token_t) { .type=LITERAL, .value=value, .offset=offset };
 }
@@ -114,10 +231,12 @@ static void add_unary_pos_neg_ops(token_t** tokens, int32_t n_tokens)
         token_t* tnext = i + 1 < n_tokens ? &(*tokens)[i + 1] : NULL;
         // current token must be +/-
         uint8_t cond1 = tcurr->type == OP_ADD || tcurr->type == OP_SUB;
-        // previous token must be a binary operator or a left parenthesis
-        uint8_t cond2 = ARITY(*tprev) == 2 || tprev->type == L_PAREN;
-        // next token must be a literal or a left parenthesis
-        uint8_t cond3 = tnext && (IS_LITERAL(*tnext) || tnext->type == L_PAREN);
+        // previous token must be a binary operator, a left parenthesis or an
+        // assignment
+        uint8_t cond2 = ARITY(*tprev) == 2 || tprev->type == L_PAREN
+            || tprev->type == ASSIGN;
+        // next token must be an operand or a left parenthesis
+        uint8_t cond3 = tnext && (IS_OPERAND(*tnext) || tnext->type == L_PAREN);
         if (cond1 && cond2 && cond3)
         {
             tcurr->type = binary_to_unary(tcurr->type);
@@ -125,78 +244,434 @@ static void add_unary_pos_neg_ops(token_t** tokens, int32_t n_tokens)
     }
 }
 
-token_t* tokenize(const char* input, int32_t* n_tokens)
+size_t lex_name(const char* c, const char* end)
 {
-    if (strlen(input) >= MAX_INPUT_LEN)
+    const char* it = c;
+    if (it < end && (isalpha((unsigned char) *it) || *it == '_'))
     {
-        *n_tokens = E_MAX_INPUT;
-        return NULL;
+        it++;
+        while (it < end && (isalnum((unsigned char) *it) || *it == '_'))
+        {
+            it++;
+        }
     }
+    return it - c;
+}
 
-    token_t* tokens = malloc(MAX_TOKENS * sizeof(token_t));
-    *n_tokens = 0;
-    const char* it = input;
+size_t lex_assignment(
+    const char* input, size_t len, size_t* name, size_t* name_len)
+{
+    const char* end = input + len;
+    const char* c = skip_whitespace(input, end);
+    *name = c - input;
+    *name_len = lex_name(c, end);
+    if (!*name_len)
+    {
+        return 0;
+    }
+    c = skip_whitespace(c + *name_len, end);
+    return c < end && *c == '=' ? (size_t) (c + 1 - input) : 0;
+}
+
+/* BLOCK LEXER
+ * the input is classified 64 characters at a time into bitmasks of whitespace
+ * and name characters, bit i of a mask being set if character i of the block
+ * is in the class; the lexer then moves from token to token with bit scans
+ * rather than testing every character, and only looks up the class of the
+ * first character of each token
+ */
+
+#if LEX_X86
+
+#define LEX_BLOCK 64
+// the masks cover the input and at least one character past its end
+#define LEX_MASK_WORDS (MAX_INPUT_LEN / LEX_BLOCK + 1)
+
+typedef enum {
+    // classes with a bitmask
+    CLASS_SPACE,
+    CLASS_WORD,  // characters of names, including digits
+    N_CLASSES,
+    // classes which are only looked up
+    CLASS_DIGIT = N_CLASSES,
+    CLASS_OP,    // operators and parentheses
+} lex_class;
+
+#define S (1 << CLASS_SPACE)
+#define D ((1 << CLASS_DIGIT) | (1 << CLASS_WORD))
+#define W (1 << CLASS_WORD)
+#define O (1 << CLASS_OP)
 
-    while (it && *it)
+// classes of each character, matching isspace and isalnum in the C locale
+static const uint8_t lex_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,  // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x10
+    S, 0, 0, 0, 0, 0, 0, 0, O, O, O, O, 0, O, 0, 0,  // 0x20
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, O, 0, 0,  // 0x30
+    0, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0x40
+    W, W, W, W, W, W, W, W, W, W, W, 0, 0, 0, 0, W,  // 0x50
+    0, W, W, W, W, W, W, W, W, W, W, W, W, W, W, W,  // 0x60
+    W, W, W, W, W, W, W, W, W, W, W, 0, 0, 0, 0, 0,  // 0x70
+};
+
+#undef S
+#undef D
+#undef W
+#undef O
+
+// token_type of each operator character, INVALID for the other characters
+static const uint8_t lex_op_types[256] = {
+    ['('] = L_PAREN,
+    [')'] = R_PAREN,
+    ['+'] = OP_ADD,
+    ['-'] = OP_SUB,
+    ['*'] = OP_MUL,
+    ['='] = ASSIGN,
+};
+
+// fills in the mask of each class for one block of LEX_BLOCK characters
+typedef void (*lex_classify_fn)(const char* block, uint64_t masks[N_CLASSES]);
+
+// defines the kernel classifying a block with vectors of a given width; a
+// character range is tested with a wrapping subtraction and a saturating one,
+// and letters are folded to lower case by setting bit 5, which maps no other
+// character into a-z
+#define LEX_CLASSIFY_KERNEL(isa, target_name, vec, pre, si, width)          \
+    __attribute__((target(target_name)))                                    \
+    static inline vec lex_range_##isa(vec x, uint8_t lo, uint8_t hi)        \
+    {                                                                       \
+        vec d = pre##_sub_epi8(x, pre##_set1_epi8((char) lo));              \
+        d = pre##_subs_epu8(d, pre##_set1_epi8((char) (hi - lo)));          \
+        return pre##_cmpeq_epi8(d, pre##_setzero_##si());                   \
+    }                                                                       \
+                                                                            \
+    __attribute__((target(target_name)))                                    \
+    static void lex_classify_##isa(                                         \
+        const char* block, uint64_t masks[N_CLASSES])                       \
+    {                                                                       \
+        uint64_t m[N_CLASSES] = { 0 };                                      \
+        for (int i = 0; i < LEX_BLOCK; i += width)                          \
+        {                                                                   \
+            vec x = pre##_loadu_##si((const vec*) (block + i));             \
+            vec c[N_CLASSES];                                               \
+            c[CLASS_SPACE] = pre##_or_##si(                                 \
+                pre##_cmpeq_epi8(x, pre##_set1_epi8(' ')),                  \
+                lex_range_##isa(x, '\t', '\r'));                            \
+            vec lower = pre##_or_##si(x, pre##_set1_epi8(0x20));            \
+            c[CLASS_WORD] = pre##_or_##si(                                  \
+                pre##_or_##si(                                              \
+                    lex_range_##isa(x, '0', '9'),                           \
+                    lex_range_##isa(lower, 'a', 'z')),                      \
+                pre##_cmpeq_epi8(x, pre##_set1_epi8('_')));                 \
+            for (int k = 0; k < N_CLASSES; k++)                             \
+            {                                                               \
+                uint32_t bits = (uint32_t) pre##_movemask_epi8(c[k]);       \
+                m[k] |= (uint64_t) bits << i;                               \
+            }                                                               \
+        }                                                                   \
+        memcpy(masks, m, sizeof(m));                                        \
+    }
+
+LEX_CLASSIFY_KERNEL(sse2, "sse2", __m128i, _mm, si128, 16)
+LEX_CLASSIFY_KERNEL(avx2, "avx2", __m256i, _mm256, si256, 32)
+
+static const lex_classify_fn lex_classifiers[N_LEX_KERNELS] = {
+    [LEX_SSE2] = lex_classify_sse2,
+    [LEX_AVX2] = lex_classify_avx2,
+};
+
+/*
+ * classify a whole input; the characters from the end of the input to the end
+ * of its last block are in no class
+ */
+static void lex_classify(
+    const char* input, size_t len, lex_classify_fn classify,
+    uint64_t masks[N_CLASSES][LEX_MASK_WORDS])
+{
+    size_t n_full = len / LEX_BLOCK;
+    uint64_t m[N_CLASSES];
+    for (size_t w = 0; w <= n_full; w++)
     {
-        // skip leading whitspace
-        it = skip_whitespace(it);
-        // all trailing whitespace consumed
-        if (!(*it))
+        const char* block = input + w * LEX_BLOCK;
+        // the last block is copied so that nothing past the input is read
+        char tail[LEX_BLOCK];
+        if (w == n_full)
         {
-            break;
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, block, len % LEX_BLOCK);
+            block = tail;
         }
-        int32_t offset = it - input;
-
-        // attempt to get an operator type
-        // note that parentheses are treated as operators here
-        token_type type = get_operator_type(it);
-        if (type != INVALID)
+        classify(block, m);
+        for (int k = 0; k < N_CLASSES; k++)
         {
-            init_token(&tokens[*n_tokens], type, offset);
-            it++;
-            *n_tokens = *n_tokens + 1;
-            // error out if max number of tokens has been exceeded
-            if (*n_tokens == MAX_TOKENS)
-            {
-                *n_tokens = E_MAX_TOKENS;
-                it = 0;
-            }
-            continue;
+            masks[k][w] = m[k];
         }
+    }
+}
 
-        // otherwise attempt to get a literal
-        int32_t value;
-        it = get_literal(it, &value);
-        if (it)
+/*
+ * get the position of the first character at or after pos which is not in the
+ * class of a mask; this is at most the length of the input, as the characters
+ * past its end are in no class
+ */
+static inline size_t lex_scan_out(const uint64_t* mask, size_t pos)
+{
+    size_t w = pos / LEX_BLOCK;
+    uint64_t bits = ~mask[w] & (~(uint64_t) 0 << (pos % LEX_BLOCK));
+    while (!bits)
+    {
+        bits = ~mask[++w];
+    }
+    return w * LEX_BLOCK + (size_t) __builtin_ctzll(bits);
+}
+
+/*
+ * lex an input into an array with room for MAX_TOKENS tokens, stopping there;
+ * returns -1 with the invalid token in bad, see lex_next, otherwise 0
+ */
+static int lex_blocks(
+    const char* input, size_t len, lex_classify_fn classify,
+    token_t* tokens, int32_t* n_tokens, token_t* bad)
+{
+    uint64_t masks[N_CLASSES][LEX_MASK_WORDS];
+    lex_classify(input, len, classify, masks);
+
+    size_t pos = lex_scan_out(masks[CLASS_SPACE], 0);
+    while (pos < len && *n_tokens < MAX_TOKENS)
+    {
+        unsigned char c = (unsigned char) input[pos];
+        uint8_t classes = lex_classes[c];
+        token_t* token = &tokens[*n_tokens];
+        size_t end;
+        if (classes & (1 << CLASS_OP))
+        {
+            init_token(token, lex_op_types[c], pos);
+            end = pos + 1;
+        }
+        else if (classes & (1 << CLASS_DIGIT))
         {
-            init_literal(&tokens[*n_tokens], value, offset);
-            *n_tokens = *n_tokens + 1;
-            // error out if max number of tokens has been exceeded
-            if (*n_tokens == MAX_TOKENS)
+            int64_t value;
+            int64_t lit_len = lex_literal(input + pos, input + len, &value);
+            if (lit_len < 0)
             {
-                *n_tokens = E_MAX_TOKENS;
-                it = 0;
+                init_token(bad, LITERAL, pos);
+                return -1;
             }
-            continue;
+            init_literal(token, value, pos);
+            end = pos + lit_len;
+        }
+        else if (classes & (1 << CLASS_WORD))
+        {
+            end = lex_scan_out(masks[CLASS_WORD], pos);
+            *token = (token_t) { .type=VARIABLE, .value=-1, .offset=pos };
+        }
+        else
+        {
+            init_token(bad, INVALID, pos);
+            return -1;
         }
+        *n_tokens = *n_tokens + 1;
+        pos = lex_scan_out(masks[CLASS_SPACE], end);
+    }
+    return 0;
+}
+
+#endif
 
-        // if this point has been reached, token is invalid
-        *n_tokens = E_INVALID_TOKEN | offset;
-        it = 0;
+// lex an input one character at a time, like lex_blocks
+static int lex_bytewise(
+    const char* input, size_t len, token_t* tokens, int32_t* n_tokens,
+    token_t* bad)
+{
+    const char* it = input;
+    const char* end = input + len;
+    int rc = 0;
+    while (*n_tokens < MAX_TOKENS
+        && (rc = lex_next(input, &it, end, &tokens[*n_tokens])) > 0)
+    {
+        *n_tokens = *n_tokens + 1;
+    }
+    if (rc < 0)
+    {
+        *bad = tokens[*n_tokens];
+        return -1;
     }
+    return 0;
+}
 
-    // if an error has been encountered, deallocate tokens array
-    if (!it)
+const char* lex_kernel_name(lex_kernel kernel)
+{
+    return lex_kernel_names[kernel];
+}
+
+int lex_kernel_supported(lex_kernel kernel)
+{
+#if LEX_X86
+    __builtin_cpu_init();
+    switch (kernel)
     {
-        free(tokens);
-        tokens = NULL;
+    case LEX_SSE2:
+        // part of the x86-64 baseline
+        return 1;
+    case LEX_AVX2:
+        return __builtin_cpu_supports("avx2") ? 1 : 0;
+    default:
+        break;
+    }
+#endif
+    return kernel == LEX_BYTEWISE;
+}
+
+lex_kernel lex_detect_kernel(void)
+{
+    lex_kernel kernel = N_LEX_KERNELS - 1;
+    while (kernel > LEX_BYTEWISE && !lex_kernel_supported(kernel))
+    {
+        kernel--;
+    }
+    return kernel;
+}
+
+int lex_next(
+    const char* input, const char** it, const char* end, token_t* token)
+{
+    // skip leading whitspace
+    const char* c = skip_whitespace(*it, end);
+    *it = c;
+    // all trailing whitespace consumed
+    if (c == end)
+    {
+        return 0;
     }
-    else
+    int64_t offset = c - input;
+
+    // attempt to get an operator type
+    // note that parentheses are treated as operators here
+    token_type type = get_operator_type(c);
+    if (type != INVALID)
+    {
+        init_token(token, type, offset);
+        *it = c + 1;
+        return 1;
+    }
+
+    // otherwise attempt to get a literal
+    int64_t value;
+    int64_t lit_len = lex_literal(c, end, &value);
+    if (lit_len < 0)
+    {
+        init_token(token, LITERAL, offset);
+        return -1;
+    }
+    if (lit_len)
+    {
+        init_literal(token, value, offset);
+        *it = c + lit_len;
+        return 1;
+    }
+
+    // otherwise attempt to get a variable name, resolved to its slot later
+    size_t name_len = lex_name(c, end);
+    if (name_len)
+    {
+        *token = (token_t) { .type=VARIABLE, .value=-1, .offset=offset };
+        *it = c + name_len;
+        return 1;
+    }
+
+    // if this point has been reached, token is invalid
+    init_token(token, INVALID, offset);
+    return -1;
+}
+
+token_t* tokenize(
+    ctx_t* ctx, const char* input, int32_t* n_tokens, diag_t* diag)
+{
+    return tokenize_n(ctx, input, strlen(input), n_tokens, diag);
+}
+
+token_t* tokenize_n(
+    ctx_t* ctx, const char* input, size_t len, int32_t* n_tokens,
+    diag_t* diag)
+{
+    // the processor's features do not change, and detecting them costs more
+    // than lexing a short expression
+    int kernel = atomic_load_explicit(&lex_kernel_used, memory_order_relaxed);
+    if (kernel < 0)
     {
-        add_unary_pos_neg_ops(&tokens, *n_tokens);
+        kernel = lex_detect_kernel();
+        atomic_store_explicit(&lex_kernel_used, kernel, memory_order_relaxed);
     }
+    return tokenize_kernel(ctx, input, len, kernel, n_tokens, diag);
+}
 
+token_t* tokenize_kernel(
+    ctx_t* ctx, const char* input, size_t len, lex_kernel kernel,
+    int32_t* n_tokens, diag_t* diag)
+{
+    if (len >= MAX_INPUT_LEN)
+    {
+        set_diag(diag, E_MAX_INPUT, NULL, -1, 0);
+        *n_tokens = -1;
+        return NULL;
+    }
+
+    // every token consumes at least one character, so the input length bounds
+    // the number of tokens
+    size_t max_tokens = len < MAX_TOKENS ? len : MAX_TOKENS;
+    token_t* tokens = ctx_alloc(ctx, max_tokens * sizeof(token_t));
+    if (!tokens)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        *n_tokens = -1;
+        return NULL;
+    }
+    *n_tokens = 0;
+    token_t bad;
+#if LEX_X86
+    int rc = kernel == LEX_BYTEWISE
+        ? lex_bytewise(input, len, tokens, n_tokens, &bad)
+        : lex_blocks(
+            input, len, lex_classifiers[kernel], tokens, n_tokens, &bad);
+#else
+    // only the bytewise lexer is supported
+    (void) kernel;
+    int rc = lex_bytewise(input, len, tokens, n_tokens, &bad);
+#endif
+
+    // unary operators are resolved first, as the magnitude of INT64_MIN is
+    // only valid after a unary minus; an out-of-range literal is reported
+    // before an invalid token which follows it
+    add_unary_pos_neg_ops(&tokens, *n_tokens);
+    for (int32_t i = 0; i < *n_tokens; i++)
+    {
+        if (lex_fold_min_literal(i ? &tokens[i - 1] : NULL, &tokens[i]))
+        {
+            bad = tokens[i];
+            *n_tokens = i;
+            rc = -1;
+            break;
+        }
+    }
+
+    if (rc < 0)
+    {
+        err_kind kind = IS_LITERAL(bad) ? E_LIT_OVERFLOW : E_INVALID_TOKEN;
+        set_diag(diag, kind, &bad, *n_tokens, 0);
+    }
+    // error out if max number of tokens has been exceeded
+    else if (*n_tokens == MAX_TOKENS)
+    {
+        set_diag(diag, E_MAX_TOKENS, NULL, -1, 0);
+    }
+
+    // if an error has been encountered, discard the tokens array, its memory
+    // is reclaimed when the context is reset
+    if (rc < 0 || *n_tokens == MAX_TOKENS)
+    {
+        *n_tokens = -1;
+        tokens = NULL;
+    }
 
     return tokens;
 }
@@ -8,16 +8,28 @@
 #ifndef LEX_H
 #define LEX_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <ctx.h>
+
 // temporary max length of input string
 #define MAX_INPUT_LEN (1024)
 // temporary max number of tokens
 #define MAX_TOKENS (256)
 
+// largest literal in any base; larger values can still be computed, see
+// bignum.h
+#define LEX_LIT_MAX INT64_MAX
+// the magnitude of INT64_MIN is only a literal directly after a unary minus;
+// lexers produce it as a literal with the value INT64_MIN, and the minus is
+// then turned into a unary plus, see lex_fold_min_literal
+#define LEX_LIT_MIN_MAGNITUDE ((uint64_t) LEX_LIT_MAX + 1)
+
 typedef enum {
     INVALID,
     LITERAL,
+    VARIABLE,
     L_PAREN,
     R_PAREN,
     OP_ADD,
@@ -25,6 +37,12 @@ typedef enum {
     OP_MUL,
     OP_POS,
     OP_NEG,
+    // only valid after the variable name starting a statement, see
+    // lex_assignment
+    ASSIGN,
+    // value which does not fit in 64 bits, only produced by evaluation, see
+    // bignum.h
+    BIGNUM,
     N_TOKEN_TYPES
 } token_type;
 
@@ -32,35 +50,51 @@ typedef enum {
 #define N_UNARY_OPS  2
 
 #define IS_LITERAL(token)  ((token).type == LITERAL)
+#define IS_VARIABLE(token) ((token).type == VARIABLE)
+// literals and variables both stand for a value
+#define IS_OPERAND(token)  (IS_LITERAL(token) || IS_VARIABLE(token))
 #define IS_OPERATOR(token) ((token).type >= OP_ADD && (token).type <= OP_NEG)
+// lexed literal of magnitude LEX_LIT_MIN_MAGNITUDE, lexed literals are
+// otherwise never negative
+#define IS_MIN_MAGNITUDE(token) \
+    (IS_LITERAL(token) && (token).value == INT64_MIN)
+
+// NOTE: the operator tables below are read-only so that they can be shared by
+// threads evaluating expressions concurrently
 
 // arity of operators
-static uint8_t arity[N_TOKEN_TYPES] = {
-    [INVALID] = 0,
-    [LITERAL] = 0,
-    [L_PAREN] = 0,
-    [R_PAREN] = 0,
-    [OP_ADD]  = 2,
-    [OP_SUB]  = 2,
-    [OP_MUL]  = 2,
-    [OP_POS]  = 1,
-    [OP_NEG]  = 1,
+static const uint8_t arity[N_TOKEN_TYPES] = {
+    [INVALID]  = 0,
+    [LITERAL]  = 0,
+    [VARIABLE] = 0,
+    [L_PAREN]  = 0,
+    [R_PAREN]  = 0,
+    [OP_ADD]   = 2,
+    [OP_SUB]   = 2,
+    [OP_MUL]   = 2,
+    [OP_POS]   = 1,
+    [OP_NEG]   = 1,
+    [ASSIGN]   = 0,
+    [BIGNUM]   = 0,
 };
 
 #define ARITY(token) arity[(token).type]
 
 // precedence of operators, taken from "C Operator Precedence"
 // https://en.cppreference.com/w/c/language/operator_precedence
-static uint8_t precedence[N_TOKEN_TYPES] = {
-    [INVALID] = 0,
-    [LITERAL] = 0,
-    [L_PAREN] = 1,
-    [R_PAREN] = 1,
-    [OP_ADD]  = 4,
-    [OP_SUB]  = 4,
-    [OP_MUL]  = 3,
-    [OP_POS]  = 2,
-    [OP_NEG]  = 2,
+static const uint8_t precedence[N_TOKEN_TYPES] = {
+    [INVALID]  = 0,
+    [LITERAL]  = 0,
+    [VARIABLE] = 0,
+    [L_PAREN]  = 1,
+    [R_PAREN]  = 1,
+    [OP_ADD]   = 4,
+    [OP_SUB]   = 4,
+    [OP_MUL]   = 3,
+    [OP_POS]   = 2,
+    [OP_NEG]   = 2,
+    [ASSIGN]   = 0,
+    [BIGNUM]   = 0,
 };
 
 #define PREC(token) precedence[(token).type]
@@ -71,26 +105,88 @@ static uint8_t precedence[N_TOKEN_TYPES] = {
 #define ASSOC_R 2
 
 // associativity of operators
-static uint8_t associativity[N_TOKEN_TYPES] = {
-    [INVALID] = 0,
-    [LITERAL] = 0,
-    [L_PAREN] = 0,
-    [R_PAREN] = 0,
-    [OP_ADD]  = ASSOC_L,
-    [OP_SUB]  = ASSOC_L,
-    [OP_MUL]  = ASSOC_L,
-    [OP_POS]  = ASSOC_R,
-    [OP_NEG]  = ASSOC_R,
+static const uint8_t associativity[N_TOKEN_TYPES] = {
+    [INVALID]  = 0,
+    [LITERAL]  = 0,
+    [VARIABLE] = 0,
+    [L_PAREN]  = 0,
+    [R_PAREN]  = 0,
+    [OP_ADD]   = ASSOC_L,
+    [OP_SUB]   = ASSOC_L,
+    [OP_MUL]   = ASSOC_L,
+    [OP_POS]   = ASSOC_R,
+    [OP_NEG]   = ASSOC_R,
+    [ASSIGN]   = 0,
+    [BIGNUM]   = 0,
 };
 
 #define ASSOC(token) associativity[(token).type]
 
+// arbitrary-precision integer, defined in bignum.h
+typedef struct bignum bignum_t;
+
 typedef struct {
     token_type type;
-    int32_t value;   // only used for literals
-    int32_t offset;  // offset from start of input string, used for errors
+    union {
+        // literal value, or the slot of a variable in its symbol table (-1
+        // until resolved, see symtab_resolve)
+        int64_t value;
+        // BIGNUM: the value, owned by the context it was computed in
+        const bignum_t* big;
+    };
+    int64_t offset;  // offset from start of input string, used for errors
 } token_t;
 
+/*
+ * get the value of a digit in any radix up to 16
+ *
+ * @iparam c := character
+ * @returns the value of the digit, or 16 if c is not a digit
+ */
+static inline int lex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    char lower = (char) (c | 0x20);
+    return lower >= 'a' && lower <= 'f' ? lower - 'a' + 10 : 16;
+}
+
+/*
+ * get the radix selected by the letter of a literal prefix following a 0
+ *
+ * @iparam c := character
+ * @returns 16 for x, 8 for o, 2 for b, in either case, otherwise 0
+ */
+static inline int lex_prefix_radix(char c)
+{
+    char lower = (char) (c | 0x20);
+    return lower == 'x' ? 16 : lower == 'o' ? 8 : lower == 'b' ? 2 : 0;
+}
+
+// diagnostic record filled in when a stage fails, defined in error.h
+typedef struct diag diag_t;
+
+// implementations of tokenize_n, the fastest one supported by the processor
+// is selected at runtime, see lex_detect_kernel
+typedef enum {
+    // one character at a time, see lex_next
+    LEX_BYTEWISE,
+    // the input is first classified into bitmasks of whitespace and of name
+    // characters (including digits) 64 characters at a time, by vector
+    // compares; token starts and ends are then found with bit scans, and only
+    // the first character of each token is looked up to tell operators,
+    // literals and names apart
+    //
+    // these only lex single expressions, which are under MAX_INPUT_LEN long;
+    // --stream lexes unbounded inputs a character at a time with its own
+    // state machine, as its tokens span the chunks it reads
+    LEX_SSE2,
+    LEX_AVX2,
+    N_LEX_KERNELS
+} lex_kernel;
+
 /*
  * initialize a token (not a literal) with a given type and offset
  *
@@ -98,7 +194,7 @@ typedef struct {
  * @iparam type := token_type for the token
  * @iparam offset := offset into the input string
  */
-void init_token(token_t* token, token_type type, int32_t offset);
+void init_token(token_t* token, token_type type, int64_t offset);
 
 /*
  * initialize a literal with a given value and offset
@@ -107,15 +203,139 @@ void init_token(token_t* token, token_type type, int32_t offset);
  * @iparam value := integer value for the literal
  * @iparam offset := offset into the input string
  */
-void init_literal(token_t* token, int32_t value, int32_t offset);
+void init_literal(token_t* token, int64_t value, int64_t offset);
+
+/*
+ * lex the next token of an input slice, skipping leading whitespace; + and -
+ * are always lexed as binary operators, see tokenize_n for how unary
+ * operators are recognized
+ *
+ * @iparam input := start of the input slice, token offsets are relative to it
+ * @iparam it := position to lex from, advanced past the token
+ * @iparam end := end of the input slice
+ * @oparam token := lexed token; an invalid token only has its offset set, and
+ *                  its type is LITERAL for a literal out of range, otherwise
+ *                  INVALID
+ * @returns 1 if a token was lexed, 0 at the end of the input, or -1 if the
+ *          input at the token offset is not a valid token
+ */
+int lex_next(
+    const char* input, const char** it, const char* end, token_t* token);
+
+/*
+ * parse the integer literal at the start of an input slice: decimal digits,
+ * or hexadecimal, octal or binary digits following a 0x, 0o or 0b prefix;
+ * single underscores may separate digits; a prefix or underscore which is not
+ * followed by a digit is not part of the literal
+ *
+ * @iparam c := start of the literal
+ * @iparam end := end of the input slice
+ * @oparam value := value of the literal, INT64_MIN for LEX_LIT_MIN_MAGNITUDE
+ * @returns the length of the literal, 0 if c does not start a literal, or -1
+ *          if the value exceeds LEX_LIT_MIN_MAGNITUDE
+ */
+int64_t lex_literal(const char* c, const char* end, int64_t* value);
+
+/*
+ * accept a literal of magnitude LEX_LIT_MIN_MAGNITUDE if it is negated, by
+ * turning the unary minus before it into a unary plus, so that its value is
+ * INT64_MIN; any other literal is left alone
+ *
+ * @iparam prev := token before the literal, NULL if it is the first token
+ * @iparam token := literal
+ * @returns 0 if the literal is valid, -1 if it is out of range
+ */
+int lex_fold_min_literal(token_t* prev, const token_t* token);
+
+/*
+ * get the length of the variable name at the start of an input slice
+ *
+ * @iparam c := start of the name
+ * @iparam end := end of the input slice
+ * @returns the length of the name, 0 if c does not start a name
+ */
+size_t lex_name(const char* c, const char* end);
+
+/*
+ * recognize an assignment statement "name = expression"
+ *
+ * @iparam input := start of the input slice
+ * @iparam len := length of the input slice
+ * @oparam name := offset of the variable name
+ * @oparam name_len := length of the variable name
+ * @returns the offset of the expression following "=", or 0 if the input is
+ *          not an assignment statement
+ */
+size_t lex_assignment(
+    const char* input, size_t len, size_t* name, size_t* name_len);
 
 /*
  * splits an input string into tokens
  *
+ * @iparam ctx := evaluation context, owns the returned array
  * @iparam input := input string
- * @oparam n_tokens := length of the returned array
+ * @oparam n_tokens := length of the returned array, or -1 on error
+ * @oparam diag := filled in with the error details if tokenization fails
+ * @returns an array of tokens
+ */
+token_t* tokenize(
+    ctx_t* ctx, const char* input, int32_t* n_tokens, diag_t* diag);
+
+/*
+ * get the name of a lexer implementation
+ *
+ * @iparam kernel := lexer implementation
+ * @returns "bytewise", "sse2" or "avx2"
+ */
+const char* lex_kernel_name(lex_kernel kernel);
+
+/*
+ * check whether the processor supports a lexer implementation
+ *
+ * @iparam kernel := lexer implementation
+ * @returns 1 if the implementation can run, otherwise 0
+ */
+int lex_kernel_supported(lex_kernel kernel);
+
+/*
+ * get the fastest lexer implementation supported by the processor;
+ * tokenize_n calls this once and keeps the result
+ *
+ * @returns the lexer implementation
+ */
+lex_kernel lex_detect_kernel(void);
+
+/*
+ * splits a length-delimited input slice into tokens; the slice does not need to
+ * be NUL-terminated, so lines can be tokenized in place (e.g. from a memory
+ * mapped file) without being copied
+ *
+ * @iparam ctx := evaluation context, owns the returned array
+ * @iparam input := start of the input slice
+ * @iparam len := length of the input slice
+ * @oparam n_tokens := length of the returned array, or -1 on error
+ * @oparam diag := filled in with the error details if tokenization fails
+ * @returns an array of tokens
+ */
+token_t* tokenize_n(
+    ctx_t* ctx, const char* input, size_t len, int32_t* n_tokens,
+    diag_t* diag);
+
+/*
+ * splits a length-delimited input slice into tokens with a given lexer
+ * implementation; every implementation returns the same tokens and
+ * diagnostics as the others
+ *
+ * @iparam ctx := evaluation context, owns the returned array
+ * @iparam input := start of the input slice
+ * @iparam len := length of the input slice
+ * @iparam kernel := lexer implementation, must be supported
+ * @oparam n_tokens := length of the returned array, or -1 on error
+ * @oparam diag := filled in with the error details if tokenization fails
  * @returns an array of tokens
  */
-token_t* tokenize(const char* input, int32_t* n_tokens);
+token_t* tokenize_kernel(
+    ctx_t* ctx, const char* input, size_t len, lex_kernel kernel,
+    int32_t* n_tokens, diag_t* diag);
 
 #endif
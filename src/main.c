@@ -4,97 +4,505 @@
  * author: Ian Brault <ian.brault@engineering.ucla.edu>
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include <batch.h>
+#include <bench.h>
+#include <check.h>
+#include <columns.h>
+#include <emit.h>
+#include <engine.h>
 #include <error.h>
-#include <eval.h>
 #include <lex.h>
+#include <serve.h>
+#include <sheet.h>
+#include <shm.h>
+#include <stream.h>
+#include <writer.h>
 
-int eval_expr(token_t* expr, int32_t n_tokens, token_t* result)
+// parse the argument to --cache, returns 0 if it is not a positive number
+static size_t parse_cache(const char* arg)
 {
-    int rc = 0;
-    // convert infix expression to Reverse Polish (postfix) notation
-    int32_t n_rpn;
-    token_t* rpn = shunting_yard(expr, n_tokens, &n_rpn);
-    if (n_rpn < 0)
+    char* end;
+    long n = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || n < 1)
     {
-        rc = n_rpn;
+        eprintf("--cache: expected a positive number of expressions\n");
+        return 0;
     }
-    else
+    return n;
+}
+
+// parse the argument to -j, 0 selects the number of online processors
+static int parse_threads(const char* arg)
+{
+    char* end;
+    long n = strtol(arg, &end, 10);
+    if (*end || n < 0 || n > BATCH_MAX_THREADS)
+    {
+        return -1;
+    }
+    if (n == 0)
     {
-        // evaluate postfix expression
-        rc = evaluate_rpn(rpn, n_rpn, result);
-        free(rpn);
+        // sysconf fails with -1
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+        n = n < 1 ? 1 : n > BATCH_MAX_THREADS ? BATCH_MAX_THREADS : n;
     }
+    return n;
+}
 
-    return rc;
+// parse the argument to --obase, returns 0 if it is not a supported base
+static int parse_obase(const char* arg)
+{
+    char* end;
+    long base = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || base < 2 || base > 16
+        || !writer_base_supported(base))
+    {
+        eprintf("--obase: expected 2, 8, 10 or 16\n");
+        return 0;
+    }
+    return base;
 }
 
-void repl()
+// check that a mode prints its results in the output base
+static int obase_supported(const char* mode)
+{
+    // these modes print something other than results, or results in a
+    // format of their own
+    static const char* const decimal_modes[] = {
+        "--bench", "--jit-check", "--emit-c", "--columns", "--sheet",
+        "--serve", "--shm", "--shm-client",
+    };
+    size_t n_modes = sizeof(decimal_modes) / sizeof(decimal_modes[0]);
+    for (size_t i = 0; i < n_modes; i++)
+    {
+        if (!strcmp(mode, decimal_modes[i]))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// look up the aggregate selected by a batch flag, 0 if it is not one
+static int parse_agg_flag(const char* arg)
+{
+    static const struct {
+        const char* name;
+        int flag;
+    } flags[] = {
+        { "--sum",          BATCH_AGG_SUM },
+        { "--min",          BATCH_AGG_MIN },
+        { "--max",          BATCH_AGG_MAX },
+        { "--count-errors", BATCH_AGG_ERRORS },
+    };
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        if (!strcmp(arg, flags[i].name))
+        {
+            return flags[i].flag;
+        }
+    }
+    return 0;
+}
+
+/*
+ * parse the argument to --histogram, a comma-separated list of ascending
+ * bounds between buckets; returns the number of bounds, or -1 if invalid
+ */
+static int32_t parse_histogram(const char* arg, int64_t** bounds)
+{
+    int32_t n = 1;
+    for (const char* c = arg; *c; c++)
+    {
+        n += *c == ',';
+    }
+    *bounds = malloc(n * sizeof(int64_t));
+    if (!*bounds)
+    {
+        eprintf("--histogram: out of memory\n");
+        return -1;
+    }
+    const char* it = arg;
+    for (int32_t i = 0; i < n; i++)
+    {
+        char* end;
+        errno = 0;
+        long long bound = strtoll(it, &end, 10);
+        if (end == it || (*end != ',' && *end != '\0') || errno == ERANGE
+            || (i > 0 && bound <= (*bounds)[i - 1]))
+        {
+            eprintf(
+                "--histogram: expected ascending comma-separated integers\n");
+            free(*bounds);
+            return -1;
+        }
+        (*bounds)[i] = bound;
+        it = end + 1;
+    }
+    return n;
+}
+
+static int repl(int obase)
 {
     const char* prompt = "\033[1;33m>\033[1;32m>\033[1;34m>\033[0m ";
     char input[MAX_INPUT_LEN];
+    // each result goes out along with the next prompt, in a single write
+    writer_t out;
+    if (writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE))
+    {
+        eprintf("failed to allocate output buffer\n");
+        return EXIT_FAILURE;
+    }
+    out.base = obase;
+    // the engine is reused across inputs so that its arena only grows to fit
+    // the largest expression seen, and so that variables persist
+    engine_t e;
+    engine_init(&e, ENGINE_PIPELINE);
     // main REPL loop
     while (1)
     {
-        printf("\n%s", prompt);
+        writer_putc(&out, '\n');
+        writer_puts(&out, prompt);
+        writer_flush(&out);
         if (!fgets(input, MAX_INPUT_LEN, stdin))
         {
             break;
         }
-        // lex input string into tokens
-        int32_t n_tokens;
-        token_t* tokens = tokenize(input, &n_tokens);
-        if (n_tokens < 0)
-        {
-            print_err(n_tokens, tokens);
-        }
-
-        // evaluate input
+        // evaluate input, skipping blank lines
         token_t result;
-        int rc = eval_expr(tokens, n_tokens, &result);
+        diag_t diag;
+        int rc = engine_eval(&e, input, strlen(input), &result, &diag);
         if (rc < 0)
         {
-            print_err(rc, tokens);
+            print_err(&diag);
         }
-        else
+        else if (rc == 0)
         {
-            printf("%d\n", result.value);
+            writer_put_value(&out, &result);
+            writer_putc(&out, '\n');
         }
-        free(tokens);
     }
+    engine_free(&e);
+    writer_free(&out);
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char* argv[])
 {
+    // the output base is given ahead of the mode, or among the options of
+    // the modes which take any
+    int obase = 10;
+    if (argc > 2 && !strcmp(argv[1], "--obase"))
+    {
+        obase = parse_obase(argv[2]);
+        if (!obase)
+        {
+            return EXIT_FAILURE;
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+        if (argc > 1 && !obase_supported(argv[1]))
+        {
+            eprintf("--obase: not supported with %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
     if (argc <= 1)
     {
-        repl();
+        return repl(obase);
     }
-    else
+    else if (!strcmp(argv[1], "--batch"))
     {
-        // lex input string into tokens
-        int32_t n_tokens;
-        token_t* tokens = tokenize(argv[1], &n_tokens);
-        if (n_tokens < 0)
+        int n_threads = 1;
+        int engine = ENGINE_PIPELINE;
+        size_t cache_capacity = 0;
+        int agg_which = 0;
+        int64_t* bounds = NULL;
+        int32_t n_bounds = 0;
+        int argi = 2;
+        while (argi < argc)
         {
-            print_err(n_tokens, tokens);
+            int flag = parse_agg_flag(argv[argi]);
+            if (flag)
+            {
+                agg_which |= flag;
+                argi++;
+                continue;
+            }
+            if (argi + 1 >= argc)
+            {
+                break;
+            }
+            if (!strcmp(argv[argi], "--histogram"))
+            {
+                free(bounds);
+                n_bounds = parse_histogram(argv[argi + 1], &bounds);
+                if (n_bounds < 0)
+                {
+                    return EXIT_FAILURE;
+                }
+                agg_which |= BATCH_AGG_HISTOGRAM;
+            }
+            else if (!strcmp(argv[argi], "-j"))
+            {
+                n_threads = parse_threads(argv[argi + 1]);
+                if (n_threads < 1)
+                {
+                    eprintf("-j: expected a positive number of threads\n");
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[argi], "--engine"))
+            {
+                engine = engine_from_name(argv[argi + 1]);
+                if (engine < 0)
+                {
+                    eprintf(
+                        "--engine: unknown engine \"%s\"\n", argv[argi + 1]);
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[argi], "--cache"))
+            {
+                cache_capacity = parse_cache(argv[argi + 1]);
+                if (!cache_capacity)
+                {
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[argi], "--obase"))
+            {
+                obase = parse_obase(argv[argi + 1]);
+                if (!obase)
+                {
+                    return EXIT_FAILURE;
+                }
+            }
+            else
+            {
+                break;
+            }
+            argi += 2;
+        }
+        batch_agg_t agg;
+        if (agg_which && batch_agg_init(&agg, agg_which, bounds, n_bounds))
+        {
+            eprintf("out of memory\n");
             return EXIT_FAILURE;
         }
-
-        // evaluate input
+        int status = batch_main(
+            argc - argi, argv + argi, n_threads, engine, cache_capacity,
+            obase, agg_which ? &agg : NULL);
+        if (agg_which)
+        {
+            batch_agg_free(&agg);
+        }
+        free(bounds);
+        return status;
+    }
+    else if (!strcmp(argv[1], "--bench"))
+    {
+        long n_iters = BENCH_DEFAULT_ITERS;
+        int argi = 2;
+        if (argi + 1 < argc && !strcmp(argv[argi], "-n"))
+        {
+            n_iters = strtol(argv[argi + 1], NULL, 10);
+            argi += 2;
+        }
+        if (argi >= argc || n_iters < 1)
+        {
+            eprintf("--bench: expected [-n ITERATIONS] EXPRESSION\n");
+            return EXIT_FAILURE;
+        }
+        return bench_main(argv[argi], n_iters);
+    }
+    else if (!strcmp(argv[1], "--jit-check"))
+    {
+        long n_exprs = CHECK_DEFAULT_EXPRS;
+        unsigned long seed = 1;
+        int argi = 2;
+        for (; argi + 1 < argc; argi += 2)
+        {
+            if (!strcmp(argv[argi], "-n"))
+            {
+                n_exprs = strtol(argv[argi + 1], NULL, 10);
+            }
+            else if (!strcmp(argv[argi], "-s"))
+            {
+                seed = strtoul(argv[argi + 1], NULL, 10);
+            }
+            else
+            {
+                break;
+            }
+        }
+        if (argi < argc || n_exprs < 1)
+        {
+            eprintf("--jit-check: expected [-n EXPRESSIONS] [-s SEED]\n");
+            return EXIT_FAILURE;
+        }
+        return check_jit_main(n_exprs, seed);
+    }
+    else if (!strcmp(argv[1], "--emit-c"))
+    {
+        int argi = 2;
+        int fold = 1;
+        if (argi < argc && !strcmp(argv[argi], "--no-fold"))
+        {
+            fold = 0;
+            argi++;
+        }
+        if (argi + 1 < argc && !strcmp(argv[argi], "--batch"))
+        {
+            return emit_batch_main(
+                argv[argi + 1], argc - argi - 2, argv + argi + 2, fold);
+        }
+        if (argi + 2 != argc)
+        {
+            eprintf(
+                "--emit-c: expected [--no-fold] NAME EXPRESSION"
+                " or [--no-fold] --batch PREFIX [FILES]\n");
+            return EXIT_FAILURE;
+        }
+        return emit_main(argv[argi], argv[argi + 1], fold);
+    }
+    else if (!strcmp(argv[1], "--stream"))
+    {
+        int argi = 2;
+        while (argi + 1 < argc && !strcmp(argv[argi], "--obase"))
+        {
+            obase = parse_obase(argv[argi + 1]);
+            if (!obase)
+            {
+                return EXIT_FAILURE;
+            }
+            argi += 2;
+        }
+        return stream_main(argc - argi, argv + argi, obase);
+    }
+    else if (!strcmp(argv[1], "--columns"))
+    {
+        int isa = -1;
+        const char* out_path = NULL;
+        int argi = 2;
+        while (argi + 1 < argc)
+        {
+            if (!strcmp(argv[argi], "--isa"))
+            {
+                isa = columns_isa_from_name(argv[argi + 1]);
+                if (isa < 0 || !columns_isa_supported(isa))
+                {
+                    eprintf(
+                        "--isa: \"%s\" is not supported\n", argv[argi + 1]);
+                    return EXIT_FAILURE;
+                }
+            }
+            else if (!strcmp(argv[argi], "-o"))
+            {
+                out_path = argv[argi + 1];
+            }
+            else
+            {
+                break;
+            }
+            argi += 2;
+        }
+        if (argc - argi < 2)
+        {
+            eprintf(
+                "--columns: expected [--isa ISA] [-o FILE] SOURCES"
+                " EXPRESSION\n");
+            return EXIT_FAILURE;
+        }
+        return columns_main(
+            argc - argi - 1, argv + argi, argv[argc - 1], isa, out_path);
+    }
+    else if (!strcmp(argv[1], "--sheet"))
+    {
+        if (argc != 3)
+        {
+            eprintf("--sheet: expected a sheet file\n");
+            return EXIT_FAILURE;
+        }
+        return sheet_main(argv[2]);
+    }
+    else if (!strcmp(argv[1], "--serve"))
+    {
+        size_t cache_capacity = 0;
+        int argi = 2;
+        if (argi + 1 < argc && !strcmp(argv[argi], "--cache"))
+        {
+            cache_capacity = parse_cache(argv[argi + 1]);
+            if (!cache_capacity)
+            {
+                return EXIT_FAILURE;
+            }
+            argi += 2;
+        }
+        if (argi >= argc)
+        {
+            eprintf("--serve: expected [--cache N] SOCKET\n");
+            return EXIT_FAILURE;
+        }
+        return serve_main(argv[argi], cache_capacity);
+    }
+    else if (!strcmp(argv[1], "--shm") || !strcmp(argv[1], "--shm-client"))
+    {
+        if (argc < 3)
+        {
+            eprintf("%s: expected a shared memory name\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        return !strcmp(argv[1], "--shm")
+            ? shm_worker_main(argv[2])
+            : shm_client_main(argv[2]);
+    }
+    else
+    {
+        engine_t e;
+        engine_init(&e, ENGINE_PIPELINE);
         token_t result;
-        int rc = eval_expr(tokens, n_tokens, &result);
-        if (rc < 0)
+        diag_t diag;
+        int rc = engine_eval(&e, argv[1], strlen(argv[1]), &result, &diag);
+        // unlike the REPL, a blank expression is an error
+        if (rc > 0)
         {
-            print_err(rc, tokens);
+            set_diag(&diag, E_EMPTY_EXPR, NULL, -1, 0);
+        }
+        if (rc)
+        {
+            print_err(&diag);
+            engine_free(&e);
             return EXIT_FAILURE;
         }
 
-        printf("%d\n", result.value);
-        free(tokens);
+        // a bignum result lives in the engine's context
+        writer_t out;
+        if (writer_init(&out, STDOUT_FILENO, WRITER_INT_LEN + 1))
+        {
+            eprintf("failed to allocate output buffer\n");
+            engine_free(&e);
+            return EXIT_FAILURE;
+        }
+        out.base = obase;
+        writer_put_value(&out, &result);
+        writer_putc(&out, '\n');
+        engine_free(&e);
+        if (writer_free(&out))
+        {
+            return EXIT_FAILURE;
+        }
     }
 
     return EXIT_SUCCESS;
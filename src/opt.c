@@ -0,0 +1,288 @@
+/*
+ * src/opt.c
+ * simplification pass over expressions in Reverse Polish notation
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <eval.h>
+#include <opt.h>
+
+// a binary operator creates at most three nodes (a negated literal, a
+// combined literal, and the operator itself) and consumes at least one
+// literal, so the tree never needs more than two nodes per RPN token
+#define OPT_NODES_PER_TOKEN 2
+
+// expression tree node
+typedef struct {
+    token_t token;
+    int32_t lhs;  // operand node indices, -1 if absent
+    int32_t rhs;
+} opt_node_t;
+
+typedef struct {
+    opt_node_t* nodes;
+    int32_t n_nodes;
+    int32_t max_nodes;
+} opt_t;
+
+/*
+ * combine two literals, as in eval.c; returns 0 if the result overflows 64
+ * bits, in which case the operator is kept for the evaluator to promote
+ */
+static int opt_fold(token_type type, int64_t x, int64_t y, int64_t* value)
+{
+    switch (type)
+    {
+    case OP_ADD:
+        return !__builtin_add_overflow(x, y, value);
+    case OP_SUB:
+        return !__builtin_sub_overflow(x, y, value);
+    default:
+        return !__builtin_mul_overflow(x, y, value);
+    }
+}
+
+#define OPT_IS_LITERAL(o, i) IS_LITERAL((o)->nodes[i].token)
+#define OPT_VALUE(o, i) ((o)->nodes[i].token.value)
+#define OPT_TYPE(o, i) ((o)->nodes[i].token.type)
+
+static int32_t opt_node(opt_t* o, token_type type, int64_t value,
+    int64_t offset, int32_t lhs, int32_t rhs)
+{
+    if (o->n_nodes == o->max_nodes)
+    {
+        return -1;
+    }
+    opt_node_t* node = &o->nodes[o->n_nodes];
+    node->token = (token_t) { .type=type, .value=value, .offset=offset };
+    node->lhs = lhs;
+    node->rhs = rhs;
+    return o->n_nodes++;
+}
+
+static int32_t opt_literal(opt_t* o, int64_t value, int64_t offset)
+{
+    return opt_node(o, LITERAL, value, offset, -1, -1);
+}
+
+static int32_t opt_unary(opt_t* o, token_type type, int64_t offset, int32_t x)
+{
+    if (x < 0 || type == OP_POS)
+    {
+        return x;
+    }
+    // -c
+    int64_t value;
+    if (OPT_IS_LITERAL(o, x) && opt_fold(OP_SUB, 0, OPT_VALUE(o, x), &value))
+    {
+        return opt_literal(o, value, offset);
+    }
+    // -(-x) = x
+    if (OPT_TYPE(o, x) == OP_NEG)
+    {
+        return o->nodes[x].lhs;
+    }
+    return opt_node(o, OP_NEG, 0, offset, x, -1);
+}
+
+static int32_t opt_binary(
+    opt_t* o, token_type type, int64_t offset, int32_t a, int32_t b)
+{
+    if (a < 0 || b < 0)
+    {
+        return -1;
+    }
+    int64_t value;
+    if (OPT_IS_LITERAL(o, a) && OPT_IS_LITERAL(o, b))
+    {
+        if (opt_fold(type, OPT_VALUE(o, a), OPT_VALUE(o, b), &value))
+        {
+            return opt_literal(o, value, offset);
+        }
+        return opt_node(o, type, 0, offset, a, b);
+    }
+
+    if (type == OP_SUB)
+    {
+        // 0 - x = -x
+        if (OPT_IS_LITERAL(o, a) && OPT_VALUE(o, a) == 0)
+        {
+            return opt_unary(o, OP_NEG, offset, b);
+        }
+        // x - c = x + -c, so that literal runs can be reassociated
+        if (OPT_IS_LITERAL(o, b)
+            && opt_fold(OP_SUB, 0, OPT_VALUE(o, b), &value))
+        {
+            int32_t c = opt_literal(o, value, offset);
+            return opt_binary(o, OP_ADD, offset, a, c);
+        }
+        // x - -y = x + y
+        if (OPT_TYPE(o, b) == OP_NEG)
+        {
+            return opt_binary(o, OP_ADD, offset, a, o->nodes[b].lhs);
+        }
+        return opt_node(o, OP_SUB, 0, offset, a, b);
+    }
+
+    // + and * commute, keep literal operands on the right
+    if (OPT_IS_LITERAL(o, a))
+    {
+        int32_t tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    if (type == OP_ADD)
+    {
+        // x + -y = x - y
+        if (OPT_TYPE(o, b) == OP_NEG)
+        {
+            return opt_binary(o, OP_SUB, offset, a, o->nodes[b].lhs);
+        }
+        if (OPT_TYPE(o, a) == OP_NEG && !OPT_IS_LITERAL(o, b))
+        {
+            return opt_binary(o, OP_SUB, offset, b, o->nodes[a].lhs);
+        }
+        if (OPT_IS_LITERAL(o, b))
+        {
+            int64_t c = OPT_VALUE(o, b);
+            // x + 0 = x
+            if (c == 0)
+            {
+                return a;
+            }
+            // (x + c) + d = x + (c + d)
+            if (OPT_TYPE(o, a) == OP_ADD
+                && OPT_IS_LITERAL(o, o->nodes[a].rhs)
+                && opt_fold(OP_ADD, c, OPT_VALUE(o, o->nodes[a].rhs), &value))
+            {
+                int32_t cd = opt_literal(o, value, offset);
+                return opt_binary(o, OP_ADD, offset, o->nodes[a].lhs, cd);
+            }
+        }
+    }
+    else if (OPT_IS_LITERAL(o, b))
+    {
+        int64_t c = OPT_VALUE(o, b);
+        // x * 0 = 0, x * 1 = x, x * -1 = -x
+        if (c == 0)
+        {
+            return b;
+        }
+        if (c == 1)
+        {
+            return a;
+        }
+        if (c == -1)
+        {
+            return opt_unary(o, OP_NEG, offset, a);
+        }
+        // (x * c) * d = x * (c * d)
+        if (OPT_TYPE(o, a) == OP_MUL && OPT_IS_LITERAL(o, o->nodes[a].rhs)
+            && opt_fold(OP_MUL, c, OPT_VALUE(o, o->nodes[a].rhs), &value))
+        {
+            int32_t cd = opt_literal(o, value, offset);
+            return opt_binary(o, OP_MUL, offset, o->nodes[a].lhs, cd);
+        }
+        // -x * c = x * -c
+        if (OPT_TYPE(o, a) == OP_NEG && opt_fold(OP_SUB, 0, c, &value))
+        {
+            int32_t nc = opt_literal(o, value, offset);
+            return opt_binary(o, OP_MUL, offset, o->nodes[a].lhs, nc);
+        }
+    }
+    return opt_node(o, type, 0, offset, a, b);
+}
+
+// write the subtree rooted at node i in postfix order
+static void opt_emit(const opt_t* o, int32_t i, token_t* out, int32_t* n_out)
+{
+    const opt_node_t* node = &o->nodes[i];
+    if (node->lhs >= 0)
+    {
+        opt_emit(o, node->lhs, out, n_out);
+    }
+    if (node->rhs >= 0)
+    {
+        opt_emit(o, node->rhs, out, n_out);
+    }
+    out[(*n_out)++] = node->token;
+}
+
+size_t optimize_scratch_size(int32_t n_rpn)
+{
+    return (size_t) n_rpn * OPT_NODES_PER_TOKEN * sizeof(opt_node_t)
+        + (size_t) n_rpn * sizeof(int32_t);
+}
+
+token_t* optimize_rpn(
+    ctx_t* ctx, const token_t* rpn, int32_t n_rpn, int32_t* n_out,
+    diag_t* diag)
+{
+    *n_out = -1;
+    token_t* out = ctx_alloc(ctx, n_rpn * sizeof(token_t));
+    size_t mark = ctx_mark(ctx);
+    opt_t o = {
+        .nodes=ctx_alloc(ctx, n_rpn * OPT_NODES_PER_TOKEN * sizeof(opt_node_t)),
+        .n_nodes=0,
+        .max_nodes=n_rpn * OPT_NODES_PER_TOKEN,
+    };
+    int32_t* stack = ctx_alloc(ctx, n_rpn * sizeof(int32_t));
+    if (!out || !o.nodes || !stack)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return NULL;
+    }
+    int32_t n_stack = 0;
+
+    for (int32_t n = 0; n < n_rpn; n++)
+    {
+        const token_t* t = &rpn[n];
+        int32_t node;
+        if (IS_OPERATOR(*t))
+        {
+            // not enough operands on the stack, see eval.c:evaluate_rpn
+            if (n_stack < ARITY(*t))
+            {
+                set_diag(diag, E_OP_MISSING_EXPR, t, n, SIDE_RIGHT);
+                ctx_release(ctx, mark);
+                return NULL;
+            }
+            if (ARITY(*t) == 2)
+            {
+                int32_t b = STACK_POP(stack, n_stack);
+                int32_t a = STACK_POP(stack, n_stack);
+                node = opt_binary(&o, t->type, t->offset, a, b);
+            }
+            else
+            {
+                int32_t a = STACK_POP(stack, n_stack);
+                node = opt_unary(&o, t->type, t->offset, a);
+            }
+        }
+        else
+        {
+            node = opt_node(&o, t->type, t->value, t->offset, -1, -1);
+        }
+        if (node < 0)
+        {
+            set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+            ctx_release(ctx, mark);
+            return NULL;
+        }
+        STACK_PUSH(stack, n_stack, node);
+    }
+    if (!n_stack)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        ctx_release(ctx, mark);
+        return NULL;
+    }
+
+    // the result is the last value pushed, as in evaluate_rpn
+    *n_out = 0;
+    opt_emit(&o, stack[n_stack - 1], out, n_out);
+    ctx_release(ctx, mark);
+    return out;
+}
@@ -0,0 +1,46 @@
+/*
+ * src/opt.h
+ * simplification pass over expressions in Reverse Polish notation
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef OPT_H
+#define OPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+
+/*
+ * simplify an expression in Reverse Polish notation: constant subexpressions
+ * are folded, identities (x + 0, x * 1, ...) and annihilators (x * 0) are
+ * removed, chained unary operators are collapsed, and runs of literals under
+ * + and * are reassociated into a single literal; literals are only combined
+ * when the result fits in 64 bits, and the evaluator's arithmetic is exact, so
+ * results are identical to the unoptimized expression
+ *
+ * @iparam ctx := evaluation context, provides memory for the result and
+ *                optimize_scratch_size bytes of scratch released on return
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @oparam n_out := length of the optimized RPN array, at most n_rpn;
+ *                  n_rpn - n_out is the number of nodes removed
+ * @oparam diag := filled in with the error details if the expression is
+ *                 invalid; the errors are the same ones evaluate_rpn reports
+ * @returns the optimized RPN array, NULL on error
+ */
+token_t* optimize_rpn(
+    ctx_t* ctx, const token_t* rpn, int32_t n_rpn, int32_t* n_out,
+    diag_t* diag);
+
+/*
+ * @iparam n_rpn := length of RPN array
+ * @returns the scratch memory used by optimize_rpn, excluding its result
+ */
+size_t optimize_scratch_size(int32_t n_rpn);
+
+#endif
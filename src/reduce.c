@@ -0,0 +1,413 @@
+/*
+ * src/reduce.c
+ * incremental shunting-yard reducer which evaluates operators as soon as they
+ * are popped from the operator stack
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <bignum.h>
+#include <error.h>
+#include <eval.h>
+#include <reduce.h>
+
+void reduce_init(reduce_t* r)
+{
+    *r = (reduce_t) { .prev_type=INVALID, .err_rank=RANK_NONE };
+}
+
+static void reduce_reset(reduce_t* r)
+{
+    r->has_pending = 0;
+    r->prev_type = INVALID;
+    r->n_tokens = 0;
+    r->n_ops = 0;
+    r->n_vals = 0;
+    r->literal_was_prev = 0;
+    r->err_rank = RANK_NONE;
+}
+
+/*
+ * record an error if it outranks the current one; token indices are ordinals
+ * within the expression, matching the token array seen by shunting_yard, and
+ * are -1 where the pipeline reports an index into a different array
+ */
+static void reduce_error(
+    reduce_t* r, reduce_rank rank, err_kind kind, const token_t* token,
+    int64_t index, uint8_t side)
+{
+    if (rank > r->err_rank)
+    {
+        set_diag(&r->err, kind, token, index, side);
+        r->err_rank = rank;
+    }
+}
+
+// push onto a stack, growing it if needed
+static int reduce_push(token_t** stack, size_t* n, size_t* size, token_t token)
+{
+    if (*n == *size)
+    {
+        size_t new_size = *size ? 2 * *size : REDUCE_INIT_DEPTH;
+        token_t* tmp = realloc(*stack, new_size * sizeof(token_t));
+        if (!tmp)
+        {
+            return -1;
+        }
+        *stack = tmp;
+        *size = new_size;
+    }
+    (*stack)[(*n)++] = token;
+
+    return 0;
+}
+
+/*
+ * move a result down over the bignums of the operands it replaces; bignums are
+ * only allocated for values on the stack, in stack order, so these are the
+ * last allocations of the context, and memory grows with the nesting depth of
+ * the expression rather than with its length
+ */
+static void reduce_reclaim(
+    reduce_t* r, const token_t* a, const token_t* b, token_t* res)
+{
+    const bignum_t* lowest = a->type == BIGNUM ? a->big
+        : b && b->type == BIGNUM ? b->big : NULL;
+    size_t mark;
+    if (!lowest || ctx_mark_of(r->ctx, lowest, &mark))
+    {
+        return;
+    }
+    // a result in an overflow block is left there, one in the region was
+    // allocated after the operands and so fits where they start
+    size_t res_mark;
+    if (res->type != BIGNUM || ctx_mark_of(r->ctx, res->big, &res_mark))
+    {
+        ctx_release(r->ctx, mark);
+        return;
+    }
+    size_t size = bignum_size(res->big);
+    const bignum_t* big = res->big;
+    ctx_release(r->ctx, mark);
+    bignum_t* moved = ctx_alloc(r->ctx, size);
+    memmove(moved, big, size);
+    res->big = moved;
+}
+
+// evaluate an operator as it leaves the operator stack
+static void reduce_apply(reduce_t* r, token_t op)
+{
+    // once evaluation has failed, only syntax errors are still looked for
+    if (r->err_rank >= RANK_EVAL)
+    {
+        return;
+    }
+    if ((size_t) ARITY(op) > r->n_vals)
+    {
+        reduce_error(r, RANK_EVAL, E_OP_MISSING_EXPR, &op, -1, SIDE_RIGHT);
+        return;
+    }
+
+    int rc;
+    if (ARITY(op) == 1)
+    {
+        token_t* val = &r->vals[r->n_vals - 1];
+        token_t operand = *val;
+        rc = OP_UN(op)(r->ctx, &operand, val);
+        if (!rc)
+        {
+            reduce_reclaim(r, &operand, NULL, val);
+        }
+    }
+    else
+    {
+        token_t op2 = STACK_POP(r->vals, r->n_vals);
+        token_t* val = &r->vals[r->n_vals - 1];
+        token_t op1 = *val;
+        rc = OP_BIN(op)(r->ctx, &op1, &op2, val);
+        if (!rc)
+        {
+            reduce_reclaim(r, &op1, &op2, val);
+        }
+    }
+    if (rc)
+    {
+        reduce_error(r, RANK_EVAL, E_NO_MEMORY, NULL, -1, 0);
+    }
+}
+
+// the shunting-yard step for a single token, see eval.c:shunting_yard
+static void reduce_shunt(reduce_t* r, token_t token)
+{
+    if (IS_OPERAND(token))
+    {
+        // operand cannot follow another operand
+        if (r->literal_was_prev)
+        {
+            reduce_error(
+                r, RANK_SCAN, E_INVALID_LIT_EXPR, &r->last, r->n_tokens - 2,
+                0);
+            return;
+        }
+        r->literal_was_prev = 1;
+        if (r->err_rank >= RANK_EVAL)
+        {
+            return;
+        }
+        // variables are looked up as they are pushed, which is when
+        // evaluate_rpn would look them up
+        if (IS_VARIABLE(token))
+        {
+            if (!symtab_defined(r->syms, &token))
+            {
+                reduce_error(r, RANK_EVAL, E_UNDEFINED_VAR, &token, -1, 0);
+                return;
+            }
+            init_literal(
+                &token, r->syms->values[token.value], token.offset);
+        }
+        if (reduce_push(&r->vals, &r->n_vals, &r->vals_size, token))
+        {
+            reduce_error(r, RANK_LEX, E_NO_MEMORY, NULL, -1, 0);
+        }
+    }
+    else if (IS_OPERATOR(token))
+    {
+        r->literal_was_prev = 0;
+        while (r->n_ops && (
+            PREC_GT(r->ops[r->n_ops - 1], token) || (
+                PREC_EQ(r->ops[r->n_ops - 1], token)
+                && ASSOC(r->ops[r->n_ops - 1]) == ASSOC_L))
+            && (r->ops[r->n_ops - 1].type != L_PAREN))
+        {
+            reduce_apply(r, STACK_POP(r->ops, r->n_ops));
+        }
+        if (reduce_push(&r->ops, &r->n_ops, &r->ops_size, token))
+        {
+            reduce_error(r, RANK_LEX, E_NO_MEMORY, NULL, -1, 0);
+        }
+    }
+    else if (token.type == L_PAREN)
+    {
+        // left parenthesis cannot follow another literal
+        if (r->literal_was_prev)
+        {
+            reduce_error(
+                r, RANK_SCAN, E_INVALID_LIT_EXPR, &r->last, r->n_tokens - 2,
+                0);
+            return;
+        }
+        if (reduce_push(&r->ops, &r->n_ops, &r->ops_size, token))
+        {
+            reduce_error(r, RANK_LEX, E_NO_MEMORY, NULL, -1, 0);
+        }
+    }
+    else if (token.type == ASSIGN)
+    {
+        reduce_error(
+            r, RANK_SCAN, E_INVALID_ASSIGN, &token, r->n_tokens - 1, 0);
+    }
+    else if (token.type == R_PAREN)
+    {
+        r->literal_was_prev = 0;
+        while (r->n_ops && r->ops[r->n_ops - 1].type != L_PAREN)
+        {
+            reduce_apply(r, STACK_POP(r->ops, r->n_ops));
+        }
+        if (r->n_ops)
+        {
+            r->n_ops--;
+        }
+        else
+        {
+            reduce_error(
+                r, RANK_SCAN, E_UNMATCHED_PAREN, &token, r->n_tokens - 1, 0);
+        }
+    }
+}
+
+// decide whether a +/- token is unary, see lex.c:add_unary_pos_neg_ops
+static void reduce_resolve_unary(reduce_t* r, token_t* token, token_t* next)
+{
+    if (token->type != OP_ADD && token->type != OP_SUB)
+    {
+        return;
+    }
+    int first = r->n_tokens == 0;
+    int after_op = arity[r->prev_type] == 2 || r->prev_type == L_PAREN
+        || r->prev_type == ASSIGN;
+    int before_operand = next && (IS_OPERAND(*next) || next->type == L_PAREN);
+    if (first || (after_op && before_operand))
+    {
+        token->type += N_BINARY_OPS;
+    }
+}
+
+// pass a token whose type is final on to the shunting-yard
+static void reduce_process(reduce_t* r, token_t token)
+{
+    // an operator at the start must be unary and right-associative
+    if (r->n_tokens == 0 && IS_OPERATOR(token)
+        && (ARITY(token) != 1 || ASSOC(token) != ASSOC_R))
+    {
+        reduce_error(r, RANK_FIRST, E_OP_MISSING_EXPR, &token, 0, SIDE_LEFT);
+    }
+    r->n_tokens++;
+    r->prev_type = token.type;
+
+    // conversion stops at the first syntax error
+    if (r->err_rank < RANK_SCAN)
+    {
+        reduce_shunt(r, token);
+    }
+    r->last = token;
+}
+
+void reduce_token(reduce_t* r, token_t token)
+{
+    if (r->err_rank == RANK_LEX)
+    {
+        return;
+    }
+    if (r->has_pending)
+    {
+        reduce_resolve_unary(r, &r->pending, &token);
+    }
+    int out_of_range = lex_fold_min_literal(
+        r->has_pending ? &r->pending : NULL, &token);
+    if (r->has_pending)
+    {
+        reduce_process(r, r->pending);
+        r->has_pending = 0;
+    }
+    if (out_of_range)
+    {
+        reduce_lex_error(r, E_LIT_OVERFLOW, token.offset);
+        return;
+    }
+    r->pending = token;
+    r->has_pending = 1;
+}
+
+void reduce_lex_error(reduce_t* r, err_kind kind, int64_t offset)
+{
+    if (offset < 0)
+    {
+        reduce_error(r, RANK_LEX, kind, NULL, -1, 0);
+        return;
+    }
+    token_t token;
+    init_token(&token, INVALID, offset);
+    int64_t index = r->n_tokens + r->has_pending;
+    reduce_error(r, RANK_LEX, kind, &token, index, 0);
+}
+
+int reduce_end(reduce_t* r, token_t* res, diag_t* diag)
+{
+    if (r->has_pending && r->err_rank < RANK_LEX)
+    {
+        reduce_resolve_unary(r, &r->pending, NULL);
+        reduce_process(r, r->pending);
+    }
+
+    // an operator at the end must be unary and left-associative
+    if (r->n_tokens && IS_OPERATOR(r->last)
+        && (ARITY(r->last) != 1 || ASSOC(r->last) != ASSOC_L))
+    {
+        reduce_error(
+            r, RANK_LAST, E_OP_MISSING_EXPR, &r->last, r->n_tokens - 1,
+            SIDE_RIGHT);
+    }
+
+    // pop the remaining operators; a left parenthesis still on the stack is
+    // unmatched, in which case nothing is evaluated
+    if (r->err_rank < RANK_SCAN)
+    {
+        size_t i = r->n_ops;
+        while (i && r->ops[i - 1].type != L_PAREN)
+        {
+            i--;
+        }
+        if (i)
+        {
+            token_t paren = r->ops[i - 1];
+            reduce_error(r, RANK_SCAN, E_UNMATCHED_PAREN, &paren, -1, 0);
+        }
+        while (r->n_ops)
+        {
+            reduce_apply(r, STACK_POP(r->ops, r->n_ops));
+        }
+    }
+
+    if (!r->err_rank && !r->n_vals)
+    {
+        reduce_error(r, RANK_EVAL, E_EMPTY_EXPR, NULL, -1, 0);
+    }
+
+    int rc = r->err_rank ? -1 : 0;
+    if (rc)
+    {
+        *diag = r->err;
+    }
+    else
+    {
+        *res = r->vals[r->n_vals - 1];
+    }
+    reduce_reset(r);
+
+    return rc;
+}
+
+int reduce_eval_n(
+    reduce_t* r, const char* input, size_t len, token_t* res, diag_t* diag)
+{
+    // the same limits as tokenize_n apply, so that both engines agree
+    if (len >= MAX_INPUT_LEN)
+    {
+        set_diag(diag, E_MAX_INPUT, NULL, -1, 0);
+        return -1;
+    }
+
+    const char* it = input;
+    const char* end = input + len;
+    int64_t n_tokens = 0;
+    token_t token;
+    int rc;
+    while ((rc = lex_next(input, &it, end, &token)) > 0)
+    {
+        if (IS_VARIABLE(token) && r->syms)
+        {
+            const char* name = input + token.offset;
+            token.value = symtab_find(r->syms, name, lex_name(name, end));
+        }
+        reduce_token(r, token);
+        if (++n_tokens == MAX_TOKENS)
+        {
+            reduce_lex_error(r, E_MAX_TOKENS, -1);
+            break;
+        }
+    }
+    if (rc < 0)
+    {
+        reduce_lex_error(
+            r, IS_LITERAL(token) ? E_LIT_OVERFLOW : E_INVALID_TOKEN,
+            token.offset);
+    }
+    // blank input is not an error for the caller to report
+    else if (n_tokens == 0)
+    {
+        return 1;
+    }
+
+    return reduce_end(r, res, diag);
+}
+
+void reduce_free(reduce_t* r)
+{
+    free(r->ops);
+    free(r->vals);
+    reduce_init(r);
+}
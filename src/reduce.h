@@ -0,0 +1,128 @@
+/*
+ * src/reduce.h
+ * incremental shunting-yard reducer which evaluates operators as soon as they
+ * are popped from the operator stack
+ *
+ * tokens are passed in one at a time, straight from a lexer, without building
+ * token or RPN arrays; memory use grows with the nesting depth of the
+ * expression (parentheses and pending lower-precedence operators) rather than
+ * with its length
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+#include <symtab.h>
+
+/*
+ * errors are ranked so that the reducer reports the same error as the
+ * tokenize -> shunting_yard -> evaluate_rpn pipeline when an expression
+ * contains several: lexer errors come first, then operators missing an operand
+ * at the start or end of the expression, then syntax errors found while
+ * converting, and finally errors found while evaluating
+ */
+typedef enum {
+    RANK_NONE,
+    RANK_EVAL,
+    RANK_SCAN,
+    RANK_LAST,
+    RANK_FIRST,
+    RANK_LEX,
+} reduce_rank;
+
+// initial capacity of the operator and value stacks
+#define REDUCE_INIT_DEPTH 64
+
+typedef struct {
+    // one-token lookahead, needed to decide whether +/- are unary
+    token_t pending;
+    int has_pending;
+    token_type prev_type;  // final type of the token before pending
+    token_t last;          // last token passed to the shunting-yard
+    int64_t n_tokens;
+    // shunting-yard state
+    token_t* ops;
+    size_t n_ops;
+    size_t ops_size;
+    token_t* vals;
+    size_t n_vals;
+    size_t vals_size;
+    int literal_was_prev;
+    // variables are looked up here, NULL if no variables are defined
+    const symtab_t* syms;
+    // owns the results which overflow 64 bits, see bignum.h; must be set
+    // before evaluating, and reset by its owner between expressions
+    ctx_t* ctx;
+    // highest-ranked error so far
+    diag_t err;
+    reduce_rank err_rank;
+} reduce_t;
+
+/*
+ * initialize a reducer; its stacks are kept across expressions; the reducer
+ * has no symbol table until syms is set, and no context until ctx is set
+ *
+ * @oparam r := reducer to be initialized
+ */
+void reduce_init(reduce_t* r);
+
+/*
+ * pass the next token of the expression to the reducer; + and - are passed as
+ * OP_ADD and OP_SUB, the reducer decides whether they are unary
+ *
+ * @iparam r := reducer
+ * @iparam token := next token; a variable must already be resolved to its slot
+ *                 in r->syms
+ */
+void reduce_token(reduce_t* r, token_t token);
+
+/*
+ * report an error found by the lexer, tokens passed afterwards are ignored
+ *
+ * @iparam r := reducer
+ * @iparam kind := error kind
+ * @iparam offset := byte offset of the offending input
+ */
+void reduce_lex_error(reduce_t* r, err_kind kind, int64_t offset);
+
+/*
+ * finish the expression and reset the reducer for the next one
+ *
+ * @iparam r := reducer
+ * @oparam res := expression result
+ * @oparam diag := filled in with the error details if the expression failed
+ * @returns 0 on success, -1 on error
+ */
+int reduce_end(reduce_t* r, token_t* res, diag_t* diag);
+
+/*
+ * fused engine: lex and evaluate an expression in a single pass, passing each
+ * token straight to the reducer instead of building token and RPN arrays;
+ * reports the same results and errors as tokenize_n followed by eval_expr
+ *
+ * @iparam r := reducer
+ * @iparam input := start of the expression; need not be NUL-terminated
+ * @iparam len := length of the expression
+ * @oparam res := expression result
+ * @oparam diag := filled in with the error details if the expression failed
+ * @returns 0 on success, 1 if the input contains no tokens, -1 on error
+ */
+int reduce_eval_n(
+    reduce_t* r, const char* input, size_t len, token_t* res, diag_t* diag);
+
+/*
+ * release the reducer's stacks
+ *
+ * @iparam r := reducer
+ */
+void reduce_free(reduce_t* r);
+
+#endif
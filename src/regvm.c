@@ -0,0 +1,241 @@
+/*
+ * src/regvm.c
+ * register-based virtual machine
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <eval.h>
+#include <regvm.h>
+
+// expression tree node rebuilt from the RPN
+typedef struct {
+    token_type type;
+    int64_t value;  // literal value or variable slot
+    int32_t lhs;    // operand node indices, -1 if absent
+    int32_t rhs;
+    uint8_t label;  // Sethi-Ullman number: registers needed by the subtree
+} regvm_node_t;
+
+typedef struct {
+    regvm_node_t* nodes;
+    regvm_insn_t* code;
+    size_t len;
+} regvm_gen_t;
+
+#define NODE_IS_LITERAL(node) ((node).type == LITERAL)
+
+static uint8_t regvm_label(regvm_node_t* nodes, int32_t i)
+{
+    regvm_node_t* node = &nodes[i];
+    // a variable is loaded into a register, unlike a literal it cannot be an
+    // immediate
+    if (NODE_IS_LITERAL(*node) || node->type == VARIABLE)
+    {
+        return 1;
+    }
+    if (node->rhs < 0)
+    {
+        return nodes[node->lhs].label;
+    }
+    regvm_node_t* lhs = &nodes[node->lhs];
+    regvm_node_t* rhs = &nodes[node->rhs];
+    // a literal operand is encoded as an immediate
+    if (NODE_IS_LITERAL(*rhs))
+    {
+        return lhs->label;
+    }
+    if (NODE_IS_LITERAL(*lhs))
+    {
+        return rhs->label;
+    }
+    if (lhs->label == rhs->label)
+    {
+        return lhs->label + 1;
+    }
+    return lhs->label > rhs->label ? lhs->label : rhs->label;
+}
+
+static void regvm_emit(
+    regvm_gen_t* gen, regvm_op op, uint8_t dst, uint8_t a, uint8_t b,
+    int64_t imm)
+{
+    gen->code[gen->len++] = (regvm_insn_t) {
+        .op=op, .dst=dst, .a=a, .b=b, .imm=imm };
+}
+
+static const regvm_op regvm_reg_ops[N_TOKEN_TYPES] = {
+    [OP_ADD] = REGVM_ADD,
+    [OP_SUB] = REGVM_SUB,
+    [OP_MUL] = REGVM_MUL,
+};
+
+static const regvm_op regvm_imm_ops[N_TOKEN_TYPES] = {
+    [OP_ADD] = REGVM_ADDI,
+    [OP_SUB] = REGVM_SUBI,
+    [OP_MUL] = REGVM_MULI,
+};
+
+// generate code leaving the value of node i in register base, using only
+// registers base and above
+static void regvm_gen(regvm_gen_t* gen, int32_t i, uint8_t base)
+{
+    regvm_node_t* node = &gen->nodes[i];
+    if (NODE_IS_LITERAL(*node))
+    {
+        regvm_emit(gen, REGVM_LOADI, base, 0, 0, node->value);
+        return;
+    }
+    if (node->type == VARIABLE)
+    {
+        regvm_emit(gen, REGVM_LOAD, base, 0, 0, node->value);
+        return;
+    }
+    if (node->rhs < 0)
+    {
+        regvm_gen(gen, node->lhs, base);
+        if (node->type == OP_NEG)
+        {
+            regvm_emit(gen, REGVM_NEG, base, base, 0, 0);
+        }
+        return;
+    }
+
+    regvm_node_t* lhs = &gen->nodes[node->lhs];
+    regvm_node_t* rhs = &gen->nodes[node->rhs];
+    if (NODE_IS_LITERAL(*rhs))
+    {
+        regvm_gen(gen, node->lhs, base);
+        regvm_emit(
+            gen, regvm_imm_ops[node->type], base, base, 0, rhs->value);
+    }
+    else if (NODE_IS_LITERAL(*lhs))
+    {
+        regvm_gen(gen, node->rhs, base);
+        regvm_op op = node->type == OP_SUB
+            ? REGVM_RSUBI : regvm_imm_ops[node->type];
+        regvm_emit(gen, op, base, base, 0, lhs->value);
+    }
+    // evaluate the operand needing more registers first, its register is
+    // then free for the other operand's temporaries
+    else if (lhs->label >= rhs->label)
+    {
+        regvm_gen(gen, node->lhs, base);
+        regvm_gen(gen, node->rhs, base + 1);
+        regvm_emit(gen, regvm_reg_ops[node->type], base, base, base + 1, 0);
+    }
+    else
+    {
+        regvm_gen(gen, node->rhs, base);
+        regvm_gen(gen, node->lhs, base + 1);
+        regvm_emit(gen, regvm_reg_ops[node->type], base, base + 1, base, 0);
+    }
+}
+
+int regvm_compile(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, regvm_prog_t* prog,
+    diag_t* diag)
+{
+    // every token becomes at most one node and one instruction
+    regvm_node_t* nodes = ctx_alloc(ctx, n_rpn * sizeof(regvm_node_t));
+    int32_t* stack = ctx_alloc(ctx, n_rpn * sizeof(int32_t));
+    regvm_insn_t* code = ctx_alloc(ctx, n_rpn * sizeof(regvm_insn_t));
+    if (!nodes || !stack || !code)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+    int32_t n_nodes = 0, n_stack = 0;
+
+    for (int n = 0; n < n_rpn; n++)
+    {
+        regvm_node_t* node = &nodes[n_nodes];
+        *node = (regvm_node_t) {
+            .type=rpn[n].type, .value=rpn[n].value, .lhs=-1, .rhs=-1 };
+        if (IS_OPERATOR(rpn[n]))
+        {
+            // not enough operands on the stack, see eval.c:evaluate_rpn
+            if (n_stack < ARITY(rpn[n]))
+            {
+                set_diag(diag, E_OP_MISSING_EXPR, &rpn[n], n, SIDE_RIGHT);
+                return -1;
+            }
+            if (ARITY(rpn[n]) == 2)
+            {
+                node->rhs = STACK_POP(stack, n_stack);
+            }
+            node->lhs = STACK_POP(stack, n_stack);
+        }
+        node->label = regvm_label(nodes, n_nodes);
+        STACK_PUSH(stack, n_stack, n_nodes++);
+    }
+
+    if (!n_stack)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        return -1;
+    }
+    // the result is the last value pushed, as in evaluate_rpn
+    int32_t root = stack[n_stack - 1];
+    if (nodes[root].label > REGVM_N_REGS)
+    {
+        set_diag(diag, E_MAX_TOKENS, NULL, -1, 0);
+        return -1;
+    }
+
+    regvm_gen_t gen = { .nodes=nodes, .code=code, .len=0 };
+    regvm_gen(&gen, root, 0);
+    prog->code = code;
+    prog->len = gen.len;
+    prog->n_regs = nodes[root].label;
+    return 0;
+}
+
+// an operation which overflows abandons the evaluation, see evaluate_rpn
+#define REGVM_CHECKED(builtin, a, b) \
+    if (builtin(a, b, &r[it->dst]))  \
+    {                                \
+        return 1;                    \
+    }                                \
+    break
+
+int regvm_run(
+    const regvm_prog_t* prog, const int64_t* vars, int64_t* result)
+{
+    int64_t r[REGVM_N_REGS];
+    const regvm_insn_t* it = prog->code;
+    const regvm_insn_t* end = it + prog->len;
+    for (; it < end; it++)
+    {
+        switch ((regvm_op) it->op)
+        {
+        case REGVM_LOADI:
+            r[it->dst] = it->imm;
+            break;
+        case REGVM_LOAD:
+            r[it->dst] = vars[it->imm];
+            break;
+        case REGVM_ADD:
+            REGVM_CHECKED(__builtin_add_overflow, r[it->a], r[it->b]);
+        case REGVM_SUB:
+            REGVM_CHECKED(__builtin_sub_overflow, r[it->a], r[it->b]);
+        case REGVM_MUL:
+            REGVM_CHECKED(__builtin_mul_overflow, r[it->a], r[it->b]);
+        case REGVM_ADDI:
+            REGVM_CHECKED(__builtin_add_overflow, r[it->a], it->imm);
+        case REGVM_SUBI:
+            REGVM_CHECKED(__builtin_sub_overflow, r[it->a], it->imm);
+        case REGVM_RSUBI:
+            REGVM_CHECKED(__builtin_sub_overflow, it->imm, r[it->a]);
+        case REGVM_MULI:
+            REGVM_CHECKED(__builtin_mul_overflow, r[it->a], it->imm);
+        case REGVM_NEG:
+            REGVM_CHECKED(__builtin_sub_overflow, (int64_t) 0, r[it->a]);
+        default:
+            break;
+        }
+    }
+
+    *result = r[0];
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * src/regvm.h
+ * register-based virtual machine
+ *
+ * an expression in Reverse Polish notation is rebuilt into the tree it
+ * implies and lowered to three-address code over a small fixed register
+ * file; registers are assigned with Sethi-Ullman numbering, evaluating the
+ * subtree which needs more registers first, so an expression needs as few
+ * live temporaries as possible, and literal operands are encoded as
+ * immediates instead of being loaded into registers
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef REGVM_H
+#define REGVM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+
+// size of the register file; a tree of n leaves needs at most log2(n) + 1
+// registers, so this is ample for MAX_TOKENS
+#define REGVM_N_REGS 16
+
+typedef enum {
+    REGVM_LOADI,  // dst = imm
+    REGVM_LOAD,   // dst = vars[imm]
+    REGVM_ADD,    // dst = a + b
+    REGVM_SUB,    // dst = a - b
+    REGVM_MUL,    // dst = a * b
+    REGVM_ADDI,   // dst = a + imm
+    REGVM_SUBI,   // dst = a - imm
+    REGVM_RSUBI,  // dst = imm - a
+    REGVM_MULI,   // dst = a * imm
+    REGVM_NEG,    // dst = -a
+    N_REGVM_OPS
+} regvm_op;
+
+typedef struct {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t a;
+    uint8_t b;
+    int64_t imm;
+} regvm_insn_t;
+
+typedef struct {
+    regvm_insn_t* code;
+    size_t len;
+    uint8_t n_regs;  // registers used, the result is left in register 0
+} regvm_prog_t;
+
+/*
+ * lower an expression in Reverse Polish notation into register code; the
+ * operand counts are checked while compiling, so running the program cannot
+ * fail
+ *
+ * @iparam ctx := evaluation context, owns the program
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @oparam prog := compiled program
+ * @oparam diag := filled in with the error details if compilation fails; the
+ *                 errors are the same ones evaluate_rpn reports
+ * @returns 0 on success, -1 on error
+ */
+int regvm_compile(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, regvm_prog_t* prog,
+    diag_t* diag);
+
+/*
+ * run a compiled program; the program is not modified, so it can be run any
+ * number of times, including concurrently
+ *
+ * @iparam prog := compiled program
+ * @iparam vars := variable values indexed by slot, may be NULL if the
+ *                 expression has no variables
+ * @oparam result := expression result
+ * @returns 0 on success, or 1 if an operation overflowed 64 bits, see vm_run
+ */
+int regvm_run(
+    const regvm_prog_t* prog, const int64_t* vars, int64_t* result);
+
+#endif
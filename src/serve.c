@@ -0,0 +1,348 @@
+/*
+ * src/serve.c
+ * long-running evaluation server over a Unix domain socket
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <batch.h>
+#include <engine.h>
+#include <error.h>
+#include <lex.h>
+#include <serve.h>
+#include <writer.h>
+
+typedef struct serve_conn {
+    int fd;
+    char in[SERVE_READ_SIZE];
+    size_t in_len;
+    int discarding;  // skipping the remainder of an over-long line
+    int eof;         // peer has finished sending requests
+    writer_t out;
+    size_t out_off;  // bytes of out already sent
+    uint32_t events;
+    // open connections, closed when the server stops
+    struct serve_conn* prev;
+    struct serve_conn* next;
+} serve_conn_t;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_on_signal(int sig)
+{
+    (void) sig;
+    serve_stop = 1;
+}
+
+static int set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int serve_listen(const char* path)
+{
+    struct sockaddr_un addr = { .sun_family=AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        eprintf("%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        eprintf("failed to create socket\n");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr))
+        || listen(fd, SOMAXCONN) || set_nonblocking(fd))
+    {
+        eprintf("%s: failed to listen on socket\n", path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void serve_close(serve_conn_t** conns, serve_conn_t* conn)
+{
+    if (conn->prev)
+    {
+        conn->prev->next = conn->next;
+    }
+    else
+    {
+        *conns = conn->next;
+    }
+    if (conn->next)
+    {
+        conn->next->prev = conn->prev;
+    }
+    close(conn->fd);
+    writer_free(&conn->out);
+    free(conn);
+}
+
+// register interest in the events the connection currently needs
+static void serve_update_events(int epfd, serve_conn_t* conn)
+{
+    size_t pending = conn->out.used - conn->out_off;
+    uint32_t events = pending < SERVE_MAX_PENDING && !conn->eof ? EPOLLIN : 0;
+    if (pending)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events != conn->events)
+    {
+        struct epoll_event ev = { .events=events, .data.ptr=conn };
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+}
+
+// send as much pending output as the socket accepts
+static int serve_flush(serve_conn_t* conn)
+{
+    while (conn->out_off < conn->out.used)
+    {
+        ssize_t n = send(
+            conn->fd, conn->out.buf + conn->out_off,
+            conn->out.used - conn->out_off, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        conn->out_off += n;
+    }
+    if (conn->out_off == conn->out.used)
+    {
+        conn->out.used = 0;
+        conn->out_off = 0;
+        return 0;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        return -1;
+    }
+
+    // the buffer is not always drained between reads, so the sent bytes are
+    // dropped once they are at least as many as the unsent ones to move
+    size_t pending = conn->out.used - conn->out_off;
+    if (conn->out_off >= pending)
+    {
+        memmove(conn->out.buf, conn->out.buf + conn->out_off, pending);
+        conn->out.used = pending;
+        conn->out_off = 0;
+    }
+
+    return 0;
+}
+
+// evaluate every complete request line in the input buffer
+static void serve_eval_requests(engine_t* e, serve_conn_t* conn)
+{
+    char* it = conn->in;
+    char* end = conn->in + conn->in_len;
+    char* nl;
+    while ((nl = memchr(it, '\n', end - it)))
+    {
+        if (conn->discarding)
+        {
+            conn->discarding = 0;
+        }
+        else
+        {
+            batch_eval_line(e, it, nl - it, &conn->out, NULL);
+        }
+        it = nl + 1;
+    }
+    conn->in_len = end - it;
+    memmove(conn->in, it, conn->in_len);
+
+    // a partial request already too long for the engine is rejected here and
+    // the rest of it skipped up to its newline, so it never fills the buffer
+    if (conn->in_len >= MAX_INPUT_LEN)
+    {
+        if (!conn->discarding)
+        {
+            char msg[ERR_MSG_LEN];
+            diag_t diag;
+            set_diag(&diag, E_MAX_INPUT, NULL, -1, 0);
+            int len = format_err(msg, sizeof(msg), &diag);
+            writer_puts(&conn->out, "error: ");
+            writer_put(&conn->out, msg, len);
+            writer_putc(&conn->out, '\n');
+        }
+        conn->discarding = 1;
+        conn->in_len = 0;
+    }
+}
+
+// read and evaluate requests, returns -1 if the connection should be closed
+static int serve_read(engine_t* e, serve_conn_t* conn)
+{
+    while (!conn->eof && conn->out.used - conn->out_off < SERVE_MAX_PENDING)
+    {
+        ssize_t n = read(
+            conn->fd, conn->in + conn->in_len, SERVE_READ_SIZE - conn->in_len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        if (n == 0)
+        {
+            // answer a final request which is missing its newline
+            if (conn->in_len && !conn->discarding)
+            {
+                batch_eval_line(
+                    e, conn->in, conn->in_len, &conn->out, NULL);
+            }
+            conn->in_len = 0;
+            conn->eof = 1;
+            return 0;
+        }
+
+        conn->in_len += n;
+        serve_eval_requests(e, conn);
+    }
+
+    return 0;
+}
+
+static void serve_accept(int epfd, int listen_fd, serve_conn_t** conns)
+{
+    while (1)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            break;
+        }
+        serve_conn_t* conn = calloc(1, sizeof(serve_conn_t));
+        if (!conn || set_nonblocking(fd) || writer_init(&conn->out, -1, 0))
+        {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->next = *conns;
+        if (*conns)
+        {
+            (*conns)->prev = conn;
+        }
+        *conns = conn;
+
+        struct epoll_event ev = { .events=conn->events, .data.ptr=conn };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+        {
+            serve_close(conns, conn);
+        }
+    }
+}
+
+int serve_main(const char* path, size_t cache_capacity)
+{
+    int listen_fd = serve_listen(path);
+    if (listen_fd < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    int epfd = epoll_create1(0);
+    // the listening socket is identified by a NULL connection pointer
+    struct epoll_event lev = { .events=EPOLLIN, .data.ptr=NULL };
+    if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &lev))
+    {
+        eprintf("failed to create event loop\n");
+        close(listen_fd);
+        unlink(path);
+        return EXIT_FAILURE;
+    }
+
+    struct sigaction sa = { .sa_handler=serve_on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // connections are served one event at a time, so a single context is
+    // shared by all of them
+    engine_t e;
+    engine_init(&e, ENGINE_PIPELINE);
+    // the engine's variables would be shared by all of them as well, so a
+    // client could read the variables assigned by another
+    e.read_only = 1;
+    if (cache_capacity && engine_enable_cache(&e, cache_capacity))
+    {
+        eprintf("failed to allocate expression cache\n");
+    }
+
+    serve_conn_t* conns = NULL;
+    struct epoll_event events[SERVE_MAX_EVENTS];
+    while (!serve_stop)
+    {
+        int n = epoll_wait(epfd, events, SERVE_MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++)
+        {
+            serve_conn_t* conn = events[i].data.ptr;
+            if (!conn)
+            {
+                serve_accept(epfd, listen_fd, &conns);
+                continue;
+            }
+
+            int rc = 0;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                rc = serve_read(&e, conn);
+            }
+            // responses are flushed even when the peer has finished sending,
+            // the connection is closed once they have all been sent
+            if (rc || serve_flush(conn) || (conn->eof && !conn->out.used))
+            {
+                serve_close(&conns, conn);
+                continue;
+            }
+            serve_update_events(epfd, conn);
+        }
+    }
+
+    // responses still pending when the server stops are dropped
+    while (conns)
+    {
+        serve_close(&conns, conns);
+    }
+    if (e.cache)
+    {
+        cache_report(e.cache->hits, e.cache->misses, e.cache->evictions);
+    }
+    engine_free(&e);
+    close(epfd);
+    close(listen_fd);
+    unlink(path);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,37 @@
+/*
+ * src/serve.h
+ * long-running evaluation server over a Unix domain socket
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+
+// maximum number of events handled per epoll_wait call
+#define SERVE_MAX_EVENTS 64
+// size of each connection's input buffer, must exceed MAX_INPUT_LEN
+#define SERVE_READ_SIZE (64 * 1024)
+// pending output above which a connection stops reading new requests
+#define SERVE_MAX_PENDING (4 << 20)
+
+/*
+ * serve requests on a Unix domain socket until interrupted
+ *
+ * each connection sends newline-framed expressions and receives one line per
+ * expression, in order, containing either the result or "error: " followed by
+ * the error message; requests of MAX_INPUT_LEN bytes or more are rejected
+ * without being buffered whole; clients may pipeline any number of requests
+ * without waiting for responses; connections share one engine, so assignments
+ * are rejected rather than letting one client see another's variables
+ *
+ * @iparam path := filesystem path of the socket, replaced if it exists
+ * @iparam cache_capacity := number of expressions cached across all
+ *                           connections, 0 disables the cache
+ * @returns the process exit status
+ */
+int serve_main(const char* path, size_t cache_capacity);
+
+#endif
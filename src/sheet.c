@@ -0,0 +1,566 @@
+/*
+ * src/sheet.c
+ * sheets of named formulas which refer to each other, recomputed
+ * incrementally
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <eval.h>
+#include <sheet.h>
+#include <writer.h>
+
+// initial number of cells, grown by doubling
+#define SHEET_INIT_CELLS 64
+
+void sheet_init(sheet_t* s)
+{
+    *s = (sheet_t) { 0 };
+    ctx_init(&s->ctx);
+    ctx_init(&s->sym_ctx);
+    symtab_init(&s->syms, &s->sym_ctx);
+}
+
+// grow the cell arrays to cover every slot of the symbol table
+static int sheet_reserve(sheet_t* s)
+{
+    if (s->syms.n_slots <= s->capacity)
+    {
+        return 0;
+    }
+    int32_t capacity = s->capacity ? s->capacity : SHEET_INIT_CELLS;
+    while (capacity < s->syms.n_slots)
+    {
+        capacity *= 2;
+    }
+    sheet_cell_t* cells = realloc(s->cells, capacity * sizeof(*cells));
+    if (!cells)
+    {
+        return -1;
+    }
+    memset(
+        cells + s->capacity, 0, (capacity - s->capacity) * sizeof(*cells));
+    s->cells = cells;
+    // the scratch lists are rebuilt by every recompute, nothing to copy
+    int32_t* affected = malloc(capacity * sizeof(*affected));
+    int32_t* order = malloc(capacity * sizeof(*order));
+    if (!affected || !order)
+    {
+        free(affected);
+        free(order);
+        return -1;
+    }
+    free(s->affected);
+    free(s->order);
+    s->affected = affected;
+    s->order = order;
+    s->n_order = 0;
+    s->capacity = capacity;
+    return 0;
+}
+
+// start a new traversal; marks from before a wraparound are cleared
+static uint32_t sheet_next_epoch(sheet_t* s)
+{
+    if (++s->epoch == 0)
+    {
+        for (int32_t i = 0; i < s->capacity; i++)
+        {
+            s->cells[i].mark = 0;
+        }
+        s->epoch = 1;
+    }
+    return s->epoch;
+}
+
+/*
+ * compile the expression of a formula into a detached cell; returns 0 on
+ * success, 1 if the formula is invalid, in which case its error is left in
+ * the cell, or -1 if there was not enough memory
+ */
+static int sheet_compile(
+    sheet_t* s, const char* src, size_t len, size_t expr, sheet_cell_t* cell,
+    diag_t* diag)
+{
+    const char* rhs = src + expr;
+    size_t rhs_len = len - expr;
+    ctx_reset(&s->ctx);
+
+    int32_t n_tokens, n_rpn = -1;
+    token_t* rpn = NULL;
+    token_t* tokens = tokenize_n(&s->ctx, rhs, rhs_len, &n_tokens, &cell->diag);
+    if (n_tokens == 0)
+    {
+        token_t assign;
+        init_token(&assign, ASSIGN, expr - 1);
+        set_diag(&cell->diag, E_OP_MISSING_EXPR, &assign, -1, SIDE_RIGHT);
+        return 1;
+    }
+    if (n_tokens > 0)
+    {
+        // names which have no formula yet become undefined cells
+        if (symtab_resolve(
+            &s->syms, rhs, rhs_len, tokens, n_tokens, 1, diag)
+            || sheet_reserve(s))
+        {
+            set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+            return -1;
+        }
+        rpn = shunting_yard(&s->ctx, tokens, n_tokens, &n_rpn, &cell->diag);
+    }
+    if (n_rpn < 0 || vm_compile(&s->ctx, rpn, n_rpn, &cell->bc, &cell->diag))
+    {
+        if (cell->diag.kind == E_NO_MEMORY)
+        {
+            *diag = cell->diag;
+            return -1;
+        }
+        // the expression was compiled on its own, so its offsets start at
+        // the "="
+        if (cell->diag.offset >= 0)
+        {
+            cell->diag.offset += expr;
+            cell->diag.token.offset += expr;
+        }
+        cell->bc = (bytecode_t) { 0 };
+        return 1;
+    }
+
+    // the bytecode, expression and dependencies outlive the scratch context
+    uint8_t* code = malloc(cell->bc.len);
+    cell->rpn = malloc(n_rpn * sizeof(token_t));
+    cell->deps = malloc(n_tokens * sizeof(sheet_dep_t));
+    if (!code || !cell->rpn || !cell->deps)
+    {
+        free(code);
+        free(cell->rpn);
+        free(cell->deps);
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+    memcpy(code, cell->bc.code, cell->bc.len);
+    cell->bc.code = code;
+    memcpy(cell->rpn, rpn, n_rpn * sizeof(token_t));
+    cell->n_rpn = n_rpn;
+
+    uint32_t epoch = sheet_next_epoch(s);
+    for (int32_t i = 0; i < n_tokens; i++)
+    {
+        int32_t slot = tokens[i].value;
+        if (!IS_VARIABLE(tokens[i]) || s->cells[slot].mark == epoch)
+        {
+            continue;
+        }
+        s->cells[slot].mark = epoch;
+        cell->deps[cell->n_deps++] = (sheet_dep_t) {
+            .slot=slot, .offset=tokens[i].offset + expr };
+    }
+    return 0;
+}
+
+// make room for one more user of each dependency, so that linking cannot fail
+static int sheet_reserve_users(sheet_t* s, const sheet_cell_t* cell)
+{
+    for (int32_t i = 0; i < cell->n_deps; i++)
+    {
+        sheet_cell_t* dep = &s->cells[cell->deps[i].slot];
+        if (dep->n_users < dep->users_capacity)
+        {
+            continue;
+        }
+        int32_t capacity = dep->users_capacity ? 2 * dep->users_capacity : 4;
+        int32_t* users = realloc(dep->users, capacity * sizeof(*users));
+        if (!users)
+        {
+            return -1;
+        }
+        dep->users = users;
+        dep->users_capacity = capacity;
+    }
+    return 0;
+}
+
+// remove a cell from the user lists of its dependencies
+static void sheet_unlink(sheet_t* s, int32_t slot)
+{
+    const sheet_cell_t* cell = &s->cells[slot];
+    for (int32_t i = 0; i < cell->n_deps; i++)
+    {
+        sheet_cell_t* dep = &s->cells[cell->deps[i].slot];
+        for (int32_t j = 0; j < dep->n_users; j++)
+        {
+            if (dep->users[j] == slot)
+            {
+                dep->users[j] = dep->users[--dep->n_users];
+                break;
+            }
+        }
+    }
+}
+
+int32_t sheet_set(sheet_t* s, const char* src, size_t len, diag_t* diag)
+{
+    if (len >= MAX_INPUT_LEN)
+    {
+        set_diag(diag, E_MAX_INPUT, NULL, -1, 0);
+        return -1;
+    }
+    size_t name, name_len;
+    size_t expr = lex_assignment(src, len, &name, &name_len);
+    if (!expr)
+    {
+        set_diag(diag, E_NOT_FORMULA, NULL, -1, 0);
+        return -1;
+    }
+    int32_t slot = symtab_intern(&s->syms, src + name, name_len);
+    if (slot < 0 || sheet_reserve(s))
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+
+    sheet_cell_t next = { 0 };
+    int rc = sheet_compile(s, src, len, expr, &next, diag);
+    if (rc < 0 || sheet_reserve_users(s, &next))
+    {
+        free(next.bc.code);
+        free(next.rpn);
+        free(next.deps);
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+
+    sheet_cell_t* cell = &s->cells[slot];
+    sheet_unlink(s, slot);
+    free(cell->bc.code);
+    free(cell->rpn);
+    free(cell->deps);
+    cell->has_formula = 1;
+    cell->bc = next.bc;
+    cell->rpn = next.rpn;
+    cell->n_rpn = next.n_rpn;
+    cell->deps = next.deps;
+    cell->n_deps = next.n_deps;
+    if (rc)
+    {
+        cell->state = SHEET_ERROR;
+        cell->diag = next.diag;
+    }
+    for (int32_t i = 0; i < cell->n_deps; i++)
+    {
+        sheet_cell_t* dep = &s->cells[cell->deps[i].slot];
+        dep->users[dep->n_users++] = slot;
+    }
+    return slot;
+}
+
+// compute a cell whose affected inputs have all been computed, or which is
+// on or downstream of a cycle
+static void sheet_compute(sheet_t* s, int32_t slot)
+{
+    sheet_cell_t* cell = &s->cells[slot];
+    if (!cell->has_formula)
+    {
+        cell->state = SHEET_UNDEFINED;
+        return;
+    }
+    // the compile error is already in the cell
+    if (!cell->bc.code)
+    {
+        cell->state = SHEET_ERROR;
+        return;
+    }
+    for (int32_t i = 0; i < cell->n_deps; i++)
+    {
+        const sheet_cell_t* dep = &s->cells[cell->deps[i].slot];
+        err_kind kind = E_OK;
+        // inputs still pending once every other cell is computed can only be
+        // waiting on a cycle
+        if (dep->mark == s->epoch && dep->pending > 0)
+        {
+            kind = E_CIRCULAR_REF;
+        }
+        else if (dep->state == SHEET_UNDEFINED)
+        {
+            kind = E_UNDEFINED_VAR;
+        }
+        else if (dep->state == SHEET_ERROR)
+        {
+            kind = E_DEP_ERROR;
+        }
+        if (kind != E_OK)
+        {
+            token_t var;
+            init_token(&var, VARIABLE, cell->deps[i].offset);
+            var.value = cell->deps[i].slot;
+            set_diag(&cell->diag, kind, &var, -1, 0);
+            cell->state = SHEET_ERROR;
+            return;
+        }
+    }
+    int64_t value;
+    if (vm_run(&cell->bc, s->syms.values, &value))
+    {
+        // an intermediate result overflowed, but the value may still fit
+        token_t res;
+        int rc = evaluate_rpn_vars(
+            &s->ctx, cell->rpn, cell->n_rpn, s->syms.values, &res,
+            &cell->diag);
+        ctx_reset(&s->ctx);
+        if (!rc && !IS_LITERAL(res))
+        {
+            set_diag(&cell->diag, E_VALUE_RANGE, NULL, -1, 0);
+            rc = -1;
+        }
+        if (rc)
+        {
+            cell->state = SHEET_ERROR;
+            return;
+        }
+        value = res.value;
+    }
+    symtab_set(&s->syms, slot, value);
+    cell->state = SHEET_OK;
+}
+
+int32_t sheet_recompute(sheet_t* s, const int32_t* seeds, int32_t n_seeds)
+{
+    uint32_t epoch = sheet_next_epoch(s);
+    sheet_cell_t* cells = s->cells;
+
+    // collect the cells downstream of the seeds, counting for each one how
+    // many of its inputs are among them
+    int32_t n_affected = 0;
+    for (int32_t i = 0; i < n_seeds; i++)
+    {
+        int32_t slot = seeds ? seeds[i] : i;
+        if (cells[slot].mark != epoch)
+        {
+            cells[slot].mark = epoch;
+            cells[slot].pending = 0;
+            s->affected[n_affected++] = slot;
+        }
+    }
+    for (int32_t i = 0; i < n_affected; i++)
+    {
+        const sheet_cell_t* cell = &cells[s->affected[i]];
+        for (int32_t j = 0; j < cell->n_users; j++)
+        {
+            sheet_cell_t* user = &cells[cell->users[j]];
+            if (user->mark != epoch)
+            {
+                user->mark = epoch;
+                user->pending = 0;
+                s->affected[n_affected++] = cell->users[j];
+            }
+            user->pending++;
+        }
+    }
+
+    // Kahn's algorithm: a cell is computed once all of its affected inputs
+    // are, and the order array doubles as the queue
+    s->n_order = 0;
+    for (int32_t i = 0; i < n_affected; i++)
+    {
+        if (!cells[s->affected[i]].pending)
+        {
+            s->order[s->n_order++] = s->affected[i];
+        }
+    }
+    for (int32_t i = 0; i < s->n_order; i++)
+    {
+        sheet_compute(s, s->order[i]);
+        const sheet_cell_t* cell = &cells[s->order[i]];
+        for (int32_t j = 0; j < cell->n_users; j++)
+        {
+            if (--cells[cell->users[j]].pending == 0)
+            {
+                s->order[s->n_order++] = cell->users[j];
+            }
+        }
+    }
+
+    // the cells which were never ready are on or downstream of a cycle
+    for (int32_t i = 0; s->n_order < n_affected; i++)
+    {
+        if (cells[s->affected[i]].pending)
+        {
+            sheet_compute(s, s->affected[i]);
+            s->order[s->n_order++] = s->affected[i];
+        }
+    }
+    return s->n_order;
+}
+
+int32_t sheet_recompute_all(sheet_t* s)
+{
+    return sheet_recompute(s, NULL, s->syms.n_slots);
+}
+
+int sheet_value(const sheet_t* s, int32_t slot, int64_t* value, diag_t* diag)
+{
+    const sheet_cell_t* cell = &s->cells[slot];
+    switch (cell->state)
+    {
+    case SHEET_OK:
+        *value = s->syms.values[slot];
+        return 0;
+    case SHEET_ERROR:
+        *diag = cell->diag;
+        return -1;
+    default:
+        set_diag(diag, E_UNDEFINED_VAR, NULL, -1, 0);
+        return -1;
+    }
+}
+
+void sheet_free(sheet_t* s)
+{
+    for (int32_t i = 0; i < s->capacity; i++)
+    {
+        free(s->cells[i].bc.code);
+        free(s->cells[i].rpn);
+        free(s->cells[i].deps);
+        free(s->cells[i].users);
+    }
+    free(s->cells);
+    free(s->affected);
+    free(s->order);
+    ctx_free(&s->ctx);
+    ctx_free(&s->sym_ctx);
+}
+
+// write "name = value" or "name: error: message" for a cell
+static void sheet_write_cell(const sheet_t* s, int32_t slot, writer_t* out)
+{
+    const symtab_name_t* name = &s->syms.names[slot];
+    writer_put(out, name->name, name->len);
+    int64_t value;
+    diag_t diag;
+    if (sheet_value(s, slot, &value, &diag))
+    {
+        char msg[ERR_MSG_LEN];
+        int msg_len = format_err(msg, sizeof(msg), &diag);
+        writer_puts(out, ": error: ");
+        writer_put(out, msg, msg_len);
+    }
+    else
+    {
+        writer_puts(out, " = ");
+        writer_put_int(out, value);
+    }
+    writer_putc(out, '\n');
+}
+
+// write the formulas recomputed by the last sheet_recompute
+static void sheet_write_order(const sheet_t* s, writer_t* out)
+{
+    for (int32_t i = 0; i < s->n_order; i++)
+    {
+        if (s->cells[s->order[i]].has_formula)
+        {
+            sheet_write_cell(s, s->order[i], out);
+        }
+    }
+}
+
+// strip trailing whitespace, returns 0 if the line is blank
+static size_t sheet_trim(const char* line, ssize_t len)
+{
+    while (len && isspace((unsigned char) line[len - 1]))
+    {
+        len--;
+    }
+    for (ssize_t i = 0; i < len; i++)
+    {
+        if (!isspace((unsigned char) line[i]))
+        {
+            return len;
+        }
+    }
+    return 0;
+}
+
+int sheet_main(const char* path)
+{
+    int is_stdin = !strcmp(path, "-");
+    FILE* f = is_stdin ? stdin : fopen(path, "r");
+    if (!f)
+    {
+        eprintf("%s: failed to open file\n", path);
+        return EXIT_FAILURE;
+    }
+    sheet_t s;
+    sheet_init(&s);
+    writer_t out;
+    writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE);
+    int status = EXIT_SUCCESS;
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    diag_t diag;
+
+    for (long lineno = 1; (len = getline(&line, &line_size, f)) >= 0;
+        lineno++)
+    {
+        size_t n = sheet_trim(line, len);
+        if (n && sheet_set(&s, line, n, &diag) < 0)
+        {
+            char msg[ERR_MSG_LEN];
+            format_err(msg, sizeof(msg), &diag);
+            eprintf("%s:%ld: %s\n", path, lineno, msg);
+            status = EXIT_FAILURE;
+        }
+    }
+    if (!is_stdin)
+    {
+        fclose(f);
+    }
+    sheet_recompute_all(&s);
+    sheet_write_order(&s, &out);
+    writer_putc(&out, '\n');
+    writer_flush(&out);
+
+    // each update is answered as soon as it is read, so that the sheet can
+    // be driven interactively
+    while (!is_stdin && (len = getline(&line, &line_size, stdin)) >= 0)
+    {
+        size_t n = sheet_trim(line, len);
+        if (!n)
+        {
+            continue;
+        }
+        int32_t slot = sheet_set(&s, line, n, &diag);
+        if (slot < 0)
+        {
+            char msg[ERR_MSG_LEN];
+            int msg_len = format_err(msg, sizeof(msg), &diag);
+            writer_puts(&out, "error: ");
+            writer_put(&out, msg, msg_len);
+            writer_putc(&out, '\n');
+        }
+        else
+        {
+            sheet_recompute(&s, &slot, 1);
+            sheet_write_order(&s, &out);
+        }
+        writer_putc(&out, '\n');
+        writer_flush(&out);
+    }
+    free(line);
+
+    if (writer_free(&out))
+    {
+        status = EXIT_FAILURE;
+    }
+    sheet_free(&s);
+    return status;
+}
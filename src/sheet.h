@@ -0,0 +1,152 @@
+/*
+ * src/sheet.h
+ * sheets of named formulas which refer to each other, recomputed
+ * incrementally
+ *
+ * each formula "name = expr" is compiled to bytecode once, and the sheet keeps
+ * the dependency graph between formulas in both directions; when formulas
+ * change, only the formulas downstream of them are recomputed, in topological
+ * order, so the cost of an update depends on the size of the affected
+ * subgraph rather than on the size of the sheet
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef SHEET_H
+#define SHEET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <symtab.h>
+#include <vm.h>
+
+typedef enum {
+    // name which is referred to but has no formula
+    SHEET_UNDEFINED,
+    // formula whose value is up to date
+    SHEET_OK,
+    // formula which failed to compile or could not be computed
+    SHEET_ERROR,
+} sheet_state;
+
+// variable read by a formula
+typedef struct {
+    int32_t slot;
+    int64_t offset;  // offset of its first use within the formula
+} sheet_dep_t;
+
+/*
+ * cell of the sheet, indexed by the slot of its name in the symbol table;
+ * values are stored in the symbol table so that bytecode reads them directly
+ */
+typedef struct {
+    uint8_t has_formula;
+    uint8_t state;
+    bytecode_t bc;       // malloc'd, empty if the formula failed to compile
+    token_t* rpn;        // malloc'd, evaluated exactly if the bytecode
+    int32_t n_rpn;       // overflows
+    sheet_dep_t* deps;   // distinct variables read by the formula
+    int32_t n_deps;
+    int32_t* users;      // cells whose formulas read this cell
+    int32_t n_users;
+    int32_t users_capacity;
+    diag_t diag;         // SHEET_ERROR: why the formula has no value
+    uint32_t mark;       // epoch of the last traversal which reached the cell
+    int32_t pending;     // during recompute: affected inputs not yet computed
+} sheet_cell_t;
+
+typedef struct {
+    ctx_t ctx;       // scratch memory for compiling formulas
+    ctx_t sym_ctx;   // owns the symbol table, never reset
+    symtab_t syms;
+    sheet_cell_t* cells;
+    int32_t capacity;
+    uint32_t epoch;
+    int32_t* affected;  // scratch list of the cells reached by a recompute
+    int32_t* order;     // cells recomputed by the last sheet_recompute, in
+                        // topological order
+    int32_t n_order;
+} sheet_t;
+
+/*
+ * create an empty sheet
+ *
+ * @oparam s := sheet to be initialized
+ */
+void sheet_init(sheet_t* s);
+
+/*
+ * set the formula of a cell, replacing its previous formula if any; values
+ * are not recomputed until sheet_recompute is called with the cell as a seed
+ *
+ * a formula which fails to compile is still set, so that the cell and every
+ * formula which depends on it report an error until it is replaced
+ *
+ * @iparam s := sheet
+ * @iparam src := statement of the form "name = expr"; need not be
+ *                NUL-terminated
+ * @iparam len := length of the statement
+ * @oparam diag := filled in with the error details if the statement is not a
+ *                 formula or there was not enough memory
+ * @returns the slot of the cell on success, otherwise -1 and the sheet is
+ *          unchanged
+ */
+int32_t sheet_set(sheet_t* s, const char* src, size_t len, diag_t* diag);
+
+/*
+ * recompute the given cells and every formula downstream of them; a formula
+ * is computed only after all of the formulas it reads, and formulas on or
+ * downstream of a cycle report E_CIRCULAR_REF; the recomputed cells are left
+ * in s->order
+ *
+ * @iparam s := sheet
+ * @iparam seeds := slots of the cells whose formulas changed, or NULL for the
+ *                  first n_seeds slots
+ * @iparam n_seeds := number of seeds
+ * @returns the number of recomputed cells
+ */
+int32_t sheet_recompute(sheet_t* s, const int32_t* seeds, int32_t n_seeds);
+
+/*
+ * recompute every formula of the sheet, e.g. after loading it
+ *
+ * @iparam s := sheet
+ * @returns the number of recomputed cells
+ */
+int32_t sheet_recompute_all(sheet_t* s);
+
+/*
+ * get the value of a cell
+ *
+ * @iparam s := sheet
+ * @iparam slot := slot of the cell
+ * @oparam value := value of the formula
+ * @oparam diag := filled in with the error details if the cell has no value
+ * @returns 0 on success, -1 on error
+ */
+int sheet_value(const sheet_t* s, int32_t slot, int64_t* value, diag_t* diag);
+
+/*
+ * release the memory of a sheet
+ *
+ * @iparam s := sheet
+ */
+void sheet_free(sheet_t* s);
+
+/*
+ * load a sheet of formulas, one per line, and print the value of every
+ * formula; then read updated or new formulas from stdin, one per line, and
+ * after each update print the values of the recomputed formulas in
+ * topological order, followed by a blank line
+ *
+ * values are printed as "name = value", or "name: error: message"
+ *
+ * @iparam path := sheet file, "-" for stdin in which case no updates are read
+ * @returns the process exit status
+ */
+int sheet_main(const char* path);
+
+#endif
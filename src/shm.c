@@ -0,0 +1,405 @@
+/*
+ * src/shm.c
+ * shared-memory ring transport for same-host clients
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <ctx.h>
+#include <eval.h>
+#include <shm.h>
+#include <writer.h>
+
+static volatile sig_atomic_t shm_stop = 0;
+
+static void shm_on_signal(int sig)
+{
+    (void) sig;
+    shm_stop = 1;
+}
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/*
+ * wait for *word to change from old: spin first, then sleep on a futex if the
+ * other side has not made progress; returns after the word changed, or after
+ * the futex wait was interrupted, so callers re-check their condition
+ *
+ * the spin count grows when spinning was enough and shrinks when the waiter
+ * had to sleep anyway, so idle sides stop burning CPU time
+ */
+static void shm_wait(
+    shm_waiter_t* waiter, _Atomic uint32_t* word, uint32_t old,
+    _Atomic uint32_t* waiting)
+{
+    for (uint32_t i = 0; i < waiter->spin; i++)
+    {
+        if (atomic_load_explicit(word, memory_order_acquire) != old)
+        {
+            if (waiter->spin < SHM_SPIN_MAX)
+            {
+                waiter->spin *= 2;
+            }
+            return;
+        }
+        cpu_relax();
+    }
+    if (waiter->spin > SHM_SPIN_MIN)
+    {
+        waiter->spin /= 2;
+    }
+
+    // announce the sleep before re-checking the word, the other side stores
+    // the word before checking the flag, so one of them sees the other
+    atomic_store(waiting, 1);
+    if (atomic_load(word) == old)
+    {
+        syscall(SYS_futex, word, FUTEX_WAIT, old, NULL, NULL, 0);
+    }
+    atomic_store(waiting, 0);
+}
+
+// wake the other side if it is sleeping on word
+static void shm_wake(_Atomic uint32_t* word, _Atomic uint32_t* waiting)
+{
+    if (atomic_load(waiting))
+    {
+        syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+// publish a new head, waking a consumer sleeping on it
+static void shm_ring_push(shm_ring_t* ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store(&ring->head, head + 1);
+    shm_wake(&ring->head, &ring->head_waiting);
+}
+
+// publish a new tail, waking a producer sleeping on it
+static void shm_ring_pop(shm_ring_t* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store(&ring->tail, tail + 1);
+    shm_wake(&ring->tail, &ring->tail_waiting);
+}
+
+// block until the ring has a slot to read, returns 0 if interrupted
+static int shm_ring_wait_readable(shm_ring_t* ring, shm_waiter_t* waiter)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head;
+    while ((head = atomic_load_explicit(&ring->head, memory_order_acquire))
+        == tail)
+    {
+        if (shm_stop)
+        {
+            return 0;
+        }
+        shm_wait(waiter, &ring->head, head, &ring->head_waiting);
+    }
+
+    return 1;
+}
+
+// block until the ring has a slot to write, returns 0 if interrupted
+static int shm_ring_wait_writable(shm_ring_t* ring, shm_waiter_t* waiter)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    while (head - tail == SHM_SLOTS)
+    {
+        if (shm_stop)
+        {
+            return 0;
+        }
+        shm_wait(waiter, &ring->tail, tail, &ring->tail_waiting);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+
+    return 1;
+}
+
+static shm_region_t* shm_map(int fd)
+{
+    void* map = mmap(
+        NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return map == MAP_FAILED ? NULL : map;
+}
+
+int shm_client_open(shm_client_t* client, const char* name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    // the worker sizes the region after creating it, and touching a mapping
+    // beyond the end of the object would fault
+    struct stat st;
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(shm_region_t))
+    {
+        close(fd);
+        return -1;
+    }
+    shm_region_t* region = shm_map(fd);
+    close(fd);
+    if (!region || region->magic != SHM_MAGIC)
+    {
+        if (region)
+        {
+            munmap(region, sizeof(shm_region_t));
+        }
+        return -1;
+    }
+
+    *client = (shm_client_t) {
+        .region=region, .waiter={ .spin=SHM_SPIN_MIN }, .pending=0 };
+    return 0;
+}
+
+int shm_client_submit(shm_client_t* client, const char* expr, size_t len)
+{
+    if (len > SHM_EXPR_LEN)
+    {
+        return -1;
+    }
+    shm_ring_t* ring = &client->region->requests;
+    if (!shm_ring_wait_writable(ring, &client->waiter))
+    {
+        return -1;
+    }
+
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    shm_request_t* req = &client->region->request_slots[head % SHM_SLOTS];
+    req->len = len;
+    memcpy(req->text, expr, len);
+    shm_ring_push(ring);
+    client->pending++;
+
+    return 0;
+}
+
+int shm_client_receive(shm_client_t* client, shm_response_t* res)
+{
+    shm_ring_t* ring = &client->region->responses;
+    if (!shm_ring_wait_readable(ring, &client->waiter))
+    {
+        return -1;
+    }
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    *res = client->region->response_slots[tail % SHM_SLOTS];
+    shm_ring_pop(ring);
+    client->pending--;
+
+    return 0;
+}
+
+void shm_client_close(shm_client_t* client)
+{
+    munmap(client->region, sizeof(shm_region_t));
+    client->region = NULL;
+}
+
+// evaluate a request into its response slot
+static void shm_eval(ctx_t* ctx, shm_request_t* req, shm_response_t* res)
+{
+    ctx_reset(ctx);
+
+    int32_t n_tokens;
+    diag_t diag;
+    token_t* tokens = tokenize_n(ctx, req->text, req->len, &n_tokens, &diag);
+    int rc = n_tokens < 0 ? -1 : 0;
+    token_t result;
+    if (!rc)
+    {
+        rc = eval_expr(ctx, tokens, n_tokens, NULL, &result, &diag);
+    }
+    // responses have room for a 64-bit value only
+    if (!rc && !IS_LITERAL(result))
+    {
+        set_diag(&diag, E_VALUE_RANGE, NULL, -1, 0);
+        rc = -1;
+    }
+
+    res->kind = rc ? diag.kind : E_OK;
+    res->value = rc ? 0 : result.value;
+    res->offset = rc ? diag.offset : -1;
+    res->message[0] = 0;
+    if (rc)
+    {
+        format_err(res->message, sizeof(res->message), &diag);
+    }
+}
+
+int shm_worker_main(const char* name)
+{
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(shm_region_t)))
+    {
+        eprintf("%s: failed to create shared memory\n", name);
+        if (fd >= 0)
+        {
+            close(fd);
+            shm_unlink(name);
+        }
+        return EXIT_FAILURE;
+    }
+    shm_region_t* region = shm_map(fd);
+    close(fd);
+    if (!region)
+    {
+        eprintf("%s: failed to map shared memory\n", name);
+        shm_unlink(name);
+        return EXIT_FAILURE;
+    }
+    // ftruncate zero-fills the region, so only the magic needs to be set
+    atomic_store((_Atomic uint32_t*) &region->magic, SHM_MAGIC);
+
+    struct sigaction sa = { .sa_handler=shm_on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    ctx_t ctx;
+    ctx_init(&ctx);
+    shm_waiter_t waiter = { .spin=SHM_SPIN_MIN };
+    shm_ring_t* requests = &region->requests;
+    shm_ring_t* responses = &region->responses;
+
+    while (shm_ring_wait_readable(requests, &waiter)
+        && shm_ring_wait_writable(responses, &waiter))
+    {
+        uint32_t tail = atomic_load_explicit(
+            &requests->tail, memory_order_relaxed);
+        uint32_t head = atomic_load_explicit(
+            &responses->head, memory_order_relaxed);
+        shm_eval(
+            &ctx, &region->request_slots[tail % SHM_SLOTS],
+            &region->response_slots[head % SHM_SLOTS]);
+        shm_ring_pop(requests);
+        shm_ring_push(responses);
+    }
+
+    ctx_free(&ctx);
+    munmap(region, sizeof(shm_region_t));
+    shm_unlink(name);
+
+    return EXIT_SUCCESS;
+}
+
+// print the oldest pending response, returns -1 if interrupted
+static int shm_client_print(shm_client_t* client, writer_t* out)
+{
+    shm_response_t res;
+    if (shm_client_receive(client, &res))
+    {
+        return -1;
+    }
+    if (res.kind == E_OK)
+    {
+        writer_put_int(out, res.value);
+    }
+    // blank lines produce blank output lines, as in batch mode
+    else if (res.kind != E_EMPTY_EXPR)
+    {
+        writer_puts(out, "error: ");
+        writer_puts(out, res.message);
+    }
+    writer_putc(out, '\n');
+
+    return 0;
+}
+
+int shm_client_main(const char* name)
+{
+    shm_client_t client;
+    if (shm_client_open(&client, name))
+    {
+        eprintf("%s: no worker is serving this region\n", name);
+        return EXIT_FAILURE;
+    }
+    writer_t out;
+    writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE);
+
+    // a signal stops the waits on a worker which is not answering
+    struct sigaction sa = { .sa_handler=shm_on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    int rc = 0;
+    while (!rc && (len = getline(&line, &size, stdin)) >= 0)
+    {
+        if (len && line[len - 1] == '\n')
+        {
+            len--;
+        }
+        // a full ring means the oldest response must be collected first
+        if (client.pending == SHM_SLOTS)
+        {
+            rc = shm_client_print(&client, &out);
+        }
+        if (!rc && len > SHM_EXPR_LEN)
+        {
+            // keep responses in order: drain before reporting the error
+            while (!rc && client.pending)
+            {
+                rc = shm_client_print(&client, &out);
+            }
+            char msg[ERR_MSG_LEN];
+            diag_t diag;
+            set_diag(&diag, E_MAX_INPUT, NULL, -1, 0);
+            format_err(msg, sizeof(msg), &diag);
+            writer_puts(&out, "error: ");
+            writer_puts(&out, msg);
+            writer_putc(&out, '\n');
+        }
+        else if (!rc)
+        {
+            rc = shm_client_submit(&client, line, len);
+        }
+    }
+    while (!rc && client.pending)
+    {
+        rc = shm_client_print(&client, &out);
+    }
+
+    free(line);
+    shm_client_close(&client);
+    int status = EXIT_SUCCESS;
+    if (rc || shm_stop)
+    {
+        writer_flush(&out);
+        eprintf("%s: interrupted\n", name);
+        status = EXIT_FAILURE;
+    }
+    if (writer_free(&out))
+    {
+        status = EXIT_FAILURE;
+    }
+
+    return status;
+}
@@ -0,0 +1,126 @@
+/*
+ * src/shm.h
+ * shared-memory ring transport for same-host clients
+ *
+ * a worker and a single client share a memory-mapped region holding two
+ * single-producer/single-consumer rings: the client writes expressions into
+ * the request ring and the worker writes results into the response ring;
+ * while both sides are busy no system calls are made, a side which finds its
+ * ring empty (or full) spins for a while and then sleeps on a futex
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <error.h>
+#include <lex.h>
+
+#define SHM_MAGIC 0x63636302
+// number of slots per ring, must be a power of two
+#define SHM_SLOTS 1024
+// maximum length of an expression in a request slot
+#define SHM_EXPR_LEN MAX_INPUT_LEN
+// bounds on the number of spins before sleeping on a futex
+#define SHM_SPIN_MIN 64
+#define SHM_SPIN_MAX (64 * 1024)
+
+// ring indices only ever increase, the slot is the index modulo SHM_SLOTS;
+// the producer and consumer sides live on separate cache lines
+typedef struct {
+    _Alignas(64) _Atomic uint32_t head;  // next slot to be written
+    _Atomic uint32_t head_waiting;       // consumer is sleeping on head
+    _Alignas(64) _Atomic uint32_t tail;  // next slot to be read
+    _Atomic uint32_t tail_waiting;       // producer is sleeping on tail
+} shm_ring_t;
+
+typedef struct {
+    uint32_t len;
+    char text[SHM_EXPR_LEN];
+} shm_request_t;
+
+typedef struct {
+    int32_t kind;    // E_OK on success, otherwise the error kind
+    int64_t value;
+    int64_t offset;  // byte offset of the offending token, -1 if none
+    char message[ERR_MSG_LEN];
+} shm_response_t;
+
+typedef struct {
+    uint32_t magic;
+    shm_ring_t requests;
+    shm_ring_t responses;
+    shm_request_t request_slots[SHM_SLOTS];
+    shm_response_t response_slots[SHM_SLOTS];
+} shm_region_t;
+
+// per-side state used to adapt the spin count to the observed latency
+typedef struct {
+    uint32_t spin;
+} shm_waiter_t;
+
+typedef struct {
+    shm_region_t* region;
+    shm_waiter_t waiter;
+    uint32_t pending;  // requests submitted without a received response
+} shm_client_t;
+
+/*
+ * attach to the region of a running worker
+ *
+ * @oparam client := client to be initialized
+ * @iparam name := shared memory object name, e.g. "/ccc"
+ * @returns 0 on success, otherwise -1
+ */
+int shm_client_open(shm_client_t* client, const char* name);
+
+/*
+ * submit an expression, blocking while the request ring is full
+ *
+ * @iparam client := client
+ * @iparam expr := expression text, need not be NUL-terminated
+ * @iparam len := length of the expression
+ * @returns 0 on success, or -1 if the expression does not fit in a slot or
+ *          the wait for a free slot was interrupted
+ */
+int shm_client_submit(shm_client_t* client, const char* expr, size_t len);
+
+/*
+ * receive the response to the oldest pending request, blocking until it is
+ * available
+ *
+ * @iparam client := client
+ * @oparam res := response
+ * @returns 0 on success, or -1 if the wait was interrupted
+ */
+int shm_client_receive(shm_client_t* client, shm_response_t* res);
+
+/*
+ * detach from the region
+ */
+void shm_client_close(shm_client_t* client);
+
+/*
+ * create a shared memory region and serve requests from it until interrupted
+ *
+ * @iparam name := shared memory object name, replaced if it exists
+ * @returns the process exit status
+ */
+int shm_worker_main(const char* name);
+
+/*
+ * submit every line read from stdin to a worker and print the responses in
+ * order, keeping the request ring full; SIGINT and SIGTERM stop the client
+ * with a failure status
+ *
+ * @iparam name := shared memory object name
+ * @returns the process exit status
+ */
+int shm_client_main(const char* name);
+
+#endif
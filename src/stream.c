@@ -0,0 +1,271 @@
+/*
+ * src/stream.c
+ * streaming evaluation of newline-delimited expressions of unbounded length
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <error.h>
+#include <stream.h>
+
+void stream_init(stream_t* s)
+{
+    *s = (stream_t) { .blank=1 };
+    reduce_init(&s->r);
+    ctx_init(&s->ctx);
+    s->r.ctx = &s->ctx;
+}
+
+// pass a completed literal on to the reducer; a prefix letter or underscore
+// left over after it starts a name, and names are not supported here
+static void stream_end_literal(stream_t* s)
+{
+    token_t token;
+    init_literal(
+        &token, s->literal == LEX_LIT_MIN_MAGNITUDE
+            ? INT64_MIN : (int64_t) s->literal, s->literal_offset);
+    reduce_token(&s->r, token);
+    if (s->lit == STREAM_LIT_PREFIX || s->lit == STREAM_LIT_SEPARATOR)
+    {
+        reduce_lex_error(&s->r, E_INVALID_TOKEN, s->pending_offset);
+        s->skipping = 1;
+    }
+    s->lit = STREAM_LIT_NONE;
+}
+
+// append a digit to the literal, which is dropped if it goes out of range
+static void stream_literal_digit(stream_t* s, int digit)
+{
+    uint64_t value;
+    s->lit = STREAM_LIT_DIGITS;
+    if (__builtin_mul_overflow(s->literal, (uint64_t) s->radix, &value)
+        || __builtin_add_overflow(value, (uint64_t) digit, &value)
+        || value > LEX_LIT_MIN_MAGNITUDE)
+    {
+        reduce_lex_error(&s->r, E_LIT_OVERFLOW, s->literal_offset);
+        s->lit = STREAM_LIT_NONE;
+        s->skipping = 1;
+        return;
+    }
+    s->literal = value;
+}
+
+/*
+ * continue the literal being lexed with the next character; returns 0 if the
+ * character is not part of the literal, which has then been passed on
+ */
+static int stream_literal_char(stream_t* s, char c)
+{
+    int digit = lex_digit_value(c);
+    if (s->lit == STREAM_LIT_ZERO && lex_prefix_radix(c))
+    {
+        // the literal is still 0 if no digit follows the prefix
+        s->lit = STREAM_LIT_PREFIX;
+        s->radix = lex_prefix_radix(c);
+        s->pending_offset = s->offset;
+        return 1;
+    }
+    if (digit < s->radix)
+    {
+        stream_literal_digit(s, digit);
+        return 1;
+    }
+    if (s->lit == STREAM_LIT_PREFIX || s->lit == STREAM_LIT_SEPARATOR)
+    {
+        stream_end_literal(s);
+        return 1;
+    }
+    if (c == '_')
+    {
+        s->lit = STREAM_LIT_SEPARATOR;
+        s->pending_offset = s->offset;
+        return 1;
+    }
+    stream_end_literal(s);
+    return 0;
+}
+
+static void stream_end_line(stream_t* s, writer_t* out)
+{
+    if (s->lit != STREAM_LIT_NONE)
+    {
+        stream_end_literal(s);
+    }
+
+    token_t result;
+    diag_t diag;
+    int rc = reduce_end(&s->r, &result, &diag);
+    // blank lines produce blank output lines, as in batch mode
+    if (!rc)
+    {
+        writer_put_value(out, &result);
+    }
+    else if (!s->blank)
+    {
+        char msg[ERR_MSG_LEN];
+        int len = format_err(msg, sizeof(msg), &diag);
+        writer_puts(out, "error: ");
+        writer_put(out, msg, len);
+    }
+    writer_putc(out, '\n');
+    ctx_reset(&s->ctx);
+
+    s->offset = 0;
+    s->skipping = 0;
+    s->blank = 1;
+}
+
+static token_type stream_operator_type(char c)
+{
+    switch (c)
+    {
+    case '(':
+        return L_PAREN;
+    case ')':
+        return R_PAREN;
+    case '+':
+        return OP_ADD;
+    case '-':
+        return OP_SUB;
+    case '*':
+        return OP_MUL;
+    default:
+        return INVALID;
+    }
+}
+
+void stream_feed(stream_t* s, const char* buf, size_t len, writer_t* out)
+{
+    for (size_t i = 0; i < len; i++, s->offset++)
+    {
+        char c = buf[i];
+        if (c == '\n')
+        {
+            stream_end_line(s, out);
+            // stream_end_line resets the offset for the next line
+            s->offset = -1;
+            continue;
+        }
+        if (s->skipping)
+        {
+            continue;
+        }
+        if (!isspace((unsigned char) c))
+        {
+            s->blank = 0;
+        }
+
+        if (s->lit != STREAM_LIT_NONE && stream_literal_char(s, c))
+        {
+            continue;
+        }
+        if (c >= '0' && c <= '9')
+        {
+            s->lit = c == '0' ? STREAM_LIT_ZERO : STREAM_LIT_DIGITS;
+            s->literal = c - '0';
+            s->radix = 10;
+            s->literal_offset = s->offset;
+            continue;
+        }
+        if (isspace((unsigned char) c))
+        {
+            continue;
+        }
+
+        token_type type = stream_operator_type(c);
+        if (type == INVALID)
+        {
+            reduce_lex_error(&s->r, E_INVALID_TOKEN, s->offset);
+            s->skipping = 1;
+            continue;
+        }
+        token_t token;
+        init_token(&token, type, s->offset);
+        reduce_token(&s->r, token);
+    }
+}
+
+void stream_finish(stream_t* s, writer_t* out)
+{
+    if (!s->blank || s->offset)
+    {
+        stream_end_line(s, out);
+    }
+}
+
+void stream_free(stream_t* s)
+{
+    reduce_free(&s->r);
+    ctx_free(&s->ctx);
+}
+
+int stream_main(int n_files, char** files, int obase)
+{
+    static char* stdin_only[] = { "-" };
+    if (!n_files)
+    {
+        n_files = 1;
+        files = stdin_only;
+    }
+
+    writer_t out;
+    char* buf = malloc(STREAM_READ_SIZE);
+    if (!buf || writer_init(&out, STDOUT_FILENO, WRITER_BUF_SIZE))
+    {
+        eprintf("failed to allocate buffers\n");
+        free(buf);
+        return EXIT_FAILURE;
+    }
+    out.base = obase;
+    stream_t s;
+    stream_init(&s);
+
+    int status = EXIT_SUCCESS;
+    for (int i = 0; i < n_files; i++)
+    {
+        int is_stdin = !strcmp(files[i], "-");
+        int fd = is_stdin ? STDIN_FILENO : open(files[i], O_RDONLY);
+        if (fd < 0)
+        {
+            writer_flush(&out);
+            eprintf("%s: failed to open file\n", files[i]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        ssize_t n;
+        while ((n = read(fd, buf, STREAM_READ_SIZE)) > 0)
+        {
+            stream_feed(&s, buf, n, &out);
+        }
+        if (n < 0)
+        {
+            writer_flush(&out);
+            eprintf("%s: failed to read file\n", files[i]);
+            status = EXIT_FAILURE;
+        }
+        stream_finish(&s, &out);
+
+        if (!is_stdin)
+        {
+            close(fd);
+        }
+    }
+
+    stream_free(&s);
+    free(buf);
+    if (writer_free(&out))
+    {
+        status = EXIT_FAILURE;
+    }
+
+    return status;
+}
@@ -0,0 +1,88 @@
+/*
+ * src/stream.h
+ * streaming evaluation of newline-delimited expressions of unbounded length
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <reduce.h>
+#include <writer.h>
+
+// size of the chunks read from the input
+#define STREAM_READ_SIZE (1 << 20)
+
+// position within a literal, which is lexed like lex_literal
+typedef enum {
+    STREAM_LIT_NONE,       // not in a literal
+    STREAM_LIT_ZERO,       // leading 0, which may start a prefix
+    STREAM_LIT_DIGITS,
+    STREAM_LIT_PREFIX,     // 0x, 0o or 0b, a digit must follow
+    STREAM_LIT_SEPARATOR,  // underscore, a digit must follow
+} stream_lit_state;
+
+/*
+ * incremental lexer feeding a reducer; expressions may be split across any
+ * number of chunks, even in the middle of a literal
+ */
+typedef struct {
+    reduce_t r;
+    ctx_t ctx;               // results which overflow 64 bits, see bignum.h
+    int64_t offset;          // offset of the next byte within the current line
+    stream_lit_state lit;
+    uint64_t literal;        // value so far, at most LEX_LIT_MIN_MAGNITUDE
+    int radix;
+    int64_t literal_offset;
+    int64_t pending_offset;  // offset of a prefix letter or an underscore
+    int skipping;            // invalid token seen, skip to the end of the line
+    int blank;               // no tokens on the current line so far
+} stream_t;
+
+/*
+ * initialize a streaming evaluator
+ *
+ * @oparam s := evaluator to be initialized
+ */
+void stream_init(stream_t* s);
+
+/*
+ * lex a chunk of input; each completed line is evaluated and its result, or
+ * error message, is written as one output line
+ *
+ * @iparam s := evaluator
+ * @iparam buf := chunk of input
+ * @iparam len := length of the chunk
+ * @iparam out := writer receiving the results
+ */
+void stream_feed(stream_t* s, const char* buf, size_t len, writer_t* out);
+
+/*
+ * evaluate a final line which is missing its newline, if any
+ *
+ * @iparam s := evaluator
+ * @iparam out := writer receiving the result
+ */
+void stream_finish(stream_t* s, writer_t* out);
+
+/*
+ * release the evaluator's memory
+ */
+void stream_free(stream_t* s);
+
+/*
+ * run streaming mode over a list of files, or stdin if no files are given
+ *
+ * @iparam n_files := number of files
+ * @iparam files := file paths, "-" refers to stdin
+ * @iparam obase := base of the results, see writer_base_supported
+ * @returns the process exit status
+ */
+int stream_main(int n_files, char** files, int obase);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * src/symtab.c
+ * symbol table of interned variable names
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <symtab.h>
+
+#define SYMTAB_FREE_BUCKET -1
+
+// initial number of slots, grown by doubling
+#define SYMTAB_INIT_SLOTS 8
+
+void symtab_init(symtab_t* s, ctx_t* ctx)
+{
+    *s = (symtab_t) { .ctx=ctx };
+}
+
+static uint32_t symtab_hash(const char* name, size_t len)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return h;
+}
+
+// find the bucket holding a name, or the free bucket where it belongs
+static symtab_bucket_t* symtab_probe(
+    const symtab_t* s, const char* name, size_t len, uint32_t hash)
+{
+    uint32_t i = hash & s->mask;
+    while (s->table[i].slot != SYMTAB_FREE_BUCKET)
+    {
+        const symtab_name_t* n = &s->names[s->table[i].slot];
+        if (s->table[i].hash == hash && n->len == len
+            && !memcmp(n->name, name, len))
+        {
+            break;
+        }
+        i = (i + 1) & s->mask;
+    }
+    return &s->table[i];
+}
+
+int32_t symtab_find(const symtab_t* s, const char* name, size_t len)
+{
+    if (!s->n_slots)
+    {
+        return -1;
+    }
+    return symtab_probe(s, name, len, symtab_hash(name, len))->slot;
+}
+
+/*
+ * double the capacity of the slot arrays and rehash; the context cannot free,
+ * so the old arrays are only reclaimed with the context itself
+ */
+static int symtab_grow(symtab_t* s)
+{
+    int32_t capacity = s->capacity ? 2 * s->capacity : SYMTAB_INIT_SLOTS;
+    // the table is kept at most half full so that probe sequences stay short
+    uint32_t n_buckets = 2 * capacity;
+    symtab_name_t* names = ctx_alloc(s->ctx, capacity * sizeof(*names));
+    int64_t* values = ctx_alloc(s->ctx, capacity * sizeof(*values));
+    uint8_t* defined = ctx_alloc(s->ctx, capacity * sizeof(*defined));
+    symtab_bucket_t* table = ctx_alloc(s->ctx, n_buckets * sizeof(*table));
+    if (!names || !values || !defined || !table)
+    {
+        return -1;
+    }
+
+    if (s->n_slots)
+    {
+        memcpy(names, s->names, s->n_slots * sizeof(*names));
+        memcpy(values, s->values, s->n_slots * sizeof(*values));
+        memcpy(defined, s->defined, s->n_slots * sizeof(*defined));
+    }
+    for (uint32_t i = 0; i < n_buckets; i++)
+    {
+        table[i].slot = SYMTAB_FREE_BUCKET;
+    }
+    s->names = names;
+    s->values = values;
+    s->defined = defined;
+    s->capacity = capacity;
+    s->table = table;
+    s->mask = n_buckets - 1;
+
+    for (int32_t slot = 0; slot < s->n_slots; slot++)
+    {
+        uint32_t hash = symtab_hash(names[slot].name, names[slot].len);
+        symtab_bucket_t* b = symtab_probe(
+            s, names[slot].name, names[slot].len, hash);
+        *b = (symtab_bucket_t) { .hash=hash, .slot=slot };
+    }
+    return 0;
+}
+
+size_t symtab_scratch_size(size_t len)
+{
+    // names are separated by at least one character
+    size_t max_names = (len + 1) / 2;
+    size_t per_slot = sizeof(symtab_name_t) + sizeof(int64_t)
+        + sizeof(uint8_t) + 2 * sizeof(symtab_bucket_t);
+    // the interned copies, each padded to the context's alignment
+    size_t size = len + max_names * sizeof(int64_t);
+    // the context cannot free, so every size the table grows through stays
+    // allocated, each array padded to the context's alignment
+    size_t capacity = SYMTAB_INIT_SLOTS;
+    while (1)
+    {
+        size += capacity * per_slot + 4 * sizeof(int64_t);
+        if (capacity >= max_names)
+        {
+            break;
+        }
+        capacity *= 2;
+    }
+    return size;
+}
+
+int32_t symtab_intern(symtab_t* s, const char* name, size_t len)
+{
+    if (s->n_slots == s->capacity && symtab_grow(s))
+    {
+        return -1;
+    }
+    uint32_t hash = symtab_hash(name, len);
+    symtab_bucket_t* b = symtab_probe(s, name, len, hash);
+    if (b->slot != SYMTAB_FREE_BUCKET)
+    {
+        return b->slot;
+    }
+
+    char* copy = ctx_alloc(s->ctx, len);
+    if (!copy)
+    {
+        return -1;
+    }
+    memcpy(copy, name, len);
+    int32_t slot = s->n_slots++;
+    s->names[slot] = (symtab_name_t) { .name=copy, .len=len };
+    s->values[slot] = 0;
+    s->defined[slot] = 0;
+    *b = (symtab_bucket_t) { .hash=hash, .slot=slot };
+    return slot;
+}
+
+void symtab_set(symtab_t* s, int32_t slot, int64_t value)
+{
+    s->values[slot] = value;
+    s->defined[slot] = 1;
+}
+
+int symtab_resolve(
+    symtab_t* s, const char* src, size_t len, token_t* tokens,
+    int32_t n_tokens, int intern, diag_t* diag)
+{
+    for (int32_t n = 0; n < n_tokens; n++)
+    {
+        if (!IS_VARIABLE(tokens[n]))
+        {
+            continue;
+        }
+        const char* name = src + tokens[n].offset;
+        size_t name_len = lex_name(name, src + len);
+        if (!intern)
+        {
+            tokens[n].value = symtab_find(s, name, name_len);
+            continue;
+        }
+        tokens[n].value = symtab_intern(s, name, name_len);
+        if (tokens[n].value < 0)
+        {
+            set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int symtab_check(
+    const symtab_t* s, const token_t* rpn, int32_t n_rpn, diag_t* diag)
+{
+    int32_t depth = 0;
+    for (int32_t n = 0; n < n_rpn; n++)
+    {
+        if (IS_VARIABLE(rpn[n]) && !symtab_defined(s, &rpn[n]))
+        {
+            set_diag(diag, E_UNDEFINED_VAR, &rpn[n], n, 0);
+            return -1;
+        }
+        if (ARITY(rpn[n]) > depth)
+        {
+            // the evaluator reports the missing operand first
+            break;
+        }
+        depth -= ARITY(rpn[n]) - 1;
+    }
+    return 0;
+}
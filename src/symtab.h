@@ -0,0 +1,141 @@
+/*
+ * src/symtab.h
+ * symbol table of interned variable names
+ *
+ * each distinct name is interned once and given a slot; the values of all
+ * variables live in one array indexed by slot, so once the variable tokens of
+ * an expression have been resolved to their slots, looking a variable up
+ * while evaluating is an array index rather than a string comparison; this
+ * lets an expression be compiled once and evaluated against many bindings
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+
+// hash table bucket; the hash is kept inline so that probing only touches the
+// table until a likely match is found
+typedef struct {
+    uint32_t hash;
+    int32_t slot;  // -1 if the bucket is free
+} symtab_bucket_t;
+
+typedef struct {
+    const char* name;  // interned copy, not NUL-terminated
+    uint32_t len;
+} symtab_name_t;
+
+typedef struct {
+    ctx_t* ctx;            // owns the table, must not be reset while in use
+    symtab_name_t* names;  // indexed by slot
+    int64_t* values;       // indexed by slot
+    uint8_t* defined;      // indexed by slot, 0 until a value is assigned
+    int32_t n_slots;
+    int32_t capacity;      // capacity of the slot arrays
+    symtab_bucket_t* table;
+    uint32_t mask;
+} symtab_t;
+
+/*
+ * create an empty symbol table; memory is allocated lazily from the context
+ *
+ * @oparam s := symbol table
+ * @iparam ctx := context which provides the memory of the table
+ */
+void symtab_init(symtab_t* s, ctx_t* ctx);
+
+/*
+ * look up the slot of a name
+ *
+ * @iparam s := symbol table
+ * @iparam name := variable name, need not be NUL-terminated
+ * @iparam len := length of the name
+ * @returns the slot of the name, or -1 if it has not been interned
+ */
+int32_t symtab_find(const symtab_t* s, const char* name, size_t len);
+
+/*
+ * upper bound on the memory a table allocates from its context when every
+ * name of a single expression is interned into it, for callers whose context
+ * cannot grow
+ *
+ * @iparam len := length of the expression
+ * @returns size in bytes
+ */
+size_t symtab_scratch_size(size_t len);
+
+/*
+ * look up the slot of a name, interning it as an undefined variable if it is
+ * not yet in the table
+ *
+ * @iparam s := symbol table
+ * @iparam name := variable name, need not be NUL-terminated
+ * @iparam len := length of the name
+ * @returns the slot of the name, or -1 if there was not enough memory
+ */
+int32_t symtab_intern(symtab_t* s, const char* name, size_t len);
+
+/*
+ * assign a value to a variable
+ *
+ * @iparam s := symbol table
+ * @iparam slot := slot returned by symtab_intern
+ * @iparam value := new value
+ */
+void symtab_set(symtab_t* s, int32_t slot, int64_t value);
+
+/*
+ * resolve the variable tokens of an expression to their slots
+ *
+ * @iparam s := symbol table
+ * @iparam src := expression source the tokens were lexed from
+ * @iparam len := length of the expression source
+ * @iparam tokens := array of tokens, variables are updated in place
+ * @iparam n_tokens := length of tokens array
+ * @iparam intern := whether names which are not yet in the table are
+ *                   interned; otherwise they are left at slot -1, which is
+ *                   never defined, so that unknown names do not grow the table
+ * @oparam diag := filled in with the error details if resolution fails
+ * @returns 0 on success, -1 if there was not enough memory
+ */
+int symtab_resolve(
+    symtab_t* s, const char* src, size_t len, token_t* tokens,
+    int32_t n_tokens, int intern, diag_t* diag);
+
+/*
+ * check that every variable of a resolved expression is defined, for the
+ * evaluators which do not look at the symbol table themselves; errors are
+ * reported in the order evaluate_rpn would find them, so a missing operand
+ * which precedes the first undefined variable is left to the evaluator
+ *
+ * @iparam s := symbol table, NULL if no variables are defined
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @oparam diag := filled in with the error details if a variable is undefined
+ * @returns 0 on success, -1 on error
+ */
+int symtab_check(
+    const symtab_t* s, const token_t* rpn, int32_t n_rpn, diag_t* diag);
+
+/*
+ * check whether a resolved variable token refers to a defined variable
+ *
+ * @iparam s := symbol table, NULL if no variables are defined
+ * @iparam token := variable token
+ * @returns 1 if the variable is defined, 0 otherwise
+ */
+static inline int symtab_defined(const symtab_t* s, const token_t* token)
+{
+    return s && token->value >= 0 && token->value < s->n_slots
+        && s->defined[token->value];
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * src/vm.c
+ * bytecode compiler and virtual machine for repeated evaluation
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <vm.h>
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#endif
+
+static const vm_op vm_ops[N_TOKEN_TYPES] = {
+    [OP_ADD] = VM_ADD,
+    [OP_SUB] = VM_SUB,
+    [OP_MUL] = VM_MUL,
+    [OP_NEG] = VM_NEG,
+};
+
+int vm_compile(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, bytecode_t* bc, diag_t* diag)
+{
+    // every token lowers to at most one push instruction, plus the return
+    uint8_t* code = ctx_alloc(ctx, n_rpn * VM_PUSH_SIZE + 1);
+    if (!code)
+    {
+        set_diag(diag, E_NO_MEMORY, NULL, -1, 0);
+        return -1;
+    }
+    size_t len = 0;
+    int depth = 0;
+
+    for (int n = 0; n < n_rpn; n++)
+    {
+        if (IS_OPERAND(rpn[n]))
+        {
+            if (depth == VM_MAX_DEPTH)
+            {
+                set_diag(diag, E_MAX_TOKENS, NULL, -1, 0);
+                return -1;
+            }
+            // variables are resolved to their slots before compiling, so
+            // loading one is an index into the bound values
+            if (IS_VARIABLE(rpn[n]))
+            {
+                int32_t slot = (int32_t) rpn[n].value;
+                code[len] = VM_LOAD;
+                memcpy(&code[len + 1], &slot, sizeof(int32_t));
+                len += VM_LOAD_SIZE;
+            }
+            else
+            {
+                code[len] = VM_PUSH;
+                memcpy(&code[len + 1], &rpn[n].value, sizeof(int64_t));
+                len += VM_PUSH_SIZE;
+            }
+            depth++;
+            continue;
+        }
+        // not enough operands on the stack, see eval.c:evaluate_rpn
+        if (depth < ARITY(rpn[n]))
+        {
+            set_diag(diag, E_OP_MISSING_EXPR, &rpn[n], n, SIDE_RIGHT);
+            return -1;
+        }
+        depth -= ARITY(rpn[n]) - 1;
+        // unary plus leaves its operand unchanged
+        if (rpn[n].type != OP_POS)
+        {
+            code[len++] = vm_ops[rpn[n].type];
+        }
+    }
+
+    if (!depth)
+    {
+        set_diag(diag, E_EMPTY_EXPR, NULL, -1, 0);
+        return -1;
+    }
+    code[len++] = VM_RET;
+
+    bc->code = code;
+    bc->len = len;
+    return 0;
+}
+
+int vm_run(const bytecode_t* bc, const int64_t* vars, int64_t* result)
+{
+    int64_t stack[VM_MAX_DEPTH];
+    int64_t* sp = stack;
+    const uint8_t* ip = bc->code;
+
+#ifdef VM_THREADED_DISPATCH
+    static const void* const labels[N_VM_OPS] = {
+        [VM_PUSH] = &&op_PUSH,
+        [VM_LOAD] = &&op_LOAD,
+        [VM_ADD]  = &&op_ADD,
+        [VM_SUB]  = &&op_SUB,
+        [VM_MUL]  = &&op_MUL,
+        [VM_NEG]  = &&op_NEG,
+        [VM_RET]  = &&op_RET,
+    };
+#define VM_CASE(op) op_##op
+#define VM_NEXT goto *labels[*ip++]
+    VM_NEXT;
+#else
+#define VM_CASE(op) case VM_##op
+#define VM_NEXT break
+    while (1)
+    {
+        switch ((vm_op) *ip++)
+        {
+#endif
+
+    VM_CASE(PUSH):
+        memcpy(sp++, ip, sizeof(int64_t));
+        ip += sizeof(int64_t);
+        VM_NEXT;
+    VM_CASE(LOAD):
+    {
+        int32_t slot;
+        memcpy(&slot, ip, sizeof(int32_t));
+        *sp++ = vars[slot];
+        ip += sizeof(int32_t);
+        VM_NEXT;
+    }
+    // an overflow abandons the evaluation, see evaluate_rpn
+    VM_CASE(ADD):
+        sp--;
+        if (__builtin_add_overflow(sp[-1], sp[0], &sp[-1]))
+        {
+            return 1;
+        }
+        VM_NEXT;
+    VM_CASE(SUB):
+        sp--;
+        if (__builtin_sub_overflow(sp[-1], sp[0], &sp[-1]))
+        {
+            return 1;
+        }
+        VM_NEXT;
+    VM_CASE(MUL):
+        sp--;
+        if (__builtin_mul_overflow(sp[-1], sp[0], &sp[-1]))
+        {
+            return 1;
+        }
+        VM_NEXT;
+    VM_CASE(NEG):
+        if (__builtin_sub_overflow((int64_t) 0, sp[-1], &sp[-1]))
+        {
+            return 1;
+        }
+        VM_NEXT;
+    VM_CASE(RET):
+        *result = sp[-1];
+        return 0;
+
+#ifndef VM_THREADED_DISPATCH
+        default:
+            *result = sp[-1];
+            return 0;
+        }
+    }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+}
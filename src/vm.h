@@ -0,0 +1,80 @@
+/*
+ * src/vm.h
+ * bytecode compiler and virtual machine for repeated evaluation
+ *
+ * an expression in Reverse Polish notation is lowered into dense bytecode:
+ * 1-byte opcodes, with literals stored inline after VM_PUSH and variable
+ * slots inline after VM_LOAD; the VM keeps
+ * operands in a plain int64 stack, so evaluating an operator is a single
+ * arithmetic instruction and an overflow check instead of an indirect call on
+ * token structs; a result which overflows is left to evaluate_rpn
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef VM_H
+#define VM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <lex.h>
+
+typedef enum {
+    VM_PUSH,  // followed by an 8-byte little-endian literal
+    VM_LOAD,  // followed by a 4-byte little-endian variable slot
+    VM_ADD,
+    VM_SUB,
+    VM_MUL,
+    VM_NEG,
+    VM_RET,
+    N_VM_OPS
+} vm_op;
+
+// every operand is pushed at most once, so the token limit bounds the depth
+#define VM_MAX_DEPTH (MAX_TOKENS)
+
+// bytes taken by an instruction which pushes a literal, the longest one
+#define VM_PUSH_SIZE (1 + sizeof(int64_t))
+// bytes taken by an instruction which loads a variable
+#define VM_LOAD_SIZE (1 + sizeof(int32_t))
+
+typedef struct {
+    uint8_t* code;
+    size_t len;
+} bytecode_t;
+
+/*
+ * lower an expression in Reverse Polish notation into bytecode; the stack
+ * depth is checked while compiling, so running the bytecode cannot fail
+ *
+ * @iparam ctx := evaluation context, owns the bytecode
+ * @iparam rpn := array of tokens in postfix notation
+ * @iparam n_rpn := length of RPN array
+ * @oparam bc := compiled bytecode
+ * @oparam diag := filled in with the error details if compilation fails; the
+ *                 errors are the same ones evaluate_rpn reports
+ * @returns 0 on success, -1 on error
+ */
+int vm_compile(
+    ctx_t* ctx, const token_t* rpn, int n_rpn, bytecode_t* bc, diag_t* diag);
+
+/*
+ * run compiled bytecode; the bytecode is not modified, so it can be run any
+ * number of times, including concurrently
+ *
+ * dispatch is threaded through computed gotos when the compiler supports
+ * them, unless VM_SWITCH_DISPATCH is defined
+ *
+ * @iparam bc := compiled bytecode
+ * @iparam vars := variable values indexed by slot, may be NULL if the
+ *                 expression has no variables
+ * @oparam result := expression result
+ * @returns 0 on success, or 1 if an operation overflowed 64 bits, in which
+ *          case the expression must be evaluated with evaluate_rpn instead
+ */
+int vm_run(const bytecode_t* bc, const int64_t* vars, int64_t* result);
+
+#endif
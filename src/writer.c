@@ -0,0 +1,235 @@
+/*
+ * src/writer.c
+ * buffered output writer used for bulk result output
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bignum.h>
+#include <writer.h>
+
+// decimal digits of every number below 100, two characters each
+static const char writer_digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+int writer_init(writer_t* w, int fd, size_t size)
+{
+    *w = (writer_t) {
+        .fd=fd, .buf=malloc(size), .size=size, .used=0, .base=10 };
+    return w->buf ? 0 : -1;
+}
+
+int writer_flush(writer_t* w)
+{
+    // in-memory writers are drained by their owner
+    if (w->fd < 0)
+    {
+        return w->failed ? -1 : 0;
+    }
+
+    size_t off = 0;
+    while (off < w->used && !w->failed)
+    {
+        ssize_t n = write(w->fd, w->buf + off, w->used - off);
+        // a write which makes no progress would be retried forever
+        if (n == 0 || (n < 0 && errno != EINTR))
+        {
+            w->failed = 1;
+        }
+        else if (n > 0)
+        {
+            off += n;
+        }
+    }
+    w->used = 0;
+
+    return w->failed ? -1 : 0;
+}
+
+// grow the buffer to fit len more bytes
+static int writer_grow(writer_t* w, size_t len)
+{
+    size_t size = w->size ? w->size : WRITER_BUF_SIZE;
+    while (size - w->used < len)
+    {
+        size *= 2;
+    }
+    char* buf = realloc(w->buf, size);
+    if (!buf)
+    {
+        w->failed = 1;
+        return -1;
+    }
+    w->buf = buf;
+    w->size = size;
+
+    return 0;
+}
+
+void writer_put(writer_t* w, const char* data, size_t len)
+{
+    if (w->size - w->used < len && w->fd < 0)
+    {
+        if (writer_grow(w, len))
+        {
+            return;
+        }
+    }
+    else if (w->size - w->used < len)
+    {
+        writer_flush(w);
+        // data larger than the whole buffer is written through directly
+        if (len > w->size)
+        {
+            w->used = len;
+            char* buf = w->buf;
+            w->buf = (char*) data;
+            writer_flush(w);
+            w->buf = buf;
+            return;
+        }
+    }
+    memcpy(w->buf + w->used, data, len);
+    w->used += len;
+}
+
+void writer_putc(writer_t* w, char c)
+{
+    if (w->used == w->size)
+    {
+        writer_put(w, &c, 1);
+        return;
+    }
+    w->buf[w->used++] = c;
+}
+
+void writer_puts(writer_t* w, const char* s)
+{
+    writer_put(w, s, strlen(s));
+}
+
+int writer_base_supported(int base)
+{
+    return base == 2 || base == 8 || base == 10 || base == 16;
+}
+
+// number of decimal digits of a value
+static inline size_t writer_n_digits(uint64_t u)
+{
+    size_t n = 1;
+    for (; u >= 100; u /= 100)
+    {
+        n += 2;
+    }
+    return n + (u >= 10);
+}
+
+size_t writer_format_int(char* buf, int64_t value, int base)
+{
+    char* p = buf;
+    uint64_t u = (uint64_t) value;
+    // the magnitude of INT64_MIN does not fit in an int64
+    if (value < 0)
+    {
+        *p++ = '-';
+        u = 0 - u;
+    }
+    if (base == 10)
+    {
+        // the digits are written from the last one, two at a time
+        char* end = p + writer_n_digits(u);
+        char* it = end;
+        for (; u >= 100; u /= 100)
+        {
+            it -= 2;
+            memcpy(it, &writer_digit_pairs[2 * (u % 100)], 2);
+        }
+        if (u >= 10)
+        {
+            memcpy(it - 2, &writer_digit_pairs[2 * u], 2);
+        }
+        else
+        {
+            it[-1] = (char) ('0' + u);
+        }
+        return end - buf;
+    }
+
+    // each digit is a group of bits
+    int bits = base == 16 ? 4 : base == 8 ? 3 : 1;
+    *p++ = '0';
+    *p++ = base == 16 ? 'x' : base == 8 ? 'o' : 'b';
+    size_t n = 1;
+    while (n * bits < 64 && u >> (n * bits))
+    {
+        n++;
+    }
+    for (size_t i = n; i > 0; i--)
+    {
+        p[i - 1] = "0123456789abcdef"[u & (base - 1)];
+        u >>= bits;
+    }
+    return p + n - buf;
+}
+
+void writer_put_int(writer_t* w, int64_t value)
+{
+    // formatted straight into the buffer when it has room
+    if (w->size - w->used >= WRITER_INT_LEN)
+    {
+        w->used += writer_format_int(w->buf + w->used, value, w->base);
+        return;
+    }
+    char digits[WRITER_INT_LEN];
+    size_t len = writer_format_int(digits, value, w->base);
+    writer_put(w, digits, len);
+}
+
+void writer_put_value(writer_t* w, const token_t* value)
+{
+    if (value->type != BIGNUM)
+    {
+        writer_put_int(w, value->value);
+        return;
+    }
+    // the text is formatted straight into the buffer, and its digits are
+    // computed in a copy of the limbs placed just past it
+    const bignum_t* b = value->big;
+    size_t len = bignum_format_len(b, w->base);
+    size_t room = len + alignof(uint32_t) + b->n_limbs * sizeof(uint32_t);
+    if (w->size - w->used < room && w->fd >= 0)
+    {
+        writer_flush(w);
+    }
+    // in-memory writers grow, and so does a buffer shorter than the value
+    if (w->size - w->used < room && writer_grow(w, room))
+    {
+        return;
+    }
+    char* text = w->buf + w->used;
+    uintptr_t end = (uintptr_t) (text + len);
+    uint32_t* scratch = (uint32_t*) ((end + alignof(uint32_t) - 1)
+        & ~(uintptr_t) (alignof(uint32_t) - 1));
+    w->used += bignum_format(text, b, w->base, scratch);
+}
+
+int writer_free(writer_t* w)
+{
+    int rc = writer_flush(w);
+    free(w->buf);
+    w->buf = NULL;
+
+    return rc;
+}
@@ -0,0 +1,109 @@
+/*
+ * src/writer.h
+ * buffered output writer used for bulk result output
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <lex.h>
+
+// default size of the output buffer
+#define WRITER_BUF_SIZE (1 << 20)
+// longest formatted integer: a sign, a prefix and 64 binary digits
+#define WRITER_INT_LEN 67
+
+typedef struct {
+    int fd;
+    char* buf;
+    size_t size;
+    size_t used;
+    int failed;  // set if a write to the file descriptor failed
+    int base;    // base of the integers written, see writer_put_int
+} writer_t;
+
+/*
+ * initialize a writer which flushes to a file descriptor; a writer with a
+ * negative file descriptor collects its output in memory, growing the buffer
+ * instead of flushing; integers are written in decimal until the base is
+ * changed
+ *
+ * @oparam w := writer to be initialized
+ * @iparam fd := file descriptor written to on flush
+ * @iparam size := size of the output buffer
+ * @returns 0 on success, otherwise -1
+ */
+int writer_init(writer_t* w, int fd, size_t size);
+
+/*
+ * append bytes to the output buffer, flushing if it is full
+ *
+ * @iparam w := writer
+ * @iparam data := bytes to be written
+ * @iparam len := number of bytes
+ */
+void writer_put(writer_t* w, const char* data, size_t len);
+
+/*
+ * append a single character to the output buffer
+ */
+void writer_putc(writer_t* w, char c);
+
+/*
+ * append a NUL-terminated string to the output buffer
+ */
+void writer_puts(writer_t* w, const char* s);
+
+/*
+ * check whether integers can be written in a base
+ *
+ * @iparam base := base
+ * @returns 1 for 2, 8, 10 and 16, otherwise 0
+ */
+int writer_base_supported(int base);
+
+/*
+ * format an integer; a negative value is written with a sign, and in the
+ * other bases the digits follow a 0b, 0o or 0x prefix, so that the output can
+ * be read back as an expression
+ *
+ * @oparam buf := output, at least WRITER_INT_LEN bytes, not NUL-terminated
+ * @iparam value := integer
+ * @iparam base := base, see writer_base_supported
+ * @returns the length of the output
+ */
+size_t writer_format_int(char* buf, int64_t value, int base);
+
+/*
+ * append an integer to the output buffer in the writer's base
+ */
+void writer_put_int(writer_t* w, int64_t value);
+
+/*
+ * append a result to the output buffer in the writer's base; the result is a
+ * literal or a bignum, see bignum.h
+ */
+void writer_put_value(writer_t* w, const token_t* value);
+
+/*
+ * write out the contents of the output buffer
+ *
+ * @iparam w := writer
+ * @returns 0 on success, otherwise -1
+ */
+int writer_flush(writer_t* w);
+
+/*
+ * flush and release the output buffer; the file descriptor is not closed
+ *
+ * @iparam w := writer
+ * @returns 0 if all output was written, otherwise -1
+ */
+int writer_free(writer_t* w);
+
+#endif
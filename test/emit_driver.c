@@ -0,0 +1,30 @@
+/*
+ * test/emit_driver.c
+ * prints the value of every function emitted by ccc --emit-c --batch emit
+ *
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+extern const long emit_count;
+extern int (* const emit_table[])(int64_t* result);
+
+int main(void)
+{
+    for (long i = 0; i < emit_count; i++)
+    {
+        int64_t result;
+        if (emit_table[i](&result))
+        {
+            printf("overflow\n");
+        }
+        else
+        {
+            printf("%" PRId64 "\n", result);
+        }
+    }
+    return 0;
+}
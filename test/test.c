@@ -3,19 +3,98 @@
  * author: Ian Brault <ian.brault@engineering.ucla.edu>
  */
 
+#define _DEFAULT_SOURCE
+
 #include <cgreen/cgreen.h>
 
+#include <test_batch.h>
+#include <test_bignum.h>
+#include <test_cache.h>
+#include <test_ccc.h>
+#include <test_columns.h>
+#include <test_ctx.h>
+#include <test_dag.h>
+#include <test_emit.h>
+#include <test_engine.h>
 #include <test_eval.h>
+#include <test_jit.h>
 #include <test_lex.h>
+#include <test_opt.h>
+#include <test_regvm.h>
+#include <test_serve.h>
+#include <test_sheet.h>
+#include <test_shm.h>
+#include <test_stream.h>
+#include <test_symtab.h>
+#include <test_vm.h>
+#include <test_writer.h>
 
 int main(int argc, char **argv)
 {
     TestSuite *suite = create_test_suite();
 
+    // test_batch.h
+    add_test(suite, test_batch_aggregates);
+    add_test(suite, test_batch_lines);
+    add_test(suite, test_batch_threads_keep_order);
+
+    // test_bignum.h
+    add_test(suite, test_bignum_apply);
+    add_test(suite, test_bignum_cmp);
+
+    // test_cache.h
+    add_test(suite, test_cache_normalize);
+    add_test(suite, test_cache_lru);
+    add_test(suite, test_cache_eviction_keeps_table_consistent);
+    add_test(suite, test_cache_engine);
+    // test_ccc.h
+    add_test(suite, test_ccc_eval);
+    add_test(suite, test_ccc_compile_run);
+    add_test(suite, test_ccc_error_value);
+    add_test(suite, test_ccc_scratch_exhausted);
+    add_test(suite, test_ccc_variables);
+    add_test(suite, test_ccc_overflow);
+
+    // test_columns.h
+    add_test(suite, test_columns_expressions);
+    add_test(suite, test_columns_random_expressions);
+    add_test(suite, test_columns_overflow);
+
+    // test_ctx.h
+    add_test(suite, test_ctx_alloc_reset);
+    add_test(suite, test_ctx_overflow_folds_on_reset);
+
+    // test_dag.h
+    add_test(suite, test_dag_eval);
+    add_test(suite, test_dag_shares_subexpressions);
+    add_test(suite, test_dag_errors);
+    // test_emit.h
+    add_test(suite, test_emit_function);
+    add_test(suite, test_emit_function_variables);
+    add_test(suite, test_emit_function_errors);
+    // test_engine.h
+    add_test(suite, test_engine_fused_matches_pipeline);
+    add_test(suite, test_engine_fused_limits);
+    add_test(suite, test_engine_vm_matches_pipeline);
+    add_test(suite, test_engine_regvm_matches_pipeline);
+    add_test(suite, test_engine_dag_matches_pipeline);
+    add_test(suite, test_engine_variables);
+    add_test(suite, test_engine_read_only);
+
+    // test_jit.h
+    add_test(suite, test_jit_expressions);
+    add_test(suite, test_jit_random_expressions);
+    add_test(suite, test_jit_variables);
+
     // test_lex.h
     add_test(suite, test_tokenize_valid);
     add_test(suite, test_tokenize_valid_invalid_syntax);
     add_test(suite, test_tokenize_invalid);
+    add_test(suite, test_tokenize_variables);
+    add_test(suite, test_tokenize_slice);
+    add_test(suite, test_lex_literals);
+    add_test(suite, test_tokenize_kernels_edge_cases);
+    add_test(suite, test_tokenize_kernels_random_inputs);
 
     // test_eval.h
     add_test(suite, test_shunting_yard_basic);
@@ -33,5 +112,45 @@ int main(int argc, char **argv)
     add_test(suite, test_eval_negation);
     add_test(suite, test_eval_invalid_binary_op);
 
+    // test_opt.h
+    add_test(suite, test_opt_fold_constants);
+    add_test(suite, test_opt_random_expressions);
+    add_test(suite, test_opt_errors);
+    // test_regvm.h
+    add_test(suite, test_regvm_run);
+    add_test(suite, test_regvm_register_count);
+
+    // test_serve.h
+    add_test(suite, test_serve_loopback);
+
+    // test_sheet.h
+    add_test(suite, test_sheet_recompute_downstream);
+    add_test(suite, test_sheet_errors);
+    add_test(suite, test_sheet_cycles);
+
+    // test_shm.h
+    add_test(suite, test_shm_round_trip);
+
+    // test_stream.h
+    add_test(suite, test_stream_eval);
+    add_test(suite, test_stream_errors);
+    add_test(suite, test_stream_literals);
+    add_test(suite, test_stream_long_chain);
+    add_test(suite, test_stream_bignum_chain);
+    add_test(suite, test_stream_error_offset);
+
+    // test_symtab.h
+    add_test(suite, test_symtab_intern);
+    add_test(suite, test_symtab_resolve_check);
+
+    // test_vm.h
+    add_test(suite, test_vm_run);
+    add_test(suite, test_vm_compile_errors);
+
+    // test_writer.h
+    add_test(suite, test_writer_format_int);
+    add_test(suite, test_writer_put_int);
+    add_test(suite, test_writer_put_value);
+
     return run_test_suite(suite, create_text_reporter());
 }
@@ -0,0 +1,240 @@
+/*
+ * test/test_batch.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cgreen/cgreen.h>
+
+#include <batch.h>
+#include <bignum.h>
+#include <engine.h>
+#include <writer.h>
+
+// evaluate each line into an accumulator
+static void batch_agg_lines(
+    engine_t* e, batch_agg_t* agg, const char* const* lines, int n_lines)
+{
+    for (int i = 0; i < n_lines; i++)
+    {
+        batch_eval_line(e, lines[i], strlen(lines[i]), NULL, agg);
+    }
+}
+
+Ensure(test_batch_aggregates)
+{
+    engine_t e;
+    engine_init(&e, ENGINE_PIPELINE);
+    static const int64_t bounds[] = { 0, 10 };
+    batch_agg_t a, b;
+    int which = BATCH_AGG_SUM | BATCH_AGG_MIN | BATCH_AGG_MAX
+        | BATCH_AGG_ERRORS | BATCH_AGG_HISTOGRAM;
+    assert_that(batch_agg_init(&a, which, bounds, 2) == 0);
+    assert_that(batch_agg_init(&b, which, bounds, 2) == 0);
+
+    // blank lines are neither results nor errors
+    const char* first[] = { "1 + 2", "-4", "", "1 +", "10" };
+    const char* second[] = {
+        "9223372036854775807", "9223372036854775807", "(1",
+        "-9223372036854775807 * 10", "9223372036854775807 * 10" };
+    batch_agg_lines(&e, &a, first, 5);
+    batch_agg_lines(&e, &b, second, 5);
+    assert_that(a.n_results == 3);
+    assert_that(a.n_errors == 1);
+    assert_that(a.min.value == -4);
+    assert_that(a.max.value == 10);
+    // each bucket holds the values from its bound up to the next one
+    assert_that(a.counts[0] == 1);
+    assert_that(a.counts[1] == 1);
+    assert_that(a.counts[2] == 1);
+    // bignums lie beyond every bound, on the side of their sign
+    assert_that(b.counts[0] == 1);
+    assert_that(b.counts[1] == 0);
+    assert_that(b.counts[2] == 3);
+
+    // the sum is exact, like the results
+    batch_agg_merge(&a, &b);
+    assert_that(a.sum.type == BIGNUM);
+    assert_that(a.n_errors == 2);
+    assert_that(a.min.type == BIGNUM && a.min.big->sign < 0);
+    assert_that(a.max.type == BIGNUM && a.max.big->sign > 0);
+    assert_that(a.counts[0] == 2);
+    assert_that(a.counts[2] == 4);
+
+    // aggregates are written in decimal whatever the base of the results
+    writer_t out;
+    writer_init(&out, -1, 0);
+    out.base = 16;
+    batch_agg_write(&a, &out);
+    const char* expected =
+        "sum: 18446744073709551623\n"
+        "min: -92233720368547758070\n"
+        "max: 92233720368547758070\n"
+        "errors: 2\n"
+        "histogram (-inf, 0): 2\n"
+        "histogram [0, 10): 1\n"
+        "histogram [10, +inf): 4\n";
+    assert_that(out.used == strlen(expected));
+    assert_that(!memcmp(out.buf, expected, out.used));
+
+    // the extremes of no results are not printed as numbers
+    batch_agg_t empty;
+    assert_that(batch_agg_init(&empty, BATCH_AGG_MIN, NULL, 0) == 0);
+    out.used = 0;
+    batch_agg_write(&empty, &out);
+    assert_that(out.used == strlen("min: none\n"));
+
+    writer_free(&out);
+    batch_agg_free(&a);
+    batch_agg_free(&b);
+    batch_agg_free(&empty);
+    engine_free(&e);
+}
+
+/*
+ * generate a batch of expressions, with an error and a blank line every so
+ * often, along with the expected output; the last line has no newline
+ */
+static void batch_test_input(int n_lines, writer_t* in, writer_t* expected)
+{
+    char line[64];
+    for (int i = 0; i < n_lines; i++)
+    {
+        if (i % 997 == 500)
+        {
+            snprintf(line, sizeof(line), "(%d\n", i);
+            writer_puts(in, line);
+            writer_puts(expected, "error: 0: unmatched \"(\"\n");
+        }
+        else if (i % 1009 == 0)
+        {
+            writer_putc(in, '\n');
+            writer_putc(expected, '\n');
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%d * 3 - 7\n", i);
+            writer_puts(in, line);
+            writer_put_int(expected, (int64_t) i * 3 - 7);
+            writer_putc(expected, '\n');
+        }
+    }
+    writer_puts(in, "1 + 1");
+    writer_puts(expected, "2\n");
+}
+
+typedef struct {
+    int fd;
+    const writer_t* in;
+    pthread_t reader;
+} batch_test_feed_t;
+
+static void batch_test_on_signal(int sig)
+{
+    (void) sig;
+}
+
+/*
+ * write the input to a pipe a few bytes at a time, so that reads end midline,
+ * after interrupting the reader while it waits for the first bytes
+ */
+static void* batch_test_feed(void* arg)
+{
+    batch_test_feed_t* feed = arg;
+    struct timespec delay = { .tv_sec=0, .tv_nsec=10000000 };
+    nanosleep(&delay, NULL);
+    pthread_kill(feed->reader, SIGUSR1);
+    for (size_t off = 0; off < feed->in->used; off += 7)
+    {
+        size_t n = feed->in->used - off < 7 ? feed->in->used - off : 7;
+        if (write(feed->fd, feed->in->buf + off, n) != (ssize_t) n)
+        {
+            break;
+        }
+    }
+    close(feed->fd);
+    return NULL;
+}
+
+Ensure(test_batch_lines)
+{
+    engine_t e;
+    engine_init(&e, ENGINE_PIPELINE);
+    writer_t in, out, expected;
+    writer_init(&in, -1, 0);
+    writer_init(&out, -1, 0);
+    writer_init(&expected, -1, 0);
+    batch_test_input(3000, &in, &expected);
+
+    // an error in the middle of the batch does not stop it, and neither does
+    // a read interrupted by a signal
+    struct sigaction sa = { .sa_handler=batch_test_on_signal }, saved;
+    sigaction(SIGUSR1, &sa, &saved);
+    int fds[2];
+    assert_that(pipe(fds) == 0);
+    batch_test_feed_t feed = {
+        .fd=fds[1], .in=&in, .reader=pthread_self() };
+    pthread_t feeder;
+    pthread_create(&feeder, NULL, batch_test_feed, &feed);
+    assert_that(batch_eval_fd(&e, fds[0], &out, NULL) == 0);
+    pthread_join(feeder, NULL);
+    close(fds[0]);
+    sigaction(SIGUSR1, &saved, NULL);
+    assert_that(out.used == expected.used);
+    assert_that(!memcmp(out.buf, expected.buf, expected.used));
+
+    writer_free(&in);
+    writer_free(&out);
+    writer_free(&expected);
+    engine_free(&e);
+}
+
+Ensure(test_batch_threads_keep_order)
+{
+    writer_t in, expected;
+    writer_init(&in, -1, 0);
+    writer_init(&expected, -1, 0);
+    // several chunks per thread
+    batch_test_input(400000, &in, &expected);
+    assert_that(in.used > 4 * BATCH_READ_SIZE);
+
+    char in_path[] = "/tmp/ccc_test_batch_XXXXXX";
+    char out_path[] = "/tmp/ccc_test_batch_XXXXXX";
+    int in_fd = mkstemp(in_path);
+    int out_fd = mkstemp(out_path);
+    assert_that(in_fd >= 0 && out_fd >= 0);
+    assert_that(write(in_fd, in.buf, in.used) == (ssize_t) in.used);
+    close(in_fd);
+
+    // batch_main writes to stdout
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    char* files[] = { in_path };
+    int status = batch_main(1, files, 4, ENGINE_PIPELINE, 0, 10, NULL);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    assert_that(status == EXIT_SUCCESS);
+
+    struct stat st;
+    fstat(out_fd, &st);
+    char* out = malloc(st.st_size);
+    assert_that(pread(out_fd, out, st.st_size, 0) == st.st_size);
+    assert_that((size_t) st.st_size == expected.used);
+    assert_that(!memcmp(out, expected.buf, expected.used));
+
+    free(out);
+    close(out_fd);
+    unlink(in_path);
+    unlink(out_path);
+    writer_free(&in);
+    writer_free(&expected);
+}
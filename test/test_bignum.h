@@ -0,0 +1,89 @@
+/*
+ * test/test_bignum.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <bignum.h>
+#include <ctx.h>
+#include <lex.h>
+
+// format a literal or bignum in a base and compare it with the expected text
+static uint8_t bignum_formats_as(const token_t* t, int base, const char* s)
+{
+    char buf[256];
+    uint32_t scratch[32];
+    if (t->type != BIGNUM || bignum_format_len(t->big, base) > sizeof(buf))
+    {
+        return 0;
+    }
+    size_t len = bignum_format(buf, t->big, base, scratch);
+    return len == strlen(s) && !memcmp(buf, s, len);
+}
+
+Ensure(test_bignum_apply)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    token_t max, min, one, res, big;
+    init_literal(&max, INT64_MAX, 0);
+    init_literal(&min, INT64_MIN, 0);
+    init_literal(&one, 1, 0);
+
+    // results which fit in 64 bits are literals
+    assert_that(bignum_apply(&ctx, OP_SUB, &max, &one, &res) == 0);
+    assert_that(IS_LITERAL(res) && res.value == INT64_MAX - 1);
+    assert_that(bignum_apply(&ctx, OP_ADD, &min, &max, &res) == 0);
+    assert_that(IS_LITERAL(res) && res.value == -1);
+
+    // the others are promoted
+    assert_that(bignum_apply(&ctx, OP_ADD, &max, &one, &big) == 0);
+    assert_that(big.type == BIGNUM);
+    assert_that(bignum_formats_as(&big, 10, "9223372036854775808"));
+    assert_that(bignum_formats_as(&big, 16, "0x8000000000000000"));
+    assert_that(bignum_apply(&ctx, OP_NEG, &min, NULL, &res) == 0);
+    assert_that(bignum_cmp(&res, &big) == 0);
+    assert_that(bignum_apply(&ctx, OP_MUL, &min, &min, &res) == 0);
+    assert_that(bignum_formats_as(
+        &res, 10, "85070591730234615865843651857942052864"));
+    assert_that(bignum_apply(&ctx, OP_MUL, &res, &min, &res) == 0);
+    assert_that(bignum_formats_as(&res, 10,
+        "-784637716923335095479473677900958302012794430558004314112"));
+    assert_that(bignum_formats_as(&res, 8,
+        "-0o1000000000000000000000000000000"
+        "000000000000000000000000000000000"));
+
+    // and demoted again as soon as they fit
+    assert_that(bignum_apply(&ctx, OP_SUB, &big, &one, &res) == 0);
+    assert_that(IS_LITERAL(res) && res.value == INT64_MAX);
+    assert_that(bignum_apply(&ctx, OP_NEG, &big, NULL, &res) == 0);
+    assert_that(IS_LITERAL(res) && res.value == INT64_MIN);
+    assert_that(bignum_apply(&ctx, OP_SUB, &big, &big, &res) == 0);
+    assert_that(IS_LITERAL(res) && res.value == 0);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_bignum_cmp)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    token_t max, min, pos, neg;
+    init_literal(&max, INT64_MAX, 0);
+    init_literal(&min, INT64_MIN, 0);
+    bignum_apply(&ctx, OP_MUL, &max, &max, &pos);
+    bignum_apply(&ctx, OP_NEG, &pos, NULL, &neg);
+
+    assert_that(bignum_cmp(&min, &max) < 0);
+    assert_that(bignum_cmp(&pos, &max) > 0);
+    assert_that(bignum_cmp(&max, &pos) < 0);
+    assert_that(bignum_cmp(&neg, &min) < 0);
+    assert_that(bignum_cmp(&min, &neg) > 0);
+    assert_that(bignum_cmp(&neg, &pos) < 0);
+    assert_that(bignum_cmp(&pos, &pos) == 0);
+
+    ctx_free(&ctx);
+}
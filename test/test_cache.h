@@ -0,0 +1,134 @@
+/*
+ * test/test_cache.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cache.h>
+#include <engine.h>
+#include <error.h>
+#include <lex.h>
+
+// normalize a NUL-terminated expression into buf, NUL-terminating it
+static uint32_t cache_key(const char* src, char* buf)
+{
+    uint32_t hash;
+    buf[cache_normalize(src, strlen(src), buf, &hash)] = '\0';
+    return hash;
+}
+
+// add a constant expression with the given value
+static void cache_put_key(cache_t* c, const char* key, int32_t value)
+{
+    char buf[64];
+    uint32_t hash = cache_key(key, buf);
+    token_t rpn;
+    init_literal(&rpn, value, 0);
+    cache_put(c, buf, strlen(buf), hash, &rpn, 1, 1, value);
+}
+
+static const cache_entry_t* cache_get_key(cache_t* c, const char* key)
+{
+    char buf[64];
+    uint32_t hash = cache_key(key, buf);
+    return cache_get(c, buf, strlen(buf), hash);
+}
+
+Ensure(test_cache_normalize)
+{
+    char a[64], b[64];
+
+    assert_that(cache_key(" ( 1+ 2 ) *\t3 ", a) == cache_key("(1+2)*3", b));
+    assert_that(strcmp(a, "(1+2)*3") == 0);
+    // whitespace between digits separates literals
+    cache_key("1 2", a);
+    cache_key("12", b);
+    assert_that(strcmp(a, "1 2") == 0);
+    assert_that(strcmp(a, b) != 0);
+    cache_key("1   \t 2 - - 3", a);
+    assert_that(strcmp(a, "1 2--3") == 0);
+}
+
+Ensure(test_cache_lru)
+{
+    cache_t c;
+    assert_that(cache_init(&c, 2) == 0);
+
+    cache_put_key(&c, "1+1", 1);
+    cache_put_key(&c, "2+2", 2);
+    const cache_entry_t* e = cache_get_key(&c, "1 + 1");
+    assert_that(e != NULL);
+    assert_that(e->value == 1);
+    // 2+2 is now the least recently used and is evicted
+    cache_put_key(&c, "3+3", 3);
+    assert_that(cache_get_key(&c, "2+2") == NULL);
+    assert_that(cache_get_key(&c, "1+1")->value == 1);
+    assert_that(cache_get_key(&c, "3+3")->value == 3);
+    assert_that(c.hits == 3);
+    assert_that(c.misses == 1);
+    assert_that(c.evictions == 1);
+
+    cache_free(&c);
+}
+
+Ensure(test_cache_eviction_keeps_table_consistent)
+{
+    cache_t c;
+    assert_that(cache_init(&c, 50) == 0);
+    char key[64];
+
+    // many evictions exercise deletion from the middle of probe sequences
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(key, sizeof(key), "%d+%d", i, i);
+        cache_put_key(&c, key, i);
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(key, sizeof(key), "%d+%d", i, i);
+        const cache_entry_t* e = cache_get_key(&c, key);
+        assert_that(i < 950 ? e == NULL : e != NULL && e->value == i);
+    }
+    assert_that(c.n_entries == 50);
+
+    cache_free(&c);
+}
+
+Ensure(test_cache_engine)
+{
+    engine_t pipeline, cached;
+    engine_init(&pipeline, ENGINE_PIPELINE);
+    engine_init(&cached, ENGINE_VM);
+    assert_that(engine_enable_cache(&cached, 16) == 0);
+
+    const char* exprs[] = {
+        "1 + 2 * 3", " 1+2*3 ", "1 2", "12", "1 + ", "(4 - 1) * 2",
+        "1 +   ", "   ", "(4-1)*2", "65536 * 65536",
+    };
+    size_t n = sizeof(exprs) / sizeof(exprs[0]);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            token_t r1, r2;
+            diag_t d1, d2;
+            size_t len = strlen(exprs[i]);
+            int rc1 = engine_eval(&pipeline, exprs[i], len, &r1, &d1);
+            int rc2 = engine_eval(&cached, exprs[i], len, &r2, &d2);
+            assert_that(rc1 == rc2);
+            assert_that(rc1 != 0 || r1.value == r2.value);
+            // errors are never cached, so their offsets stay accurate
+            assert_that(rc1 != -1
+                || (d1.kind == d2.kind && d1.offset == d2.offset));
+        }
+    }
+    // only the 4 distinct successful expressions were ever missed
+    assert_that(cached.cache->n_entries == 4);
+
+    engine_free(&pipeline);
+    engine_free(&cached);
+}
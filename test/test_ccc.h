@@ -0,0 +1,158 @@
+/*
+ * test/test_ccc.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <ccc.h>
+
+Ensure(test_ccc_eval)
+{
+    char scratch[4096];
+    ccc_t* c = ccc_init(scratch, sizeof(scratch));
+    assert_that(c != NULL);
+
+    const char* input = "16 * (36 + 64)";
+    int64_t result;
+    ccc_errkind kind = ccc_eval(c, input, strlen(input), &result, NULL);
+    assert_that(kind == CCC_OK);
+    assert_that(result == 1600);
+}
+
+Ensure(test_ccc_compile_run)
+{
+    char scratch[4096];
+    ccc_t* c = ccc_init(scratch, sizeof(scratch));
+
+    const char* input = "-(2 - 5) * 3";
+    ccc_expr_t* expr;
+    assert_that(ccc_compile(c, input, strlen(input), &expr, NULL) == CCC_OK);
+    // repeated evaluation does not consume scratch space
+    for (int i = 0; i < 1000; i++)
+    {
+        int64_t result;
+        assert_that(ccc_run(c, expr, &result, NULL) == CCC_OK);
+        assert_that(result == 9);
+    }
+}
+
+Ensure(test_ccc_error_value)
+{
+    char scratch[4096];
+    ccc_t* c = ccc_init(scratch, sizeof(scratch));
+
+    const char* input = "(1 + 2)) - 5";
+    int64_t result;
+    ccc_error_t err;
+    ccc_errkind kind = ccc_eval(c, input, strlen(input), &result, &err);
+    assert_that(kind == CCC_E_UNMATCHED_PAREN);
+    assert_that(err.kind == CCC_E_UNMATCHED_PAREN);
+    assert_that(err.offset == 7);
+    assert_that(strcmp(err.message, "7: unmatched \")\"") == 0);
+}
+
+Ensure(test_ccc_scratch_exhausted)
+{
+    char scratch[256];
+    ccc_t* c = ccc_init(scratch, sizeof(scratch));
+
+    const char* input = "1 + 2 + 3 + 4 + 5 + 6 + 7 + 8 + 9 + 10";
+    int64_t result;
+    ccc_errkind kind = ccc_eval(c, input, strlen(input), &result, NULL);
+    assert_that(kind == CCC_E_NO_MEMORY);
+
+    // the recommended scratch size is always sufficient
+    char big[16384];
+    assert_that(ccc_scratch_size(strlen(input)) <= sizeof(big));
+    c = ccc_init(big, ccc_scratch_size(strlen(input)));
+    kind = ccc_eval(c, input, strlen(input), &result, NULL);
+    assert_that(kind == CCC_OK);
+    assert_that(result == 55);
+
+    // the region needs no particular alignment
+    c = ccc_init(big + 1, sizeof(big) - 1);
+    assert_that((char*) c > big);
+    kind = ccc_eval(c, input, strlen(input), &result, NULL);
+    assert_that(kind == CCC_OK);
+    assert_that(result == 55);
+}
+
+Ensure(test_ccc_variables)
+{
+    char scratch[8192];
+    ccc_t* c = ccc_init(scratch, sizeof(scratch));
+
+    // compile once, then bind different values on every run
+    const char* input = "price * qty - discount * (qty * 0 + price)";
+    ccc_expr_t* expr;
+    assert_that(ccc_compile(c, input, strlen(input), &expr, NULL) == CCC_OK);
+    assert_that(ccc_n_vars(expr) == 3);
+    int32_t price = ccc_var_index(expr, "price", 5);
+    int32_t qty = ccc_var_index(expr, "qty", 3);
+    int32_t discount = ccc_var_index(expr, "discount", 8);
+    assert_that(price == 0 && qty == 1 && discount == 2);
+    assert_that(ccc_var_index(expr, "tax", 3) == -1);
+
+    for (int32_t i = 0; i < 100; i++)
+    {
+        int64_t values[3];
+        values[price] = 10 + i;
+        values[qty] = i;
+        values[discount] = i % 3;
+        int64_t result;
+        assert_that(ccc_run_vars(c, expr, values, 3, &result, NULL) == CCC_OK);
+        assert_that(result == (10 + i) * i - (i % 3) * (10 + i));
+    }
+
+    // every variable needs a value
+    int64_t result;
+    ccc_error_t err;
+    assert_that(ccc_run(c, expr, &result, &err) == CCC_E_UNDEFINED_VAR);
+    assert_that(err.offset == -1);
+    assert_that(strcmp(err.message, "undefined variable") == 0);
+
+    // the library has no assignment
+    input = "x = 1";
+    assert_that(ccc_eval(c, input, strlen(input), &result, &err)
+        == CCC_E_INVALID_ASSIGN);
+    assert_that(err.offset == 2);
+
+    // the recommended scratch size covers the variable names
+    input = "a * b + c * d - e * f + g * h - i * j + k * l";
+    char big[16384];
+    assert_that(ccc_scratch_size(strlen(input)) <= sizeof(big));
+    c = ccc_init(big, ccc_scratch_size(strlen(input)));
+    assert_that(ccc_compile(c, input, strlen(input), &expr, NULL) == CCC_OK);
+    assert_that(ccc_n_vars(expr) == 12);
+}
+
+Ensure(test_ccc_overflow)
+{
+    char scratch[8192];
+    ccc_t* c = ccc_init(scratch, sizeof(scratch));
+
+    const char* input = "x * x - x * x + 1";
+    ccc_expr_t* expr;
+    assert_that(ccc_compile(c, input, strlen(input), &expr, NULL) == CCC_OK);
+    // the intermediate products overflow, but the result fits; evaluating it
+    // exactly does not consume scratch space either
+    for (int i = 0; i < 1000; i++)
+    {
+        int64_t x = INT64_MAX - i, result;
+        assert_that(ccc_run_vars(c, expr, &x, 1, &result, NULL) == CCC_OK);
+        assert_that(result == 1);
+    }
+
+    int64_t result;
+    ccc_error_t err;
+    input = "9223372036854775807 + 1";
+    assert_that(ccc_eval(c, input, strlen(input), &result, &err)
+        == CCC_E_VALUE_RANGE);
+    assert_that(strcmp(err.message, "value does not fit in 64 bits") == 0);
+    input = "-9223372036854775807 - 1";
+    assert_that(ccc_eval(c, input, strlen(input), &result, NULL) == CCC_OK);
+    assert_that(result == INT64_MIN);
+}
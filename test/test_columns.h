@@ -0,0 +1,297 @@
+/*
+ * test/test_columns.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <bignum.h>
+#include <check.h>
+#include <columns.h>
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <symtab.h>
+#include <utils.h>
+
+#define COLUMNS_TEST_VARS 3
+// a full block followed by a partial one, so that the vector kernels also
+// finish with the scalar kernel
+#define COLUMNS_TEST_ROWS (COLUMNS_BLOCK_ROWS + 13)
+
+static int64_t columns_test_data[COLUMNS_TEST_VARS][COLUMNS_TEST_ROWS];
+
+// fill the columns with 32-bit values, or with values of any magnitude
+static void columns_test_fill(uint32_t seed, int wide)
+{
+    uint64_t state = seed;
+    for (int i = 0; i < COLUMNS_TEST_VARS; i++)
+    {
+        for (int j = 0; j < COLUMNS_TEST_ROWS; j++)
+        {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            columns_test_data[i][j] = wide
+                ? (int64_t) state >> (state % 64) : (int32_t) (state >> 32);
+        }
+    }
+}
+
+// evaluate a block of rows, exactly if it overflowed like columns_main does
+static uint8_t columns_test_block(
+    ctx_t* ctx, columns_exec_t* x, const columns_prog_t* prog, int row,
+    int n, token_t* out)
+{
+    const int64_t* vars[COLUMNS_TEST_VARS];
+    for (int i = 0; i < COLUMNS_TEST_VARS; i++)
+    {
+        vars[i] = &columns_test_data[i][row];
+    }
+    static int64_t values[COLUMNS_BLOCK_ROWS];
+    int overflow = columns_exec_block(x, vars, n, values);
+    for (int j = 0; j < n; j++)
+    {
+        init_literal(&out[j], values[j], 0);
+        if (!overflow)
+        {
+            continue;
+        }
+        int64_t row_vars[COLUMNS_TEST_VARS];
+        for (int i = 0; i < COLUMNS_TEST_VARS; i++)
+        {
+            row_vars[i] = vars[i][j];
+        }
+        diag_t diag;
+        if (evaluate_rpn_vars(
+            ctx, prog->rpn, prog->n_rpn, row_vars, &out[j], &diag))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * run an expression in Reverse Polish notation over the test columns with
+ * every supported instruction set, and compare each row with evaluate_rpn;
+ * returns 0 if any row differs
+ */
+static uint8_t columns_matches_interpreter(
+    ctx_t* ctx, symtab_t* syms, const token_t* rpn, int32_t n_rpn)
+{
+    columns_prog_t prog;
+    diag_t diag;
+    if (columns_compile(ctx, rpn, n_rpn, COLUMNS_TEST_VARS, &prog, &diag))
+    {
+        return 0;
+    }
+    static token_t expected[COLUMNS_TEST_ROWS], out[COLUMNS_TEST_ROWS];
+    for (int j = 0; j < COLUMNS_TEST_ROWS; j++)
+    {
+        for (int i = 0; i < COLUMNS_TEST_VARS; i++)
+        {
+            symtab_set(syms, i, columns_test_data[i][j]);
+        }
+        if (evaluate_rpn(ctx, rpn, n_rpn, syms, &expected[j], &diag))
+        {
+            return 0;
+        }
+    }
+
+    for (int isa = 0; isa < N_COLUMNS_ISAS; isa++)
+    {
+        columns_exec_t x;
+        if (!columns_isa_supported(isa) || columns_exec_init(&x, &prog, isa))
+        {
+            continue;
+        }
+        uint8_t ok = 1;
+        for (int row = 0; row < COLUMNS_TEST_ROWS && ok;
+            row += COLUMNS_BLOCK_ROWS)
+        {
+            int n = COLUMNS_TEST_ROWS - row < COLUMNS_BLOCK_ROWS
+                ? COLUMNS_TEST_ROWS - row : COLUMNS_BLOCK_ROWS;
+            ok = columns_test_block(ctx, &x, &prog, row, n, &out[row]);
+        }
+        columns_exec_free(&x);
+        for (int j = 0; j < COLUMNS_TEST_ROWS && ok; j++)
+        {
+            ok = bignum_cmp(&out[j], &expected[j]) == 0;
+        }
+        if (!ok)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// compile a source expression over the variables a, b and c
+static token_t* columns_test_rpn(
+    ctx_t* ctx, symtab_t* syms, const char* input, int32_t* n_rpn)
+{
+    diag_t diag;
+    int32_t n_tokens;
+    token_t* t = tokenize(ctx, input, &n_tokens, &diag);
+    if (!t || symtab_resolve(
+        syms, input, strlen(input), t, n_tokens, 0, &diag))
+    {
+        return NULL;
+    }
+    return shunting_yard(ctx, t, n_tokens, n_rpn, &diag);
+}
+
+Ensure(test_columns_expressions)
+{
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+    symtab_intern(&syms, "a", 1);
+    symtab_intern(&syms, "b", 1);
+    symtab_intern(&syms, "c", 1);
+    columns_test_fill(1, 0);
+
+    const char* inputs[] = {
+        "a * 3 + b - c",
+        "-(a - b) * (c + 65536) * 65536",
+        "a * a * a - -b",
+        // results held in a column or a constant block rather than in a
+        // temporary
+        "a",
+        "+b",
+        "c * 1 + 0",
+        "2 * 21",
+        // every operand is used twice
+        "(a + b) * (a - b) - (c * c + -c)",
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        int32_t n_rpn;
+        token_t* rpn = columns_test_rpn(&ctx, &syms, inputs[i], &n_rpn);
+        assert_that(rpn != NULL);
+        assert_that(columns_matches_interpreter(&ctx, &syms, rpn, n_rpn));
+    }
+
+    int32_t n_rpn;
+    columns_prog_t prog;
+    diag_t diag;
+    token_t* rpn = columns_test_rpn(&ctx, &syms, "a * (b + c)", &n_rpn);
+    assert_that(columns_compile(&ctx, rpn, n_rpn, 3, &prog, &diag) == 0);
+    assert_that(prog.n_code == 2);
+    assert_that(prog.n_temps == 3);
+    assert_that(prog.n_consts == 0);
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+}
+
+Ensure(test_columns_random_expressions)
+{
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+    for (int i = 0; i < COLUMNS_TEST_VARS; i++)
+    {
+        symtab_intern(&syms, "abc" + i, 1);
+    }
+    columns_test_fill(7, 1);
+
+    uint32_t state = 42;
+    char input[256];
+    for (int n = 0; n < 200; n++)
+    {
+        ctx_reset(&ctx);
+        check_gen_expr(&state, input, sizeof(input));
+        diag_t diag;
+        int32_t n_tokens, n_rpn;
+        token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
+        assert_that(t != NULL);
+        // every other literal reads a column instead
+        for (int32_t i = 0, k = 0; i < n_tokens; i++)
+        {
+            if (IS_LITERAL(t[i]) && k++ % 2 == 0)
+            {
+                t[i].type = VARIABLE;
+                t[i].value = k % COLUMNS_TEST_VARS;
+            }
+        }
+        token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
+        assert_that(rpn != NULL);
+        assert_that(columns_matches_interpreter(&ctx, &syms, rpn, n_rpn));
+    }
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+}
+
+Ensure(test_columns_overflow)
+{
+    ctx_t ctx, sym_ctx, eval_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    ctx_init(&eval_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+    symtab_intern(&syms, "a", 1);
+    symtab_intern(&syms, "b", 1);
+    columns_test_fill(3, 1);
+    columns_test_data[0][5] = INT64_MIN;
+    columns_test_data[1][5] = 1;
+    columns_test_data[0][9] = INT64_MAX;
+    columns_test_data[1][9] = 1;
+
+    // with a single operator, a group of rows overflows exactly when the
+    // result of one of them does not fit in 64 bits; groups of 4 rows cover
+    // whole vectors of every instruction set
+    const char* inputs[] = { "a + b", "a - b", "a * b", "-a" };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        int32_t n_rpn;
+        token_t* rpn = columns_test_rpn(&ctx, &syms, inputs[i], &n_rpn);
+        columns_prog_t prog;
+        diag_t diag;
+        assert_that(columns_compile(&ctx, rpn, n_rpn, 2, &prog, &diag) == 0);
+        for (int isa = 0; isa < N_COLUMNS_ISAS; isa++)
+        {
+            columns_exec_t x;
+            if (!columns_isa_supported(isa)
+                || columns_exec_init(&x, &prog, isa))
+            {
+                continue;
+            }
+            int n_overflows = 0;
+            for (int row = 0; row + 4 <= COLUMNS_TEST_ROWS; row += 4)
+            {
+                const int64_t* vars[] = {
+                    &columns_test_data[0][row], &columns_test_data[1][row] };
+                int64_t out[4];
+                int overflow = columns_exec_block(&x, vars, 4, out);
+                int big = 0;
+                for (int j = 0; j < 4; j++)
+                {
+                    int64_t values[] = { vars[0][j], vars[1][j] };
+                    token_t res;
+                    evaluate_rpn_vars(
+                        &eval_ctx, rpn, n_rpn, values, &res, &diag);
+                    big |= !IS_LITERAL(res);
+                    assert_that(overflow || res.value == out[j]);
+                }
+                assert_that(overflow == big);
+                n_overflows += overflow;
+                ctx_reset(&eval_ctx);
+            }
+            assert_that(n_overflows > 0);
+            columns_exec_free(&x);
+        }
+    }
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+    ctx_free(&eval_ctx);
+}
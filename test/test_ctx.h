@@ -0,0 +1,47 @@
+/*
+ * test/test_ctx.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <ctx.h>
+
+Ensure(test_ctx_alloc_reset)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+
+    char* a = ctx_alloc(&ctx, 10);
+    char* b = ctx_alloc(&ctx, 10);
+    assert_that(a != NULL && b != NULL);
+    assert_that(b - a >= 10);
+
+    // after a reset the region is reused from the start
+    ctx_reset(&ctx);
+    char* c = ctx_alloc(&ctx, 10);
+    assert_that(c == a);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_ctx_overflow_folds_on_reset)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+
+    ctx_alloc(&ctx, CTX_INIT_SIZE / 2);
+    char* big = ctx_alloc(&ctx, CTX_INIT_SIZE);
+    assert_that(big != NULL);
+    assert_that(ctx.overflow != NULL);
+
+    // the overflow is folded into the region, so the same allocations fit
+    ctx_reset(&ctx);
+    assert_that(ctx.overflow == NULL);
+    assert_that(ctx.size >= CTX_INIT_SIZE + CTX_INIT_SIZE / 2);
+    ctx_alloc(&ctx, CTX_INIT_SIZE / 2);
+    ctx_alloc(&ctx, CTX_INIT_SIZE);
+    assert_that(ctx.overflow == NULL);
+
+    ctx_free(&ctx);
+}
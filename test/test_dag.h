@@ -0,0 +1,107 @@
+/*
+ * test/test_dag.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <ctx.h>
+#include <dag.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <utils.h>
+
+// build the DAG of an expression, returns -1 and fills diag on error
+static int dag_build_expr(
+    ctx_t* ctx, const char* input, dag_t* dag, diag_t* diag)
+{
+    int32_t n_tokens, n_rpn;
+    token_t* t = tokenize(ctx, input, &n_tokens, diag);
+    token_t* rpn = t ? shunting_yard(ctx, t, n_tokens, &n_rpn, diag) : NULL;
+    if (!rpn)
+    {
+        return -1;
+    }
+    return dag_build(ctx, rpn, n_rpn, dag, diag);
+}
+
+Ensure(test_dag_eval)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    dag_t dag;
+    diag_t diag;
+    int64_t value;
+
+    assert_that(dag_build_expr(&ctx, "16 * (36 + 64)", &dag, &diag) == 0);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 0);
+    assert_that(value == 1600);
+    assert_that(
+        dag_build_expr(&ctx, "10 - (-2) - +2 - (-(-10))", &dag, &diag) == 0);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 0);
+    assert_that(value == 0);
+    assert_that(
+        dag_build_expr(&ctx, "65536 * 65536 - 2000000000", &dag, &diag) == 0);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 0);
+    assert_that(value == 2294967296);
+    // results which overflow 64 bits are left to the interpreter
+    assert_that(
+        dag_build_expr(&ctx, "4294967296 * 4294967296 - 1", &dag, &diag) == 0);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 1);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_dag_shares_subexpressions)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    dag_t dag;
+    diag_t diag;
+    int64_t value;
+
+    // 1, 2, 3, 2 * 3, 1 + 2 * 3, and the product of the two copies
+    assert_that(
+        dag_build_expr(&ctx, "(1 + 2 * 3) * (1 + 2 * 3)", &dag, &diag) == 0);
+    assert_that(dag.n_nodes == 6);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 0);
+    assert_that(value == 49);
+    // commutative operands are shared in either order: 2, 5, 2 + 5, 2 * 5,
+    // and the difference, product and sum
+    assert_that(
+        dag_build_expr(&ctx, "(2 + 5) - (5 + 2) + 2 * 5 * (5 * 2)", &dag,
+            &diag) == 0);
+    assert_that(dag.n_nodes == 7);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 0);
+    assert_that(value == 100);
+    // the size of the DAG does not grow with the number of copies
+    assert_that(
+        dag_build_expr(&ctx, "(7 - 3) + (7 - 3) + (7 - 3) + (7 - 3) + (7 - 3)",
+            &dag, &diag) == 0);
+    assert_that(dag.n_nodes == 7);
+    assert_that(dag_eval(&ctx, &dag, NULL, &value) == 0);
+    assert_that(value == 20);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_dag_errors)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    dag_t dag;
+    diag_t diag;
+
+    // the same errors as evaluate_rpn
+    token_t rpn[2];
+    init_literal(&rpn[0], 1, 0);
+    init_token(&rpn[1], OP_MUL, 2);
+    assert_that(dag_build(&ctx, rpn, 2, &dag, &diag) == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 2));
+    assert_that(diag.index == 1);
+    assert_that(dag_build(&ctx, rpn, 0, &dag, &diag) == -1);
+    assert_that(diag.kind == E_EMPTY_EXPR);
+
+    ctx_free(&ctx);
+}
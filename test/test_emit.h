@@ -0,0 +1,116 @@
+/*
+ * test/test_emit.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#include <ctx.h>
+#include <emit.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <symtab.h>
+#include <utils.h>
+#include <writer.h>
+
+// emit an expression as function f into buf, returns -1 and fills diag on
+// error
+static int emit_expr_to(
+    const char* input, int fold, char* buf, size_t size, diag_t* diag)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    symtab_t syms;
+    symtab_init(&syms, &ctx);
+    int32_t n_tokens, n_rpn;
+    token_t* t = tokenize(&ctx, input, &n_tokens, diag);
+    if (t && symtab_resolve(
+        &syms, input, strlen(input), t, n_tokens, 1, diag))
+    {
+        t = NULL;
+    }
+    token_t* rpn = t ? shunting_yard(&ctx, t, n_tokens, &n_rpn, diag) : NULL;
+    if (!rpn)
+    {
+        ctx_free(&ctx);
+        return -1;
+    }
+
+    int fds[2];
+    assert_that(pipe(fds) == 0);
+    writer_t out;
+    writer_init(&out, fds[1], 4096);
+    int rc = emit_function(&ctx, &out, "f", rpn, n_rpn, &syms, fold, diag);
+    writer_free(&out);
+    close(fds[1]);
+    ssize_t len = read(fds[0], buf, size - 1);
+    buf[len > 0 ? len : 0] = '\0';
+    close(fds[0]);
+
+    ctx_free(&ctx);
+    return rc;
+}
+
+Ensure(test_emit_function)
+{
+    char buf[1024] = "";
+    diag_t diag;
+
+    // constant subexpressions are folded unless they overflow
+    assert_that(emit_expr_to("2 * (3 + 4) - 1", 1, buf, sizeof(buf), &diag)
+        == 0);
+    assert_that(strstr(buf,
+        "int f(int64_t* result)\n{\n    *result = 13;\n    return 0;\n}\n")
+        != NULL);
+    assert_that(emit_expr_to("-9223372036854775807 - 1", 1, buf, sizeof(buf),
+        &diag) == 0);
+    assert_that(strstr(buf, "*result = INT64_MIN;") != NULL);
+    assert_that(emit_expr_to("9223372036854775807 + 1", 1, buf, sizeof(buf),
+        &diag) == 0);
+    assert_that(strstr(buf,
+        "*result = ccc_add(&overflow, 9223372036854775807, 1);") != NULL);
+    assert_that(strstr(buf, "return overflow ? -1 : 0;") != NULL);
+
+    // unfolded arithmetic goes through the prelude helpers
+    assert_that(emit_expr_to("-(1 - +2) * 3", 0, buf, sizeof(buf), &diag)
+        == 0);
+    assert_that(strstr(buf, "*result = ccc_mul(&overflow, "
+        "ccc_neg(&overflow, ccc_sub(&overflow, 1, 2)), 3);") != NULL);
+}
+
+Ensure(test_emit_function_variables)
+{
+    char buf[1024] = "";
+    diag_t diag;
+
+    // variables become parameters in order of first appearance; constant
+    // subexpressions around them are still folded
+    assert_that(emit_expr_to("qty * (2 + 3) - tax", 1, buf, sizeof(buf), &diag)
+        == 0);
+    assert_that(strstr(buf,
+        "int f(int64_t* result, int64_t v_qty, int64_t v_tax)\n{\n"
+        "    int overflow = 0;\n"
+        "    *result = ccc_sub(&overflow, ccc_mul(&overflow, v_qty, 5), "
+        "v_tax);\n") != NULL);
+    // names which are C keywords are still valid parameters
+    assert_that(emit_expr_to("-int", 1, buf, sizeof(buf), &diag) == 0);
+    assert_that(strstr(buf, "int f(int64_t* result, int64_t v_int)") != NULL);
+    assert_that(strstr(buf, "*result = ccc_neg(&overflow, v_int);") != NULL);
+}
+
+Ensure(test_emit_function_errors)
+{
+    char buf[1024] = "";
+    diag_t diag;
+
+    // invalid expressions are reported, and nothing is written
+    assert_that(emit_expr_to("1 + 2 * ", 1, buf, sizeof(buf), &diag) == -1);
+    assert_that(diag.kind == E_OP_MISSING_EXPR);
+    assert_that(emit_expr_to("()", 1, buf, sizeof(buf), &diag) == -1);
+    assert_that(diag.kind == E_EMPTY_EXPR);
+    assert_that(strlen(buf) == 0);
+}
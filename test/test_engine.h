@@ -0,0 +1,227 @@
+/*
+ * test/test_engine.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <engine.h>
+#include <utils.h>
+
+static const char* engine_exprs[] = {
+    "16 * (36 + 64)", "10 - (-2) - +2 - (-(-10))", "-5 * 3", "   ",
+    "2 * 3 + 4 * 5 - 6", "-(1 + 2) * -(3)", "((((7))))", "1 - - 1",
+    "(1 + 2)) - 5", "(1 + 2) - ((3 + 4) + 5", "* 1 2", "1 2 *",
+    "1 2 * * 3", "1(1)", "1 * * 2", "32 * abc", "-()", "()", "1 +",
+    "99999999999 * 2", "(1 2", "1 + (2 * 3 4)", "(1)(2)", "65536 * 65536",
+    "0xffff_ffff * 0b11 - 0o7", "2147483648", "0x1_0000_0000", "1_ + 2",
+    "-9223372036854775808", "(-0x8000_0000_0000_0000) * 1",
+    "9223372036854775808", "2 - 9223372036854775808 $",
+};
+
+// evaluate an expression with two engines and compare the outcomes
+static uint8_t engines_agree(
+    engine_t* pipeline, engine_t* other, const char* expr)
+{
+    token_t res_p, res_o;
+    diag_t diag_p, diag_o;
+    size_t len = strlen(expr);
+    int rc_p = engine_eval(pipeline, expr, len, &res_p, &diag_p);
+    int rc_o = engine_eval(other, expr, len, &res_o, &diag_o);
+    if (rc_p != rc_o)
+    {
+        return 0;
+    }
+    if (rc_p == 0)
+    {
+        return res_p.value == res_o.value;
+    }
+    if (rc_p < 0)
+    {
+        return diag_is(diag_o, diag_p.kind, diag_p.offset)
+            && diag_o.side == diag_p.side;
+    }
+    return 1;
+}
+
+Ensure(test_engine_fused_matches_pipeline)
+{
+    engine_t pipeline, fused;
+    engine_init(&pipeline, ENGINE_PIPELINE);
+    engine_init(&fused, ENGINE_FUSED);
+
+    size_t n = sizeof(engine_exprs) / sizeof(engine_exprs[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        assert_that(engines_agree(&pipeline, &fused, engine_exprs[i]));
+    }
+
+    engine_free(&pipeline);
+    engine_free(&fused);
+}
+
+Ensure(test_engine_fused_limits)
+{
+    // the fused engine enforces the same input and token limits
+    char expr[MAX_INPUT_LEN + 1];
+    engine_t fused;
+    engine_init(&fused, ENGINE_FUSED);
+    token_t res;
+    diag_t diag;
+
+    memset(expr, ' ', MAX_INPUT_LEN);
+    expr[MAX_INPUT_LEN] = 0;
+    assert_that(engine_eval(&fused, expr, MAX_INPUT_LEN, &res, &diag) == -1);
+    assert_that(diag.kind == E_MAX_INPUT);
+
+    // "1+1+...+1" with one token too many, then with one token to spare
+    for (int i = 0; i < MAX_TOKENS; i++)
+    {
+        expr[i] = i % 2 ? '+' : '1';
+    }
+    assert_that(engine_eval(&fused, expr, MAX_TOKENS + 1, &res, &diag) == -1);
+    assert_that(diag.kind == E_MAX_TOKENS);
+    assert_that(engine_eval(&fused, expr, MAX_TOKENS - 1, &res, &diag) == 0);
+    assert_that(res.value == MAX_TOKENS / 2);
+
+    engine_free(&fused);
+}
+
+Ensure(test_engine_vm_matches_pipeline)
+{
+    engine_t pipeline, vm;
+    engine_init(&pipeline, ENGINE_PIPELINE);
+    engine_init(&vm, ENGINE_VM);
+
+    size_t n = sizeof(engine_exprs) / sizeof(engine_exprs[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        assert_that(engines_agree(&pipeline, &vm, engine_exprs[i]));
+    }
+
+    engine_free(&pipeline);
+    engine_free(&vm);
+}
+
+Ensure(test_engine_regvm_matches_pipeline)
+{
+    engine_t pipeline, regvm;
+    engine_init(&pipeline, ENGINE_PIPELINE);
+    engine_init(&regvm, ENGINE_REGVM);
+
+    size_t n = sizeof(engine_exprs) / sizeof(engine_exprs[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        assert_that(engines_agree(&pipeline, &regvm, engine_exprs[i]));
+    }
+
+    engine_free(&pipeline);
+    engine_free(&regvm);
+}
+
+Ensure(test_engine_dag_matches_pipeline)
+{
+    engine_t pipeline, dag;
+    engine_init(&pipeline, ENGINE_PIPELINE);
+    engine_init(&dag, ENGINE_DAG);
+
+    size_t n = sizeof(engine_exprs) / sizeof(engine_exprs[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        assert_that(engines_agree(&pipeline, &dag, engine_exprs[i]));
+    }
+
+    engine_free(&pipeline);
+    engine_free(&dag);
+}
+
+static const char* engine_statements[] = {
+    "x = 6", "y = x * 7 - 1", "x + y", "-x * -(y - x)", "z", "x y",
+    "x (1)", "x = ", " = 3", "1 = 2", "x = y = 1", "x = (y", "y = y + 1",
+    "y", "long_name_2 = x * x * x", "long_name_2 - x", "x = x", "  w  =  4 ",
+    "w * undefined",
+};
+
+Ensure(test_engine_variables)
+{
+    // every engine, with and without a cache, sees the same variables
+    engine_t engines[2 * N_ENGINES];
+    for (int i = 0; i < 2 * N_ENGINES; i++)
+    {
+        engine_init(&engines[i], i % N_ENGINES);
+        if (i >= N_ENGINES)
+        {
+            assert_that(engine_enable_cache(&engines[i], 4) == 0);
+        }
+    }
+
+    token_t res;
+    diag_t diag;
+    size_t n = sizeof(engine_statements) / sizeof(engine_statements[0]);
+    for (size_t i = 0; i < n; i++)
+    {
+        const char* expr = engine_statements[i];
+        size_t len = strlen(expr);
+        int rc = engine_eval(&engines[0], expr, len, &res, &diag);
+        for (int j = 1; j < 2 * N_ENGINES; j++)
+        {
+            token_t res_j;
+            diag_t diag_j;
+            assert_that(
+                engine_eval(&engines[j], expr, len, &res_j, &diag_j) == rc);
+            if (rc == 0)
+            {
+                assert_that(res_j.value == res.value);
+            }
+            else if (rc < 0)
+            {
+                assert_that(diag_is(diag_j, diag.kind, diag.offset));
+            }
+        }
+    }
+
+    const char* expr = "y = y + 1";
+    assert_that(engine_eval(&engines[0], expr, strlen(expr), &res, &diag)
+        == 0);
+    assert_that(res.value == 43);
+    expr = "x = ";
+    assert_that(engine_eval(&engines[0], expr, strlen(expr), &res, &diag)
+        == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 2));
+    expr = "x = (y";
+    assert_that(engine_eval(&engines[0], expr, strlen(expr), &res, &diag)
+        == -1);
+    assert_that(diag_is(diag, E_UNMATCHED_PAREN, 4));
+    expr = "z";
+    assert_that(engine_eval(&engines[0], expr, strlen(expr), &res, &diag)
+        == -1);
+    assert_that(diag_is(diag, E_UNDEFINED_VAR, 0));
+
+    for (int i = 0; i < 2 * N_ENGINES; i++)
+    {
+        engine_free(&engines[i]);
+    }
+}
+
+Ensure(test_engine_read_only)
+{
+    engine_t e;
+    engine_init(&e, ENGINE_FUSED);
+    token_t res;
+    diag_t diag;
+    const char* expr = "x = 1";
+    assert_that(engine_eval(&e, expr, strlen(expr), &res, &diag) == 0);
+
+    // variables can still be read, but not assigned
+    e.read_only = 1;
+    expr = "x + 1";
+    assert_that(engine_eval(&e, expr, strlen(expr), &res, &diag) == 0);
+    assert_that(res.value == 2);
+    expr = "x = 2";
+    assert_that(engine_eval(&e, expr, strlen(expr), &res, &diag) == -1);
+    assert_that(diag_is(diag, E_READ_ONLY, 2));
+
+    engine_free(&e);
+}
@@ -13,12 +13,15 @@
 Ensure(test_shunting_yard_basic)
 {
     const char* input = "1 + 2 * 3";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
     assert_that(n_rpn == 5);
     // RPN should be: 1 2 3 * +
@@ -28,18 +31,21 @@ Ensure(test_shunting_yard_basic)
     assert_that(token_is_op(rpn[3], OP_MUL));
     assert_that(token_is_op(rpn[4], OP_ADD));
 
-    free(t);
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_parens)
 {
     const char* input = "3 * (4 + 2) - ((1 - 5) * 3)";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
     assert_that(n_rpn == 11);
     // RPN should be: 3 4 2 + * 1 5 - 3 * -
@@ -55,18 +61,21 @@ Ensure(test_shunting_yard_parens)
     assert_that(token_is_op(rpn[9], OP_MUL));
     assert_that(token_is_op(rpn[10], OP_SUB));
 
-    free(t);
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_addition_chain)
 {
     const char* input = "0+1+2+3+4";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
     assert_that(n_rpn == 9);
     // RPN should be: 0 1 + 2 + 3 + 4 +
@@ -80,167 +89,236 @@ Ensure(test_shunting_yard_addition_chain)
     assert_that(token_is_literal(rpn[7], 4));
     assert_that(token_is_op(rpn[8], OP_ADD));
 
-    free(t);
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_unmatched_lparen)
 {
     const char* input = "(1 + 2) - ((3 + 4) + 5";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn == NULL);
-    assert_that(n_rpn == (E_UNMATCHED_PAREN | 10));
+    assert_that(n_rpn == -1);
+    assert_that(diag_is(diag, E_UNMATCHED_PAREN, 10));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_unmatched_rparen)
 {
     const char* input = "(1 + 2)) - 5";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn == NULL);
-    assert_that(n_rpn == (E_UNMATCHED_PAREN | 7));
+    assert_that(n_rpn == -1);
+    assert_that(diag_is(diag, E_UNMATCHED_PAREN, 7));
+    assert_that(diag.index == 5);
+    assert_that(token_is_op(diag.token, R_PAREN));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_op_missing_lhs)
 {
     const char* input = "* 1 2";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn == NULL);
-    assert_that(n_rpn == (E_OP_MISSING_EXPR | 0));
+    assert_that(n_rpn == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 0));
+    assert_that(diag.side == SIDE_LEFT);
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_op_missing_rhs)
 {
     const char* input = "1 2 *";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn == NULL);
-    assert_that(n_rpn == (E_OP_MISSING_EXPR | (0x1 << 10) | 4));
+    assert_that(n_rpn == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 4));
+    assert_that(diag.side == SIDE_RIGHT);
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_successive_literals)
 {
     const char* input = "1 2 * * 3";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn == NULL);
-    assert_that(n_rpn == (E_INVALID_LIT_EXPR | 0));
+    assert_that(n_rpn == -1);
+    assert_that(diag_is(diag, E_INVALID_LIT_EXPR, 0));
+    assert_that(token_is_literal(diag.token, 1));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_shunting_yard_literal_paren)
 {
     const char* input = "1(1)";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn == NULL);
-    assert_that(n_rpn == (E_INVALID_LIT_EXPR | 0));
+    assert_that(n_rpn == -1);
+    assert_that(diag_is(diag, E_INVALID_LIT_EXPR, 0));
+    assert_that(token_is_literal(diag.token, 1));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_eval_add)
 {
     const char* input = "1 + 2 + 3 + 4";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
 
     token_t res;
-    int rc = evaluate_rpn(rpn, n_rpn, &res);
+    int rc = evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag);
     assert_that(rc == 0);
     assert_that(token_is_literal(res, 10));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_eval_sub)
 {
     const char* input = "128 - 64 - 32 - 0";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
 
     token_t res;
-    int rc = evaluate_rpn(rpn, n_rpn, &res);
+    int rc = evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag);
     assert_that(rc == 0);
     assert_that(token_is_literal(res, 32));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_eval_mul)
 {
     const char* input = "1 * 2 * 4 * 8";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
 
     token_t res;
-    int rc = evaluate_rpn(rpn, n_rpn, &res);
+    int rc = evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag);
     assert_that(rc == 0);
     assert_that(token_is_literal(res, 64));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_eval_negation)
 {
     const char* input = "10 - (-2) - +2 - (-(-10))";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
 
     token_t res;
-    int rc = evaluate_rpn(rpn, n_rpn, &res);
+    int rc = evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag);
     assert_that(rc == 0);
     assert_that(token_is_literal(res, 0));
+
+    ctx_free(&ctx);
 }
 
 Ensure(test_eval_invalid_binary_op)
 {
     const char* input = "1 * * 2";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
     assert_that(t != NULL);
 
     int32_t n_rpn;
-    token_t* rpn = shunting_yard(t, n_tokens, &n_rpn);
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
     assert_that(rpn != NULL);
 
     token_t res;
-    int rc = evaluate_rpn(rpn, n_rpn, &res);
-    assert_that(rc == (E_OP_MISSING_EXPR | (0x1 << 10) | 2));
+    int rc = evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag);
+    assert_that(rc == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 2));
+    assert_that(diag.side == SIDE_RIGHT);
+
+    ctx_free(&ctx);
 }
@@ -0,0 +1,173 @@
+/*
+ * test/test_jit.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <check.h>
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <jit.h>
+#include <lex.h>
+#include <regvm.h>
+#include <symtab.h>
+
+/*
+ * evaluate an expression with evaluate_rpn and natively; returns 1 if the
+ * results are the same, 2 if the native code reported an overflow, which it
+ * must for a result that does not fit in 64 bits, and 0 if the results differ
+ * or the expression could not be compiled
+ */
+static uint8_t jit_matches_interpreter(ctx_t* ctx, const char* input)
+{
+    ctx_reset(ctx);
+    diag_t diag;
+    int32_t n_tokens, n_rpn;
+    token_t* t = tokenize(ctx, input, &n_tokens, &diag);
+    token_t* rpn = t ? shunting_yard(ctx, t, n_tokens, &n_rpn, &diag) : NULL;
+    token_t res;
+    regvm_prog_t prog;
+    if (!rpn || evaluate_rpn(ctx, rpn, n_rpn, NULL, &res, &diag)
+        || regvm_compile(ctx, rpn, n_rpn, &prog, &diag))
+    {
+        return 0;
+    }
+
+    jit_result_t r;
+    jit_code_t code;
+    if (!jit_compile(&prog, &code))
+    {
+        r = code.fn(NULL);
+        jit_free(&code);
+    }
+    // only platforms without a JIT may fail to compile
+    else if (!JIT_AVAILABLE)
+    {
+        r.overflow = regvm_run(&prog, NULL, &r.value);
+    }
+    else
+    {
+        return 0;
+    }
+    if (r.overflow)
+    {
+        return 2;
+    }
+    return IS_LITERAL(res) && r.value == res.value;
+}
+
+Ensure(test_jit_expressions)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+
+    assert_that(jit_matches_interpreter(&ctx, "16 * (36 + 64)") == 1);
+    assert_that(
+        jit_matches_interpreter(&ctx, "10 - (-2) - +2 - (-(-10))") == 1);
+    assert_that(jit_matches_interpreter(&ctx, "1 - (2 * 3)") == 1);
+    assert_that(jit_matches_interpreter(&ctx, "(1 * 2) - (3 + 4 * 5)") == 1);
+    assert_that(
+        jit_matches_interpreter(&ctx, "65536 * 65536 - 2000000000") == 1);
+    // enough registers to reach r8-r11, which need REX prefixes
+    assert_that(jit_matches_interpreter(&ctx,
+        "(((((1+2)*(3-4))-((5*6)+(7-8)))*(((9+10)-(11*12))+((13-14)*(15+16))))"
+        "-((((17*18)+(19-20))*((21+22)-(23*24)))-(((25-26)*(27+28))+((29*30)"
+        "-(31+32)))))*2") == 1);
+
+    // immediates which need a 64-bit move, and results at the limits
+    assert_that(jit_matches_interpreter(
+        &ctx, "(1 + 9223372036854775806) * 1") == 1);
+    assert_that(
+        jit_matches_interpreter(&ctx, "-9223372036854775807 - (0 + 1)") == 1);
+    assert_that(
+        jit_matches_interpreter(&ctx, "3037000499 * (3037000499 + 0)") == 1);
+    // every operator reports overflow
+    assert_that(
+        jit_matches_interpreter(&ctx, "9223372036854775807 + (0 + 1)") == 2);
+    assert_that(jit_matches_interpreter(
+        &ctx, "-9223372036854775807 - (1 + 1)") == 2);
+    assert_that(
+        jit_matches_interpreter(&ctx, "4294967296 * (4294967296 + 0)") == 2);
+    assert_that(jit_matches_interpreter(
+        &ctx, "-(-9223372036854775807 - (0 + 1))") == 2);
+    assert_that(jit_matches_interpreter(
+        &ctx, "1 - (-9223372036854775807 - (0 + 1))") == 2);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_jit_random_expressions)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    uint32_t state = 12345;
+    char expr[MAX_INPUT_LEN];
+
+    for (int i = 0; i < 2000; i++)
+    {
+        check_gen_expr(&state, expr, sizeof(expr));
+        ctx_reset(&ctx);
+        int32_t n_tokens;
+        diag_t diag;
+        // skip the few expressions which exceed the token limit
+        if (tokenize(&ctx, expr, &n_tokens, &diag))
+        {
+            assert_that(jit_matches_interpreter(&ctx, expr) != 0);
+        }
+    }
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_jit_variables)
+{
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t syms;
+    symtab_init(&syms, &sym_ctx);
+
+    // enough registers that variables are loaded into r8-r11 as well
+    const char* input =
+        "((a*b-c*d)*(e*f-g*h))-((h*g-f*e)*(d*c-b*a*65536))";
+    int32_t n_tokens, n_rpn;
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
+    assert_that(t != NULL);
+    assert_that(
+        symtab_resolve(&syms, input, strlen(input), t, n_tokens, 1, &diag)
+        == 0);
+    assert_that(syms.n_slots == 8);
+    for (int32_t slot = 0; slot < syms.n_slots; slot++)
+    {
+        symtab_set(&syms, slot, 1000 * slot - 3);
+    }
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
+    token_t res;
+    regvm_prog_t prog;
+    assert_that(evaluate_rpn(&ctx, rpn, n_rpn, &syms, &res, &diag) == 0);
+    assert_that(regvm_compile(&ctx, rpn, n_rpn, &prog, &diag) == 0);
+    int64_t value;
+    assert_that(regvm_run(&prog, syms.values, &value) == 0);
+    assert_that(value == res.value);
+
+    jit_code_t code;
+    if (!jit_compile(&prog, &code))
+    {
+        jit_result_t r = code.fn(syms.values);
+        assert_that(r.overflow == 0);
+        assert_that(r.value == res.value);
+        jit_free(&code);
+    }
+    else
+    {
+        assert_that(!JIT_AVAILABLE);
+    }
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+}
@@ -3,8 +3,11 @@
  * author: Ian Brault <ian.brault@engineering.ucla.edu>
  */
 
+#include <string.h>
+
 #include <cgreen/cgreen.h>
 
+#include <check.h>
 #include <error.h>
 #include <lex.h>
 #include <utils.h>
@@ -12,8 +15,11 @@
 Ensure(test_tokenize_valid)
 {
     const char* input = "  +1+  23 * (-456 + +0 )";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
 
     assert_that(t != NULL);
     assert_that(n_tokens == 12);
@@ -54,14 +60,17 @@ Ensure(test_tokenize_valid)
     assert_that(token_is_op(t[11], R_PAREN));
     assert_that(t[11].offset == 23);
 
-    free(t);
+    ctx_free(&ctx);
 }
 
 Ensure(test_tokenize_valid_invalid_syntax)
 {
     const char* input = " * * 123 0  ";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
 
     assert_that(t != NULL);
     assert_that(n_tokens == 4);
@@ -71,15 +80,305 @@ Ensure(test_tokenize_valid_invalid_syntax)
     assert_that(token_is_literal(t[2], 123));
     assert_that(token_is_literal(t[3], 0));
 
-    free(t);
+    ctx_free(&ctx);
 }
 
 Ensure(test_tokenize_invalid)
 {
-    const char* input = "  32 * abc";
+    const char* input = "  32 * $bc";
+    ctx_t ctx;
+    ctx_init(&ctx);
     int32_t n_tokens;
-    token_t* t = tokenize(input, &n_tokens);
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
 
     assert_that(t == NULL);
-    assert_that(n_tokens == (E_INVALID_TOKEN | 7));
-}
\ No newline at end of file
+    assert_that(n_tokens == -1);
+    assert_that(diag_is(diag, E_INVALID_TOKEN, 7));
+    assert_that(diag.index == 2);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_tokenize_variables)
+{
+    const char* input = "x1 = -_y * 2z";
+    ctx_t ctx;
+    ctx_init(&ctx);
+    int32_t n_tokens;
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
+
+    assert_that(t != NULL);
+    assert_that(n_tokens == 7);
+    // variables are unresolved until looked up in a symbol table
+    assert_that(t[0].type == VARIABLE && t[0].value == -1);
+    assert_that(token_is_op(t[1], ASSIGN));
+    assert_that(t[1].offset == 3);
+    // a variable is an operand, so the minus before it is unary
+    assert_that(token_is_op(t[2], OP_NEG));
+    assert_that(t[3].type == VARIABLE && t[3].offset == 6);
+    assert_that(token_is_op(t[4], OP_MUL));
+    // a name cannot start with a digit
+    assert_that(token_is_literal(t[5], 2));
+    assert_that(t[6].type == VARIABLE && t[6].offset == 12);
+
+    // statements are split at the "=" following a leading name
+    size_t name, name_len;
+    assert_that(lex_assignment(input, strlen(input), &name, &name_len) == 4);
+    assert_that(name == 0 && name_len == 2);
+    input = "  total\t=1";
+    assert_that(lex_assignment(input, strlen(input), &name, &name_len) == 9);
+    assert_that(name == 2 && name_len == 5);
+    input = "x + y = 1";
+    assert_that(lex_assignment(input, strlen(input), &name, &name_len) == 0);
+    input = "1 = x";
+    assert_that(lex_assignment(input, strlen(input), &name, &name_len) == 0);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_tokenize_slice)
+{
+    // only the first 4 characters are tokenized, the slice is not terminated
+    const char* input = "12+3456";
+    ctx_t ctx;
+    ctx_init(&ctx);
+    int32_t n_tokens;
+    diag_t diag;
+    token_t* t = tokenize_n(&ctx, input, 4, &n_tokens, &diag);
+
+    assert_that(t != NULL);
+    assert_that(n_tokens == 3);
+    assert_that(token_is_literal(t[0], 12));
+    assert_that(token_is_op(t[1], OP_ADD));
+    assert_that(token_is_literal(t[2], 3));
+    assert_that(t[2].offset == 3);
+
+    ctx_free(&ctx);
+}
+
+/*
+ * tokenize an input with every supported lexer implementation and compare the
+ * tokens and diagnostics with those of the bytewise lexer; returns 0 if any
+ * differ
+ */
+static uint8_t lex_kernels_agree(ctx_t* ctx, const char* input, size_t len)
+{
+    int32_t n_expected;
+    diag_t expected;
+    token_t* t_expected = tokenize_kernel(
+        ctx, input, len, LEX_BYTEWISE, &n_expected, &expected);
+    for (int kernel = LEX_BYTEWISE + 1; kernel < N_LEX_KERNELS; kernel++)
+    {
+        if (!lex_kernel_supported(kernel))
+        {
+            continue;
+        }
+        int32_t n_tokens;
+        diag_t diag;
+        token_t* t = tokenize_kernel(ctx, input, len, kernel, &n_tokens, &diag);
+        if (n_tokens != n_expected)
+        {
+            return 0;
+        }
+        if (!t)
+        {
+            if (!diag_is(diag, expected.kind, expected.offset)
+                || diag.index != expected.index)
+            {
+                return 0;
+            }
+            continue;
+        }
+        for (int32_t i = 0; i < n_tokens; i++)
+        {
+            if (t[i].type != t_expected[i].type
+                || t[i].value != t_expected[i].value
+                || t[i].offset != t_expected[i].offset)
+            {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// lex a single literal, returning -2 if it is not lexed in full
+static int64_t lex_literal_str(const char* input, int64_t* value)
+{
+    size_t len = strlen(input);
+    int64_t n = lex_literal(input, input + len, value);
+    return n < 0 || (size_t) n == len ? n : -2;
+}
+
+Ensure(test_lex_literals)
+{
+    int64_t v;
+    assert_that(lex_literal_str("0", &v) == 1 && v == 0);
+    assert_that(
+        lex_literal_str("9223372036854775807", &v) == 19 && v == INT64_MAX);
+    // the magnitude of INT64_MIN is lexed as INT64_MIN, see
+    // lex_fold_min_literal
+    assert_that(
+        lex_literal_str("9223372036854775808", &v) == 19 && v == INT64_MIN);
+    assert_that(lex_literal_str("9223372036854775809", &v) == -1);
+    assert_that(lex_literal_str("99999999999999999999999", &v) == -1);
+    // leading zeros do not count towards the range, nor select octal
+    assert_that(lex_literal_str("00000000009223372036854775807", &v) > 0);
+    assert_that(v == INT64_MAX);
+    assert_that(lex_literal_str("0017", &v) > 0 && v == 17);
+
+    // prefixed literals have the same range as decimal ones
+    assert_that(lex_literal_str("0xDEAD_beef", &v) > 0 && v == 0xdeadbeef);
+    assert_that(lex_literal_str("0x7FFF_FFFF_FFFF_FFFF", &v) > 0);
+    assert_that(v == INT64_MAX);
+    assert_that(lex_literal_str("0x8000_0000_0000_0000", &v) > 0);
+    assert_that(v == INT64_MIN);
+    assert_that(lex_literal_str("0x8000_0000_0000_0001", &v) == -1);
+    assert_that(lex_literal_str("0XFFFFFFFFFFFFFFFF", &v) == -1);
+    assert_that(lex_literal_str("0o777777777777777777777", &v) > 0);
+    assert_that(v == INT64_MAX);
+    assert_that(lex_literal_str("0o1000000000000000000000", &v) > 0);
+    assert_that(lex_literal_str("0o1000000000000000000001", &v) == -1);
+    assert_that(lex_literal_str("0b1000_0000", &v) > 0 && v == 128);
+    assert_that(lex_literal_str("1_2_3", &v) > 0 && v == 123);
+
+    // prefixes and underscores which are not followed by a digit are left
+    // over for the next token
+    const char* partial[] = { "0x", "0xg", "0b2", "0o8", "1_", "1__2", "2_x" };
+    for (size_t i = 0; i < sizeof(partial) / sizeof(partial[0]); i++)
+    {
+        const char* c = partial[i];
+        assert_that(lex_literal(c, c + strlen(c), &v) == 1);
+    }
+    assert_that(lex_literal("x1", "x1" + 2, &v) == 0);
+
+    // the 8-digit conversion agrees with digit at a time conversion over
+    // every alignment of the digits within the literal
+    uint32_t state = 5;
+    char input[32];
+    for (int n = 0; n < 2000; n++)
+    {
+        int len = 1 + n % 19;
+        uint64_t expected = 0;
+        for (int i = 0; i < len; i++)
+        {
+            state = state * 1103515245u + 12345u;
+            input[i] = (char) ('0' + (state >> 16) % 10);
+            expected = expected * 10 + (uint64_t) (input[i] - '0');
+        }
+        input[len] = 0;
+        int64_t rc = lex_literal_str(input, &v);
+        assert_that(expected > LEX_LIT_MIN_MAGNITUDE
+            ? rc == -1 : rc == len && (uint64_t) v == expected);
+    }
+
+    // out of range literals are reported at their offset
+    ctx_t ctx;
+    ctx_init(&ctx);
+    int32_t n_tokens;
+    diag_t diag;
+    const char* expr = "1 + 0x1_0000_0000_0000_0000 * $";
+    assert_that(tokenize(&ctx, expr, &n_tokens, &diag) == NULL);
+    assert_that(diag_is(diag, E_LIT_OVERFLOW, 4));
+    assert_that(diag.index == 2);
+
+    // INT64_MIN can be written after a unary minus only, which then leaves
+    // the literal alone
+    token_t* t = tokenize(&ctx, "2 * -9223372036854775808", &n_tokens, &diag);
+    assert_that(t != NULL && n_tokens == 4);
+    assert_that(token_is_op(t[2], OP_POS) && t[3].value == INT64_MIN);
+    expr = "2 - 9223372036854775808 $";
+    assert_that(tokenize(&ctx, expr, &n_tokens, &diag) == NULL);
+    assert_that(diag_is(diag, E_LIT_OVERFLOW, 4));
+    assert_that(diag.index == 2);
+    ctx_free(&ctx);
+}
+
+Ensure(test_tokenize_kernels_edge_cases)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    const char* inputs[] = {
+        "",
+        " \t\n\v\f\r",
+        "x1 = -_y * 2z",
+        "99999999999999999999 + 4294967297",
+        "0x7fffffff - 0b_1 * 0o1_7 + 1__2 + 0x",
+        "1 + $",
+        "a\xe9" "b",
+        "(((1)))",
+        "A_Z9 - z_a0 * _",
+        "1 \x1f 2",
+        "@[`{",
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++)
+    {
+        assert_that(lex_kernels_agree(&ctx, inputs[i], strlen(inputs[i])));
+    }
+
+    // tokens, whitespace runs and invalid characters straddling the block
+    // boundaries, and inputs ending on a boundary
+    char input[MAX_INPUT_LEN + 1];
+    for (size_t len = 1; len <= 200; len++)
+    {
+        for (size_t at = 0; at < len; at++)
+        {
+            memset(input, ' ', len);
+            memset(input + at, 'v', len - at < 3 ? len - at : 3);
+            assert_that(lex_kernels_agree(&ctx, input, len));
+            input[at] = '7';
+            assert_that(lex_kernels_agree(&ctx, input, len));
+            input[at] = '#';
+            assert_that(lex_kernels_agree(&ctx, input, len));
+            ctx_reset(&ctx);
+        }
+    }
+
+    // the longest accepted input, too many tokens and too long an input
+    memset(input, '1', MAX_INPUT_LEN);
+    assert_that(lex_kernels_agree(&ctx, input, MAX_INPUT_LEN - 1));
+    assert_that(lex_kernels_agree(&ctx, input, MAX_INPUT_LEN));
+    for (int i = 0; i < MAX_INPUT_LEN; i += 2)
+    {
+        input[i] = '-';
+    }
+    assert_that(lex_kernels_agree(&ctx, input, MAX_TOKENS));
+    assert_that(lex_kernels_agree(&ctx, input, MAX_TOKENS - 1));
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_tokenize_kernels_random_inputs)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    uint32_t state = 11;
+    char input[MAX_INPUT_LEN];
+    for (int n = 0; n < 500; n++)
+    {
+        ctx_reset(&ctx);
+        size_t len = check_gen_expr(&state, input, sizeof(input));
+        assert_that(lex_kernels_agree(&ctx, input, len));
+    }
+
+    // arbitrary bytes, weighted towards the characters of valid tokens
+    const char alphabet[] = " \t0123456789+-*()=_azAZxob";
+    for (int n = 0; n < 500; n++)
+    {
+        ctx_reset(&ctx);
+        state = state * 1103515245u + 12345u;
+        size_t len = (state >> 16) % 300;
+        for (size_t i = 0; i < len; i++)
+        {
+            state = state * 1103515245u + 12345u;
+            uint32_t r = state >> 16;
+            input[i] = r % 8
+                ? alphabet[r / 8 % (sizeof(alphabet) - 1)] : (char) (r / 8);
+        }
+        assert_that(lex_kernels_agree(&ctx, input, len));
+    }
+
+    ctx_free(&ctx);
+}
@@ -0,0 +1,108 @@
+/*
+ * test/test_opt.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <bignum.h>
+#include <check.h>
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <opt.h>
+#include <utils.h>
+
+// optimize an expression and evaluate both forms, returns 0 if the results
+// differ or the expression is invalid
+static uint8_t opt_matches_interpreter(
+    ctx_t* ctx, const char* input, int32_t* n_rpn, int32_t* n_opt)
+{
+    ctx_reset(ctx);
+    diag_t diag;
+    int32_t n_tokens;
+    token_t* t = tokenize(ctx, input, &n_tokens, &diag);
+    token_t* rpn = t ? shunting_yard(ctx, t, n_tokens, n_rpn, &diag) : NULL;
+    token_t* opt = rpn ? optimize_rpn(ctx, rpn, *n_rpn, n_opt, &diag) : NULL;
+    token_t res, opt_res;
+    if (!opt || evaluate_rpn(ctx, rpn, *n_rpn, NULL, &res, &diag)
+        || evaluate_rpn(ctx, opt, *n_opt, NULL, &opt_res, &diag))
+    {
+        return 0;
+    }
+    return bignum_cmp(&res, &opt_res) == 0;
+}
+
+Ensure(test_opt_fold_constants)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    int32_t n_rpn, n_opt;
+
+    assert_that(
+        opt_matches_interpreter(&ctx, "16 * (36 + 64)", &n_rpn, &n_opt));
+    assert_that(n_rpn == 5);
+    assert_that(n_opt == 1);
+    assert_that(opt_matches_interpreter(
+        &ctx, "10 - (-2) - +2 - (-(-10))", &n_rpn, &n_opt));
+    assert_that(n_opt == 1);
+    assert_that(opt_matches_interpreter(
+        &ctx, "65536 * 65536 - 2147483647 - 2", &n_rpn, &n_opt));
+    assert_that(n_opt == 1);
+    // subexpressions which overflow are left to the evaluator
+    assert_that(opt_matches_interpreter(
+        &ctx, "(9223372036854775807 + 1) * 3", &n_rpn, &n_opt));
+    assert_that(n_opt > 1);
+    assert_that(opt_matches_interpreter(
+        &ctx, "4294967296 * 4294967296 * 0", &n_rpn, &n_opt));
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_opt_random_expressions)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    uint32_t state = 54321;
+    char expr[MAX_INPUT_LEN];
+
+    for (int i = 0; i < 2000; i++)
+    {
+        check_gen_expr(&state, expr, sizeof(expr));
+        ctx_reset(&ctx);
+        int32_t n_tokens, n_rpn, n_opt;
+        diag_t diag;
+        // skip the few expressions which exceed the token limit
+        if (tokenize(&ctx, expr, &n_tokens, &diag))
+        {
+            // constant expressions fold to a single literal, unless an
+            // intermediate result overflows
+            assert_that(opt_matches_interpreter(&ctx, expr, &n_rpn, &n_opt));
+            assert_that(n_opt >= 1 && n_opt <= n_rpn);
+        }
+    }
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_opt_errors)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    diag_t diag;
+    int32_t n_opt;
+
+    // the same errors as evaluate_rpn
+    token_t rpn[2];
+    init_literal(&rpn[0], 1, 0);
+    init_token(&rpn[1], OP_ADD, 2);
+    assert_that(optimize_rpn(&ctx, rpn, 2, &n_opt, &diag) == NULL);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 2));
+    assert_that(diag.index == 1);
+    assert_that(optimize_rpn(&ctx, rpn, 0, &n_opt, &diag) == NULL);
+    assert_that(diag.kind == E_EMPTY_EXPR);
+    assert_that(n_opt == -1);
+
+    ctx_free(&ctx);
+}
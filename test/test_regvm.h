@@ -0,0 +1,97 @@
+/*
+ * test/test_regvm.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <regvm.h>
+#include <utils.h>
+
+// compile an expression to register code, returns -1 and fills diag on error
+static int regvm_compile_expr(
+    ctx_t* ctx, const char* input, regvm_prog_t* prog, diag_t* diag)
+{
+    int32_t n_tokens, n_rpn;
+    token_t* t = tokenize(ctx, input, &n_tokens, diag);
+    if (!t)
+    {
+        return -1;
+    }
+    token_t* rpn = shunting_yard(ctx, t, n_tokens, &n_rpn, diag);
+    if (!rpn)
+    {
+        return -1;
+    }
+    return regvm_compile(ctx, rpn, n_rpn, prog, diag);
+}
+
+Ensure(test_regvm_run)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    regvm_prog_t prog;
+    diag_t diag;
+    int64_t value;
+
+    assert_that(regvm_compile_expr(&ctx, "16 * (36 + 64)", &prog, &diag) == 0);
+    assert_that(regvm_run(&prog, NULL, &value) == 0);
+    assert_that(value == 1600);
+    assert_that(regvm_compile_expr(
+        &ctx, "10 - (-2) - +2 - (-(-10))", &prog, &diag) == 0);
+    assert_that(regvm_run(&prog, NULL, &value) == 0);
+    assert_that(value == 0);
+    // literal left operands of subtraction are reversed, not swapped
+    assert_that(regvm_compile_expr(&ctx, "1 - (2 * 3)", &prog, &diag) == 0);
+    assert_that(regvm_run(&prog, NULL, &value) == 0);
+    assert_that(value == -5);
+
+    // immediates use all 64 bits, and overflow is reported
+    assert_that(regvm_compile_expr(
+        &ctx, "9223372036854775806 + 1", &prog, &diag) == 0);
+    assert_that(regvm_run(&prog, NULL, &value) == 0);
+    assert_that(value == INT64_MAX);
+    assert_that(regvm_compile_expr(
+        &ctx, "9223372036854775807 + 1", &prog, &diag) == 0);
+    assert_that(regvm_run(&prog, NULL, &value) == 1);
+    assert_that(regvm_compile_expr(
+        &ctx, "1 - (-9223372036854775807 - 1)", &prog, &diag) == 0);
+    assert_that(regvm_run(&prog, NULL, &value) == 1);
+
+    assert_that(regvm_compile_expr(&ctx, "1 * * 2", &prog, &diag) == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 2));
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_regvm_register_count)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    regvm_prog_t prog;
+    diag_t diag;
+    int64_t value;
+
+    // a chain only needs its accumulator, literals are immediates
+    assert_that(regvm_compile_expr(
+        &ctx, "1 + 2 + 3 + 4 + 5 + 6 + 7 + 8", &prog, &diag) == 0);
+    assert_that(prog.n_regs == 1);
+    // products within a sum need one temporary
+    assert_that(regvm_compile_expr(
+        &ctx, "1 + 2 * 3 - 4 + 5 * 6 - 7 + 8", &prog, &diag) == 0);
+    assert_that(prog.n_regs == 2);
+    assert_that(regvm_run(&prog, NULL, &value) == 0);
+    assert_that(value == 34);
+    // a balanced tree needs one more register per level
+    assert_that(regvm_compile_expr(
+        &ctx, "((1 + 2) * (3 + 4)) - ((5 + 6) * (7 + 8))", &prog, &diag) == 0);
+    assert_that(prog.n_regs == 3);
+    assert_that(regvm_run(&prog, NULL, &value) == 0);
+    assert_that(value == -144);
+
+    ctx_free(&ctx);
+}
@@ -0,0 +1,122 @@
+/*
+ * test/test_serve.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cgreen/cgreen.h>
+
+#include <serve.h>
+
+typedef struct {
+    const char* path;
+    int status;
+} serve_test_server_t;
+
+static void* serve_test_run(void* arg)
+{
+    serve_test_server_t* server = arg;
+    server->status = serve_main(server->path, 0);
+    return NULL;
+}
+
+// connect to the server, retrying until it is listening
+static int serve_test_connect(const char* path)
+{
+    struct sockaddr_un addr = { .sun_family=AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    for (int i = 0; i < 1000; i++)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (!connect(fd, (struct sockaddr*) &addr, sizeof(addr)))
+        {
+            return fd;
+        }
+        close(fd);
+        struct timespec delay = { .tv_sec=0, .tv_nsec=1000000 };
+        nanosleep(&delay, NULL);
+    }
+    return -1;
+}
+
+// send every request at once, then read responses until the server closes
+static uint8_t serve_test_exchange(
+    const char* path, const char* requests, const char* expected)
+{
+    int fd = serve_test_connect(path);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    size_t len = strlen(requests);
+    if (write(fd, requests, len) != (ssize_t) len)
+    {
+        close(fd);
+        return 0;
+    }
+    shutdown(fd, SHUT_WR);
+
+    char buf[1024];
+    size_t used = 0;
+    ssize_t n;
+    while (used < sizeof(buf)
+        && (n = read(fd, buf + used, sizeof(buf) - used)) > 0)
+    {
+        used += n;
+    }
+    close(fd);
+    return used == strlen(expected) && !memcmp(buf, expected, used);
+}
+
+Ensure(test_serve_loopback)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/ccc_test_serve_%d.sock", (int) getpid());
+    serve_test_server_t server = { .path=path, .status=-1 };
+    pthread_t thread;
+    assert_that(pthread_create(&thread, NULL, serve_test_run, &server) == 0);
+
+    // pipelined requests are answered in order, one line per request
+    assert_that(serve_test_exchange(
+        path, "1 + 2\n3 * 4\n(1\n\n2 * (3 + 4)\n",
+        "3\n12\nerror: 0: unmatched \"(\"\n\n14\n"));
+    // assignments are rejected, so connections cannot share variables
+    assert_that(serve_test_exchange(
+        path, "secret = 42\nsecret\n",
+        "error: 7: assignment is not allowed here\n"
+        "error: 0: undefined variable\n"));
+
+    // a request too long for the engine is rejected without being buffered
+    // whole, and the requests after it are still answered
+    size_t long_len = 4 * SERVE_READ_SIZE;
+    char* requests = malloc(long_len + 4);
+    memset(requests, '1', long_len);
+    memcpy(requests + long_len, "\n2\n", 4);
+    assert_that(serve_test_exchange(
+        path, requests, "error: maximum input length (1024) exceeded\n2\n"));
+    free(requests);
+
+    // a connection still open when the server stops is closed
+    int fd = serve_test_connect(path);
+    assert_that(fd >= 0);
+    char buf[16];
+    assert_that(write(fd, "5\n", 2) == 2);
+    assert_that(read(fd, buf, sizeof(buf)) == 2 && !memcmp(buf, "5\n", 2));
+
+    // the server has installed its signal handlers once it has answered
+    pthread_kill(thread, SIGTERM);
+    pthread_join(thread, NULL);
+    assert_that(server.status == EXIT_SUCCESS);
+    assert_that(read(fd, buf, sizeof(buf)) == 0);
+    close(fd);
+    assert_that(access(path, F_OK) != 0);
+}
@@ -0,0 +1,138 @@
+/*
+ * test/test_sheet.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <error.h>
+#include <sheet.h>
+#include <utils.h>
+
+static int32_t sheet_set_str(sheet_t* s, const char* src)
+{
+    diag_t diag;
+    return sheet_set(s, src, strlen(src), &diag);
+}
+
+static int sheet_is(const sheet_t* s, const char* name, int64_t expected)
+{
+    int64_t value;
+    diag_t diag;
+    int32_t slot = symtab_find(&s->syms, name, strlen(name));
+    return slot >= 0 && !sheet_value(s, slot, &value, &diag)
+        && value == expected;
+}
+
+static int sheet_err_is(
+    const sheet_t* s, const char* name, err_kind kind, int64_t offset)
+{
+    int64_t value;
+    diag_t diag;
+    int32_t slot = symtab_find(&s->syms, name, strlen(name));
+    return slot >= 0 && sheet_value(s, slot, &value, &diag)
+        && diag_is(diag, kind, offset);
+}
+
+Ensure(test_sheet_recompute_downstream)
+{
+    sheet_t s;
+    sheet_init(&s);
+    // formulas may refer to names which are defined later
+    assert_that(sheet_set_str(&s, "total = net + tax") >= 0);
+    assert_that(sheet_set_str(&s, "net = price * qty") >= 0);
+    assert_that(sheet_set_str(&s, "tax = net * 2") >= 0);
+    assert_that(sheet_set_str(&s, "price = 5") >= 0);
+    assert_that(sheet_set_str(&s, "qty = 3") >= 0);
+    assert_that(sheet_set_str(&s, "other = 7") >= 0);
+    assert_that(sheet_recompute_all(&s) == 6);
+    assert_that(sheet_is(&s, "total", 45));
+    assert_that(sheet_is(&s, "other", 7));
+
+    // only the formulas downstream of the update are recomputed, each after
+    // the formulas it reads
+    int32_t slot = sheet_set_str(&s, "qty = 4");
+    assert_that(sheet_recompute(&s, &slot, 1) == 4);
+    const char* expected[] = { "qty", "net", "tax", "total" };
+    for (int i = 0; i < 4; i++)
+    {
+        const char* name = expected[i];
+        assert_that(
+            s.order[i] == symtab_find(&s.syms, name, strlen(name)));
+    }
+    assert_that(sheet_is(&s, "total", 60));
+
+    // replacing a formula drops its old dependencies
+    slot = sheet_set_str(&s, "tax = 1");
+    assert_that(sheet_recompute(&s, &slot, 1) == 2);
+    slot = sheet_set_str(&s, "price = 1");
+    assert_that(sheet_recompute(&s, &slot, 1) == 3);
+    assert_that(sheet_is(&s, "total", 5));
+
+    sheet_free(&s);
+}
+
+Ensure(test_sheet_errors)
+{
+    sheet_t s;
+    sheet_init(&s);
+    diag_t diag;
+    assert_that(sheet_set(&s, "1 + 2", 5, &diag) == -1);
+    assert_that(diag_is(diag, E_NOT_FORMULA, -1));
+
+    assert_that(sheet_set_str(&s, "a = b + 1") >= 0);
+    assert_that(sheet_set_str(&s, "c = a * 2") >= 0);
+    assert_that(sheet_set_str(&s, "d = 1 +") >= 0);
+    assert_that(sheet_set_str(&s, "e = d") >= 0);
+    sheet_recompute_all(&s);
+    assert_that(sheet_err_is(&s, "a", E_UNDEFINED_VAR, 4));
+    assert_that(sheet_err_is(&s, "c", E_DEP_ERROR, 4));
+    assert_that(sheet_err_is(&s, "d", E_OP_MISSING_EXPR, 6));
+    assert_that(sheet_err_is(&s, "e", E_DEP_ERROR, 4));
+
+    // defining the missing name fixes everything downstream of it
+    int32_t slot = sheet_set_str(&s, "b = 4");
+    assert_that(sheet_recompute(&s, &slot, 1) == 3);
+    assert_that(sheet_is(&s, "c", 10));
+
+    // values are 64 bits, and may overflow on the way to one which fits
+    assert_that(sheet_set_str(&s, "f = 9223372036854775807") >= 0);
+    assert_that(sheet_set_str(&s, "g = f * 2") >= 0);
+    assert_that(sheet_set_str(&s, "h = f * 2 - f") >= 0);
+    assert_that(sheet_set_str(&s, "i = g") >= 0);
+    sheet_recompute_all(&s);
+    assert_that(sheet_err_is(&s, "g", E_VALUE_RANGE, -1));
+    assert_that(sheet_is(&s, "h", INT64_MAX));
+    assert_that(sheet_err_is(&s, "i", E_DEP_ERROR, 4));
+
+    sheet_free(&s);
+}
+
+Ensure(test_sheet_cycles)
+{
+    sheet_t s;
+    sheet_init(&s);
+    assert_that(sheet_set_str(&s, "a = c + 1") >= 0);
+    assert_that(sheet_set_str(&s, "b = a + 1") >= 0);
+    assert_that(sheet_set_str(&s, "c = b + 1") >= 0);
+    assert_that(sheet_set_str(&s, "d = c * 2") >= 0);
+    assert_that(sheet_set_str(&s, "e = e") >= 0);
+    sheet_recompute_all(&s);
+    assert_that(sheet_err_is(&s, "a", E_CIRCULAR_REF, 4));
+    assert_that(sheet_err_is(&s, "b", E_CIRCULAR_REF, 4));
+    assert_that(sheet_err_is(&s, "c", E_CIRCULAR_REF, 4));
+    // formulas downstream of a cycle cannot be computed either
+    assert_that(sheet_err_is(&s, "d", E_CIRCULAR_REF, 4));
+    assert_that(sheet_err_is(&s, "e", E_CIRCULAR_REF, 4));
+
+    // breaking the cycle recomputes its former members in order
+    int32_t slot = sheet_set_str(&s, "a = 1");
+    assert_that(sheet_recompute(&s, &slot, 1) == 4);
+    assert_that(sheet_is(&s, "b", 2));
+    assert_that(sheet_is(&s, "c", 3));
+    assert_that(sheet_is(&s, "d", 6));
+
+    sheet_free(&s);
+}
@@ -0,0 +1,106 @@
+/*
+ * test/test_shm.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cgreen/cgreen.h>
+
+#include <error.h>
+#include <shm.h>
+
+typedef struct {
+    const char* name;
+    int status;
+} shm_test_worker_t;
+
+static void* shm_test_run(void* arg)
+{
+    shm_test_worker_t* worker = arg;
+    worker->status = shm_worker_main(worker->name);
+    return NULL;
+}
+
+// attach to the worker, retrying until it has created the region
+static int shm_test_open(shm_client_t* client, const char* name)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        if (!shm_client_open(client, name))
+        {
+            return 0;
+        }
+        struct timespec delay = { .tv_sec=0, .tv_nsec=1000000 };
+        nanosleep(&delay, NULL);
+    }
+    return -1;
+}
+
+Ensure(test_shm_round_trip)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/ccc_test_shm_%d", (int) getpid());
+    shm_test_worker_t worker = { .name=name, .status=-1 };
+    pthread_t thread;
+    assert_that(pthread_create(&thread, NULL, shm_test_run, &worker) == 0);
+    shm_client_t client;
+    assert_that(shm_test_open(&client, name) == 0);
+
+    // requests are submitted in groups smaller than the rings, for enough
+    // rounds that the ring indices wrap around the slots several times
+    char expr[64];
+    int ok = 1;
+    for (int round = 0; round < 3 * SHM_SLOTS / 100; round++)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            int len = snprintf(expr, sizeof(expr), "%d * 3 - 7", round + i);
+            ok &= shm_client_submit(&client, expr, len) == 0;
+        }
+        for (int i = 0; i < 100; i++)
+        {
+            shm_response_t res;
+            ok &= shm_client_receive(&client, &res) == 0;
+            ok &= res.kind == E_OK && res.value == (round + i) * 3 - 7;
+        }
+    }
+    assert_that(ok);
+    assert_that(client.pending == 0);
+
+    // errors come back with their message, results with no room in a
+    // response are reported as out of range
+    const char* bad[] = { "(1", "9223372036854775807 + 1" };
+    for (int i = 0; i < 2; i++)
+    {
+        shm_client_submit(&client, bad[i], strlen(bad[i]));
+    }
+    shm_response_t res;
+    assert_that(shm_client_receive(&client, &res) == 0);
+    assert_that(res.kind == E_UNMATCHED_PAREN && res.offset == 0);
+    assert_that(strcmp(res.message, "0: unmatched \"(\"") == 0);
+    assert_that(shm_client_receive(&client, &res) == 0);
+    assert_that(res.kind == E_VALUE_RANGE);
+
+    // the worker has installed its signal handlers once it has answered
+    pthread_kill(thread, SIGTERM);
+    pthread_join(thread, NULL);
+    assert_that(worker.status == EXIT_SUCCESS);
+
+    // once interrupted, the client fails rather than waiting on a worker
+    // which will never answer
+    assert_that(shm_client_receive(&client, &res) == -1);
+    for (int i = 0; i < SHM_SLOTS; i++)
+    {
+        ok &= shm_client_submit(&client, "1", 1) == 0;
+    }
+    assert_that(ok);
+    assert_that(shm_client_submit(&client, "1", 1) == -1);
+    shm_client_close(&client);
+}
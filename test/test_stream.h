@@ -0,0 +1,147 @@
+/*
+ * test/test_stream.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <stream.h>
+#include <writer.h>
+
+// feed input to a streaming evaluator in chunks of the given size and compare
+// the output lines against the expected output
+static uint8_t stream_output_is(
+    const char* input, size_t chunk, const char* expected)
+{
+    stream_t s;
+    stream_init(&s);
+    writer_t out;
+    writer_init(&out, -1, 0);
+
+    size_t len = strlen(input);
+    for (size_t i = 0; i < len; i += chunk)
+    {
+        stream_feed(&s, input + i, len - i < chunk ? len - i : chunk, &out);
+    }
+    stream_finish(&s, &out);
+
+    uint8_t same = out.used == strlen(expected)
+        && !memcmp(out.buf, expected, out.used);
+    writer_free(&out);
+    stream_free(&s);
+
+    return same;
+}
+
+Ensure(test_stream_eval)
+{
+    const char* input = "16 * (36 + 64)\n10 - (-2) - +2 - (-(-10))\n\n-5 * 3";
+    const char* expected = "1600\n0\n\n-15\n";
+    // results do not depend on where the input is split
+    assert_that(stream_output_is(input, 1, expected));
+    assert_that(stream_output_is(input, 3, expected));
+    assert_that(stream_output_is(input, strlen(input), expected));
+}
+
+Ensure(test_stream_errors)
+{
+    const char* input = "(1 + 2)) - 5\n1 2 *\n* 1 2\n1 * * 2\n32 * abc\n-()\n";
+    const char* expected =
+        "error: 7: unmatched \")\"\n"
+        "error: 4: operator \"*\" missing right-hand expression\n"
+        "error: 0: operator \"*\" missing left-hand expression\n"
+        "error: 2: operator \"*\" missing right-hand expression\n"
+        "error: 5: invalid token\n"
+        "error: 0: operator \"-\" missing right-hand expression\n";
+    assert_that(stream_output_is(input, 2, expected));
+}
+
+Ensure(test_stream_literals)
+{
+    const char* input =
+        "0x7fff_ffff_ffff_ffff + 0b1\n0o17 * 1_000\n"
+        "9223372036854775808 + (\n0x1_0000_0000_0000_0000\n"
+        "0x\n1_ + 2\n0b2\n00012\n-0x8000_0000_0000_0000\n";
+    const char* expected =
+        "9223372036854775808\n15000\n"
+        "error: 0: integer literal out of range\n"
+        "error: 0: integer literal out of range\n"
+        "error: 1: invalid token\n"
+        "error: 1: invalid token\n"
+        "error: 1: invalid token\n"
+        "12\n"
+        "-9223372036854775808\n";
+    // literals, prefixes and separators may be split across chunks
+    for (size_t chunk = 1; chunk <= 4; chunk++)
+    {
+        assert_that(stream_output_is(input, chunk, expected));
+    }
+}
+
+Ensure(test_stream_long_chain)
+{
+    // expressions are not limited by MAX_INPUT_LEN or MAX_TOKENS
+    size_t n = 10 * MAX_INPUT_LEN;
+    char* input = malloc(2 * n + 2);
+    for (size_t i = 0; i < n; i++)
+    {
+        input[2 * i] = '1';
+        input[2 * i + 1] = '+';
+    }
+    input[2 * n] = '1';
+    input[2 * n + 1] = 0;
+
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%zu\n", n + 1);
+    assert_that(stream_output_is(input, 4096, expected));
+
+    free(input);
+}
+
+Ensure(test_stream_bignum_chain)
+{
+    stream_t s;
+    stream_init(&s);
+    writer_t out;
+    writer_init(&out, -1, 0);
+
+    // the bignums of finished terms are released as the chain is reduced, so
+    // a chain which overflows needs no more memory than a short one
+    const char* term = "9223372036854775807 + ";
+    for (int i = 0; i < 100000; i++)
+    {
+        stream_feed(&s, term, strlen(term), &out);
+    }
+    assert_that(s.ctx.overflow == NULL);
+    assert_that(s.ctx.used < 256);
+    stream_feed(&s, "0\n", 2, &out);
+
+    const char* expected = "922337203685477580700000\n";
+    assert_that(out.used == strlen(expected));
+    assert_that(!memcmp(out.buf, expected, out.used));
+
+    writer_free(&out);
+    stream_free(&s);
+}
+
+Ensure(test_stream_error_offset)
+{
+    // error positions are not truncated past the first kilobyte of a line
+    size_t n = 2 * MAX_INPUT_LEN;
+    char* input = malloc(n + 3);
+    memset(input, ' ', n);
+    input[n] = '1';
+    input[n + 1] = ')';
+    input[n + 2] = 0;
+
+    char expected[64];
+    snprintf(
+        expected, sizeof(expected), "error: %zu: unmatched \")\"\n", n + 1);
+    assert_that(stream_output_is(input, 4096, expected));
+
+    free(input);
+}
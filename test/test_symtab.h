@@ -0,0 +1,106 @@
+/*
+ * test/test_symtab.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <cgreen/cgreen.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <symtab.h>
+#include <utils.h>
+
+Ensure(test_symtab_intern)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    symtab_t s;
+    symtab_init(&s, &ctx);
+
+    assert_that(symtab_find(&s, "x", 1) == -1);
+    assert_that(symtab_intern(&s, "x", 1) == 0);
+    assert_that(symtab_intern(&s, "xy", 2) == 1);
+    // names need not be NUL-terminated
+    assert_that(symtab_intern(&s, "x + 1", 1) == 0);
+    assert_that(symtab_find(&s, "xyz", 2) == 1);
+
+    // slots stay put as the table grows
+    char name[16];
+    for (int i = 0; i < 100; i++)
+    {
+        int len = snprintf(name, sizeof(name), "v%d", i);
+        assert_that(symtab_intern(&s, name, len) == i + 2);
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        int len = snprintf(name, sizeof(name), "v%d", i);
+        assert_that(symtab_find(&s, name, len) == i + 2);
+    }
+    assert_that(symtab_find(&s, "x", 1) == 0);
+    assert_that(s.n_slots == 102);
+
+    // interned variables are undefined until assigned
+    token_t x = { .type=VARIABLE, .value=0, .offset=0 };
+    assert_that(!symtab_defined(&s, &x));
+    symtab_set(&s, 0, 42);
+    assert_that(symtab_defined(&s, &x));
+    assert_that(s.values[0] == 42);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_symtab_resolve_check)
+{
+    ctx_t ctx, sym_ctx;
+    ctx_init(&ctx);
+    ctx_init(&sym_ctx);
+    symtab_t s;
+    symtab_init(&s, &sym_ctx);
+
+    const char* input = "rate * (hours + rate) - bonus";
+    int32_t n_tokens, n_rpn;
+    diag_t diag;
+    token_t* t = tokenize(&ctx, input, &n_tokens, &diag);
+    assert_that(t != NULL);
+
+    // without interning, unknown names are left unresolved
+    assert_that(
+        symtab_resolve(&s, input, strlen(input), t, n_tokens, 0, &diag) == 0);
+    assert_that(t[0].value == -1);
+    assert_that(s.n_slots == 0);
+
+    assert_that(
+        symtab_resolve(&s, input, strlen(input), t, n_tokens, 1, &diag) == 0);
+    assert_that(s.n_slots == 3);
+    assert_that(t[0].value == 0);
+    assert_that(t[3].value == 1);
+    assert_that(t[5].value == 0);
+    assert_that(t[8].value == 2);
+
+    // the first undefined variable in evaluation order is reported
+    token_t* rpn = shunting_yard(&ctx, t, n_tokens, &n_rpn, &diag);
+    assert_that(rpn != NULL);
+    symtab_set(&s, 0, 3);
+    assert_that(symtab_check(&s, rpn, n_rpn, &diag) == -1);
+    assert_that(diag_is(diag, E_UNDEFINED_VAR, 8));
+    symtab_set(&s, 1, 4);
+    assert_that(symtab_check(&s, rpn, n_rpn, &diag) == -1);
+    assert_that(diag_is(diag, E_UNDEFINED_VAR, 24));
+    symtab_set(&s, 2, 5);
+    assert_that(symtab_check(&s, rpn, n_rpn, &diag) == 0);
+
+    token_t res;
+    assert_that(evaluate_rpn(&ctx, rpn, n_rpn, &s, &res, &diag) == 0);
+    assert_that(res.value == 3 * (4 + 3) - 5);
+    // without a symbol table, nothing is defined
+    assert_that(evaluate_rpn(&ctx, rpn, n_rpn, NULL, &res, &diag) == -1);
+    assert_that(diag_is(diag, E_UNDEFINED_VAR, 0));
+
+    ctx_free(&ctx);
+    ctx_free(&sym_ctx);
+}
@@ -0,0 +1,88 @@
+/*
+ * test/test_vm.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <cgreen/cgreen.h>
+
+#include <ctx.h>
+#include <error.h>
+#include <eval.h>
+#include <lex.h>
+#include <utils.h>
+#include <vm.h>
+
+// compile an expression to bytecode, returns -1 and fills diag on error
+static int vm_compile_expr(
+    ctx_t* ctx, const char* input, bytecode_t* bc, diag_t* diag)
+{
+    int32_t n_tokens, n_rpn;
+    token_t* t = tokenize(ctx, input, &n_tokens, diag);
+    if (!t)
+    {
+        return -1;
+    }
+    token_t* rpn = shunting_yard(ctx, t, n_tokens, &n_rpn, diag);
+    if (!rpn)
+    {
+        return -1;
+    }
+    return vm_compile(ctx, rpn, n_rpn, bc, diag);
+}
+
+Ensure(test_vm_run)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    bytecode_t bc;
+    diag_t diag;
+    int64_t value;
+
+    assert_that(vm_compile_expr(&ctx, "16 * (36 + 64)", &bc, &diag) == 0);
+    assert_that(vm_run(&bc, NULL, &value) == 0);
+    assert_that(value == 1600);
+    assert_that(
+        vm_compile_expr(&ctx, "10 - (-2) - +2 - (-(-10))", &bc, &diag) == 0);
+    assert_that(vm_run(&bc, NULL, &value) == 0);
+    assert_that(value == 0);
+    // bytecode is not consumed by running it
+    assert_that(vm_compile_expr(&ctx, "-(2 - 5) * 3", &bc, &diag) == 0);
+    for (int i = 0; i < 1000; i++)
+    {
+        assert_that(vm_run(&bc, NULL, &value) == 0);
+        assert_that(value == 9);
+    }
+
+    // literals and results use all 64 bits, and overflow is reported
+    assert_that(vm_compile_expr(
+        &ctx, "-9223372036854775807 - 1", &bc, &diag) == 0);
+    assert_that(vm_run(&bc, NULL, &value) == 0);
+    assert_that(value == INT64_MIN);
+    assert_that(vm_compile_expr(&ctx, "-(-9223372036854775807 - 1)", &bc,
+        &diag) == 0);
+    assert_that(vm_run(&bc, NULL, &value) == 1);
+    assert_that(
+        vm_compile_expr(&ctx, "4294967296 * 2147483648", &bc, &diag) == 0);
+    assert_that(vm_run(&bc, NULL, &value) == 1);
+
+    ctx_free(&ctx);
+}
+
+Ensure(test_vm_compile_errors)
+{
+    // errors are found at compile time, matching evaluate_rpn
+    ctx_t ctx;
+    ctx_init(&ctx);
+    bytecode_t bc;
+    diag_t diag;
+
+    assert_that(vm_compile_expr(&ctx, "1 * * 2", &bc, &diag) == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 2));
+    assert_that(diag.side == SIDE_RIGHT);
+    assert_that(vm_compile_expr(&ctx, "-()", &bc, &diag) == -1);
+    assert_that(diag_is(diag, E_OP_MISSING_EXPR, 0));
+    assert_that(vm_compile_expr(&ctx, "()", &bc, &diag) == -1);
+    assert_that(diag.kind == E_EMPTY_EXPR);
+
+    ctx_free(&ctx);
+}
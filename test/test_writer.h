@@ -0,0 +1,134 @@
+/*
+ * test/test_writer.h
+ * author: Ian Brault <ian.brault@engineering.ucla.edu>
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cgreen/cgreen.h>
+
+#include <bignum.h>
+#include <ctx.h>
+#include <lex.h>
+#include <writer.h>
+
+// format an integer and compare it against the expected text
+static uint8_t writer_formats(int64_t value, int base, const char* expected)
+{
+    char buf[WRITER_INT_LEN];
+    size_t len = writer_format_int(buf, value, base);
+    return len == strlen(expected) && !memcmp(buf, expected, len);
+}
+
+Ensure(test_writer_format_int)
+{
+    assert_that(writer_formats(0, 10, "0"));
+    assert_that(writer_formats(9, 10, "9"));
+    assert_that(writer_formats(10, 10, "10"));
+    assert_that(writer_formats(-100, 10, "-100"));
+    assert_that(writer_formats(INT64_MAX, 10, "9223372036854775807"));
+    assert_that(writer_formats(INT64_MIN, 10, "-9223372036854775808"));
+
+    // the other bases write a sign and the magnitude, like literals
+    assert_that(writer_formats(0, 16, "0x0"));
+    assert_that(writer_formats(255, 16, "0xff"));
+    assert_that(writer_formats(-1, 16, "-0x1"));
+    assert_that(writer_formats(INT64_MIN, 16, "-0x8000000000000000"));
+    assert_that(writer_formats(8, 8, "0o10"));
+    assert_that(writer_formats(INT64_MAX, 8, "0o777777777777777777777"));
+    assert_that(writer_formats(5, 2, "0b101"));
+    assert_that(writer_formats(INT64_MIN, 2,
+        "-0b1000000000000000000000000000000000000000000000000000000000000000"));
+
+    // every base agrees with printf, and the magnitudes read back as the same
+    // value
+    static const int bases[] = { 2, 8, 16 };
+    uint64_t state = 3;
+    for (int n = 0; n < 4000; n++)
+    {
+        state = state * 6364136223846793005u + 1442695040888963407u;
+        int64_t value = (int64_t) state >> (n % 64);
+        uint64_t mag = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+        char expected[32];
+        snprintf(expected, sizeof(expected), "%" PRId64, value);
+        assert_that(writer_formats(value, 10, expected));
+        snprintf(expected, sizeof(expected), "%s0x%" PRIx64,
+            value < 0 ? "-" : "", mag);
+        assert_that(writer_formats(value, 16, expected));
+
+        for (int i = 0; i < 3; i++)
+        {
+            char buf[WRITER_INT_LEN];
+            size_t len = writer_format_int(buf, value, bases[i]);
+            size_t sign = value < 0;
+            int64_t read;
+            // the magnitude of INT64_MIN is not a valid literal
+            assert_that(lex_literal(buf + sign, buf + len, &read)
+                == (value == INT64_MIN ? -1 : (int64_t) (len - sign)));
+            assert_that(value == INT64_MIN || (uint64_t) read == mag);
+        }
+    }
+}
+
+Ensure(test_writer_put_int)
+{
+    writer_t out;
+    writer_init(&out, -1, 0);
+    writer_put_int(&out, -42);
+    writer_putc(&out, ' ');
+    out.base = 16;
+    writer_put_int(&out, -42);
+    writer_putc(&out, ' ');
+    out.base = 2;
+    writer_put_int(&out, 6);
+    const char* expected = "-42 -0x2a 0b110";
+    assert_that(out.used == strlen(expected));
+    assert_that(!memcmp(out.buf, expected, out.used));
+    writer_free(&out);
+}
+
+Ensure(test_writer_put_value)
+{
+    ctx_t ctx;
+    ctx_init(&ctx);
+    token_t min, big, small;
+    init_literal(&min, INT64_MIN, 0);
+    init_literal(&small, -7, 0);
+    bignum_apply(&ctx, OP_MUL, &min, &min, &big);
+    const char* expected =
+        "85070591730234615865843651857942052864 "
+        "0x40000000000000000000000000000000 -7";
+
+    // bignums are formatted in place in an in-memory writer, which grows
+    writer_t out;
+    writer_init(&out, -1, 0);
+    writer_put_value(&out, &big);
+    writer_putc(&out, ' ');
+    out.base = 16;
+    writer_put_value(&out, &big);
+    writer_putc(&out, ' ');
+    out.base = 10;
+    writer_put_value(&out, &small);
+    assert_that(out.used == strlen(expected));
+    assert_that(!memcmp(out.buf, expected, out.used));
+    writer_free(&out);
+
+    // and in a buffer too short for them, which grows as well
+    int fds[2];
+    assert_that(pipe(fds) == 0);
+    writer_init(&out, fds[1], 8);
+    writer_puts(&out, "85070");
+    writer_put_value(&out, &big);
+    assert_that(writer_free(&out) == 0);
+    close(fds[1]);
+    char buf[64];
+    ssize_t n = read(fds[0], buf, sizeof(buf));
+    close(fds[0]);
+    assert_that(n == 43);
+    assert_that(!memcmp(buf, "85070", 5) && !memcmp(buf + 5, expected, 38));
+
+    ctx_free(&ctx);
+}
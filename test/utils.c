@@ -15,4 +15,8 @@ uint8_t token_is_op(token_t token, token_type op_type)
 uint8_t token_is_literal(token_t token, int32_t value)
 {
     return token.type == LITERAL && token.value == value;
-}
\ No newline at end of file
+}
+uint8_t diag_is(diag_t diag, err_kind kind, int64_t offset)
+{
+    return diag.kind == kind && diag.offset == offset;
+}
@@ -8,9 +8,11 @@
 #ifndef TEST_UTILS_H
 #define TEST_UTILS_H
 
+#include <error.h>
 #include <lex.h>
 
 uint8_t token_is_op(token_t token, token_type op_type);
 uint8_t token_is_literal(token_t token, int32_t value);
+uint8_t diag_is(diag_t diag, err_kind kind, int64_t offset);
 
 #endif
\ No newline at end of file